@@ -253,6 +253,34 @@ enum lsof_file_flag {
     LSOF_FILE_FLAG_INODE_VALID = 0x00000020,
 };
 
+/** @enum Information lsof_gather() collects, see lsof_set_fields() */
+enum lsof_field {
+    /** \ref struct lsof_file.size */
+    LSOF_FIELD_SIZE = 0x0001,
+    /** \ref struct lsof_file.offset */
+    LSOF_FIELD_OFFSET = 0x0002,
+    /** \ref struct lsof_file.num_links */
+    LSOF_FIELD_NUM_LINKS = 0x0004,
+    /** \ref struct lsof_file.dev, \ref struct lsof_file.rdev, \ref struct
+     * lsof_file.inode and \ref struct lsof_file.file_type of files named by a
+     * path, and those of sockets; implies LSOF_FIELD_SOCKET */
+    LSOF_FIELD_NODE = 0x0008,
+    /** \ref struct lsof_file.access */
+    LSOF_FIELD_ACCESS = 0x0010,
+    /** \ref struct lsof_file.lock */
+    LSOF_FIELD_LOCK = 0x0020,
+    /** Memory-mapped files: those with \ref struct lsof_file.fd_type
+     * LSOF_FD_MEMORY and the like */
+    LSOF_FIELD_MAPS = 0x0040,
+    /** Socket protocol, addresses and state: \ref struct lsof_file.file_type
+     * and \ref struct lsof_file.name of sockets */
+    LSOF_FIELD_SOCKET = 0x0080,
+    /** \ref struct lsof_process.selinux_context */
+    LSOF_FIELD_SELINUX_CONTEXT = 0x0100,
+    /** All of the above */
+    LSOF_FIELD_ALL = 0x01ff,
+};
+
 /** An open file
  */
 struct lsof_file {
@@ -375,7 +403,16 @@ struct lsof_selection {
     uint64_t integer;
 };
 
-/** The result of lsof_gather() */
+/** The result of lsof_gather()
+ *
+ * Since API version 3, the result is a single allocation holding this
+ * structure, the processes array, the files of all processes, the selections
+ * array and the strings they point to. The files are one array in process
+ * order: the files of `processes[i]` are followed by those of
+ * `processes[i + 1]`, so `processes[i].files - processes[0].files` is the
+ * index of the first file of process i. Equal strings may share storage.
+ * The result does not refer to the context that gathered it.
+ */
 struct lsof_result {
     size_t num_processes;           /**< length of processes array */
     struct lsof_process *processes; /**< array of processes */
@@ -389,7 +426,7 @@ struct lsof_result {
  * you may use this macro to check the existence of
  * functions
  */
-#    define LSOF_API_VERSION 1
+#    define LSOF_API_VERSION 8
 
 /** Get runtime API version of liblsof
  *
@@ -443,12 +480,27 @@ enum lsof_error lsof_avoid_blocking(struct lsof_context *ctx, int avoid);
 /** Ask lsof to avoid forking
  *
  * To avoid being blocked by some kernel operations, liblsof does them in forked
- * child processes. Call this function to change this behavior.
+ * child processes, or in worker threads on Linux. Call this function to change
+ * this behavior.
  *
  * \since API version 1
  */
 enum lsof_error lsof_avoid_forking(struct lsof_context *ctx, int avoid);
 
+/** Ask lsof to scan processes with multiple threads
+ *
+ * By default, liblsof scans processes one at a time. Call this function with
+ * `threads` greater than 1 to let liblsof scan processes with that many
+ * threads. The result is the same as that of a serial scan. liblsof falls back
+ * to a serial scan when endpoint information is requested or an NFS file
+ * system is mounted.
+ *
+ * \return LSOF_ERROR_UNSUPPORTED if the platform lacks parallel scanning
+ *
+ * \since API version 2
+ */
+enum lsof_error lsof_set_scan_threads(struct lsof_context *ctx, int threads);
+
 /** Ask lsof to AND the selections
  *
  * By default, lsof OR the selections, for example, if you call
@@ -460,6 +512,39 @@ enum lsof_error lsof_avoid_forking(struct lsof_context *ctx, int avoid);
  */
 enum lsof_error lsof_logic_and(struct lsof_context *ctx);
 
+/** Tell lsof which information the caller needs
+ *
+ * By default, lsof_gather() collects everything it can about every file.
+ * `fields` is a mask of \ref lsof_field values; information outside it may be
+ * left out of the result, and the system calls and /proc reads that would
+ * find it may be skipped. A file whose information is left out is still
+ * reported, with the corresponding \ref lsof_file_flag clear or its
+ * \ref struct lsof_file.file_type LSOF_FILE_UNKNOWN_STAT or
+ * LSOF_FILE_SOCKET. Information the selections depend on is collected
+ * regardless of `fields`.
+ *
+ * \since API version 6
+ */
+enum lsof_error lsof_set_fields(struct lsof_context *ctx, uint32_t fields);
+
+/** Ask lsof to stop after finding some selected files
+ *
+ * lsof_gather() and lsof_gather_stream() stop walking the processes, in PID
+ * order, once `max_matches` selected files have been found, so the result
+ * holds the processes walked until then. 0, the default, sets no limit. The
+ * limit doesn't apply to lsof_gather_delta(), whose selected files are known
+ * only after the walk.
+ *
+ * A selection may be reported not found because the walk stopped before
+ * reaching its files.
+ *
+ * \return LSOF_ERROR_UNSUPPORTED if the platform can't stop the walk
+ *
+ * \since API version 7
+ */
+enum lsof_error lsof_set_max_matches(struct lsof_context *ctx,
+                                     size_t max_matches);
+
 /** Ask lsof to select process by command
  *
  * Select process executing the command that begins with the characters of
@@ -494,12 +579,109 @@ enum lsof_error lsof_freeze(struct lsof_context *ctx);
  * If the context is not frozen, lsof_freeze() will be called.
  *
  * \return LSOF_INVALID_ARGUMENT if either pointer argument is NULL
+ * \return LSOF_ERROR_NO_MEMORY if the result can't be allocated
  *
  * \since API version 1
  */
 enum lsof_error lsof_gather(struct lsof_context *ctx,
                             struct lsof_result **result);
 
+/** Callback of lsof_gather_stream()
+ *
+ * `process` and the files and strings it points to are valid only until the
+ * callback returns.
+ *
+ * \return 0 to continue gathering, non-zero to stop
+ *
+ * \since API version 4
+ */
+typedef int (*lsof_process_callback)(struct lsof_process *process,
+                                     void *user_data);
+
+/** List open files, handing each process to a callback
+ *
+ * Like lsof_gather(), but rather than return all processes at once, call
+ * `on_process` for each selected process, with `user_data`, as soon as the
+ * process has been scanned. The process is freed when the callback returns,
+ * so the memory used is bounded by the largest single process rather than
+ * by the whole system. The callback may stop the gather by returning
+ * non-zero.
+ *
+ * Processes are scanned serially in this mode, even if
+ * lsof_set_scan_threads() asked for more threads. Selection status is not
+ * reported.
+ *
+ * If the context is not frozen, lsof_freeze() will be called.
+ *
+ * \return LSOF_INVALID_ARGUMENT if either pointer argument is NULL
+ * \return LSOF_ERROR_NO_MEMORY if a process can't be allocated; the gather
+ * stops
+ *
+ * \since API version 4
+ */
+enum lsof_error lsof_gather_stream(struct lsof_context *ctx,
+                                   lsof_process_callback on_process,
+                                   void *user_data);
+
+/** List the open files that changed since the previous call
+ *
+ * Like lsof_gather(), but keep the gathered files in the context and return
+ * only the differences from those of the previous call, in three results:
+ * `added` holds the files that are newly open, `removed` the files that are
+ * no longer open, as they were last seen, and `changed` the files that are
+ * still open but differ in type, access mode, lock, device, node, link count,
+ * name or state, as they are now. Size and offset changes are not reported.
+ * Each result holds only the processes with files in it. The first call
+ * reports all files as added.
+ *
+ * Processes are told apart by PID and, where the dialect knows it, start
+ * time, so the files of a process that reuses the PID of an exited one are
+ * reported as added, and those of the exited one as removed.
+ *
+ * On Linux, the stat(2) calls of a file descriptor are skipped when its link
+ * and its /proc/<PID>/fdinfo/<FD> content haven't changed since the previous
+ * call.
+ *
+ * Selection status is reported only in `added`. Free the three results
+ * with `lsof_free_result()`.
+ *
+ * If the context is not frozen, lsof_freeze() will be called.
+ *
+ * \return LSOF_INVALID_ARGUMENT if any pointer argument is NULL
+ * \return LSOF_ERROR_NO_MEMORY if a result can't be allocated; no result is
+ * returned, and the next call reports the differences from this one
+ *
+ * \since API version 5
+ */
+enum lsof_error lsof_gather_delta(struct lsof_context *ctx,
+                                  struct lsof_result **added,
+                                  struct lsof_result **removed,
+                                  struct lsof_result **changed);
+
+/** List the open files of the processes of a PID set
+ *
+ * Like lsof_gather(), but only the processes whose PIDs are among the
+ * `num_pids` of `pids` are listed, subject to the selections as usual.
+ * Their /proc directories are read directly, so the cost depends on the
+ * size of the set rather than on the number of processes of the system.
+ * A PID that isn't that of a process -- e.g., one of another task of a
+ * process -- is ignored. Selection status is reported as by lsof_gather().
+ *
+ * Each call may be given a different set.
+ *
+ * If the context is not frozen, lsof_freeze() will be called.
+ *
+ * \return LSOF_INVALID_ARGUMENT if `result` is NULL, or `pids` is NULL
+ * and `num_pids` isn't zero
+ * \return LSOF_ERROR_NO_MEMORY if the result can't be allocated
+ * \return LSOF_ERROR_UNSUPPORTED if the platform can't read processes
+ * directly
+ *
+ * \since API version 8
+ */
+enum lsof_error lsof_gather_pids(struct lsof_context *ctx, const uint32_t *pids,
+                                 size_t num_pids, struct lsof_result **result);
+
 /** Destroy a lsof context
  *
  * You should call `lsof_free_result` to free all `struct lsof_result`
@@ -512,6 +694,8 @@ enum lsof_error lsof_gather(struct lsof_context *ctx,
 void lsof_destroy(struct lsof_context *ctx);
 
 /** Free struct lsof_result
+ *
+ * Since API version 3, this is a single `free()` of the result block.
  *
  * \since API version 1
  */
@@ -72,6 +72,8 @@
                  * modifier */
 #    endif      /* !defined(INODETYPE) */
 
+#    include "hash.h"
+
 struct l_dev {
     dev_t rdev;      /* device */
     INODETYPE inode; /* inode number */
@@ -345,6 +347,7 @@ extern int optind;
 #    define LSOF_REPO_URL LSOF_GITHUB_URL "/" LSOF_REPO
 #    define LSOF_FAQ_URL LSOF_REPO_URL "/blob/" LSOF_BRANCH "/00FAQ"
 #    define LSOF_MAN_URL LSOF_REPO_URL "/blob/" LSOF_BRANCH "/Lsof.8"
+#    define MAXSCANTHR 64 /* maximum -j process scanning threads */
 #    define MIN_AF_ADDR sizeof(struct in_addr)
 /* minimum AF_* address length */
 
@@ -356,7 +359,7 @@ extern int optind;
 #    endif                              /* defined(HASIPv6) */
 
 #    define MAXDCPATH 4 /* paths in DCpath[] */
-#    define MAXNWAD 100 /* maximum network addresses */
+#    define MAXNWAD 100000 /* maximum network addresses */
 
 #    if !defined(MEMMOVE)
 #        define MEMMOVE memmove
@@ -579,6 +582,23 @@ extern int ZoneColW;
 #    define SELFILE (SELFD | SELNFS | SELNLINK | SELNM) /* file selecters */
 #    define SELNW (SELNA | SELNET | SELUNX)             /* network selecters */
 
+/*
+ * File attributes the output or the selections need (NeedAttr); a dialect
+ * may skip finding those that aren't needed.  All but NEED_FLAGS are the
+ * lsof_set_fields() LSOF_FIELD_* values.
+ */
+#    define NEED_SIZE LSOF_FIELD_SIZE       /* file size */
+#    define NEED_OFFSET LSOF_FIELD_OFFSET   /* file offset */
+#    define NEED_NLINK LSOF_FIELD_NUM_LINKS /* link count */
+#    define NEED_NODE LSOF_FIELD_NODE       /* device, inode and type */
+#    define NEED_ACCESS LSOF_FIELD_ACCESS   /* access mode */
+#    define NEED_LOCK LSOF_FIELD_LOCK       /* lock */
+#    define NEED_MAPS LSOF_FIELD_MAPS       /* memory-mapped files */
+#    define NEED_SOCK LSOF_FIELD_SOCKET     /* socket protocol information */
+#    define NEED_CNTX LSOF_FIELD_SELINUX_CONTEXT /* security context */
+#    define NEED_FLAGS 0x1000                   /* file flags (+f g) */
+#    define NEED_ALL (LSOF_FIELD_ALL | NEED_FLAGS)
+
 /*
  * Exit Status
  */
@@ -721,6 +741,11 @@ struct fd_lst {
     struct fd_lst *next;
 };
 
+struct fd_range {
+    int lo; /* range start */
+    int hi; /* range end */
+};
+
 struct fieldsel {
     char id;          /* field ID character */
     unsigned char st; /* field status */
@@ -737,6 +762,36 @@ extern char *InodeFmt_d;
 extern char *InodeFmt_x;
 extern int LastPid;
 
+#    if defined(HASARENA)
+/*
+ * The per-gather arena
+ *
+ * lfile structures and their strings are carved from a list of chunks,
+ * oldest first.  A mark records an allocation position that can be returned
+ * to; a reset returns to the start of the first chunk.  Neither frees a
+ * chunk, so a repeat reuses the space the previous gather grew.
+ */
+
+#        define ARENAALIGN 16          /* arena structure alignment */
+#        define ARENACHUNK (64 * 1024) /* arena chunk size */
+
+struct arena_chunk {
+    struct arena_chunk *next; /* next chunk */
+    size_t size;              /* space in chunk */
+    size_t used;              /* space allocated from chunk */
+};
+
+struct arena_mark {
+    struct arena_chunk *chunk; /* chunk being allocated from (NULL if none) */
+    size_t used;               /* its allocated space */
+};
+
+struct lsof_arena {
+    struct arena_chunk *first; /* first chunk */
+    struct arena_chunk *cur;   /* chunk being allocated from */
+};
+#    endif /* defined(HASARENA) */
+
 struct lfile {
     enum lsof_file_access_mode access;
     enum lsof_lock_mode lock;
@@ -747,6 +802,8 @@ struct lfile {
                               * 2: iproto contains string
                               * 3: print inode in hex
                               */
+    unsigned char chg;       /* change since the previous gather --
+                              * DELTA_* values */
     unsigned char is_com;    /* common stream status */
     unsigned char is_nfs;    /* NFS file status */
     unsigned char is_stream; /* stream device status */
@@ -932,13 +989,57 @@ struct lproc {
     int pgid;  /* process group ID */
     int ppid;  /* parent process ID */
     uid_t uid; /* user ID */
+    unsigned long long start; /* start time, telling apart processes that
+                               * reuse a PID (0 == unknown) */
 
 #    if defined(HASZONES)
     char *zn; /* zone name */
 #    endif    /* defined(HASZONES) */
 
     struct lfile *file; /* open files of process */
+
+#    if defined(HASARENA)
+    struct arena_mark amark; /* arena position before the files */
+#    endif                   /* defined(HASARENA) */
+};
+
+/*
+ * lfile chg values -- see delta_mark()
+ */
+#    define DELTA_NONE 0    /* unchanged */
+#    define DELTA_ADDED 1   /* not in the previous gather */
+#    define DELTA_CHANGED 2 /* in the previous gather, but different */
+#    define DELTA_REMOVED 3 /* only in the previous gather */
+#    define DELTA_SEL(c) (1 << (c)) /* lsof_context delta_sel bit */
+
+/*
+ * Has the selected file limit been reached?
+ */
+#    define MATCHES_DONE(c)                                                    \
+        ((c)->max_matches && ((c)->matches >= (c)->max_matches))
+
+/*
+ * Set a selection's find state.  A parallel scanning thread records it with
+ * found_defer() instead, and the scan sets it with found_apply() once the
+ * threads are done, so that the threads don't write the shared selections.
+ */
+#    if defined(HASPARSCAN)
+#        define SEL_FOUND(c, fl, v)                                            \
+            do {                                                               \
+                if ((c)->found_deferred)                                       \
+                    found_defer((c), (void *)&(fl), sizeof(fl), (int)(v));     \
+                else                                                           \
+                    (fl) = (v);                                                \
+            } while (0)
+
+struct found_mark { /* a find state recorded by found_defer() */
+    void *fl;       /* its address; NULL == empty slot */
+    size_t sz;      /* its size */
+    int v;          /* its value */
 };
+#    else /* !defined(HASPARSCAN) */
+#        define SEL_FOUND(c, fl, v) ((fl) = (v))
+#    endif /* defined(HASPARSCAN) */
 
 extern char *Memory;
 
@@ -961,6 +1062,7 @@ struct nwad {
     int af;                       /* address family -- e.g.,
                                    * AF_INET, AF_INET6 */
     unsigned char a[MAX_AF_ADDR]; /* address */
+    int plen;                     /* address prefix length (bits) */
     int sport;                    /* starting port */
     int eport;                    /* ending port */
     int f;                        /* find state */
@@ -1207,6 +1309,9 @@ struct lsof_context {
     /* -O option status */
     int avoid_forking;
 
+    /* -j option: number of process scanning threads (0 or 1 == serial) */
+    int scan_threads;
+
     /* -X option status */
     int x_opt;
 
@@ -1230,6 +1335,19 @@ struct lsof_context {
      * 1 == exclude */
     int fd_list_ty;
 
+    /* the selections compiled by compile_sels() for is_proc_excl() and
+     * ck_fd_status() */
+    int sels_compiled;
+    inohash_t sel_pid_set;  /* sel_pid[] entries by PID */
+    inohash_t sel_pgid_set; /* sel_pgid[] entries by PGID */
+    inohash_t sel_uid_set;  /* sel_uid[] entries by UID */
+    uint32_t fd_type_mask;  /* 1 << fd_type of fd_list's non-numeric types */
+    struct fd_range *fd_ranges; /* fd_list's numeric ranges, sorted and
+                                 * merged */
+    int fd_ranges_num;          /* fd_ranges[] count */
+    struct nwad_node *nwad_trie[2]; /* sel_net_addr[] by IPv4 and IPv6
+                                     * address prefix */
+
     /* mount supplement state:
      * 0 == none
      * 1 == create
@@ -1315,6 +1433,27 @@ struct lsof_context {
     /* -s option status */
     int show_size;
 
+    /* NEED_* file attributes -- NEED_ALL unless the caller says otherwise */
+    int need_attrs;
+
+    /* skip the rest of a process's files once it is selected -- set by -t */
+    int first_match;
+
+    /* stop the process walk after this many selected files (0 == no limit)
+     * -- set by --max-matches and lsof_set_max_matches() */
+    size_t max_matches;
+
+    /* selected files the walk has found */
+    size_t matches;
+
+    /* the rest of the current process's files needn't be read */
+    int files_done;
+
+    /* gather only the processes of these PIDs -- set by lsof_gather_pids()
+     * (NULL == all) */
+    const uint32_t *pid_set;
+    size_t pid_set_size;
+
     /** Temporary */
     /* name characters for printing */
     char *name_buf;
@@ -1330,11 +1469,49 @@ struct lsof_context {
     size_t procs_size;
     size_t procs_cap;
 
+    /** lsof_gather_stream() callback (NULL if not streaming) */
+    lsof_process_callback stream_cb;
+    /** and its user data */
+    void *stream_data;
+    /** lsof_gather_stream() status */
+    enum lsof_error stream_err;
+
+    /** Keep each gather to compare with the next one: lsof_gather_delta()
+     *  and the -r option's d suffix */
+    int delta;
+    /** Select only files with these change statuses -- DELTA_SEL() bits
+     *  (0 == any) */
+    int delta_sel;
+    /** The previous gather's processes, their count and capacity */
+    struct lproc *delta_procs;
+    size_t delta_procs_size;
+    size_t delta_procs_cap;
+#    if defined(HASARENA)
+    /** Arena of the previous gather's files */
+    struct lsof_arena delta_arena;
+#    endif /* defined(HASARENA) */
+
     /** Pointer to current file */
     struct lfile *cur_file;
     /** Pointer to previous file */
     struct lfile *prev_file;
 
+#    if defined(HASARENA)
+    /** Arena of the files and their strings */
+    struct lsof_arena arena;
+    /** Arena position before the current file */
+    struct arena_mark file_mark;
+#    endif /* defined(HASARENA) */
+
+#    if defined(HASPARSCAN)
+    /** Find states a scanning thread has recorded for found_apply(), and
+     *  whether it records them -- see SEL_FOUND() */
+    int found_deferred;
+    struct found_mark *found_marks; /* slots, hashed by address */
+    size_t found_marks_size;        /* slots in use */
+    size_t found_marks_mask;        /* slot count - 1 */
+#    endif                          /* defined(HASPARSCAN) */
+
     /** Warnings and errors */
     FILE *err;
     char *program_name;
@@ -1402,6 +1579,8 @@ struct lsof_context {
 #    define Fblock (ctx->avoid_blocking)
 /* avoid forking overhead */
 #    define Fovhd (ctx->avoid_forking)
+/* process scanning threads */
+#    define ScanThr (ctx->scan_threads)
 /* endpoint status */
 #    define FeptE (ctx->endpoint_status)
 /* select tasks */
@@ -1528,6 +1707,8 @@ struct lsof_context {
 #    define Foffset (ctx->show_offset)
 /* -s option status */
 #    define Fsize (ctx->show_size)
+/* needed file attributes */
+#    define NeedAttr (ctx->need_attrs)
 
 /* Utility macro to free if non-null and set the pointer to null */
 #    define CLEAN(ptr)                                                         \
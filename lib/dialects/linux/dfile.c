@@ -320,7 +320,7 @@ int is_file_named(
         break;
     }
     if (s)
-        s->f = 1;
+        SEL_FOUND(ctx, s->f, 1);
     return (1);
 }
 
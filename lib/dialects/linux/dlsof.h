@@ -72,6 +72,22 @@
 
 #    include <sys/syscall.h>
 
+#    if defined(HASSTATX)
+#        include <linux/stat.h>
+#        if !defined(__NR_statx)
+#            undef HASSTATX
+#        endif /* !defined(__NR_statx) */
+#        if !defined(AT_STATX_DONT_SYNC)
+#            define AT_STATX_DONT_SYNC 0x4000
+#        endif /* !defined(AT_STATX_DONT_SYNC) */
+#    endif     /* defined(HASSTATX) */
+
+#    if defined(HASIOURING) && !defined(HASSTATX)
+#        undef HASIOURING /* the ring's statx(2) results need statx_to_stat() */
+#    endif                /* defined(HASIOURING) && !defined(HASSTATX) */
+
+#    include "hash.h"
+
 /*
  * This definition is needed for the common function prototype definitions
  * in "proto.h", but isn't used in /proc-based lsof.
@@ -198,6 +214,174 @@ extern dev_t MqueueDev;
 #    define OFFSET_FDINFO 2
 extern int OffType;
 
-struct lsof_context_dialect {};
+struct map_stat {        /* process_proc_map() stat(2) cache entry */
+    dev_t dev;           /* maps file device */
+    INODETYPE inode;     /* maps file inode number */
+    char *path;          /* stat(2) path; NULL == /proc/<PID>/map_files */
+    unsigned char valid; /* sv, en and sb are valid */
+    int sv;              /* stat(2) return value */
+    int en;              /* stat(2) errno, if sv != 0 */
+    struct stat sb;      /* stat(2) buffer, if sv == 0 */
+    unsigned long seen;  /* map_serial of the last process mapping it */
+    struct map_stat *next; /* next entry with the same inode */
+};
+
+/*
+ * /proc/<ID>/fd/<FD> link source kinds whose stat(2) results process_id()
+ * can derive from the link text
+ */
+#    define FDLINK_SOCK 0 /* "socket:[<inode>]" */
+#    define FDLINK_PIPE 1 /* "pipe:[<inode>]" */
+#    define FDLINK_ANON 2 /* "anon_inode:<name>" */
+#    define FDLINK_KINDS 2 /* number of kinds with stat(2) templates */
+
+#    if defined(HASFDMEMO)
+struct fd_memo {              /* process_id() stat(2) results of an FD, kept
+                               * between delta gathers */
+    int pid;                  /* PID */
+    int tid;                  /* TID (0 == none) */
+    unsigned long long start; /* process start time */
+    int fd;                   /* FD number */
+    uint64_t lh;              /* hash of the link text */
+    uint64_t ih;              /* hash of the fdinfo text, less pos: */
+    unsigned char valid;      /* sb, ss, lsb and ls are valid */
+    struct stat sb;           /* stat(2) buffer */
+    int ss;                   /* its SB_* status */
+    struct stat lsb;          /* lstat(2) buffer */
+    int ls;                   /* its SB_* status */
+    unsigned long seen;       /* fd_memo_serial of the last gather to see
+                               * the FD */
+    struct fd_memo *next;     /* next entry with the same key */
+};
+#        define FD_MEMO_INFOSZ 4096 /* fdinfo text buffer size */
+#    endif                          /* defined(HASFDMEMO) */
+
+/*
+ * The content signature of a /proc table, so that a table reader can tell
+ * that the table hasn't changed since it was last read -- see
+ * proc_sig_read() in dproc.c
+ */
+struct proc_sig {
+    char *buf;     /* content buffer */
+    size_t sz;     /* buffer size */
+    size_t len;    /* content length */
+    uint64_t hash; /* content hash */
+    int valid;     /* len and hash are those of the last content */
+};
+#    define PROC_SIG_BUFSZ 65536 /* initial content buffer size */
+
+struct id_list { /* read_id_dir() result */
+    int *ids;       /* IDs, in ascending order */
+    int n;          /* number of IDs */
+    int alloc;      /* allocated number of IDs */
+};
+
+#    if defined(HASIOURING)
+/*
+ * A process_id() batch of /proc/<ID>/fd entries, whose stat(2) and fdinfo
+ * reads are queued to the context's io_uring -- see dring.c
+ */
+#        define FD_BATCH 64 /* FDs per batch */
+
+struct fd_batch_ent {
+    int ll;     /* getlinksrc() return value */
+    int en;     /* getlinksrc() errno, if ll < 1 */
+    int rest;   /* offset of the getlinksrc() rest in src[] (-1 if none) */
+    int so;     /* stat(2) ring operation (-1 if none) */
+    int lso;    /* lstat(2) ring operation (-1 if none) */
+    int io;     /* fdinfo read ring operation (-1 if none) */
+    char src[MAXPATHLEN + 1]; /* getlinksrc() link source */
+};
+
+struct fd_ring; /* io_uring state, private to dring.c */
+#    endif      /* defined(HASIOURING) */
+
+struct lsof_context_dialect {
+    /* regular and socket file checking state, see gather_proc_info() */
+    short cckreg; /* conditional status of regular file checking:
+                   *     0 = unconditionally check
+                   *     1 = conditionally check */
+    short ckscko; /* socket file only checking status:
+                   *     0 = none
+                   *     1 = check only socket files */
+
+#    if defined(HASSERVE)
+    int tables_warm; /* the -W server has just read the lock and socket
+                      * tables -- see warm_tables() */
+#    endif           /* defined(HASSERVE) */
+
+    /* get_fields() field pointers */
+    char **fields;
+    int fields_alloc;
+
+    /* gather_proc_info() path buffers */
+    char *pid_path; /* /proc/<PID>/ */
+    int pid_path_len;
+    char *task_path; /* /proc/<PID>/task */
+    int task_path_len;
+    char *tid_path; /* /proc/<PID>/task/<TID>/stat */
+    int tid_path_len;
+
+    /* process_id() path buffers */
+    char *fd_dir_path; /* /proc/<ID>/fd/ */
+    int fd_dir_path_len;
+    char *id_path; /* /proc/<ID>/{cwd,root,exe,fd/<FD>} */
+    int id_path_len;
+
+    /* read_id_stat() buffers */
+    char *cmd_buf; /* command name */
+    MALLOC_S cmd_buf_len;
+    char *stat_vbuf; /* stat stream buffer */
+    size_t stat_vbuf_len;
+
+    /* read_id_dir() buffers */
+    char *dents_buf;         /* getdents64() buffer */
+    struct id_list proc_ids; /* /proc PIDs */
+    int pid_direct;          /* proc_ids are the selected PIDs, not those
+                              * read from /proc */
+    struct id_list task_ids; /* /proc/<PID>/task TIDs */
+    struct id_list fd_ids;   /* /proc/<ID>/fd FDs */
+
+    /* process_id() socket and pipe stat(2) templates */
+    struct stat link_sb[FDLINK_KINDS]; /* templates, indexed by FDLINK_* */
+    short link_sb_def[FDLINK_KINDS];   /* link_sb[] SB_* status
+                                        * (0 == undefined) */
+
+#    if defined(HASSTATX)
+    /* process_id() statx(2) field masks, set by initialize() */
+    unsigned int stx_smask; /* for a stat(2) */
+    unsigned int stx_lmask; /* for an lstat(2) */
+    int no_statx;           /* statx(2) is unsupported */
+#    endif                  /* defined(HASSTATX) */
+
+#    if defined(HASIOURING)
+    /* process_id() io_uring FD batches */
+    int ring_ok;               /* io_uring use: 1 = yes, -1 = no */
+    struct fd_ring *ring;      /* io_uring, opened by ring_open() */
+    struct fd_batch_ent *fd_batch; /* the current batch */
+#    endif                     /* defined(HASIOURING) */
+
+#    if defined(HASFDMEMO)
+    /* process_id() FD stat(2) results, kept between delta gathers */
+    int fd_memo_on;               /* keep them for this gather */
+    inohash_t fd_memos;           /* struct fd_memo chains, hashed by ID and
+                                   * FD */
+    unsigned long fd_memo_serial; /* gather serial number */
+    char *fd_memo_info;           /* fdinfo text buffer */
+#    endif                        /* defined(HASFDMEMO) */
+
+    /* process_proc_map() buffers */
+    inohash_t map_stats;      /* stat(2) cache of struct map_stat chains,
+                               * hashed by inode and cleared for each
+                               * gather */
+    unsigned long map_serial; /* process_proc_map() call serial number */
+    int no_procmap_query;     /* PROCMAP_QUERY ioctl(2) is unsupported */
+    char *maps_vbuf; /* maps stream buffer */
+    size_t maps_vbuf_len;
+};
+
+/* Convenience macros to access the dialect context */
+#    define Cckreg (ctx->dialect.cckreg)
+#    define Ckscko (ctx->dialect.ckscko)
 
 #endif /* LINUX_LSOF_H	*/
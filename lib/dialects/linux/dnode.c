@@ -470,8 +470,8 @@ int get_fields(struct lsof_context *ctx, /* context */
     char *bp, *cp, *sp;
     int i, j, n;
     MALLOC_S len;
-    static char **fp = (char **)NULL;
-    static int nfpa = 0;
+    char **fp = ctx->dialect.fields;
+    int nfpa = ctx->dialect.fields_alloc;
 
     for (cp = ln, n = 0; cp && *cp;) {
         for (bp = cp; *bp && (*bp == ' ' || *bp == '\t'); bp++)
@@ -548,6 +548,8 @@ int get_fields(struct lsof_context *ctx, /* context */
                     Pn, (int)len);
                 Error(ctx);
             }
+            ctx->dialect.fields = fp;
+            ctx->dialect.fields_alloc = nfpa;
         }
         fp[n++] = bp;
     }
@@ -565,22 +567,30 @@ void get_locks(struct lsof_context *ctx, /* context */
     unsigned long bp, ep;
     char buf[MAXPATHLEN], *ec, **fp;
     dev_t dev;
-    int ex, i, h, mode, pid;
+    int ex, i, h, mode, pid, rv;
     INODETYPE inode;
     struct llock *lp, *np;
     FILE *ls;
     long maj, min;
     enum lsof_lock_mode type;
-    static char *vbuf = (char *)NULL;
-    static size_t vsz = (size_t)0;
+    static struct llock *fl = (struct llock *)NULL; /* free llock list */
+    static struct proc_sig sig;                      /* /proc/locks
+                                                      * signature */
     /*
-     * Destroy previous lock information.
+     * Read the /proc lock file.  If its content hasn't changed since the
+     * last gather, keep the lock information from it.
+     */
+    if (!(rv = proc_sig_read(ctx, p, &sig)) && LckH)
+        return;
+    /*
+     * Put the previous lock information on the free list.
      */
     if (LckH) {
         for (i = 0; i < PIDBUCKS; i++) {
             for (lp = LckH[i]; lp; lp = np) {
                 np = lp->next;
-                (void)free((FREE_P *)lp);
+                lp->next = fl;
+                fl = lp;
             }
             LckH[i] = (struct llock *)NULL;
         }
@@ -598,10 +608,10 @@ void get_locks(struct lsof_context *ctx, /* context */
         }
     }
     /*
-     * Open the /proc lock file, assign a page size buffer to its stream,
-     * and read it.
+     * Parse the content read.
      */
-    if (!(ls = open_proc_stream(ctx, p, "r", &vbuf, &vsz, 0)))
+    if ((rv < 0) || !sig.len ||
+        !(ls = fmemopen((void *)sig.buf, sig.len, "r")))
         return;
     while (fgets(buf, sizeof(buf), ls)) {
         if (get_fields(ctx, buf, ":", &fp, (int *)NULL, 0) < 10)
@@ -676,9 +686,12 @@ void get_locks(struct lsof_context *ctx, /* context */
         if (lp)
             continue;
         /*
-         * Allocate a new llock structure and link it to the PID hash bucket.
+         * Take an llock structure from the free list, or allocate a new one,
+         * and link it to the PID hash bucket.
          */
-        if (!(lp = (struct llock *)malloc(sizeof(struct llock)))) {
+        if ((lp = fl))
+            fl = lp->next;
+        else if (!(lp = (struct llock *)malloc(sizeof(struct llock)))) {
             (void)snpf(buf, sizeof(buf), "%" INODEPSPEC "u", inode);
             (void)fprintf(
                 stderr, "%s: can't allocate llock: PID %d; dev %x; inode %s\n",
@@ -715,9 +728,10 @@ void process_proc_node(struct lsof_context *ctx, /* context */
     size_t sz;
     char *tn;
     /*
-     * Set the access mode, if possible.
+     * Set the access mode, if possible and needed.
      */
-    if (l && (ls & SB_MODE) && ((l->st_mode & S_IFMT) == S_IFLNK)) {
+    if ((NeedAttr & NEED_ACCESS) && l && (ls & SB_MODE) &&
+        ((l->st_mode & S_IFMT) == S_IFLNK)) {
         if ((access = l->st_mode & (S_IRUSR | S_IWUSR)) == S_IRUSR)
             Lf->access = LSOF_FILE_ACCESS_READ;
         else if (access == S_IWUSR)
@@ -803,7 +817,7 @@ void process_proc_node(struct lsof_context *ctx, /* context */
     /*
      * Check for a lock.
      */
-    if (Lf->dev_def && (Lf->inp_ty == 1))
+    if ((NeedAttr & NEED_LOCK) && Lf->dev_def && (Lf->inp_ty == 1))
         (void)check_lock(ctx);
     /*
      * Save the file size.
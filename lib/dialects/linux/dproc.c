@@ -31,6 +31,11 @@
 #include "common.h"
 
 #include <inttypes.h>
+#include <sys/ioctl.h>
+
+#if defined(HASPARSCAN)
+#    include <pthread.h>
+#endif /* defined(HASPARSCAN) */
 
 /*
  * Local definitions
@@ -71,10 +76,43 @@
 #    define ULLONG_MAX 18446744073709551615ULL
 #endif /* !defined(ULLONG_MAX) */
 
-#define NS_PATH_LENGTH 100  /* namespace path string length */
+#define DENTSBUFSZ 65536    /* read_id_dir() getdents64() buffer size */
 #define MAP_PATH_LENGTH 100 /* map_files path length */
 #define ADDR_LENGTH 100     /* addr range of map_files length */
 
+#if !defined(PROCMAP_QUERY)
+/*
+ * The PROCMAP_QUERY /proc/<PID>/maps ioctl(2) of Linux 6.11 and above, for
+ * building with older <linux/fs.h> headers
+ */
+struct procmap_query {
+    uint64_t size;          /* sizeof(struct procmap_query) */
+    uint64_t query_flags;   /* PROCMAP_QUERY_* flags */
+    uint64_t query_addr;    /* address to query */
+    uint64_t vma_start;     /* returned VMA start address */
+    uint64_t vma_end;       /* returned VMA end address */
+    uint64_t vma_flags;     /* returned VMA protection flags */
+    uint64_t vma_page_size; /* returned VMA page size */
+    uint64_t vma_offset;    /* returned file offset */
+    uint64_t inode;         /* returned file inode number */
+    uint32_t dev_major;     /* returned file device major */
+    uint32_t dev_minor;     /* returned file device minor */
+    uint32_t vma_name_size; /* name buffer size in; name length + 1 out */
+    uint32_t build_id_size; /* build ID buffer size in; length out */
+    uint64_t vma_name_addr; /* name buffer address */
+    uint64_t build_id_addr; /* build ID buffer address */
+};
+#    define PROCMAP_QUERY_COVERING_OR_NEXT_VMA 0x10
+#    define PROCMAP_QUERY_FILE_BACKED_VMA 0x20
+#    define PROCMAP_QUERY _IOWR('f', 17, struct procmap_query)
+#endif /* !defined(PROCMAP_QUERY) */
+
+/*
+ * The file attributes only the stat(2) of a file named by a path supplies
+ */
+
+#define NEED_STATS (NEED_LOCK | NEED_NLINK | NEED_NODE | NEED_SIZE)
+
 /*
  * Local structures
  */
@@ -97,40 +135,60 @@ struct l_fdinfo {
     size_t tfd_count;
 };
 
-/*
- * Local variables
- */
-
-static short Cckreg; /* conditional status of regular file
-                      * checking:
-                      *     0 = unconditionally check
-                      *     1 = conditionally check */
-static short Ckscko; /* socket file only checking status:
-                      *     0 = none
-                      *     1 = check only socket files */
-
 /*
  * Local function prototypes
  */
 
 static MALLOC_S alloc_cbf(struct lsof_context *ctx, MALLOC_S len, char **cbf,
                           MALLOC_S cbfa);
-static int get_fdinfo(struct lsof_context *ctx, char *p, int msk,
-                      struct l_fdinfo *fi);
-static int getlinksrc(char *ln, char *src, int srcl, char **rest);
+static void clear_map_stats(struct lsof_context *ctx);
+#if defined(HASSTATX)
+static int do_statx(char *arg, char *rbuf, int rbln);
+#endif /* defined(HASSTATX) */
+static int fd_stat(struct lsof_context *ctx, int op, int dfd, char *nm,
+                   struct stat *sb, int flags);
+static int fd_stat_safely(struct lsof_context *ctx, char *path,
+                          struct stat *sb, int flags);
+#if defined(HASFDMEMO)
+static struct fd_memo *fd_memo_find(struct lsof_context *ctx, int ifd,
+                                    char *fdnm, int fd, char *link,
+                                    char **info);
+static void fd_memo_sweep(struct lsof_context *ctx);
+#endif /* defined(HASFDMEMO) */
+#if defined(HASIOURING)
+static int fill_fd_batch(struct lsof_context *ctx, int fdfd, int ifd, int fx);
+static int get_batch_link(struct fd_batch_ent *be, char *src, int srcl,
+                          char **rest);
+#endif /* defined(HASIOURING) */
+static void gather_pid_info(struct lsof_context *ctx, int pid);
+static void get_direct_pids(struct lsof_context *ctx, struct id_list *il);
+static int get_fdinfo(struct lsof_context *ctx, int dfd, char *p, int msk,
+                      struct l_fdinfo *fi, char *info);
+static int getlinksrc(int dfd, char *ln, char *src, int srcl, char **rest);
+static int get_link_kind(char *src, char *rest, INODETYPE *ino);
+static int is_tgid(int pfd, int id);
 static int isefsys(struct lsof_context *ctx, char *path,
                    enum lsof_file_type type, int l, efsys_list_t **rep,
                    struct lfile **lfr);
-static int nm2id(char *nm, int *id, int *idl);
-static int read_id_stat(struct lsof_context *ctx, char *p, int id, char **cmd,
-                        int *ppid, int *pgid);
-static void process_proc_map(struct lsof_context *ctx, char *p, struct stat *s,
-                             int ss);
-static int process_id(struct lsof_context *ctx, char *idp, int idpl, char *cmd,
-                      UID_ARG uid, int pid, int ppid, int pgid, int tid,
-                      char *tcmd);
+static int need_fdinfo(struct lsof_context *ctx, char *rest);
+static int need_lstat(struct lsof_context *ctx);
+static int need_stat(struct lsof_context *ctx, char *src);
+static int read_id_dir(struct lsof_context *ctx, int dfd, struct id_list *il);
+static int read_id_stat(struct lsof_context *ctx, int dfd, char *p, int id,
+                        char **cmd, int *ppid, int *pgid,
+                        unsigned long long *start);
+static int read_proc_map(struct lsof_context *ctx, FILE *ms, int *pq,
+                         uint64_t *addr, char *buf, size_t bufl,
+                         uint64_t *start, uint64_t *end, dev_t *dev,
+                         INODETYPE *inode, char **path);
+static void process_proc_map(struct lsof_context *ctx, int idfd,
+                             struct stat *s, int ss);
+static int process_id(struct lsof_context *ctx, int idfd, char *idp, int idpl,
+                      char *cmd, UID_ARG uid, int pid, int ppid, int pgid,
+                      unsigned long long start, int tid, char *tcmd);
 static int statEx(struct lsof_context *ctx, char *p, struct stat *s, int *ss);
 
+static int fd_compare(const void *a, const void *b);
 static void snp_eventpoll(char *p, int len, int *tfds, int tfd_count);
 
 #if defined(HASSELINUX)
@@ -204,50 +262,1053 @@ static MALLOC_S alloc_cbf(struct lsof_context *ctx, /* context */
 }
 
 /*
- * gather_proc_info() -- gather process information
+ * gather_pid_info() -- gather the information of a /proc/<PID> directory
  */
 
-void gather_proc_info(struct lsof_context *ctx) {
+static void gather_pid_info(struct lsof_context *ctx, /* context */
+                            int pid)                  /* process ID */
+{
     char *cmd, *tcmd;
     char cmdbuf[MAXPATHLEN];
-    struct dirent *dp;
     unsigned char ht, pidts;
-    int n, nl, pgid, pid, ppid, prv, rv, tid, tpgid, tppid, tx;
-    static char *path = (char *)NULL;
-    static int pathl = 0;
-    static char *pidpath = (char *)NULL;
-    static MALLOC_S pidpathl = 0;
-    static MALLOC_S pidx = 0;
-    static DIR *ps = (DIR *)NULL;
+    int i, n, nl, pgid, ppid, prv, rv, tid, tpgid, tppid, tx;
+    MALLOC_S len;
+    unsigned long long start, tstart;
     struct stat sb;
-    static char *taskpath = (char *)NULL;
-    static int taskpathl = 0;
-    static char *tidpath = (char *)NULL;
-    static int tidpathl = 0;
-    DIR *ts;
     UID_ARG uid;
+    char *pidpath;
+    int pfd, tfd;
+    char tidnm[16];
 
     /*
-     * Do one-time setup.
+     * Build path to PID's directory.
      */
-    if (!pidpath) {
-        pidx = strlen(PROCFS) + 1;
-        pidpathl = pidx + 64 + 1; /* 64 is growth room */
-        if (!(pidpath = (char *)malloc(pidpathl))) {
+    len = strlen(PROCFS) + 1 + 10 + 1 + 1; /* 10 is the maximum PID width */
+    if ((int)len > ctx->dialect.pid_path_len) {
+        if (ctx->dialect.pid_path)
+            pidpath = (char *)realloc((MALLOC_P *)ctx->dialect.pid_path, len);
+        else
+            pidpath = (char *)malloc(len);
+        if (!pidpath) {
             (void)fprintf(stderr,
-                          "%s: can't allocate %d bytes for \"%s/\"<pid>\n", Pn,
-                          (int)pidpathl, PROCFS);
+                          "%s: can't allocate %d bytes for \"%s/%d/\"\n", Pn,
+                          (int)len, PROCFS, pid);
             Error(ctx);
         }
-        (void)snpf(pidpath, pidpathl, "%s/", PROCFS);
+        ctx->dialect.pid_path = pidpath;
+        ctx->dialect.pid_path_len = (int)len;
     }
+    pidpath = ctx->dialect.pid_path;
+    n = snpf(pidpath, ctx->dialect.pid_path_len, "%s/%d/", PROCFS, pid);
     /*
-     * Get lock and net information.
+     * Open the PID's directory, so that its entries may be reached without
+     * another /proc path lookup, and process its stat info.
      */
-    (void)make_proc_path(ctx, pidpath, pidx, &path, &pathl, "locks");
-    (void)get_locks(ctx, path);
-    (void)make_proc_path(ctx, pidpath, pidx, &path, &pathl, "net/");
-    (void)set_net_paths(ctx, path, strlen(path));
+    if ((pfd = open(pidpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return;
+    if (fstat(pfd, &sb) || (ctx->dialect.pid_direct && !is_tgid(pfd, pid))) {
+        (void)close(pfd);
+        return;
+    }
+    uid = (UID_ARG)sb.st_uid;
+    ht = pidts = 0;
+    /*
+     * Get the PID's command name.
+     */
+    if ((prv = read_id_stat(ctx, pfd, "stat", pid, &cmd, &ppid, &pgid,
+                            &start)) < 0)
+        cmd = NULL; /* NULL means failure to get command name */
+
+#if defined(HASTASKS)
+    /*
+     * Task reporting has been selected, so save the process' command
+     * string, so that task processing won't change it in the buffer of
+     * read_id_stat().
+     *
+     * Check the tasks of the process first, so that the "-p<PID> -aK"
+     * options work properly.
+     */
+    else if (!IgnTasks && (Selflags & SELTASK)) {
+        char *taskpath, *tidpath;
+        int tdfd, tidpathl;
+
+        /*
+         * Copy cmd before next call to read_id_stat due to the shared
+         * command buffer
+         */
+        if (cmd) {
+            strncpy(cmdbuf, cmd, sizeof(cmdbuf) - 1);
+            cmdbuf[sizeof(cmdbuf) - 1] = '\0';
+            cmd = cmdbuf;
+        }
+
+        (void)make_proc_path(ctx, pidpath, n, &ctx->dialect.task_path,
+                             &ctx->dialect.task_path_len, "task");
+        taskpath = ctx->dialect.task_path;
+        tx = n + 4;
+        if ((tfd = openat(pfd, "task", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >=
+                0 &&
+            read_id_dir(ctx, tfd, &ctx->dialect.task_ids) < 0) {
+            (void)close(tfd);
+            tfd = -1;
+        }
+        if (tfd >= 0) {
+
+            /*
+             * Process the PID's tasks.  Record the open files of those
+             * whose TIDs do not match the PID and which are themselves
+             * not zombies.
+             */
+            for (i = 0; (i < ctx->dialect.task_ids.n) && !MATCHES_DONE(ctx);
+                 i++) {
+
+                /*
+                 * Get the task ID.  Skip the task if its ID matches the
+                 * process PID.
+                 */
+                tid = ctx->dialect.task_ids.ids[i];
+                nl = snpf(tidnm, sizeof(tidnm), "%d", tid);
+                if (tid == pid) {
+                    pidts = 1;
+                    continue;
+                }
+                /*
+                 * Form the path for the TID.
+                 */
+                tidpath = ctx->dialect.tid_path;
+                if ((tx + 1 + nl + 1 + 4) > ctx->dialect.tid_path_len) {
+                    tidpathl = tx + 1 + n + 1 + 4 + 64;
+                    if (tidpath)
+                        tidpath =
+                            (char *)realloc((MALLOC_P *)tidpath, tidpathl);
+                    else
+                        tidpath = (char *)malloc((MALLOC_S)tidpathl);
+                    if (!tidpath) {
+                        (void)fprintf(stderr,
+                                      "%s: can't allocate %d task bytes", Pn,
+                                      tidpathl);
+                        (void)fprintf(stderr, " for \"%s/%s/stat\"\n",
+                                      taskpath, tidnm);
+                        Error(ctx);
+                    }
+                    ctx->dialect.tid_path = tidpath;
+                    ctx->dialect.tid_path_len = tidpathl;
+                }
+                (void)snpf(tidpath, ctx->dialect.tid_path_len, "%s/%s/",
+                           taskpath, tidnm);
+                if ((tdfd = openat(tfd, tidnm,
+                                   O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+                    continue;
+                /*
+                 * Check the task state.
+                 */
+                rv = read_id_stat(ctx, tdfd, "stat", tid, &tcmd, &tppid,
+                                  &tpgid, &tstart);
+                /*
+                 * Attempt to record the task.
+                 */
+                if ((rv >= 0) && (rv != 1) &&
+                    !process_id(ctx, tdfd, tidpath, (tx + 1 + nl + 1), cmd,
+                                uid, pid, tppid, tpgid, tstart, tid, tcmd)) {
+                    ht = 1;
+                }
+                (void)close(tdfd);
+            }
+            (void)close(tfd);
+        }
+    }
+#endif /* defined(HASTASKS) */
+
+    /*
+     * If the main process is a task and task selection has been specified
+     * along with option ANDing, enter the main process temporarily as a
+     * task, so that the "-aK" option set lists the main process along
+     * with its tasks.
+     */
+    if ((prv >= 0) && (prv != 1) && !MATCHES_DONE(ctx)) {
+        tid = (Fand && ht && pidts && !IgnTasks && (Selflags & SELTASK)) ? pid
+                                                                          : 0;
+        if ((!process_id(ctx, pfd, pidpath, n, cmd, uid, pid, ppid, pgid,
+                         start, tid, (char *)NULL)) &&
+            tid) {
+            Lp->tid = 0;
+        }
+    }
+    (void)close(pfd);
+}
+
+/*
+ * get_direct_pids() -- get the PIDs whose /proc directories are read
+ *			without reading /proc: those lsof_gather_pids() has
+ *			asked for, or the included -p PIDs
+ */
+
+static void get_direct_pids(struct lsof_context *ctx, /* context */
+                            struct id_list *il)       /* ID list receiver */
+{
+    int i, j, n;
+    int *ids;
+    MALLOC_S len;
+
+    n = ctx->pid_set ? (int)ctx->pid_set_size : Npid;
+    il->n = 0;
+    if (n > il->alloc) {
+        len = (MALLOC_S)(n * sizeof(int));
+        if (il->ids)
+            ids = (int *)realloc((MALLOC_P *)il->ids, len);
+        else
+            ids = (int *)malloc(len);
+        if (!ids) {
+            (void)fprintf(stderr, "%s: no space for %d PIDs\n", Pn, n);
+            Error(ctx);
+        }
+        il->ids = ids;
+        il->alloc = n;
+    }
+    for (i = 0; i < n; i++) {
+        if (ctx->pid_set) {
+            if (ctx->pid_set[i] <= (uint32_t)INT_MAX)
+                il->ids[il->n++] = (int)ctx->pid_set[i];
+        } else if (!Spid[i].x)
+            il->ids[il->n++] = Spid[i].i;
+    }
+    /*
+     * Read each process once, in PID order, as from /proc.
+     */
+    if (il->n > 1) {
+        (void)qsort((QSORT_P *)il->ids, (size_t)il->n, sizeof(int),
+                    fd_compare);
+        for (i = j = 1; i < il->n; i++) {
+            if (il->ids[i] != il->ids[j - 1])
+                il->ids[j++] = il->ids[i];
+        }
+        il->n = j;
+    }
+}
+
+/*
+ * is_tgid() -- is an ID that of a process, rather than that of one of its
+ *		other tasks?
+ *
+ * Every task has a /proc/<ID> directory, but only those of processes are
+ * listed when /proc is read.
+ */
+
+static int is_tgid(int pfd, /* /proc/<ID> directory fd */
+                   int id)  /* ID */
+{
+    char buf[512], *cp;
+    int fd, n;
+
+    if ((fd = openat(pfd, "status", O_RDONLY | O_CLOEXEC)) < 0)
+        return (0);
+    n = (int)read(fd, buf, sizeof(buf) - 1);
+    (void)close(fd);
+    if (n <= 0)
+        return (0);
+    buf[n] = '\0';
+    if (!(cp = strstr(buf, "\nTgid:")))
+        return (1);
+    return ((atoi(cp + 6) == id) ? 1 : 0);
+}
+
+#if defined(HASPARSCAN)
+/*
+ * Parallel process scanning (-j)
+ *
+ * The PIDs of the /proc directory are read into an array that is divided
+ * into one contiguous run per scanning thread.  A thread takes PIDs from the
+ * front of its own run; when its run is exhausted it steals PIDs from the
+ * back of the other threads' runs.
+ *
+ * Each thread gathers into its own copy of the context.  When all threads
+ * have finished, their lproc structures are moved to the caller's context in
+ * /proc directory order, so the result is the same as a serial scan's.
+ */
+
+struct scan_run {        /* a scanning thread's run of PIDs */
+    pthread_mutex_t mtx; /* run lock */
+    int head;            /* index of next PID to take */
+    int tail;            /* index after the last PID of the run */
+};
+
+struct scan_slot { /* the result of scanning a PID */
+    int thr;       /* scanning thread index */
+    int lpx;       /* index of first lproc in the thread's context */
+    int nlp;       /* number of lproc structures */
+};
+
+struct scan_thread;
+
+struct scan_state {
+    int *pids;                 /* PIDs read from /proc (not owned) */
+    int npids;                 /* number of pids[] entries */
+    struct scan_slot *slots;   /* results, indexed as pids[] */
+    struct scan_run *runs;     /* PID runs, one per thread */
+    struct scan_thread *thrs;  /* scanning threads */
+    int nthr;                  /* number of scanning threads */
+};
+
+struct scan_thread {           /* a scanning thread */
+    struct scan_state *st;     /* shared scan state */
+    int thr;                   /* thread index */
+    struct lsof_context *ctx;  /* thread's copy of the context */
+    pthread_t tid;             /* thread ID */
+    int started;               /* thread was started */
+};
+
+/*
+ * scan_ctx_free() -- free a scanning thread's context copy
+ */
+
+static void scan_ctx_free(struct lsof_context *tc) /* context copy */
+{
+    if (!tc)
+        return;
+
+#if defined(HASARENA)
+    /* Any unlinked file goes with the arena space, moved or freed. */
+    (void)arena_free(tc);
+#else  /* !defined(HASARENA) */
+    if (tc->cur_file) {
+        CLEAN(tc->cur_file->dev_ch);
+        CLEAN(tc->cur_file->nm);
+        CLEAN(tc->cur_file->nma);
+        CLEAN(tc->cur_file);
+    }
+#endif /* defined(HASARENA) */
+
+    /* The lproc structures have been moved; free only their array. */
+    CLEAN(tc->procs);
+    CLEAN(tc->name_buf);
+    (void)found_free(tc);
+    CLEAN(tc->dialect.fields);
+    CLEAN(tc->dialect.pid_path);
+    CLEAN(tc->dialect.task_path);
+    CLEAN(tc->dialect.tid_path);
+    CLEAN(tc->dialect.fd_dir_path);
+    CLEAN(tc->dialect.id_path);
+    CLEAN(tc->dialect.cmd_buf);
+    CLEAN(tc->dialect.stat_vbuf);
+    (void)clear_map_stats(tc);
+    CLEAN(tc->dialect.map_stats.slot);
+    CLEAN(tc->dialect.maps_vbuf);
+    CLEAN(tc->dialect.dents_buf);
+    CLEAN(tc->dialect.task_ids.ids);
+    CLEAN(tc->dialect.fd_ids.ids);
+
+#if defined(HASIOURING)
+    (void)ring_close(tc);
+    CLEAN(tc->dialect.fd_batch);
+#endif /* defined(HASIOURING) */
+
+    CLEAN(tc);
+}
+
+/*
+ * scan_ctx_new() -- make a scanning thread's copy of a context
+ *
+ * The copy shares the selection parameters of the original, but has its own
+ * output and temporary buffers.
+ */
+
+static struct lsof_context *
+scan_ctx_new(struct lsof_context *ctx) /* original context */
+{
+    struct lsof_context *tc;
+
+    if (!(tc = (struct lsof_context *)malloc(sizeof(struct lsof_context)))) {
+        (void)fprintf(stderr, "%s: no space for scanning thread context\n",
+                      Pn);
+        Error(ctx);
+    }
+    *tc = *ctx;
+    tc->procs = (struct lproc *)NULL;
+    tc->procs_size = tc->procs_cap = 0;
+    tc->cur_proc = (struct lproc *)NULL;
+    tc->cur_file = tc->prev_file = (struct lfile *)NULL;
+
+#if defined(HASARENA)
+    /* The thread allocates files from its own arena. */
+    zeromem((char *)&tc->arena, sizeof(tc->arena));
+#endif /* defined(HASARENA) */
+
+    /* The thread records the find states it sets for found_apply(). */
+    tc->found_deferred = 1;
+    tc->found_marks = (struct found_mark *)NULL;
+    tc->found_marks_size = tc->found_marks_mask = 0;
+
+    if (!(tc->name_buf = (char *)malloc(Namechl))) {
+        (void)fprintf(stderr, "%s: no space for scanning thread name buffer\n",
+                      Pn);
+        Error(ctx);
+    }
+    tc->name_buf[0] = '\0';
+    zeromem((char *)&tc->dialect, sizeof(tc->dialect));
+    tc->dialect.cckreg = Cckreg;
+    tc->dialect.ckscko = Ckscko;
+    tc->dialect.pid_direct = ctx->dialect.pid_direct;
+
+#if defined(HASSTATX)
+    tc->dialect.stx_smask = ctx->dialect.stx_smask;
+    tc->dialect.stx_lmask = ctx->dialect.stx_lmask;
+    tc->dialect.no_statx = ctx->dialect.no_statx;
+#endif /* defined(HASSTATX) */
+
+#if defined(HASIOURING)
+    /* The thread opens its own ring, if the probe found one. */
+    tc->dialect.ring_ok = ctx->dialect.ring_ok;
+#endif /* defined(HASIOURING) */
+
+    return (tc);
+}
+
+/*
+ * scan_take() -- take the index of the next PID to scan
+ *
+ * return: the pids[] index; -1 if all PIDs have been taken
+ */
+
+static int scan_take(struct scan_state *st, /* scan state */
+                     int thr)               /* taking thread's index */
+{
+    int i, x = -1;
+    struct scan_run *r;
+
+    for (i = 0; (i < st->nthr) && (x < 0); i++) {
+        r = &st->runs[(thr + i) % st->nthr];
+        (void)pthread_mutex_lock(&r->mtx);
+        if (r->head < r->tail)
+            x = i ? --r->tail : r->head++;
+        (void)pthread_mutex_unlock(&r->mtx);
+    }
+    return (x);
+}
+
+/*
+ * scan_thread() -- scanning thread function
+ */
+
+static void *scan_thread(void *arg) /* struct scan_thread pointer */
+{
+    struct scan_thread *t = (struct scan_thread *)arg;
+    struct scan_state *st = t->st;
+    struct lsof_context *ctx = t->ctx;
+    size_t b;
+    int x;
+
+    while ((x = scan_take(st, t->thr)) >= 0) {
+        b = Nlproc;
+        gather_pid_info(ctx, st->pids[x]);
+        st->slots[x].thr = t->thr;
+        st->slots[x].lpx = (int)b;
+        st->slots[x].nlp = (int)(Nlproc - b);
+    }
+    return (NULL);
+}
+
+/*
+ * scan_parallel() -- scan the /proc PID directories with multiple threads
+ */
+
+static void scan_parallel(struct lsof_context *ctx, /* context */
+                          int *pids,                /* /proc PIDs */
+                          int npids)                /* number of pids[] */
+{
+    int i, x;
+    MALLOC_S len;
+    struct scan_state st;
+    struct scan_slot *sl;
+    struct lsof_context *tc;
+    size_t cap;
+
+    if (!npids)
+        return;
+    zeromem((char *)&st, sizeof(st));
+    st.pids = pids;
+    st.npids = npids;
+    /*
+     * Divide the PIDs into runs and start the scanning threads.  The calling
+     * thread scans, too, as thread zero.
+     */
+    st.nthr = (ScanThr < st.npids) ? ScanThr : st.npids;
+    if (!(st.slots = (struct scan_slot *)calloc((MALLOC_S)st.npids,
+                                                sizeof(struct scan_slot))) ||
+        !(st.runs = (struct scan_run *)calloc((MALLOC_S)st.nthr,
+                                              sizeof(struct scan_run))) ||
+        !(st.thrs = (struct scan_thread *)calloc((MALLOC_S)st.nthr,
+                                                 sizeof(struct scan_thread)))) {
+        (void)fprintf(stderr, "%s: no space for %d scanning threads\n", Pn,
+                      st.nthr);
+        Error(ctx);
+    }
+    for (i = 0; i < st.nthr; i++) {
+        (void)pthread_mutex_init(&st.runs[i].mtx, NULL);
+        st.runs[i].head = (int)(((long)st.npids * i) / st.nthr);
+        st.runs[i].tail = (int)(((long)st.npids * (i + 1)) / st.nthr);
+        st.thrs[i].st = &st;
+        st.thrs[i].thr = i;
+        st.thrs[i].ctx = scan_ctx_new(ctx);
+    }
+    for (i = 1; i < st.nthr; i++) {
+        if (!pthread_create(&st.thrs[i].tid, NULL, scan_thread, &st.thrs[i]))
+            st.thrs[i].started = 1;
+    }
+    (void)scan_thread(&st.thrs[0]);
+    for (i = 1; i < st.nthr; i++) {
+        if (st.thrs[i].started)
+            (void)pthread_join(st.thrs[i].tid, NULL);
+    }
+    /*
+     * Move the lproc structures to the caller's context in PID order.
+     */
+    for (x = 0; x < st.npids; x++) {
+        sl = &st.slots[x];
+        if (!sl->nlp)
+            continue;
+        tc = st.thrs[sl->thr].ctx;
+        if ((Nlproc + sl->nlp) > ctx->procs_cap) {
+            cap = ((Nlproc + sl->nlp + LPROCINCR - 1) / LPROCINCR) * LPROCINCR;
+            len = (MALLOC_S)(cap * sizeof(struct lproc));
+            if (Lproc)
+                Lproc = (struct lproc *)realloc((MALLOC_P *)Lproc, len);
+            else
+                Lproc = (struct lproc *)malloc(len);
+            if (!Lproc) {
+                (void)fprintf(stderr,
+                              "%s: no space for %d local proc structures\n",
+                              Pn, (int)cap);
+                Error(ctx);
+            }
+            ctx->procs_cap = cap;
+        }
+        (void)memcpy((void *)&Lproc[Nlproc], (void *)&tc->procs[sl->lpx],
+                     sl->nlp * sizeof(struct lproc));
+        Nlproc += sl->nlp;
+    }
+    if (Nlproc)
+        Lp = &Lproc[Nlproc - 1];
+    /*
+     * Record the selections the threads found, take their arena space, then
+     * free their contexts.
+     */
+    for (i = 0; i < st.nthr; i++) {
+        tc = st.thrs[i].ctx;
+
+#if defined(HASARENA)
+        (void)arena_move(ctx, tc);
+#endif /* defined(HASARENA) */
+
+        if (Fnet && (tc->net == 2))
+            Fnet = 2;
+        if (Fnfs && (tc->sel_nfs == 2))
+            Fnfs = 2;
+        if (Ftask && (tc->sel_task == 2))
+            Ftask = 2;
+        (void)found_apply(ctx, tc);
+        scan_ctx_free(tc);
+        (void)pthread_mutex_destroy(&st.runs[i].mtx);
+    }
+    CLEAN(st.slots);
+    CLEAN(st.runs);
+    CLEAN(st.thrs);
+}
+#endif /* defined(HASPARSCAN) */
+
+#if defined(HASSTATX)
+/*
+ * do_statx() - do a statx(2) function for fd_stat_safely()
+ *
+ * The argument is "<flags> <mask> <path>", the flags and mask in hexadecimal.
+ */
+
+static int do_statx(char *arg,  /* argument */
+                    char *rbuf, /* response buffer */
+                    int rbln)   /* response buffer length */
+
+/* ARGSUSED */
+
+{
+    char *cp;
+    unsigned long fl, mk;
+
+    fl = strtoul(arg, &cp, 16);
+    mk = strtoul(cp, &cp, 16);
+    if (*cp++ != ' ') {
+        errno = EINVAL;
+        return (-1);
+    }
+    return ((int)syscall(__NR_statx, AT_FDCWD, cp, (int)fl, (unsigned int)mk,
+                         (struct statx *)rbuf));
+}
+
+/*
+ * statx_to_stat() - convert a statx(2) result to a stat(2) one
+ *
+ * return: the SB_* status of *sb
+ */
+
+int statx_to_stat(struct statx *sx, /* statx(2) result */
+                  struct stat *sb)  /* stat(2) result buffer */
+{
+    int ss = SB_DEV | SB_RDEV;
+
+    zeromem((char *)sb, sizeof(struct stat));
+    sb->st_dev = makedev(sx->stx_dev_major, sx->stx_dev_minor);
+    sb->st_rdev = makedev(sx->stx_rdev_major, sx->stx_rdev_minor);
+    if ((sx->stx_mask & (STATX_TYPE | STATX_MODE)) ==
+        (STATX_TYPE | STATX_MODE)) {
+        sb->st_mode = (mode_t)sx->stx_mode;
+        ss |= SB_MODE;
+    }
+    if (sx->stx_mask & STATX_INO) {
+        sb->st_ino = (ino_t)sx->stx_ino;
+        ss |= SB_INO;
+    }
+    if (sx->stx_mask & STATX_NLINK) {
+        sb->st_nlink = (nlink_t)sx->stx_nlink;
+        ss |= SB_NLINK;
+    }
+    if (sx->stx_mask & STATX_SIZE) {
+        sb->st_size = (off_t)sx->stx_size;
+        ss |= SB_SIZE;
+    }
+    sb->st_uid = (uid_t)sx->stx_uid;
+    sb->st_gid = (gid_t)sx->stx_gid;
+    sb->st_blksize = (blksize_t)sx->stx_blksize;
+    sb->st_blocks = (blkcnt_t)sx->stx_blocks;
+    sb->st_atim.tv_sec = (time_t)sx->stx_atime.tv_sec;
+    sb->st_atim.tv_nsec = (long)sx->stx_atime.tv_nsec;
+    sb->st_mtim.tv_sec = (time_t)sx->stx_mtime.tv_sec;
+    sb->st_mtim.tv_nsec = (long)sx->stx_mtime.tv_nsec;
+    sb->st_ctim.tv_sec = (time_t)sx->stx_ctime.tv_sec;
+    sb->st_ctim.tv_nsec = (long)sx->stx_ctime.tv_nsec;
+    return (ss);
+}
+#endif /* defined(HASSTATX) */
+
+/*
+ * fd_stat() - stat(2) or lstat(2) a /proc/<ID> link, or get the result of
+ *	       the ring operation that did it
+ *
+ * Where statx(2) is available, only the fields initialize() found are needed
+ * are requested, and the file's cached attributes are accepted, so that a
+ * network file system needn't be asked for them.
+ *
+ * return: the SB_* status of *sb (0 if the stat(2) failed; errno is set)
+ */
+
+static int fd_stat(struct lsof_context *ctx, /* context */
+                   int op,          /* ring operation (-1 if none) */
+                   int dfd,         /* directory fd nm is relative to */
+                   char *nm,        /* link name */
+                   struct stat *sb, /* stat(2) result buffer */
+                   int flags)       /* fstatat(2) flags */
+{
+
+#if defined(HASSTATX)
+    struct statx sx;
+#endif /* defined(HASSTATX) */
+
+#if defined(HASIOURING)
+    int rv;
+
+    if (op >= 0 && (rv = ring_stat_result(ctx, op, sb)) >= 0)
+        return (rv);
+#endif /* defined(HASIOURING) */
+
+#if defined(HASSTATX)
+    if (!ctx->dialect.no_statx) {
+        if (!syscall(__NR_statx, dfd, nm, flags | AT_STATX_DONT_SYNC,
+                     (flags & AT_SYMLINK_NOFOLLOW) ? ctx->dialect.stx_lmask
+                                                   : ctx->dialect.stx_smask,
+                     &sx))
+            return (statx_to_stat(&sx, sb));
+        if (errno != ENOSYS)
+            return (0);
+        ctx->dialect.no_statx = 1;
+    }
+#endif /* defined(HASSTATX) */
+
+    return (fstatat(dfd, nm, sb, flags) ? 0 : SB_ALL);
+}
+
+/*
+ * fd_stat_safely() - stat(2) or lstat(2) a /proc/<ID> link path safely
+ *		      (i. e., with timeout)
+ *
+ * return: the SB_* status of *sb (0 if the stat(2) failed; errno is set)
+ */
+
+static int fd_stat_safely(struct lsof_context *ctx, /* context */
+                          char *path,               /* link path */
+                          struct stat *sb, /* stat(2) result buffer */
+                          int flags)       /* AT_SYMLINK_NOFOLLOW or 0 */
+{
+
+#if defined(HASSTATX)
+    char arg[MAXPATHLEN + 1];
+    struct statx sx;
+
+    if (!ctx->dialect.no_statx && !Fblock) {
+        (void)snpf(arg, sizeof(arg), "%x %x %s", flags | AT_STATX_DONT_SYNC,
+                   (flags & AT_SYMLINK_NOFOLLOW) ? ctx->dialect.stx_lmask
+                                                 : ctx->dialect.stx_smask,
+                   path);
+        if (!dosafely(ctx, do_statx, arg, (char *)&sx, sizeof(sx)))
+            return (statx_to_stat(&sx, sb));
+        if (errno != ENOSYS)
+            return (0);
+        ctx->dialect.no_statx = 1;
+    }
+#endif /* defined(HASSTATX) */
+
+    if (flags & AT_SYMLINK_NOFOLLOW)
+        return (lstatsafely(ctx, path, sb) ? 0 : SB_ALL);
+    return (statsafely(ctx, path, sb) ? 0 : SB_ALL);
+}
+
+#if defined(HASFDMEMO)
+/*
+ * FD stat(2) results kept between delta gathers
+ *
+ * When the gathers of lsof_gather_delta() or of the -r option's d suffix
+ * follow each other, process_id() reads the fdinfo text of an FD whose
+ * stat(2) results aren't derived from its link text, and looks for the FD's
+ * entry.  If the FD's link text and fdinfo text -- which carries its flags,
+ * position, mount ID and, on newer kernels, inode number -- haven't changed,
+ * the FD still refers to the same open file, and the stat(2) and lstat(2)
+ * results of the previous gather are used again -- but for those of a
+ * regular file or directory when its size, offset or link count is needed,
+ * since they change with its contents, not its open file.  Entries of FDs
+ * that a gather didn't see are freed at its end.
+ */
+
+/*
+ * fd_memo_hash() - hash a text (64 bit FNV-1a)
+ */
+
+static uint64_t fd_memo_hash(char *s) /* text */
+{
+    return (proc_sig_hash(s, strlen(s)));
+}
+
+/*
+ * fd_memo_info_hash() - hash an fdinfo text, less its pos: line (64 bit
+ *			 FNV-1a)
+ *
+ * The offset moves with each read and write, and has no bearing on the
+ * stat(2) results; get_fdinfo() takes it from the text just read.
+ */
+
+static uint64_t fd_memo_info_hash(char *b) /* text */
+{
+    int bol = 1;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (; *b; b++) {
+        if (bol && !strncmp(b, "pos:", 4)) {
+            while (b[1] && b[1] != '\n')
+                b++;
+            b++;
+            if (!*b)
+                break;
+            continue;
+        }
+        bol = (*b == '\n');
+        h ^= (unsigned char)*b;
+        h *= 0x100000001b3ULL;
+    }
+    return (h);
+}
+
+/*
+ * fd_memo_stale() - may an FD entry's results be stale though its texts
+ *		     are unchanged?
+ *
+ * return: 1 if they may
+ */
+
+static int fd_memo_stale(struct lsof_context *ctx, /* context */
+                         struct fd_memo *mp)       /* entry */
+{
+    mode_t ty;
+
+    if (!(NeedAttr & (NEED_SIZE | NEED_OFFSET | NEED_NLINK)))
+        return (0);
+    ty = (mp->ss & SB_MODE) ? (mp->sb.st_mode & S_IFMT) : 0;
+    return ((ty == S_IFREG) || (ty == S_IFDIR));
+}
+
+/*
+ * fd_memo_key() - index key of an FD entry
+ */
+
+static INODETYPE fd_memo_key(struct fd_memo *mp) /* entry */
+{
+    return ((INODETYPE)(((uint64_t)(unsigned int)mp->pid << 32) ^
+                        ((uint64_t)(unsigned int)mp->tid << 12) ^
+                        (uint64_t)mp->start ^ (uint64_t)(unsigned int)mp->fd));
+}
+
+/*
+ * fd_memo_find() - find the entry of an FD of the current process
+ *
+ * The FD's fdinfo text is read, and returned for get_fdinfo().  An entry is
+ * made for an FD that has none.  The entry's results are valid only if the
+ * FD's link and fdinfo texts -- but for the fdinfo pos: line -- are those of
+ * the previous gather.
+ *
+ * return: the entry; NULL if the fdinfo text couldn't be read whole or there
+ *	   was no space
+ */
+
+static struct fd_memo *fd_memo_find(struct lsof_context *ctx, /* context */
+                                    int ifd,    /* /proc/<ID>/fdinfo fd */
+                                    char *fdnm, /* FD name */
+                                    int fd,     /* FD number */
+                                    char *link, /* FD link text */
+                                    char **info) /* returned fdinfo text */
+{
+    char *b;
+    int f;
+    uint64_t ih, lh;
+    INODETYPE k;
+    size_t len = 0;
+    struct fd_memo m, *mp;
+    ssize_t n = 0;
+
+    if (!(b = ctx->dialect.fd_memo_info) &&
+        !(b = ctx->dialect.fd_memo_info = (char *)malloc(FD_MEMO_INFOSZ)))
+        return ((struct fd_memo *)NULL);
+    /*
+     * Read the fdinfo text.  A text that fills the buffer may have been cut
+     * short.
+     */
+    if ((f = openat(ifd, fdnm, O_RDONLY | O_CLOEXEC)) < 0)
+        return ((struct fd_memo *)NULL);
+    while (len < FD_MEMO_INFOSZ - 1 &&
+           (n = read(f, b + len, FD_MEMO_INFOSZ - 1 - len)) > 0)
+        len += (size_t)n;
+    (void)close(f);
+    if (n < 0 || len >= FD_MEMO_INFOSZ - 1)
+        return ((struct fd_memo *)NULL);
+    b[len] = '\0';
+    *info = b;
+    /*
+     * Find or make the FD's entry.
+     */
+    lh = fd_memo_hash(link);
+    ih = fd_memo_info_hash(b);
+    m.pid = Lp->pid;
+    m.tid = Lp->tid;
+    m.start = Lp->start;
+    m.fd = fd;
+    k = fd_memo_key(&m);
+    for (mp = (struct fd_memo *)inohash_find(&ctx->dialect.fd_memos, k); mp;
+         mp = mp->next) {
+        if ((mp->pid == m.pid) && (mp->tid == m.tid) &&
+            (mp->start == m.start) && (mp->fd == fd))
+            break;
+    }
+    if (!mp) {
+        if (!(mp = (struct fd_memo *)malloc(sizeof(struct fd_memo))))
+            return ((struct fd_memo *)NULL);
+        *mp = m;
+        mp->valid = 0;
+        mp->next = (struct fd_memo *)inohash_find(&ctx->dialect.fd_memos, k);
+        if (inohash_insert(&ctx->dialect.fd_memos, k, (void *)mp)) {
+            (void)free((FREE_P *)mp);
+            return ((struct fd_memo *)NULL);
+        }
+    } else if ((mp->lh != lh) || (mp->ih != ih))
+        mp->valid = 0;
+    mp->lh = lh;
+    mp->ih = ih;
+    mp->seen = ctx->dialect.fd_memo_serial;
+    return (mp);
+}
+
+/*
+ * fd_memo_free() - free the FD entries
+ */
+
+void fd_memo_free(struct lsof_context *ctx) /* context */
+{
+    size_t h;
+    struct fd_memo *mp, *np;
+
+    INOHASH_FOREACH(&ctx->dialect.fd_memos, h, mp) {
+        for (; mp; mp = np) {
+            np = mp->next;
+            (void)free((FREE_P *)mp);
+        }
+    }
+    CLEAN(ctx->dialect.fd_memos.slot);
+    ctx->dialect.fd_memos.mask = ctx->dialect.fd_memos.count = 0;
+    CLEAN(ctx->dialect.fd_memo_info);
+}
+
+/*
+ * fd_memo_sweep() - free the entries of the FDs a gather didn't see
+ */
+
+static void fd_memo_sweep(struct lsof_context *ctx) /* context */
+{
+    size_t h, n = 0;
+    struct fd_memo *keep = (struct fd_memo *)NULL, *mp, *np;
+    INODETYPE k;
+
+    INOHASH_FOREACH(&ctx->dialect.fd_memos, h, mp) {
+        for (; mp; mp = np) {
+            np = mp->next;
+            if (mp->seen != ctx->dialect.fd_memo_serial) {
+                (void)free((FREE_P *)mp);
+                continue;
+            }
+            mp->next = keep;
+            keep = mp;
+            n++;
+        }
+    }
+    if (!ctx->dialect.fd_memos.slot)
+        return;
+    if (inohash_reset(&ctx->dialect.fd_memos, n)) {
+        for (mp = keep; mp; mp = np) {
+            np = mp->next;
+            (void)free((FREE_P *)mp);
+        }
+        CLEAN(ctx->dialect.fd_memos.slot);
+        ctx->dialect.fd_memos.mask = ctx->dialect.fd_memos.count = 0;
+        return;
+    }
+    /*
+     * The index has room for the kept entries, so entering them can't fail.
+     */
+    for (mp = keep; mp; mp = np) {
+        np = mp->next;
+        k = fd_memo_key(mp);
+        mp->next = (struct fd_memo *)inohash_find(&ctx->dialect.fd_memos, k);
+        (void)inohash_insert(&ctx->dialect.fd_memos, k, (void *)mp);
+    }
+}
+#endif /* defined(HASFDMEMO) */
+
+#if defined(HASIOURING)
+/*
+ * fill_fd_batch() - fill the next process_id() batch of FDs
+ *
+ * io_uring has no readlink(2), so the FDs' links are read here.  They tell
+ * which stat(2) and lstat(2) calls process_id() will make; those and the
+ * fdinfo reads are queued to the ring and run.
+ *
+ * return: the number of FDs in the batch; 0 if there's no ring
+ */
+
+static int fill_fd_batch(struct lsof_context *ctx, /* context */
+                         int fdfd, /* /proc/<ID>/fd directory fd */
+                         int ifd,  /* /proc/<ID>/fdinfo directory fd (-1 if
+                                    * fdinfo isn't to be read) */
+                         int fx)   /* fd_ids index of the first FD */
+{
+    struct fd_batch_ent *be;
+    char fdnm[16], *rest;
+    int i, lk, n;
+    INODETYPE lino;
+    int qk = 0; /* FDLINK_* kinds whose template stat(2) is queued */
+
+    if (ctx->dialect.ring_ok < 0 || ring_open(ctx)) {
+        ctx->dialect.ring_ok = -1;
+        return (0);
+    }
+    if (!ctx->dialect.fd_batch &&
+        !(ctx->dialect.fd_batch = (struct fd_batch_ent *)malloc(
+              FD_BATCH * sizeof(struct fd_batch_ent)))) {
+        (void)fprintf(stderr, "%s: no space for FD batch\n", Pn);
+        Error(ctx);
+    }
+    if ((n = ctx->dialect.fd_ids.n - fx) > FD_BATCH)
+        n = FD_BATCH;
+    (void)ring_reset(ctx);
+    for (i = 0; i < n; i++) {
+        be = &ctx->dialect.fd_batch[i];
+        be->io = be->lso = be->rest = be->so = -1;
+        (void)snpf(fdnm, sizeof(fdnm), "%d", ctx->dialect.fd_ids.ids[fx + i]);
+        if ((be->ll = getlinksrc(fdfd, fdnm, be->src, sizeof(be->src),
+                                 &rest)) < 1) {
+            be->en = errno;
+            continue;
+        }
+        if (rest)
+            be->rest = (int)(rest - be->src);
+        /*
+         * Queue what process_id() would fstatat(2): only one stat(2) of a
+         * socket or pipe when there's no template for its kind yet.
+         */
+        lk = (ifd >= 0) ? get_link_kind(be->src, rest, &lino) : -1;
+        if (lk < 0) {
+            if (need_lstat(ctx))
+                be->lso =
+                    ring_stat(ctx, fdfd, fdnm,
+                              AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                              ctx->dialect.stx_lmask);
+            if (need_stat(ctx, be->src))
+                be->so = ring_stat(ctx, fdfd, fdnm, AT_STATX_DONT_SYNC,
+                                   ctx->dialect.stx_smask);
+        } else if (lk >= FDLINK_KINDS ||
+                   !(ctx->dialect.link_sb_def[lk] || (qk & (1 << lk)))) {
+            be->so = ring_stat(ctx, fdfd, fdnm, AT_STATX_DONT_SYNC,
+                               ctx->dialect.stx_smask);
+            if (lk < FDLINK_KINDS)
+                qk |= (1 << lk);
+        }
+        if (ifd >= 0 && (!Ckscko || lk < 0 || lk == FDLINK_SOCK) &&
+            need_fdinfo(ctx, rest))
+            be->io = ring_read(ctx, ifd, fdnm);
+    }
+    (void)ring_run(ctx);
+    return (n);
+}
+#endif /* defined(HASIOURING) */
+
+/*
+ * gather_proc_info() -- gather process information
+ */
+
+void gather_proc_info(struct lsof_context *ctx) {
+    int i;
+    static char *path = (char *)NULL;
+    static int pathl = 0;
+    char pp[MAXPATHLEN];
+    int ppl;
+    static int ps = -1;
+    int rt = 1; /* read the lock and net tables */
+
+    /*
+     * Get lock and net information, unless the -W server has just read it.
+     */
+    ppl = snpf(pp, sizeof(pp), "%s/", PROCFS);
+    ctx->matches = 0;
+
+#if defined(HASSERVE)
+    if (ctx->dialect.tables_warm) {
+        ctx->dialect.tables_warm = 0;
+        rt = 0;
+    }
+#endif /* defined(HASSERVE) */
+
+    if (rt && (NeedAttr & NEED_LOCK)) {
+        (void)make_proc_path(ctx, pp, ppl, &path, &pathl, "locks");
+        (void)get_locks(ctx, path);
+    }
+    if (rt) {
+        (void)make_proc_path(ctx, pp, ppl, &path, &pathl, "net/");
+        (void)set_net_paths(ctx, path, strlen(path));
+    }
+    /*
+     * Forget the mapped file stat(2) results of the previous gather.
+     */
+    (void)clear_map_stats(ctx);
     /*
      * If only socket files have been selected, or socket files have been
      * selected ANDed with other selection options, enable the skipping of
@@ -295,146 +1356,76 @@ void gather_proc_info(struct lsof_context *ctx) {
         Cckreg = Ckscko = 0;
     }
     /*
-     * Read /proc, looking for PID directories.  Open each one and
-     * gather its process and file information.
+     * When only the processes of some PIDs can be selected, or
+     * lsof_gather_pids() has asked for some, take their PIDs instead of
+     * reading /proc.  Otherwise read /proc, looking for PID directories.
+     * Open each one and gather its process and file information.
      */
-    if (!ps) {
-        if (!(ps = opendir(PROCFS))) {
+    if ((ctx->dialect.pid_direct = (ctx->pid_set || sel_pids_only(ctx))))
+        (void)get_direct_pids(ctx, &ctx->dialect.proc_ids);
+    else {
+        if (ps < 0 &&
+            (ps = open(PROCFS, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
             (void)fprintf(stderr, "%s: can't open %s\n", Pn, PROCFS);
             Error(ctx);
         }
-    } else
-        (void)rewinddir(ps);
-    while ((dp = readdir(ps))) {
-        if (nm2id(dp->d_name, &pid, &n))
-            continue;
-        /*
-         * Build path to PID's directory.
-         */
-        if ((pidx + n + 1 + 1) > pidpathl) {
-            pidpathl = pidx + n + 1 + 1 + 64;
-            if (!(pidpath = (char *)realloc((MALLOC_P *)pidpath, pidpathl))) {
-                (void)fprintf(stderr,
-                              "%s: can't allocate %d bytes for \"%s/%s/\"\n",
-                              Pn, (int)pidpathl, PROCFS, dp->d_name);
-                Error(ctx);
-            }
+        if (read_id_dir(ctx, ps, &ctx->dialect.proc_ids) < 0) {
+            (void)fprintf(stderr, "%s: can't read %s: %s\n", Pn, PROCFS,
+                          strerror(errno));
+            Error(ctx);
         }
-        (void)snpf(pidpath + pidx, pidpathl - pidx, "%s/", dp->d_name);
-        n += (pidx + 1);
-        /*
-         * Process the PID's stat info.
-         */
-        if (stat(pidpath, &sb))
-            continue;
-        uid = (UID_ARG)sb.st_uid;
-        ht = pidts = 0;
-        /*
-         * Get the PID's command name.
-         */
-        (void)make_proc_path(ctx, pidpath, n, &path, &pathl, "stat");
-        if ((prv = read_id_stat(ctx, path, pid, &cmd, &ppid, &pgid)) < 0)
-            cmd = NULL; /* NULL means failure to get command name */
+    }
 
-#if defined(HASTASKS)
-        /*
-         * Task reporting has been selected, so save the process' command
-         * string, so that task processing won't change it in the buffer of
-         * read_id_stat().
-         *
-         * Check the tasks of the process first, so that the "-p<PID> -aK"
-         * options work properly.
-         */
-        else if (!IgnTasks && (Selflags & SELTASK)) {
-            /*
-             * Copy cmd before next call to read_id_stat due to static
-             * variables
-             */
-            if (cmd) {
-                strncpy(cmdbuf, cmd, sizeof(cmdbuf) - 1);
-                cmdbuf[sizeof(cmdbuf) - 1] = '\0';
-                cmd = cmdbuf;
-            }
+#if defined(HASFDMEMO)
+    /*
+     * Keep the FD stat(2) results for the next delta gather.  Threads scanning
+     * in parallel don't use them.
+     */
+    ctx->dialect.fd_memo_on = ctx->delta && !HasNFS;
+    ctx->dialect.fd_memo_serial++;
+#endif /* defined(HASFDMEMO) */
 
-            (void)make_proc_path(ctx, pidpath, n, &taskpath, &taskpathl,
-                                 "task");
-            tx = n + 4;
-            if ((ts = opendir(taskpath))) {
+#if defined(HASPARSCAN)
+    /*
+     * Scan with multiple threads when -j has been specified, unless endpoint
+     * information is being gathered (it refers to Lproc[] indexes while it is
+     * gathered), an NFS file system is mounted (stat(2) calls may then be
+     * made in child processes), lsof_gather_stream() is streaming or the
+     * selected files are limited (the limit is on the first ones in PID
+     * order).
+     */
+    if ((ScanThr > 1) && !FeptE && !HasNFS && !ctx->stream_cb &&
+        !ctx->max_matches) {
+        if (NeedAttr & NEED_SOCK)
+            (void)preload_sock_info(ctx);
+        scan_parallel(ctx, ctx->dialect.proc_ids.ids, ctx->dialect.proc_ids.n);
+        return;
+    }
+#endif /* defined(HASPARSCAN) */
 
-                /*
-                 * Process the PID's tasks.  Record the open files of those
-                 * whose TIDs do not match the PID and which are themselves
-                 * not zombies.
-                 */
-                while ((dp = readdir(ts))) {
+    for (i = 0; i < ctx->dialect.proc_ids.n; i++) {
+        gather_pid_info(ctx, ctx->dialect.proc_ids.ids[i]);
 
-                    /*
-                     * Get the task ID.  Skip the task if its ID matches the
-                     * process PID.
-                     */
-                    if (nm2id(dp->d_name, &tid, &nl))
-                        continue;
-                    if (tid == pid) {
-                        pidts = 1;
-                        continue;
-                    }
-                    /*
-                     * Form the path for the TID.
-                     */
-                    if ((tx + 1 + nl + 1 + 4) > tidpathl) {
-                        tidpathl = tx + 1 + n + 1 + 4 + 64;
-                        if (tidpath)
-                            tidpath =
-                                (char *)realloc((MALLOC_P *)tidpath, tidpathl);
-                        else
-                            tidpath = (char *)malloc((MALLOC_S)tidpathl);
-                        if (!tidpath) {
-                            (void)fprintf(stderr,
-                                          "%s: can't allocate %d task bytes",
-                                          Pn, tidpathl);
-                            (void)fprintf(stderr, " for \"%s/%s/stat\"\n",
-                                          taskpath, dp->d_name);
-                            Error(ctx);
-                        }
-                    }
-                    (void)snpf(tidpath, tidpathl, "%s/%s/stat", taskpath,
-                               dp->d_name);
-                    /*
-                     * Check the task state.
-                     */
-                    rv = read_id_stat(ctx, tidpath, tid, &tcmd, &tppid, &tpgid);
-                    if ((rv < 0) || (rv == 1))
-                        continue;
-                    /*
-                     * Attempt to record the task.
-                     */
-                    if (!process_id(ctx, tidpath, (tx + 1 + nl + 1), cmd, uid,
-                                    pid, tppid, tpgid, tid, tcmd)) {
-                        ht = 1;
-                    }
-                }
-                (void)closedir(ts);
-            }
-        }
-#endif /* defined(HASTASKS) */
+#if defined(HASPROCSTREAM)
+        /*
+         * When streaming, hand the process (and its tasks) over and free
+         * them before scanning the next one.
+         */
+        if (ctx->stream_cb && stream_procs(ctx))
+            break;
+#endif /* defined(HASPROCSTREAM) */
 
         /*
-         * If the main process is a task and task selection has been specified
-         * along with option ANDing, enter the main process temporarily as a
-         * task, so that the "-aK" option set lists the main process along
-         * with its tasks.
+         * Stop when the selected file limit has been reached.
          */
-        if ((prv >= 0) && (prv != 1)) {
-            tid = (Fand && ht && pidts && !IgnTasks && (Selflags & SELTASK))
-                      ? pid
-                      : 0;
-            if ((!process_id(ctx, pidpath, n, cmd, uid, pid, ppid, pgid, tid,
-                             (char *)NULL)) &&
-                tid) {
-                Lp->tid = 0;
-            }
-        }
+        if (MATCHES_DONE(ctx))
+            break;
     }
+
+#if defined(HASFDMEMO)
+    if (ctx->dialect.fd_memo_on)
+        (void)fd_memo_sweep(ctx);
+#endif /* defined(HASFDMEMO) */
 }
 
 /*
@@ -442,15 +1433,18 @@ void gather_proc_info(struct lsof_context *ctx) {
  */
 
 static int get_fdinfo(struct lsof_context *ctx, /* context */
-                      char *p,                  /* path to fdinfo file */
+                      int dfd, /* directory fd p is relative to */
+                      char *p, /* path to fdinfo file */
                       int msk,             /* mask for information type: e.g.,
                                             * the FDINFO_* definition */
-                      struct l_fdinfo *fi) /* pointer to local fdinfo values
+                      struct l_fdinfo *fi, /* pointer to local fdinfo values
                                             * return structure */
+                      char *info) /* the fdinfo text, already read (NULL if
+                                   * it must be read from p) */
 {
     char buf[MAXPATHLEN + 1], *ep, **fp;
     FILE *fs;
-    int rv = 0;
+    int fd, rv = 0;
     unsigned long ul;
     unsigned long long ull;
     /*
@@ -469,8 +1463,15 @@ static int get_fdinfo(struct lsof_context *ctx, /* context */
     fi->pid = -1;
     fi->tfd_count = 0;
 
-    if (!p || !*p || !(fs = fopen(p, "r")))
-        return (0);
+    fs = info ? fmemopen((void *)info, strlen(info), "r") : (FILE *)NULL;
+    if (!fs) {
+        if (!p || !*p || ((fd = openat(dfd, p, O_RDONLY | O_CLOEXEC)) < 0))
+            return (0);
+        if (!(fs = fdopen(fd, "r"))) {
+            (void)close(fd);
+            return (0);
+        }
+    }
     /*
      * Read the fdinfo file.
      */
@@ -577,11 +1578,42 @@ static int get_fdinfo(struct lsof_context *ctx, /* context */
     return (rv);
 }
 
+#if defined(HASIOURING)
+/*
+ * get_batch_link() - get the getlinksrc() result of an FD batch entry
+ */
+
+static int get_batch_link(struct fd_batch_ent *be, /* batch entry */
+                          char *src,   /* link source path return address */
+                          int srcl,    /* length of src[] */
+                          char **rest) /* pointer to what follows the ':' in
+                                        * the link source path */
+{
+    size_t l;
+
+    *rest = (char *)NULL;
+    if (be->ll < 1) {
+        errno = be->en;
+        return (be->ll);
+    }
+    l = (be->rest >= 0) ? be->rest + strlen(be->src + be->rest) : be->ll;
+    if (l >= (size_t)srcl) {
+        errno = ENAMETOOLONG;
+        return (-1);
+    }
+    (void)memcpy(src, be->src, l + 1);
+    if (be->rest >= 0)
+        *rest = src + be->rest;
+    return (be->ll);
+}
+#endif /* defined(HASIOURING) */
+
 /*
  * getlinksrc() - get the source path name for the /proc/<PID>/fd/<FD> link
  */
 
-static int getlinksrc(char *ln,    /* link path */
+static int getlinksrc(int dfd,      /* directory fd ln is relative to */
+                      char *ln,    /* link path */
                       char *src,   /* link source path return address */
                       int srcl,    /* length of src[] */
                       char **rest) /* pointer to what follows the ':' in
@@ -593,7 +1625,7 @@ static int getlinksrc(char *ln,    /* link path */
 
     if (rest)
         *rest = (char *)NULL;
-    if ((ll = readlink(ln, src, srcl - 1)) < 1 || ll >= srcl)
+    if ((ll = readlinkat(dfd, ln, src, srcl - 1)) < 1 || ll >= srcl)
         return (-1);
     src[ll] = '\0';
     if (*src == '/')
@@ -607,6 +1639,75 @@ static int getlinksrc(char *ln,    /* link path */
     return (ll);
 }
 
+/*
+ * get_link_kind() - classify a getlinksrc() link source whose stat(2)
+ *		     results can be derived from its text
+ *
+ * return: FDLINK_* kind; -1 if the link source can't be classified
+ */
+
+static int get_link_kind(char *src,      /* getlinksrc() link source */
+                         char *rest,     /* getlinksrc() rest pointer */
+                         INODETYPE *ino) /* inode number return address
+                                          * (FDLINK_SOCK and FDLINK_PIPE) */
+{
+    char *cp;
+    int k;
+    INODETYPE n;
+
+    if (!rest)
+        return (-1);
+    if (!strcmp(src, "anon_inode"))
+        return (FDLINK_ANON);
+    if (!strcmp(src, "socket"))
+        k = FDLINK_SOCK;
+    else if (!strcmp(src, "pipe"))
+        k = FDLINK_PIPE;
+    else
+        return (-1);
+    /*
+     * Convert the "[<inode>]" that follows the ':'.
+     */
+    if (*rest != '[' || !isdigit((unsigned char)rest[1]))
+        return (-1);
+    for (cp = rest + 1, n = 0; isdigit((unsigned char)*cp); cp++) {
+        n = (n * 10) + (INODETYPE)(*cp - '0');
+    }
+    if (*cp != ']' || *(cp + 1))
+        return (-1);
+    *ino = n;
+    return (k);
+}
+
+#if defined(HASSERVE)
+/*
+ * warm_tables() - read the lock and socket tables in the -W server, so that
+ *		   the child it forks next inherits them
+ *
+ * The socket tables are read with their endpoint information and without
+ * selection filters, so that they hold what any query can need.  A table
+ * whose content hasn't changed since the last call is kept.
+ */
+
+void warm_tables(struct lsof_context *ctx) {
+    int fe = FeptE;
+    static char *path = (char *)NULL;
+    static int pathl = 0;
+    char pp[MAXPATHLEN];
+    int ppl;
+
+    ppl = snpf(pp, sizeof(pp), "%s/", PROCFS);
+    (void)make_proc_path(ctx, pp, ppl, &path, &pathl, "locks");
+    (void)get_locks(ctx, path);
+    (void)make_proc_path(ctx, pp, ppl, &path, &pathl, "net/");
+    (void)set_net_paths(ctx, path, strlen(path));
+    FeptE = 1;
+    (void)preload_sock_info(ctx);
+    FeptE = fe;
+    ctx->dialect.tables_warm = 1;
+}
+#endif /* defined(HASSERVE) */
+
 /*
  * initialize() - perform all initialization
  */
@@ -644,7 +1745,9 @@ void initialize(struct lsof_context *ctx) {
         if (OffType == OFFSET_UNKNOWN) {
             (void)snpf(path, sizeof(path), "%s/%d/fdinfo/%d", PROCFS, Mypid,
                        fd);
-            if (get_fdinfo(ctx, path, FDINFO_POS, &fi) & FDINFO_POS) {
+            if (get_fdinfo(ctx, AT_FDCWD, path, FDINFO_POS, &fi,
+                           (char *)NULL) &
+                FDINFO_POS) {
                 if (fi.pos == (off_t)LSTAT_TEST_SEEK)
                     OffType = OFFSET_FDINFO;
             }
@@ -656,9 +1759,37 @@ void initialize(struct lsof_context *ctx) {
             (void)fprintf(
                 stderr, "%s: WARNING: can't report offset; disregarding -o.\n",
                 Pn);
+        if (Foffset)
+            NeedAttr |= NEED_SIZE;
         Foffset = 0;
         Fsize = 1;
     }
+
+#if defined(HASSTATX)
+    /*
+     * Compute the statx(2) field masks of the FD stat(2) and lstat(2) calls
+     * from the file attributes needed.  The type, mode and inode number are
+     * always needed; the device numbers always come back.
+     */
+    ctx->dialect.stx_smask = STATX_TYPE | STATX_MODE | STATX_INO;
+    if (NeedAttr & NEED_SIZE)
+        ctx->dialect.stx_smask |= STATX_SIZE;
+    if (NeedAttr & NEED_NLINK)
+        ctx->dialect.stx_smask |= STATX_NLINK;
+    ctx->dialect.stx_lmask = STATX_TYPE | STATX_MODE;
+    if ((OffType == OFFSET_LSTAT) && (NeedAttr & NEED_OFFSET))
+        ctx->dialect.stx_lmask |= STATX_SIZE;
+#endif /* defined(HASSTATX) */
+
+#if defined(HASIOURING)
+    /*
+     * If the LSOFIOURING environment variable asks for it, probe for the
+     * io_uring process_id() uses to batch the stat(2) and fdinfo reads of
+     * FDs.
+     */
+    ctx->dialect.ring_ok = (getenv("LSOFIOURING") && !ring_open(ctx)) ? 1 : -1;
+#endif /* defined(HASIOURING) */
+
     /*
      * Make sure the local mount info table is loaded if doing anything other
      * than just Internet lookups.  (HasNFS is defined during the loading of the
@@ -784,35 +1915,6 @@ static int isefsys(struct lsof_context *ctx, /* context */
     return (1);
 }
 
-/*
- * nm2id() - convert a name to an integer ID
- */
-
-static int nm2id(char *nm, /* pointer to name */
-                 int *id,  /* pointer to ID receiver */
-                 int *idl) /* pointer to ID length receiver */
-{
-    int tid, tidl;
-    int invalid;
-
-    for (*id = *idl = tid = tidl = 0; *nm; nm++) {
-
-#if defined(__STDC__) /* { */
-        invalid = !isdigit((unsigned char)*nm);
-#else  /* !defined(__STDC__)	   } { */
-        invalid = !isascii(*nm) || !isdigit((unsigned char)*cp);
-#endif /* defined(__STDC__)	   } */
-        if (invalid) {
-            return (1);
-        }
-        tid = tid * 10 + (int)(*nm - '0');
-        tidl++;
-    }
-    *id = tid;
-    *idl = tidl;
-    return (0);
-}
-
 /*
  * open_proc_stream() -- open a /proc stream
  */
@@ -830,13 +1932,43 @@ FILE *open_proc_stream(struct lsof_context *ctx, /* context */
                                     *         and Error()
                                     */
 {
-    FILE *fs;                      /* opened stream */
+    return (open_proc_stream_at(ctx, AT_FDCWD, p, m, buf, sz, act));
+}
+
+/*
+ * open_proc_stream_at() -- open a /proc stream relative to a directory fd
+ */
+
+FILE *open_proc_stream_at(struct lsof_context *ctx, /* context */
+                          int dfd, /* directory fd p is relative to
+                                    * (AT_FDCWD for the current directory) */
+                          char *p, /* pointer to path to open */
+                          char *m, /* pointer to mode -- e.g., "r" */
+                          char **buf, /* pointer tp setvbuf() address
+                                       * (NULL if none) */
+                          size_t *sz, /* setvbuf() size (0 if none or if
+                                       * getpagesize() desired */
+                          int act)    /* fopen() failure action:
+                                       *     0 : return (FILE *)NULL
+                                       *   <>0 : fprintf() an error message
+                                       *         and Error()
+                                       */
+{
+    FILE *fs = (FILE *)NULL;       /* opened stream */
+    int fd;                        /* opened file descriptor */
     static size_t psz = (size_t)0; /* page size */
     size_t tsz;                    /* temporary size */
     /*
-     * Open the stream.
+     * Open the stream.  Only read streams are opened relative to a directory
+     * fd.
      */
-    if (!(fs = fopen(p, m))) {
+    if (dfd == AT_FDCWD || strcmp(m, "r"))
+        fs = fopen(p, m);
+    else if ((fd = openat(dfd, p, O_RDONLY | O_CLOEXEC)) >= 0) {
+        if (!(fs = fdopen(fd, m)))
+            (void)close(fd);
+    }
+    if (!fs) {
         if (!act)
             return ((FILE *)NULL);
         (void)fprintf(stderr, "%s: can't fopen(%s, \"%s\"): %s\n", Pn, p, m,
@@ -868,15 +2000,156 @@ FILE *open_proc_stream(struct lsof_context *ctx, /* context */
         }
         *sz = tsz;
     }
-    /*
-     * Assign the buffer to the stream.
-     */
-    if (setvbuf(fs, *buf, _IOFBF, tsz)) {
-        (void)fprintf(stderr, "%s: setvbuf(%s)=%d failure: %s\n", Pn, p,
-                      (int)tsz, strerror(errno));
+    /*
+     * Assign the buffer to the stream.
+     */
+    if (setvbuf(fs, *buf, _IOFBF, tsz)) {
+        (void)fprintf(stderr, "%s: setvbuf(%s)=%d failure: %s\n", Pn, p,
+                      (int)tsz, strerror(errno));
+        Error(ctx);
+    }
+    return (fs);
+}
+
+/*
+ * need_fdinfo() - is an FD's fdinfo needed?
+ *
+ * It supplies the offset, the flags and, when the lstat(2) is elided, the
+ * access mode; and the identifiers that complete the names of eventfd,
+ * eventpoll and pidfd anonymous inodes.
+ */
+
+static int need_fdinfo(struct lsof_context *ctx, /* context */
+                       char *rest) /* getlinksrc() rest pointer */
+{
+    if (NeedAttr & (NEED_ACCESS | NEED_FLAGS | NEED_OFFSET))
+        return (1);
+    return (rest && rest[0] == '[' && (rest[1] == 'e' || rest[1] == 'p'));
+}
+
+/*
+ * need_lstat() - is an FD's lstat(2) needed?
+ *
+ * It supplies the access mode and, with OFFSET_LSTAT, the offset.
+ */
+
+static int need_lstat(struct lsof_context *ctx) /* context */
+{
+    if (NeedAttr & NEED_ACCESS)
+        return (1);
+    return ((OffType == OFFSET_LSTAT) && (NeedAttr & NEED_OFFSET));
+}
+
+/*
+ * need_stat() - is the stat(2) of a file needed?
+ *
+ * The NAME of a file whose link source is a path is the path, so its
+ * stat(2) is needed only for the attributes shown or selected, for its lock
+ * and for an NFS or socket-only check.  Other link sources must be stat'd to
+ * be identified.
+ */
+
+static int need_stat(struct lsof_context *ctx, /* context */
+                     char *src)                /* getlinksrc() link source */
+{
+    return ((NeedAttr & NEED_STATS) || HasNFS || Ckscko || *src != '/');
+}
+
+/*
+ * proc_sig_hash() - hash a text of known length (64 bit FNV-1a)
+ */
+
+uint64_t proc_sig_hash(char *b, /* text */
+                       size_t l) /* its length */
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (; l; b++, l--) {
+        h ^= (unsigned char)*b;
+        h *= 0x100000001b3ULL;
+    }
+    return (h);
+}
+
+/*
+ * proc_sig_grow() - make room for n bytes in a signature's content buffer
+ */
+
+void proc_sig_grow(struct lsof_context *ctx, /* context */
+                   struct proc_sig *ps,      /* signature */
+                   size_t n,                 /* bytes needed */
+                   char *nm)                 /* content name, for errors */
+{
+    size_t sz;
+
+    if (n <= ps->sz)
+        return;
+    for (sz = ps->sz ? ps->sz : PROC_SIG_BUFSZ; sz < n; sz *= 2)
+        ;
+    if (!(ps->buf = (char *)realloc((MALLOC_P *)ps->buf, (MALLOC_S)sz))) {
+        (void)fprintf(stderr, "%s: can't allocate %d bytes for %s\n", Pn,
+                      (int)sz, nm);
         Error(ctx);
     }
-    return (fs);
+    ps->sz = sz;
+}
+
+/*
+ * proc_sig_note() - note the content in a signature's buffer
+ *
+ * return: 1 if the content differs from what was noted before
+ *	   0 if it doesn't
+ */
+
+int proc_sig_note(struct proc_sig *ps, /* signature */
+                  size_t l)            /* content length */
+{
+    uint64_t h = proc_sig_hash(ps->buf, l);
+
+    if (ps->valid && (ps->len == l) && (ps->hash == h))
+        return (0);
+    ps->len = l;
+    ps->hash = h;
+    ps->valid = 1;
+    return (1);
+}
+
+/*
+ * proc_sig_read() - read a /proc file into a signature's buffer and note its
+ *		     content
+ *
+ * return: 1 if the content differs from what was noted before
+ *	   0 if it doesn't
+ *	  -1 if the file can't be read (the signature is then forgotten)
+ */
+
+int proc_sig_read(struct lsof_context *ctx, /* context */
+                  char *p,                  /* path */
+                  struct proc_sig *ps)      /* signature */
+{
+    int fd;
+    ssize_t nr;
+    size_t l = 0;
+
+    if ((fd = open(p, O_RDONLY | O_CLOEXEC)) < 0) {
+        ps->valid = 0;
+        return (-1);
+    }
+    for (;;) {
+        (void)proc_sig_grow(ctx, ps, l + PROC_SIG_BUFSZ / 2, p);
+        if ((nr = read(fd, ps->buf + l, ps->sz - l)) < 0) {
+            if (errno == EINTR)
+                continue;
+            (void)close(fd);
+            ps->valid = 0;
+            return (-1);
+        }
+        if (!nr)
+            break;
+        l += (size_t)nr;
+    }
+    (void)close(fd);
+    return (proc_sig_note(ps, l));
 }
 
 /*
@@ -887,6 +2160,7 @@ FILE *open_proc_stream(struct lsof_context *ctx, /* context */
  */
 
 static int process_id(struct lsof_context *ctx, /* context */
+                      int idfd,                 /* ID's directory fd */
                       char *idp,                /* pointer to ID's path */
                       int idpl,    /* pointer to ID's path length */
                       char *cmd,   /* pointer to ID's command */
@@ -894,30 +2168,33 @@ static int process_id(struct lsof_context *ctx, /* context */
                       int pid,     /* ID's PID */
                       int ppid,    /* parent PID */
                       int pgid,    /* parent GID */
+                      unsigned long long start, /* start time */
                       int tid,     /* task ID, if non-zero */
                       char *tcmd)  /* task command, if non-NULL) */
 {
     int av = 0;
-    static char *dpath = (char *)NULL;
-    static int dpathl = 0;
+    char *dpath;
     short efs, enls, enss, lnk, oty, pn, pss, sf;
-    int fd, i, ls = 0, n, ss, sv;
+    int fd, fdfd, fx, i, ifd = -1, lk, ll, ls = 0, lso, so, ss, sv;
+    INODETYPE lino;
     struct l_fdinfo fi;
-    DIR *fdp;
-    struct dirent *fp;
-    static char *ipath = (char *)NULL;
-    static int ipathl = 0;
-    int j = 0;
+    char fdnm[16];
     struct lfile *lfr;
-    struct stat lsb, sb;
+    struct stat lsb, sb, tsb;
     char nmabuf[MAXPATHLEN + 1], pbuf[MAXPATHLEN + 1];
-    static char *path = (char *)NULL;
-    static int pathl = 0;
-    static char *pathi = (char *)NULL;
-    static int pathil = 0;
+    char *info, *path;
     char *rest;
     int txts = 0;
 
+#if defined(HASFDMEMO)
+    int mm;
+    struct fd_memo *mp;
+#endif /* defined(HASFDMEMO) */
+
+#if defined(HASIOURING)
+    int bn = 0, bx = 0, rb;
+#endif /* defined(HASIOURING) */
+
 #if defined(HASSELINUX)
     cntxlist_t *cntxp;
 #endif /* defined(HASSELINUX) */
@@ -945,6 +2222,7 @@ static int process_id(struct lsof_context *ctx, /* context */
         Ckscko = (sf & SelProc) ? 0 : 1;
     }
     alloc_lproc(ctx, pid, pgid, ppid, uid, cmd, (int)pss, (int)sf);
+    Lp->start = start;
     Plf = (struct lfile *)NULL;
 
 #if defined(HASTASKS)
@@ -968,9 +2246,11 @@ static int process_id(struct lsof_context *ctx, /* context */
      */
     efs = 0;
     if (!Ckscko) {
-        (void)make_proc_path(ctx, idp, idpl, &path, &pathl, "cwd");
+        (void)make_proc_path(ctx, idp, idpl, &ctx->dialect.id_path,
+                             &ctx->dialect.id_path_len, "cwd");
+        path = ctx->dialect.id_path;
         alloc_lfile(ctx, LSOF_FD_CWD, -1);
-        if (getlinksrc(path, pbuf, sizeof(pbuf), (char **)NULL) < 1) {
+        if (getlinksrc(idfd, "cwd", pbuf, sizeof(pbuf), (char **)NULL) < 1) {
             if (!Fwarn) {
                 zeromem((char *)&sb, sizeof(sb));
                 lnk = ss = 0;
@@ -987,13 +2267,14 @@ static int process_id(struct lsof_context *ctx, /* context */
                 !isefsys(ctx, pbuf, LSOF_FILE_UNKNOWN_CWD, 1, NULL, &lfr)) {
                 efs = 1;
                 pn = 0;
-            } else {
-                ss = SB_ALL;
+            } else if (!need_stat(ctx, pbuf))
+                ss = 0;
+            else {
                 if (HasNFS) {
-                    if ((sv = statsafely(ctx, path, &sb)))
+                    if ((sv = !(ss = fd_stat_safely(ctx, path, &sb, 0))))
                         sv = statEx(ctx, pbuf, &sb, &ss);
                 } else
-                    sv = stat(path, &sb);
+                    sv = !(ss = fd_stat(ctx, -1, idfd, "cwd", &sb, 0));
                 if (sv) {
                     ss = 0;
                     if (!Fwarn) {
@@ -1016,10 +2297,12 @@ static int process_id(struct lsof_context *ctx, /* context */
      * Process the ID's root directory info.
      */
     lnk = ss = 0;
-    if (!Ckscko) {
-        (void)make_proc_path(ctx, idp, idpl, &path, &pathl, "root");
+    if (!Ckscko && !ctx->files_done) {
+        (void)make_proc_path(ctx, idp, idpl, &ctx->dialect.id_path,
+                             &ctx->dialect.id_path_len, "root");
+        path = ctx->dialect.id_path;
         alloc_lfile(ctx, LSOF_FD_ROOT_DIR, -1);
-        if (getlinksrc(path, pbuf, sizeof(pbuf), (char **)NULL) < 1) {
+        if (getlinksrc(idfd, "root", pbuf, sizeof(pbuf), (char **)NULL) < 1) {
             if (!Fwarn) {
                 zeromem((char *)&sb, sizeof(sb));
                 (void)snpf(nmabuf, sizeof(nmabuf), "(readlink: %s)",
@@ -1034,13 +2317,14 @@ static int process_id(struct lsof_context *ctx, /* context */
             if (Efsysl &&
                 !isefsys(ctx, pbuf, LSOF_FILE_UNKNOWN_ROOT_DIR, 1, NULL, NULL))
                 pn = 0;
+            else if (!need_stat(ctx, pbuf))
+                ss = 0;
             else {
-                ss = SB_ALL;
                 if (HasNFS) {
-                    if ((sv = statsafely(ctx, path, &sb)))
+                    if ((sv = !(ss = fd_stat_safely(ctx, path, &sb, 0))))
                         sv = statEx(ctx, pbuf, &sb, &ss);
                 } else
-                    sv = stat(path, &sb);
+                    sv = !(ss = fd_stat(ctx, -1, idfd, "root", &sb, 0));
                 if (sv) {
                     ss = 0;
                     if (!Fwarn) {
@@ -1063,10 +2347,12 @@ static int process_id(struct lsof_context *ctx, /* context */
      * Process the ID's execution info.
      */
     lnk = ss = txts = 0;
-    if (!Ckscko) {
-        (void)make_proc_path(ctx, idp, idpl, &path, &pathl, "exe");
+    if (!Ckscko && !ctx->files_done) {
+        (void)make_proc_path(ctx, idp, idpl, &ctx->dialect.id_path,
+                             &ctx->dialect.id_path_len, "exe");
+        path = ctx->dialect.id_path;
         alloc_lfile(ctx, LSOF_FD_PROGRAM_TEXT, -1);
-        if (getlinksrc(path, pbuf, sizeof(pbuf), (char **)NULL) < 1) {
+        if (getlinksrc(idfd, "exe", pbuf, sizeof(pbuf), (char **)NULL) < 1) {
             zeromem((void *)&sb, sizeof(sb));
             if (!Fwarn) {
                 if ((errno != ENOENT) || uid) {
@@ -1083,16 +2369,22 @@ static int process_id(struct lsof_context *ctx, /* context */
             if (Efsysl && !isefsys(ctx, pbuf, LSOF_FILE_UNKNOWN_PROGRAM_TEXT, 1,
                                    NULL, NULL))
                 pn = 0;
-            else {
-                ss = SB_ALL;
+            else if (!need_stat(ctx, pbuf) && !(NeedAttr & NEED_MAPS)) {
+
+                /*
+                 * The memory map info needs the executable's device and
+                 * inode, to recognize its mapping.
+                 */
+                ss = 0;
+            } else {
                 if (HasNFS) {
-                    if ((sv = statsafely(ctx, path, &sb))) {
+                    if ((sv = !(ss = fd_stat_safely(ctx, path, &sb, 0)))) {
                         sv = statEx(ctx, pbuf, &sb, &ss);
                         if (!sv && (ss & SB_DEV) && (ss & SB_INO))
                             txts = 1;
                     }
                 } else
-                    sv = stat(path, &sb);
+                    sv = !(ss = fd_stat(ctx, -1, idfd, "exe", &sb, 0));
                 if (sv) {
                     ss = 0;
                     if (!Fwarn) {
@@ -1115,59 +2407,73 @@ static int process_id(struct lsof_context *ctx, /* context */
     /*
      * Process the ID's memory map info.
      */
-    if (!Ckscko) {
-        (void)make_proc_path(ctx, idp, idpl, &path, &pathl, "maps");
-        (void)process_proc_map(ctx, path, txts ? &sb : (struct stat *)NULL,
+    if (!Ckscko && !ctx->files_done && (NeedAttr & NEED_MAPS)) {
+        (void)process_proc_map(ctx, idfd, txts ? &sb : (struct stat *)NULL,
                                txts ? ss : 0);
     }
 
 #if defined(HASSELINUX)
     /*
-     * Process the PID's SELinux context.
+     * Process the PID's SELinux context, if the output or a selection
+     * needs it.
      */
     /*
      * match the valid contexts.
      */
-    errno = 0;
-    if (getpidcon(pid, &Lp->cntx) == -1) {
-        Lp->cntx = (char *)NULL;
-        if (!Fwarn) {
-            (void)snpf(nmabuf, sizeof(nmabuf), "(getpidcon: %s)",
-                       strerror(errno));
-            if (!(Lp->cntx = strdup(nmabuf))) {
-                (void)fprintf(stderr, "%s: no context error space: PID %ld", Pn,
-                              (long)Lp->pid);
-                Error(ctx);
+    if (NeedAttr & NEED_CNTX) {
+        errno = 0;
+        if (getpidcon(pid, &Lp->cntx) == -1) {
+            Lp->cntx = (char *)NULL;
+            if (!Fwarn) {
+                (void)snpf(nmabuf, sizeof(nmabuf), "(getpidcon: %s)",
+                           strerror(errno));
+                if (!(Lp->cntx = strdup(nmabuf))) {
+                    (void)fprintf(stderr,
+                                  "%s: no context error space: PID %ld", Pn,
+                                  (long)Lp->pid);
+                    Error(ctx);
+                }
             }
-        }
-    } else if (CntxArg) {
+        } else if (CntxArg) {
 
-        /*
-         * See if context includes the process.
-         */
-        for (cntxp = CntxArg; cntxp; cntxp = cntxp->next) {
-            if (cmp_cntx_eq(Lp->cntx, cntxp->cntx)) {
-                cntxp->f = 1;
-                Lp->pss |= PS_PRI;
-                Lp->sf |= SELCNTX;
-                break;
+            /*
+             * See if context includes the process.
+             */
+            for (cntxp = CntxArg; cntxp; cntxp = cntxp->next) {
+                if (cmp_cntx_eq(Lp->cntx, cntxp->cntx)) {
+                    SEL_FOUND(ctx, cntxp->f, 1);
+                    Lp->pss |= PS_PRI;
+                    Lp->sf |= SELCNTX;
+                    break;
+                }
             }
         }
     }
 #endif /* defined(HASSELINUX) */
 
     /*
-     * Process the ID's file descriptor directory.
+     * Process the ID's file descriptor directory, unless the files read so
+     * far have been enough.
      */
-    if ((i = make_proc_path(ctx, idp, idpl, &dpath, &dpathl, "fd/")) < 3)
+    if (ctx->files_done)
+        return (0);
+    if ((i = make_proc_path(ctx, idp, idpl, &ctx->dialect.fd_dir_path,
+                            &ctx->dialect.fd_dir_path_len, "fd/")) < 3)
         return (0);
+    dpath = ctx->dialect.fd_dir_path;
     dpath[i - 1] = '\0';
     if ((OffType == OFFSET_FDINFO) &&
-        ((j = make_proc_path(ctx, idp, idpl, &ipath, &ipathl, "fdinfo/")) >= 7))
+        ((ifd = openat(idfd, "fdinfo", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >=
+         0))
         oty = 1;
     else
         oty = 0;
-    if (!(fdp = opendir(dpath))) {
+    if ((fdfd = openat(idfd, "fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0 &&
+        read_id_dir(ctx, fdfd, &ctx->dialect.fd_ids) < 0) {
+        (void)close(fdfd);
+        fdfd = -1;
+    }
+    if (fdfd < 0) {
         if (!Fwarn) {
             (void)snpf(nmabuf, sizeof(nmabuf), "%s (opendir: %s)", dpath,
                        strerror(errno));
@@ -1176,15 +2482,70 @@ static int process_id(struct lsof_context *ctx, /* context */
             (void)add_nma(ctx, nmabuf, strlen(nmabuf));
             link_lfile(ctx);
         }
+        if (ifd >= 0)
+            (void)close(ifd);
         return (0);
     }
     dpath[i - 1] = '/';
-    while ((fp = readdir(fdp))) {
-        if (nm2id(fp->d_name, &fd, &n))
-            continue;
-        (void)make_proc_path(ctx, dpath, i, &path, &pathl, fp->d_name);
+
+#if defined(HASIOURING)
+    /*
+     * Batch the FDs' system calls with io_uring, unless they must be made
+     * safely, or exempt file system checks must come first.
+     */
+    rb = (ctx->dialect.ring_ok > 0 && !HasNFS && !Efsysl);
+#endif /* defined(HASIOURING) */
+
+#if defined(HASFDMEMO)
+    /*
+     * Use the FD stat(2) results of the previous delta gather.  They make
+     * the calls the ring would batch unnecessary.
+     */
+    mm = ctx->dialect.fd_memo_on && oty;
+#    if defined(HASIOURING)
+    if (mm)
+        rb = 0;
+#    endif /* defined(HASIOURING) */
+#endif     /* defined(HASFDMEMO) */
+
+    for (fx = 0; fx < ctx->dialect.fd_ids.n; fx++) {
+        fd = ctx->dialect.fd_ids.ids[fx];
+        (void)snpf(fdnm, sizeof(fdnm), "%d", fd);
+        info = (char *)NULL;
+        lso = so = -1;
+
+#if defined(HASIOURING)
+        if (rb && fx >= bx + bn) {
+            bx = fx;
+            if (!(bn = fill_fd_batch(ctx, fdfd, oty ? ifd : -1, fx)))
+                rb = 0;
+        }
+#endif /* defined(HASIOURING) */
+
+        /*
+         * The system calls for the FD are made relative to the fd/ directory
+         * descriptor.  Its /proc path is assembled only as the name of
+         * last resort and for the path-based NFS and socket attribute calls.
+         */
+        (void)make_proc_path(ctx, dpath, i, &ctx->dialect.id_path,
+                             &ctx->dialect.id_path_len, fdnm);
+        path = ctx->dialect.id_path;
+        lk = -1;
         (void)alloc_lfile(ctx, LSOF_FD_NUMERIC, fd);
-        if (getlinksrc(path, pbuf, sizeof(pbuf), &rest) < 1) {
+
+#if defined(HASIOURING)
+        if (rb) {
+            struct fd_batch_ent *be = &ctx->dialect.fd_batch[fx - bx];
+
+            info = ring_read_result(ctx, be->io);
+            lso = be->lso;
+            so = be->so;
+            ll = get_batch_link(be, pbuf, sizeof(pbuf), &rest);
+        } else
+#endif /* defined(HASIOURING) */
+
+            ll = getlinksrc(fdfd, fdnm, pbuf, sizeof(pbuf), &rest);
+        if (ll < 1) {
             zeromem((char *)&sb, sizeof(sb));
             lnk = ss = 0;
             if (!Fwarn) {
@@ -1203,34 +2564,96 @@ static int process_id(struct lsof_context *ctx, /* context */
                 efs = 1;
                 pn = 0;
             } else {
-                if (HasNFS) {
-                    if (lstatsafely(ctx, path, &lsb)) {
+                /*
+                 * When fdinfo supplies the access flags and offset, the
+                 * lstat(2) of a socket, pipe or anonymous inode link is
+                 * elided.  The stat(2) of a socket or pipe is elided, too,
+                 * once one has been done: its results differ from those of
+                 * a previous one only in the inode number, which the link
+                 * text supplies.
+                 */
+                lk = (oty && !HasNFS) ? get_link_kind(pbuf, rest, &lino) : -1;
+                if (lk >= 0) {
+                    zeromem((char *)&lsb, sizeof(lsb));
+                    lsb.st_mode = S_IFLNK;
+                    ls = SB_MODE;
+                    enls = 0;
+                    if (lk < FDLINK_KINDS && ctx->dialect.link_sb_def[lk]) {
+                        sb = ctx->dialect.link_sb[lk];
+                        sb.st_ino = (ino_t)lino;
+                        ss = ctx->dialect.link_sb_def[lk];
+                        enss = 0;
+                    } else {
+                        ss = fd_stat(ctx, so, fdfd, fdnm, &sb, 0);
+                        enss = errno;
+                        if ((ss & SB_INO) && (lk < FDLINK_KINDS) &&
+                            ((INODETYPE)sb.st_ino == lino)) {
+                            ctx->dialect.link_sb[lk] = sb;
+                            ctx->dialect.link_sb_def[lk] = (short)ss;
+                        }
+                    }
+                } else if (HasNFS) {
+                    if (!(ls = fd_stat_safely(ctx, path, &lsb,
+                                              AT_SYMLINK_NOFOLLOW))) {
                         (void)statEx(ctx, pbuf, &lsb, &ls);
                         enls = errno;
-                    } else {
+                    } else
                         enls = 0;
-                        ls = SB_ALL;
-                    }
-                    if (statsafely(ctx, path, &sb)) {
+                    if (!(ss = fd_stat_safely(ctx, path, &sb, 0))) {
                         (void)statEx(ctx, pbuf, &sb, &ss);
                         enss = errno;
-                    } else {
+                    } else
                         enss = 0;
-                        ss = SB_ALL;
-                    }
                 } else {
-                    ls = lstat(path, &lsb) ? 0 : SB_ALL;
-                    enls = errno;
-                    ss = stat(path, &sb) ? 0 : SB_ALL;
-                    enss = errno;
+
+#if defined(HASFDMEMO)
+                    mp = mm ? fd_memo_find(ctx, ifd, fdnm, fd, pbuf, &info)
+                            : (struct fd_memo *)NULL;
+                    if (mp && mp->valid && fd_memo_stale(ctx, mp))
+                        mp->valid = 0;
+                    if (mp && mp->valid) {
+                        lsb = mp->lsb;
+                        ls = mp->ls;
+                        sb = mp->sb;
+                        ss = mp->ss;
+                        enls = enss = 0;
+                    } else
+#endif /* defined(HASFDMEMO) */
+
+                    {
+                        /*
+                         * Make only the calls whose results are needed.
+                         */
+                        if (need_lstat(ctx)) {
+                            ls = fd_stat(ctx, lso, fdfd, fdnm, &lsb,
+                                         AT_SYMLINK_NOFOLLOW);
+                            enls = errno;
+                        } else
+                            ls = enls = 0;
+                        if (need_stat(ctx, pbuf)) {
+                            ss = fd_stat(ctx, so, fdfd, fdnm, &sb, 0);
+                            enss = errno;
+                        } else
+                            ss = enss = 0;
+
+#if defined(HASFDMEMO)
+                        if (mp && ls && ss) {
+                            mp->lsb = lsb;
+                            mp->ls = ls;
+                            mp->sb = sb;
+                            mp->ss = ss;
+                            mp->valid = 1;
+                        }
+#endif /* defined(HASFDMEMO) */
+                    }
                 }
-                if (!ls && !Fwarn) {
+                if (!ls && enls && !Fwarn) {
                     (void)snpf(nmabuf, sizeof(nmabuf), "lstat: %s)",
                                strerror(enls));
                     nmabuf[sizeof(nmabuf) - 1] = '\0';
                     (void)add_nma(ctx, nmabuf, strlen(nmabuf));
                 }
-                if (!ss && !Fwarn) {
+                if (!ss && enss && !Fwarn) {
                     (void)snpf(nmabuf, sizeof(nmabuf), "(stat: %s)",
                                strerror(enss));
                     nmabuf[sizeof(nmabuf) - 1] = '\0';
@@ -1249,12 +2672,13 @@ static int process_id(struct lsof_context *ctx, /* context */
             /* Clear fi in case oty == 0 */
             fi.eventfd_id = -1;
             fi.pid = -1;
-            fi.tfd_count = -1;
+            fi.tfd_count = 0;
 
-            if (oty) {
+            if (oty && !efs && !need_fdinfo(ctx, rest)) {
+                av = 0;
+                ls &= ~SB_SIZE;
+            } else if (oty) {
                 int fdinfo_mask = FDINFO_BASE;
-                (void)make_proc_path(ctx, ipath, j, &pathi, &pathil,
-                                     fp->d_name);
 
                 if (rest && rest[0] == '[' && rest[1] == 'e' &&
                     rest[2] == 'v' && rest[3] == 'e' && rest[4] == 'n' &&
@@ -1274,7 +2698,8 @@ static int process_id(struct lsof_context *ctx, /* context */
                 if (rest && rest[0] == '[' && rest[1] == 'p')
                     fdinfo_mask |= FDINFO_PID;
 
-                if ((av = get_fdinfo(ctx, pathi, fdinfo_mask, &fi)) &
+                if ((av = get_fdinfo(ctx, ifd, fdnm, fdinfo_mask, &fi,
+                                     info)) &
                     FDINFO_POS) {
                     if (efs) {
                         lfr->off = (SZOFFTYPE)fi.pos;
@@ -1286,6 +2711,36 @@ static int process_id(struct lsof_context *ctx, /* context */
                 } else
                     ls &= ~SB_SIZE;
 
+                if (lk >= 0 && (NeedAttr & NEED_ACCESS)) {
+                    /*
+                     * Supply the elided lstat(2)'s access mode from the
+                     * fdinfo flags, or do the lstat(2) if there are none.
+                     */
+                    if (av & FDINFO_FLAGS) {
+                        switch (fi.flags & O_ACCMODE) {
+                        case O_RDONLY:
+                            lsb.st_mode |= S_IRUSR;
+                            break;
+                        case O_WRONLY:
+                            lsb.st_mode |= S_IWUSR;
+                            break;
+                        default:
+                            lsb.st_mode |= (S_IRUSR | S_IWUSR);
+                        }
+                    } else if (!fstatat(fdfd, fdnm, &tsb,
+                                        AT_SYMLINK_NOFOLLOW))
+                        lsb.st_mode = tsb.st_mode;
+                    else {
+                        ls = 0;
+                        if (!Fwarn) {
+                            (void)snpf(nmabuf, sizeof(nmabuf), "lstat: %s)",
+                                       strerror(errno));
+                            nmabuf[sizeof(nmabuf) - 1] = '\0';
+                            (void)add_nma(ctx, nmabuf, strlen(nmabuf));
+                        }
+                    }
+                }
+
 #if !defined(HASNOFSFLAGS)
                 if (av & FDINFO_FLAGS) {
                     if (efs) {
@@ -1343,27 +2798,26 @@ static int process_id(struct lsof_context *ctx, /* context */
                     link_lfile(ctx);
             }
         }
+        if (ctx->files_done)
+            break;
     }
-    (void)closedir(fdp);
+    (void)close(fdfd);
+    if (ifd >= 0)
+        (void)close(ifd);
     return (0);
 }
 
 /* compare mount namespace of this lsof process and the target process */
 
-static int compare_mntns(int pid) /* pid of the target process */
+static int compare_mntns(int idfd) /* /proc/<ID> directory fd of the target
+                                    * process */
 {
-    char nspath[NS_PATH_LENGTH];
     struct stat sb_self, sb_target;
-    int ret;
 
     if (stat("/proc/self/ns/mnt", &sb_self))
         return -1;
 
-    ret = snprintf(nspath, sizeof(nspath), "/proc/%d/ns/mnt", pid);
-    if (ret >= sizeof(nspath) || ret <= 0)
-        return -1;
-
-    if (stat(nspath, &sb_target))
+    if (fstatat(idfd, "ns/mnt", &sb_target, 0))
         return -1;
 
     if (sb_self.st_ino != sb_target.st_ino)
@@ -1372,82 +2826,84 @@ static int compare_mntns(int pid) /* pid of the target process */
     return 0;
 }
 
+/*
+ * clear_map_stats() - clear the process_proc_map() stat(2) cache
+ */
+
+static void clear_map_stats(struct lsof_context *ctx) /* context */
+{
+    size_t h;
+    struct map_stat *mp, *np;
+
+    INOHASH_FOREACH(&ctx->dialect.map_stats, h, mp) {
+        for (; mp; mp = np) {
+            np = mp->next;
+            if (mp->path)
+                (void)free((FREE_P *)mp->path);
+            (void)free((FREE_P *)mp);
+        }
+    }
+    if (ctx->dialect.map_stats.slot)
+        (void)inohash_reset(&ctx->dialect.map_stats, 0);
+}
+
 /*
  * process_proc_map() - process the memory map of a process
+ *
+ * The file-backed mappings are read with read_proc_map().
+ *
+ * The stat(2) result of each mapped file's path is cached for the rest of
+ * the gather, keyed by the maps file device, inode and path, so a library
+ * that many processes map is only stat(2)'d once.  For a process in another
+ * mount namespace, the /proc/<PID>/map_files entry is stat(2)'d instead; it
+ * reaches the mapped file itself, so its successful result is cached by
+ * device and inode alone.
  */
 
 static void
 process_proc_map(struct lsof_context *ctx, /* context */
-                 char *p,                  /* path to process maps file */
+                 int idfd,       /* /proc/<ID> directory fd */
                  struct stat *s, /* executing text file state buffer */
                  int ss)         /* *s status -- i.e., SB_* values */
 {
-    char buf[MAXPATHLEN + 1], *ep, fmtbuf[32], **fp, nmabuf[MAXPATHLEN + 1];
+    char buf[MAXPATHLEN + 1], fmtbuf[32], nmabuf[MAXPATHLEN + 1], *path;
+    char mfpath[MAP_PATH_LENGTH];
     dev_t dev;
-    int ds, efs, en, i, mss, sv;
-    int eb = 6;
+    int ds, efs, en, mf, mss, sv;
+    int pq = !ctx->dialect.no_procmap_query;
     INODETYPE inode;
-    MALLOC_S len;
-    long maj, min;
     FILE *ms;
-    int ns = 0;
+    struct map_stat *mp, *msp;
     struct stat sb;
-    struct saved_map {
-        dev_t dev;
-        INODETYPE inode;
-    };
-    static struct saved_map *sm = (struct saved_map *)NULL;
     efsys_list_t *rep;
-    static int sma = 0;
-    static char *vbuf = (char *)NULL;
-    static size_t vsz = (size_t)0;
     int diff_mntns = 0;
+    uint64_t addr = 0, end, start;
+    unsigned long serial = ++ctx->dialect.map_serial;
     /*
-     * Open the /proc/<pid>/maps file, assign a page size buffer to its stream,
-     * and read it/
+     * Open the /proc/<pid>/maps file and assign a page size buffer to its
+     * stream, in case it must be read as text.
      */
-    if (!(ms = open_proc_stream(ctx, p, "r", &vbuf, &vsz, 0)))
+    if (!(ms = open_proc_stream_at(ctx, idfd, "maps", "r",
+                                   &ctx->dialect.maps_vbuf,
+                                   &ctx->dialect.maps_vbuf_len, 0)))
         return;
 
     /* target process in a different mount namespace from lsof process. */
-    if (compare_mntns(Lp->pid))
+    if (compare_mntns(idfd))
         diff_mntns = 1;
 
-    while (fgets(buf, sizeof(buf), ms)) {
-        if (get_fields(ctx, buf, ":", &fp, &eb, 1) < 7)
-            continue; /* not enough fields */
-        if (!fp[6] || !*fp[6])
-            continue; /* no path name */
+    while (!ctx->files_done &&
+           read_proc_map(ctx, ms, &pq, &addr, buf, sizeof(buf), &start, &end,
+                         &dev, &inode, &path)) {
         /*
          * See if the path ends in " (deleted)".  If it does, strip the
          * " (deleted)" characters and remember that they were there.
          */
-        if (((ds = (int)strlen(fp[6])) > 10) &&
-            !strcmp(fp[6] + ds - 10, " (deleted)")) {
-            *(fp[6] + ds - 10) = '\0';
+        if (((ds = (int)strlen(path)) > 10) &&
+            !strcmp(path + ds - 10, " (deleted)")) {
+            *(path + ds - 10) = '\0';
         } else
             ds = 0;
-        /*
-         * Assemble the major and minor device numbers.
-         */
-        ep = (char *)NULL;
-        if (!fp[3] || !*fp[3] || (maj = strtol(fp[3], &ep, 16)) == LONG_MIN ||
-            maj == LONG_MAX || !ep || *ep)
-            continue;
-        ep = (char *)NULL;
-        if (!fp[4] || !*fp[4] || (min = strtol(fp[4], &ep, 16)) == LONG_MIN ||
-            min == LONG_MAX || !ep || *ep)
-            continue;
-        /*
-         * Assemble the device and inode numbers.  If they are both zero, skip
-         * the entry.
-         */
-        dev = (dev_t)makedev((int)maj, (int)min);
-        if (!fp[5] || !*fp[5])
-            continue;
-        ep = (char *)NULL;
-        if ((inode = strtoull(fp[5], &ep, 0)) == ULLONG_MAX || !ep || *ep)
-            continue;
         if (!dev && !inode)
             continue;
         /*
@@ -1457,87 +2913,103 @@ process_proc_map(struct lsof_context *ctx, /* context */
         if (s && (ss & SB_DEV) && (ss & SB_INO) && (dev == s->st_dev) &&
             (inode == (INODETYPE)s->st_ino))
             continue;
+        /*
+         * For a process in another mount namespace, stat(2) the file's
+         * /proc/[pid]/map_files entry, which follows symbolic links
+         * regardless of namespaces.
+         */
+        mf = 0;
+        if (diff_mntns) {
+            char range[ADDR_LENGTH];
+            int ret;
+
+            if ((ret = snprintf(range, sizeof(range), "%" PRIx64 "-%" PRIx64,
+                                start, end)) > 0 &&
+                ret < sizeof(range) &&
+                (ret = snprintf(mfpath, sizeof(mfpath), "/proc/%d/map_files/%s",
+                                Lp->pid, range)) > 0 &&
+                ret < sizeof(mfpath))
+                mf = 1;
+        }
         /*
          * See if this device + inode pair has already been processed as
-         * a map entry.
+         * a map entry of this process, and look for the stat(2) cache entry
+         * of its path (or map_files entry).
          */
-        for (i = 0; i < ns; i++) {
-            if (dev == sm[i].dev && inode == sm[i].inode)
+        msp = (struct map_stat *)NULL;
+        mp = (struct map_stat *)inohash_find(&ctx->dialect.map_stats, inode);
+        for (; mp; mp = mp->next) {
+            if (mp->dev != dev)
+                continue;
+            if (mp->seen == serial)
                 break;
+            if (!msp &&
+                (mf ? !mp->path : (mp->path && !strcmp(mp->path, path))))
+                msp = mp;
         }
-        if (i < ns)
+        if (mp)
             continue;
-        /*
-         * Record the processing of this map entry's device and inode pair.
-         */
-        if (ns >= sma) {
-            sma += 10;
-            len = (MALLOC_S)(sma * sizeof(struct saved_map));
-            if (sm)
-                sm = (struct saved_map *)realloc(sm, len);
-            else
-                sm = (struct saved_map *)malloc(len);
-            if (!sm) {
-                (void)fprintf(
-                    stderr,
-                    "%s: can't allocate %d bytes for saved maps, PID %d\n", Pn,
-                    (int)len, Lp->pid);
+        if (!msp) {
+
+            /*
+             * Make a cache entry and put it at the head of the inode's chain.
+             */
+            if (!(msp = (struct map_stat *)malloc(sizeof(struct map_stat))) ||
+                (!mf && !(msp->path = mkstrcpy(path, (MALLOC_S *)NULL)))) {
+                (void)fprintf(stderr,
+                              "%s: no space for map stat cache, PID %d\n", Pn,
+                              Lp->pid);
+                Error(ctx);
+            }
+            if (mf)
+                msp->path = (char *)NULL;
+            msp->dev = dev;
+            msp->inode = inode;
+            msp->valid = 0;
+            msp->next = (struct map_stat *)inohash_find(
+                &ctx->dialect.map_stats, inode);
+            if (inohash_insert(&ctx->dialect.map_stats, inode, (void *)msp)) {
+                (void)fprintf(stderr,
+                              "%s: no space for map stat cache, PID %d\n", Pn,
+                              Lp->pid);
                 Error(ctx);
             }
         }
-        sm[ns].dev = dev;
-        sm[ns++].inode = inode;
+        msp->seen = serial;
         /*
          * Allocate space for the mapped file, then get stat(2) information
          * for it.  Skip the stat(2) operation if this is on an exempt file
          * system.
          */
         alloc_lfile(ctx, LSOF_FD_MEMORY, -1);
-        if (Efsysl && !isefsys(ctx, fp[6], LSOF_FILE_NONE, 0, &rep, NULL))
+        if (Efsysl && !isefsys(ctx, path, LSOF_FILE_NONE, 0, &rep, NULL))
             efs = sv = 1;
         else
             efs = 0;
-
-        /* For processes in different mount namespace from lsof process,
-         * stat corresponding files under /proc/[pid]/map_files would follow
-         * symlinks regardless of namespaces.
-         */
-        if (diff_mntns) {
-            char path[MAP_PATH_LENGTH];
-            char addr[ADDR_LENGTH];
-            uint64_t start, end;
-            int ret;
-
-            if (sscanf(fp[0], "%" SCNx64 "-%" SCNx64, &start, &end) != 2)
-                goto stat_directly;
-
-            ret = snprintf(addr, sizeof(addr), "%" PRIx64 "-%" PRIx64, start,
-                           end);
-            if (ret >= sizeof(addr) || ret <= 0)
-                goto stat_directly;
-
-            ret = snprintf(path, sizeof(path), "/proc/%d/map_files/%s", Lp->pid,
-                           addr);
-            if (ret >= sizeof(path) || ret <= 0)
-                goto stat_directly;
-
-            if (!efs) {
-                if (HasNFS)
-                    sv = statsafely(ctx, path, &sb);
-                else
-                    sv = stat(path, &sb);
-            }
-        } else {
-        stat_directly:
-            if (!efs) {
+        en = 0;
+        if (!efs) {
+            if (!msp->valid) {
                 if (HasNFS)
-                    sv = statsafely(ctx, fp[6], &sb);
+                    sv = statsafely(ctx, mf ? mfpath : path, &sb);
                 else
-                    sv = stat(fp[6], &sb);
+                    sv = stat(mf ? mfpath : path, &sb);
+                msp->sv = sv;
+                msp->en = sv ? errno : 0;
+                if (!sv)
+                    msp->sb = sb;
+                /*
+                 * A map_files stat(2) failure may depend on the process, so
+                 * it isn't kept.
+                 */
+                msp->valid = (!mf || !sv);
+            } else {
+                sv = msp->sv;
+                if (!sv)
+                    sb = msp->sb;
             }
+            en = msp->en;
         }
         if (sv || efs) {
-            en = errno;
             /*
              * Applying stat(2) to the file was not possible (file is on an
              * exempt file system) or stat(2) failed, so manufacture a partial
@@ -1606,7 +3078,7 @@ process_proc_map(struct lsof_context *ctx, /* context */
          * Record the file's information.
          */
         if (!efs)
-            process_proc_node(ctx, fp[6], fp[6], &sb, mss, (struct stat *)NULL,
+            process_proc_node(ctx, path, path, &sb, mss, (struct stat *)NULL,
                               0);
         else {
 
@@ -1618,7 +3090,7 @@ process_proc_map(struct lsof_context *ctx, /* context */
             Lf->dev = sb.st_dev;
             Lf->inode = (ino_t)sb.st_ino;
             Lf->dev_def = Lf->inp_ty = 1;
-            (void)enter_nm(ctx, fp[6]);
+            (void)enter_nm(ctx, path);
             Lf->type =
                 ds ? LSOF_FILE_UNKNOWN_DELETED : LSOF_FILE_UNKNOWN_MEMORY;
             (void)snpf(nmabuf, sizeof(nmabuf), "(%ce %s)",
@@ -1632,6 +3104,191 @@ process_proc_map(struct lsof_context *ctx, /* context */
     (void)fclose(ms);
 }
 
+/*
+ * read_proc_map() - read the next file-backed mapping of a maps file
+ *
+ * The PROCMAP_QUERY ioctl(2) is asked for the next file-backed mapping
+ * at or above *addr, so only those mappings are returned, already in binary.
+ * When the kernel doesn't support it, the maps file is parsed as text.
+ *
+ * return: 1 == a mapping was returned
+ *         0 == no more mappings
+ */
+
+static int
+read_proc_map(struct lsof_context *ctx, /* context */
+              FILE *ms,          /* maps file stream */
+              int *pq,           /* use PROCMAP_QUERY (reset on failure) */
+              uint64_t *addr,    /* PROCMAP_QUERY next query address */
+              char *buf,         /* path (and text line) buffer */
+              size_t bufl,       /* buf length */
+              uint64_t *start,   /* returned mapping start address */
+              uint64_t *end,     /* returned mapping end address */
+              dev_t *dev,        /* returned mapped file device */
+              INODETYPE *inode,  /* returned mapped file inode */
+              char **path)       /* returned mapped file path */
+{
+    char *ep, **fp;
+    int eb = 6;
+    long maj, min;
+    struct procmap_query q;
+
+    while (*pq) {
+        zeromem((char *)&q, sizeof(q));
+        q.size = sizeof(q);
+        q.query_flags =
+            PROCMAP_QUERY_COVERING_OR_NEXT_VMA | PROCMAP_QUERY_FILE_BACKED_VMA;
+        q.query_addr = *addr;
+        q.vma_name_addr = (uint64_t)(uintptr_t)buf;
+        q.vma_name_size = (uint32_t)bufl;
+        if (ioctl(fileno(ms), PROCMAP_QUERY, &q) < 0) {
+            if (errno == ENOENT)
+                return (0); /* no more file-backed mappings */
+            if (errno == ENAMETOOLONG) {
+
+                /*
+                 * Skip a mapping whose path doesn't fit the buffer.
+                 */
+                q.vma_name_addr = (uint64_t)0;
+                q.vma_name_size = 0;
+                if (ioctl(fileno(ms), PROCMAP_QUERY, &q) < 0)
+                    return (0);
+                *addr = q.vma_end;
+                continue;
+            }
+            if (*addr)
+                return (0); /* the process has probably exited */
+            /*
+             * The first query failed, so read the maps file as text.  Stop
+             * trying PROCMAP_QUERY if the kernel doesn't know it.
+             */
+            if (errno == ENOTTY)
+                ctx->dialect.no_procmap_query = 1;
+            *pq = 0;
+            break;
+        }
+        *addr = q.vma_end;
+        if (!q.vma_name_size || !*buf)
+            continue; /* no path name */
+        *start = q.vma_start;
+        *end = q.vma_end;
+        *dev = (dev_t)makedev((int)q.dev_major, (int)q.dev_minor);
+        *inode = (INODETYPE)q.inode;
+        *path = buf;
+        return (1);
+    }
+    while (fgets(buf, (int)bufl, ms)) {
+        if (get_fields(ctx, buf, ":", &fp, &eb, 1) < 7)
+            continue; /* not enough fields */
+        if (!fp[6] || !*fp[6])
+            continue; /* no path name */
+        if (sscanf(fp[0], "%" SCNx64 "-%" SCNx64, start, end) != 2)
+            continue;
+        /*
+         * Assemble the major and minor device numbers.
+         */
+        ep = (char *)NULL;
+        if (!fp[3] || !*fp[3] || (maj = strtol(fp[3], &ep, 16)) == LONG_MIN ||
+            maj == LONG_MAX || !ep || *ep)
+            continue;
+        ep = (char *)NULL;
+        if (!fp[4] || !*fp[4] || (min = strtol(fp[4], &ep, 16)) == LONG_MIN ||
+            min == LONG_MAX || !ep || *ep)
+            continue;
+        *dev = (dev_t)makedev((int)maj, (int)min);
+        /*
+         * Assemble the inode number.
+         */
+        if (!fp[5] || !*fp[5])
+            continue;
+        ep = (char *)NULL;
+        if ((*inode = strtoull(fp[5], &ep, 0)) == ULLONG_MAX || !ep || *ep)
+            continue;
+        *path = fp[6];
+        return (1);
+    }
+    return (0);
+}
+
+/*
+ * read_id_dir() - read the numeric entry names of a /proc directory
+ *
+ * The entries are read with large getdents64() buffers and their names are
+ * converted to IDs as they are read; names that aren't decimal IDs are
+ * skipped.  The IDs are returned in ascending order in il->ids[].
+ *
+ * return: the number of IDs; -1 if the directory can't be read
+ */
+
+static int read_id_dir(struct lsof_context *ctx, /* context */
+                       int dfd,             /* open directory fd */
+                       struct id_list *il)  /* ID list receiver */
+{
+    struct linux_dirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    } *de;
+    char *cp;
+    long nr, off;
+    int id, *ids, sorted = 1, v;
+    MALLOC_S len;
+
+    il->n = 0;
+    if (!ctx->dialect.dents_buf &&
+        !(ctx->dialect.dents_buf = (char *)malloc(DENTSBUFSZ))) {
+        (void)fprintf(stderr, "%s: no space for directory entry buffer\n", Pn);
+        Error(ctx);
+    }
+    if (lseek(dfd, (off_t)0, SEEK_SET) == (off_t)-1)
+        return (-1);
+    while ((nr = syscall(SYS_getdents64, dfd, ctx->dialect.dents_buf,
+                         DENTSBUFSZ)) > 0) {
+        for (off = 0; off < nr; off += de->d_reclen) {
+            de = (struct linux_dirent64 *)(ctx->dialect.dents_buf + off);
+            /*
+             * Convert the name to an ID, skipping "." and "..", names that
+             * aren't decimal numbers, and numbers that overflow an int.
+             */
+            for (cp = de->d_name, id = 0; *cp; cp++) {
+                if (!isdigit((unsigned char)*cp))
+                    break;
+                v = (int)(*cp - '0');
+                if (id > (INT_MAX - v) / 10)
+                    break;
+                id = (id * 10) + v;
+            }
+            if (*cp || cp == de->d_name)
+                continue;
+            if (il->n >= il->alloc) {
+                il->alloc = il->alloc ? (il->alloc * 2) : 1024;
+                len = (MALLOC_S)(il->alloc * sizeof(int));
+                if (il->ids)
+                    ids = (int *)realloc((MALLOC_P *)il->ids, len);
+                else
+                    ids = (int *)malloc(len);
+                if (!ids) {
+                    (void)fprintf(stderr, "%s: no space for %d /proc IDs\n",
+                                  Pn, il->alloc);
+                    Error(ctx);
+                }
+                il->ids = ids;
+            }
+            if (il->n && (id < il->ids[il->n - 1]))
+                sorted = 0;
+            il->ids[il->n++] = id;
+        }
+    }
+    if (nr < 0)
+        return (-1);
+    if (!sorted)
+        (void)qsort((QSORT_P *)il->ids, (size_t)il->n, sizeof(int),
+                    fd_compare);
+    return (il->n);
+}
+
 /*
  * read_id_stat() - read ID (PID or LWP ID) status
  *
@@ -1641,25 +3298,26 @@ process_proc_map(struct lsof_context *ctx, /* context */
  *	    2 == ID is a thread
  */
 static int read_id_stat(struct lsof_context *ctx, /* context */
-                        char *p,                  /* path to status file */
+                        int dfd, /* directory fd p is relative to */
+                        char *p, /* path to status file */
                         int id,                   /* ID: PID or LWP */
                         char **cmd,               /* malloc'd command name */
                         int *ppid, /* returned parent PID for PID type */
-                        int *pgid) /* returned process group ID for PID
+                        int *pgid, /* returned process group ID for PID
                                     * type */
+                        unsigned long long *start) /* returned start time
+                                                    * (0 if unknown) */
 {
     char buf[MAXPATHLEN], *cp, *cp1, **fp;
-    int ch, cx, es, pc;
-    static char *cbf = (char *)NULL;
-    static MALLOC_S cbfa = 0;
+    int ch, cx, es, nf, pc;
+    char *cbf = ctx->dialect.cmd_buf;
     FILE *fs;
-    static char *vbuf = (char *)NULL;
-    static size_t vsz = (size_t)0;
     /*
      * Open the stat file path, assign a page size buffer to its stream,
      * and read the file's first line.
      */
-    if (!(fs = open_proc_stream(ctx, p, "r", &vbuf, &vsz, 0)))
+    if (!(fs = open_proc_stream_at(ctx, dfd, p, "r", &ctx->dialect.stat_vbuf,
+                                   &ctx->dialect.stat_vbuf_len, 0)))
         return (-1);
     if (!(cp = fgets(buf, sizeof(buf), fs))) {
 
@@ -1726,8 +3384,12 @@ static int read_id_stat(struct lsof_context *ctx, /* context */
             if (!pc)
                 break;
         }
-        if ((cx + 2) > cbfa)
-            cbfa = alloc_cbf(ctx, (cx + 2), &cbf, cbfa);
+        if ((cx + 2) > ctx->dialect.cmd_buf_len) {
+            ctx->dialect.cmd_buf_len =
+                alloc_cbf(ctx, (cx + 2), &ctx->dialect.cmd_buf,
+                          ctx->dialect.cmd_buf_len);
+            cbf = ctx->dialect.cmd_buf;
+        }
         cbf[cx] = ch;
         cx++;
         cbf[cx] = '\0';
@@ -1746,7 +3408,7 @@ static int read_id_stat(struct lsof_context *ctx, /* context */
     (void)fclose(fs);
     if (!cp || !*cp)
         return (-1);
-    if (get_fields(ctx, cp, (char *)NULL, &fp, (int *)NULL, 0) < 3)
+    if ((nf = get_fields(ctx, cp, (char *)NULL, &fp, (int *)NULL, 0)) < 3)
         return (-1);
     /*
      * Convert and return parent process (fourth field) and process group (fifth
@@ -1760,6 +3422,11 @@ static int read_id_stat(struct lsof_context *ctx, /* context */
         *pgid = atoi(fp[2]);
     else
         return (-1);
+    /*
+     * Return the start time (twenty-second field), which tells apart the
+     * processes that reuse an ID.
+     */
+    *start = (nf > 19 && fp[19]) ? strtoull(fp[19], (char **)NULL, 10) : 0;
     /*
      * Check the state in the third field.  If it is 'Z', return that
      * indication.
@@ -57,13 +57,39 @@ extern void clean_tcpudp6(struct lsof_context *ctx, int free_array);
 #endif
 extern int is_file_named(struct lsof_context *ctx, int ty, char *p,
                          struct mounts *mp, int cd);
+#if defined(HASFDMEMO)
+extern void fd_memo_free(struct lsof_context *ctx);
+#endif /* defined(HASFDMEMO) */
 extern int make_proc_path(struct lsof_context *ctx, char *pp, int lp, char **np,
                           int *npl, char *sf);
 extern FILE *open_proc_stream(struct lsof_context *ctx, char *p, char *mode,
                               char **buf, size_t *sz, int act);
+extern FILE *open_proc_stream_at(struct lsof_context *ctx, int dfd, char *p,
+                                 char *mode, char **buf, size_t *sz, int act);
+extern void proc_sig_grow(struct lsof_context *ctx, struct proc_sig *ps,
+                          size_t n, char *nm);
+extern uint64_t proc_sig_hash(char *b, size_t l);
+extern int proc_sig_note(struct proc_sig *ps, size_t l);
+extern int proc_sig_read(struct lsof_context *ctx, char *p,
+                         struct proc_sig *ps);
 extern void process_proc_node(struct lsof_context *ctx, char *p, char *pbr,
                               struct stat *s, int ss, struct stat *l, int ls);
+extern void preload_sock_info(struct lsof_context *ctx);
 extern void process_proc_sock(struct lsof_context *ctx, char *p, char *pbr,
                               struct stat *s, int ss, struct stat *l, int ls);
 extern void set_net_paths(struct lsof_context *ctx, char *p, int pl);
-extern void refresh_socket_info(struct lsof_context *ctx);
\ No newline at end of file
+extern void refresh_socket_info(struct lsof_context *ctx);
+#if defined(HASIOURING)
+extern void ring_close(struct lsof_context *ctx);
+extern int ring_open(struct lsof_context *ctx);
+extern int ring_read(struct lsof_context *ctx, int dfd, char *nm);
+extern char *ring_read_result(struct lsof_context *ctx, int x);
+extern void ring_reset(struct lsof_context *ctx);
+extern void ring_run(struct lsof_context *ctx);
+extern int ring_stat(struct lsof_context *ctx, int dfd, char *nm, int flags,
+                     unsigned int mask);
+extern int ring_stat_result(struct lsof_context *ctx, int x, struct stat *sb);
+#endif /* defined(HASIOURING) */
+#if defined(HASSTATX)
+extern int statx_to_stat(struct statx *sx, struct stat *sb);
+#endif /* defined(HASSTATX) */
\ No newline at end of file
@@ -0,0 +1,504 @@
+/*
+ * dring.c - Linux io_uring batching of /proc stat(2) and file reads for
+ *	     /proc-based lsof
+ */
+
+/*
+ * Copyright 1997 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include "common.h"
+
+#if defined(HASIOURING)
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+
+/*
+ * The ring queues operations on behalf of process_id(): ring_stat() and
+ * ring_read() queue them, ring_run() submits them all and waits for their
+ * completions, and ring_stat_result() and ring_read_result() return their
+ * results.
+ *
+ * A file read is an openat(2), submitted with the stat(2) operations, and
+ * then a read(2) hard linked to a close(2), submitted together once the
+ * openat(2) completions are in.  A batch thus costs two io_uring_enter(2)
+ * calls.
+ */
+
+/*
+ * Local definitions
+ */
+
+#    define RING_ENTRIES 256 /* submission queue entries */
+#    define RING_OPS RING_ENTRIES /* operations per batch */
+#    define RING_READS 64         /* file reads per batch */
+#    define RING_READSZ 1024      /* file read buffer size */
+
+#    define RING_OP_STAT 1 /* ring_op.kind: statx(2) */
+#    define RING_OP_READ 2 /* ring_op.kind: openat(2), read(2), close(2) */
+
+#    define RING_UD_READ 0x10000  /* user_data flag: read(2) completion */
+#    define RING_UD_CLOSE 0x20000 /* user_data flag: close(2) completion */
+#    define RING_UD_OP 0xffff     /* user_data operation index mask */
+
+/*
+ * Local structures
+ */
+
+struct ring_op {
+    int kind;            /* RING_OP_* */
+    int done;            /* operation completed */
+    int res;             /* statx(2) or read(2) result (-errno on failure) */
+    int fd;              /* openat(2) file descriptor (-1 if none) */
+    int rx;              /* read buffer index */
+    unsigned int mask;   /* statx(2) field mask */
+    char nm[16];         /* FD name, relative to the directory fd */
+    struct statx stx;    /* statx(2) result */
+};
+
+struct fd_ring {
+    int fd; /* io_uring file descriptor */
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr; /* mmap(2)'d rings */
+    size_t sq_len, cq_len, sqes_len;
+    int broken;            /* io_uring_enter(2) failed -- see ring_wait() */
+    int nops;              /* operations queued */
+    int nreads;            /* read buffers used */
+    struct ring_op ops[RING_OPS];
+    char reads[RING_READS][RING_READSZ];
+};
+
+/*
+ * Local function prototypes
+ */
+
+static int ring_enter(int fd, unsigned int sub, unsigned int wait);
+static struct io_uring_sqe *ring_sqe(struct fd_ring *r);
+static int ring_wait(struct fd_ring *r, int n);
+
+/*
+ * ring_close() - close a context's io_uring
+ */
+
+void ring_close(struct lsof_context *ctx) /* context */
+{
+    struct fd_ring *r = ctx->dialect.ring;
+
+    if (!r)
+        return;
+    if (r->sqes)
+        (void)munmap((void *)r->sqes, r->sqes_len);
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr)
+        (void)munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr)
+        (void)munmap(r->sq_ptr, r->sq_len);
+    if (r->fd >= 0)
+        (void)close(r->fd);
+    /*
+     * A broken ring's operations may still complete into its buffers, so
+     * they aren't freed.
+     */
+    if (!r->broken)
+        (void)free((FREE_P *)r);
+    ctx->dialect.ring = (struct fd_ring *)NULL;
+}
+
+/*
+ * ring_enter() - submit ring entries and wait for completions
+ */
+
+static int ring_enter(int fd,            /* io_uring file descriptor */
+                      unsigned int sub,  /* entries to submit */
+                      unsigned int wait) /* completions to wait for */
+{
+    int rv;
+
+    do {
+        rv = (int)syscall(__NR_io_uring_enter, fd, sub, wait,
+                          wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (rv < 0 && errno == EINTR);
+    return (rv);
+}
+
+/*
+ * ring_open() - open a context's io_uring
+ *
+ * The kernel is probed for the statx(2), openat(2), read(2) and close(2)
+ * operations the ring needs.
+ *
+ * return: 0 == the ring is open
+ *	  -1 == io_uring can't be used
+ */
+
+int ring_open(struct lsof_context *ctx) /* context */
+{
+    struct io_uring_params p;
+    struct io_uring_probe *pr;
+    struct fd_ring *r;
+    static const int need[] = {IORING_OP_STATX, IORING_OP_OPENAT,
+                               IORING_OP_READ, IORING_OP_CLOSE};
+    size_t i, prl;
+
+    if (ctx->dialect.ring)
+        return (0);
+    if (!(r = (struct fd_ring *)calloc(1, sizeof(struct fd_ring))))
+        return (-1);
+    ctx->dialect.ring = r;
+    zeromem((char *)&p, sizeof(p));
+    if ((r->fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &p)) < 0) {
+        ring_close(ctx);
+        return (-1);
+    }
+    /*
+     * See that the kernel has the operations.
+     */
+    prl = sizeof(struct io_uring_probe) +
+          IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    if (!(pr = (struct io_uring_probe *)calloc(1, prl)) ||
+        syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, pr,
+                IORING_OP_LAST) < 0) {
+        if (pr)
+            (void)free((FREE_P *)pr);
+        ring_close(ctx);
+        return (-1);
+    }
+    for (i = 0; i < sizeof(need) / sizeof(need[0]); i++) {
+        if (need[i] > pr->last_op ||
+            !(pr->ops[need[i]].flags & IO_URING_OP_SUPPORTED))
+            break;
+    }
+    (void)free((FREE_P *)pr);
+    if (i < sizeof(need) / sizeof(need[0])) {
+        ring_close(ctx);
+        return (-1);
+    }
+    /*
+     * Map the submission and completion rings and the submission entries.
+     */
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len)
+            r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    if ((r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd,
+                          IORING_OFF_SQ_RING)) == MAP_FAILED) {
+        r->sq_ptr = NULL;
+        ring_close(ctx);
+        return (-1);
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->cq_ptr = r->sq_ptr;
+    else if ((r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, r->fd,
+                               IORING_OFF_CQ_RING)) == MAP_FAILED) {
+        r->cq_ptr = NULL;
+        ring_close(ctx);
+        return (-1);
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    if ((r->sqes = (struct io_uring_sqe *)mmap(
+             NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES)) ==
+        MAP_FAILED) {
+        r->sqes = NULL;
+        ring_close(ctx);
+        return (-1);
+    }
+    r->sq_head = (unsigned int *)((char *)r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned int *)((char *)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned int *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)((char *)r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned int *)((char *)r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned int *)((char *)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned int *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+    return (0);
+}
+
+/*
+ * ring_read() - queue a read of a small file
+ *
+ * return: operation index; -1 if the batch is full
+ */
+
+int ring_read(struct lsof_context *ctx, /* context */
+              int dfd, /* directory fd nm is relative to */
+              char *nm) /* FD name */
+{
+    struct ring_op *op;
+    struct fd_ring *r = ctx->dialect.ring;
+
+    if (!r || r->broken || r->nops >= RING_OPS || r->nreads >= RING_READS)
+        return (-1);
+    op = &r->ops[r->nops];
+    op->kind = RING_OP_READ;
+    op->done = 0;
+    op->fd = dfd;
+    op->rx = r->nreads++;
+    (void)snpf(op->nm, sizeof(op->nm), "%s", nm);
+    return (r->nops++);
+}
+
+/*
+ * ring_read_result() - get the result of a ring_read()
+ *
+ * return: the NUL terminated file contents; NULL if they weren't read
+ *	   completely
+ */
+
+char *ring_read_result(struct lsof_context *ctx, /* context */
+                       int x)                    /* operation index */
+{
+    char *b;
+    struct ring_op *op;
+    struct fd_ring *r = ctx->dialect.ring;
+
+    if (!r || x < 0 || x >= r->nops)
+        return ((char *)NULL);
+    op = &r->ops[x];
+    if (!op->done || op->res < 0 || op->res >= RING_READSZ - 1)
+        return ((char *)NULL);
+    b = r->reads[op->rx];
+    b[op->res] = '\0';
+    return (b);
+}
+
+/*
+ * ring_reset() - start a new batch of ring operations
+ */
+
+void ring_reset(struct lsof_context *ctx) /* context */
+{
+    struct fd_ring *r = ctx->dialect.ring;
+
+    if (r)
+        r->nops = r->nreads = 0;
+}
+
+/*
+ * ring_run() - submit the queued ring operations and wait for them to
+ *		complete
+ *
+ * Operations that couldn't be submitted are left undone, and the files
+ * opened for them are closed.
+ */
+
+void ring_run(struct lsof_context *ctx) /* context */
+{
+    int i, n;
+    struct ring_op *op;
+    struct fd_ring *r = ctx->dialect.ring;
+    struct io_uring_sqe *sqe;
+
+    if (!r || !r->nops)
+        return;
+    /*
+     * Submit the statx(2) and openat(2) operations.
+     */
+    for (i = n = 0; i < r->nops; i++) {
+        op = &r->ops[i];
+        sqe = ring_sqe(r);
+        sqe->fd = op->fd;
+        sqe->addr = (uint64_t)(uintptr_t)op->nm;
+        sqe->user_data = (uint64_t)i;
+        if (op->kind == RING_OP_STAT) {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->len = op->mask;
+            sqe->off = (uint64_t)(uintptr_t)&op->stx;
+            sqe->statx_flags = (uint32_t)op->res;
+        } else {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }
+        op->fd = -1;
+        n++;
+    }
+    if (ring_wait(r, n))
+        goto close_rest;
+    /*
+     * Submit a read(2) and a close(2) for each file opened.
+     */
+    for (i = n = 0; i < r->nops; i++) {
+        op = &r->ops[i];
+        if (op->kind != RING_OP_READ || op->fd < 0)
+            continue;
+        op->done = 0;
+        sqe = ring_sqe(r);
+        sqe->opcode = IORING_OP_READ;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        sqe->fd = op->fd;
+        sqe->addr = (uint64_t)(uintptr_t)r->reads[op->rx];
+        sqe->len = RING_READSZ - 1;
+        sqe->user_data = (uint64_t)(i | RING_UD_READ);
+        sqe = ring_sqe(r);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = op->fd;
+        sqe->user_data = (uint64_t)(i | RING_UD_CLOSE);
+        n += 2;
+    }
+    if (n)
+        (void)ring_wait(r, n);
+    /*
+     * Close what the ring didn't -- all the files opened, if the ring failed
+     * before their reads could be submitted.
+     */
+
+close_rest:
+    for (i = 0; i < r->nops; i++) {
+        op = &r->ops[i];
+        if (op->kind == RING_OP_READ && op->fd >= 0) {
+            (void)close(op->fd);
+            op->fd = -1;
+        }
+    }
+}
+
+/*
+ * ring_sqe() - get a cleared submission queue entry
+ */
+
+static struct io_uring_sqe *ring_sqe(struct fd_ring *r) /* ring */
+{
+    unsigned int t = *r->sq_tail;
+    unsigned int x = t & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[x];
+
+    zeromem((char *)sqe, sizeof(struct io_uring_sqe));
+    r->sq_array[x] = x;
+    __atomic_store_n(r->sq_tail, t + 1, __ATOMIC_RELEASE);
+    return (sqe);
+}
+
+/*
+ * ring_stat() - queue a stat(2) or an lstat(2)
+ *
+ * return: operation index; -1 if the batch is full
+ */
+
+int ring_stat(struct lsof_context *ctx, /* context */
+              int dfd,           /* directory fd nm is relative to */
+              char *nm,          /* FD name */
+              int flags,         /* statx(2) flags */
+              unsigned int mask) /* statx(2) field mask */
+{
+    struct ring_op *op;
+    struct fd_ring *r = ctx->dialect.ring;
+
+    if (!r || r->broken || r->nops >= RING_OPS)
+        return (-1);
+    op = &r->ops[r->nops];
+    op->kind = RING_OP_STAT;
+    op->done = 0;
+    op->fd = dfd;
+    op->res = flags;
+    op->mask = mask;
+    (void)snpf(op->nm, sizeof(op->nm), "%s", nm);
+    return (r->nops++);
+}
+
+/*
+ * ring_stat_result() - get the result of a ring_stat()
+ *
+ * return: >0 == the SB_* status of *sb
+ *	    0 == the stat(2) failed; errno has been set
+ *	   -1 == the stat(2) wasn't done
+ */
+
+int ring_stat_result(struct lsof_context *ctx, /* context */
+                     int x,                    /* operation index */
+                     struct stat *sb)          /* stat(2) result buffer */
+{
+    struct ring_op *op;
+    struct fd_ring *r = ctx->dialect.ring;
+
+    if (!r || x < 0 || x >= r->nops || !r->ops[x].done)
+        return (-1);
+    op = &r->ops[x];
+    if (op->res < 0) {
+        errno = -op->res;
+        return (0);
+    }
+    return (statx_to_stat(&op->stx, sb));
+}
+
+/*
+ * ring_wait() - submit n ring entries and reap their completions
+ *
+ * return: 0 == all completions were reaped
+ *	  -1 == io_uring_enter(2) failed
+ */
+
+static int ring_wait(struct fd_ring *r, /* ring */
+                     int n)             /* entries to submit */
+{
+    struct io_uring_cqe *cqe;
+    unsigned int h, t;
+    struct ring_op *op;
+    int rv, sub = n;
+
+    while (n > 0) {
+        if ((rv = ring_enter(r->fd, (unsigned int)sub, 1)) < 0) {
+
+            /*
+             * Drop what wasn't submitted and stop using the ring: the
+             * operations that were submitted may still complete into this
+             * batch's buffers.
+             */
+            *r->sq_tail = *r->sq_head;
+            r->broken = 1;
+            return (-1);
+        }
+        sub -= (rv < sub) ? rv : sub;
+        h = *r->cq_head;
+        t = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; h != t; h++) {
+            cqe = &r->cqes[h & *r->cq_mask];
+            n--;
+            if ((cqe->user_data & RING_UD_OP) >= (uint64_t)r->nops)
+                continue;
+            op = &r->ops[cqe->user_data & RING_UD_OP];
+            if (cqe->user_data & RING_UD_CLOSE) {
+                if (cqe->res >= 0)
+                    op->fd = -1;
+                continue;
+            }
+            op->done = 1;
+            if (op->kind == RING_OP_READ && !(cqe->user_data & RING_UD_READ))
+                op->fd = (op->res = cqe->res) >= 0 ? cqe->res : -1;
+            else
+                op->res = cqe->res;
+        }
+        __atomic_store_n(r->cq_head, h, __ATOMIC_RELEASE);
+    }
+    return (0);
+}
+#else  /* !defined(HASIOURING) */
+char ring_d1[] = "d";
+char *ring_d2 = ring_d1;
+#endif /* defined(HASIOURING) */
@@ -45,12 +45,29 @@
 #    include <stdint.h>          /* for unt8_t */
 #    include <unistd.h>          /* for getpagesize */
 #    define SOCKET_BUFFER_SIZE (getpagesize() < 8192L ? getpagesize() : 8192L)
+#    define UNIX_DIAG_BUFSZ 32768 /* unix_diag dump receive buffer size */
 #endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
 
 #if defined(HASSOSTATE)
 #    include <linux/net.h> /* for SS_* */
 #endif                     /* defined(HASSOSTATE) */
 
+#if defined(HASINETDIAG)
+/*
+ * NETLINK inet_diag definitions
+ */
+
+#    include <sys/socket.h>       /* for AF_NETLINK */
+#    include <linux/netlink.h>    /* for NETLINK_SOCK_DIAG */
+#    include <linux/sock_diag.h>  /* for SOCK_DIAG_BY_FAMILY */
+#    include <linux/inet_diag.h>  /* for inet_diag_req_v2 */
+#    if !defined(IPPROTO_UDPLITE)
+#        define IPPROTO_UDPLITE 136
+#    endif                        /* !defined(IPPROTO_UDPLITE) */
+#    define INET_DIAG_BUFSZ 32768 /* inet_diag dump receive buffer size */
+#    define INET_DIAG_BCSZ 4096   /* inet_diag filter bytecode size limit */
+#endif                            /* defined(HASINETDIAG) */
+
 /*
  * Local definitions
  */
@@ -58,7 +75,6 @@
 #define INOBUCKS                                                               \
     128 /* inode hash bucket count -- must be                                  \
          * a power of two */
-#define INOHASH(ino) ((int)((ino * 31415) >> 3) & (INOBUCKS - 1))
 #define TCPUDPHASH(ino) ((int)((ino * 31415) >> 3) & (TcpUdp_bucks - 1))
 #define TCPUDP6HASH(ino) ((int)((ino * 31415) >> 3) & (TcpUdp6_bucks - 1))
 
@@ -104,7 +120,6 @@ struct ax25sin {  /* AX25 socket information */
     unsigned long sq, rq;   /* send and receive queue values */
     unsigned char sqs, rqs; /* send and receive queue states */
     int state;
-    struct ax25sin *next;
 };
 
 struct icmpin {
@@ -113,7 +128,6 @@ struct icmpin {
     char *ra;        /* remote address */
     MALLOC_S lal;    /* strlen(la) */
     MALLOC_S ral;    /* strlen(ra) */
-    struct icmpin *next;
 };
 
 struct ipxsin { /* IPX socket information */
@@ -122,20 +136,17 @@ struct ipxsin { /* IPX socket information */
     char *ra; /* remote address */
     int state;
     unsigned long txq, rxq; /* transmit and receive queue values */
-    struct ipxsin *next;
 };
 
 struct nlksin {      /* Netlink socket information */
     INODETYPE inode; /* node number */
     unsigned int pr; /* protocol */
-    struct nlksin *next;
 };
 
 struct packin { /* packet information */
     INODETYPE inode;
     int ty; /* socket type */
     int pr; /* protocol */
-    struct packin *next;
 };
 
 struct rawsin { /* raw socket information */
@@ -146,7 +157,6 @@ struct rawsin { /* raw socket information */
     MALLOC_S lal; /* strlen(la) */
     MALLOC_S ral; /* strlen(ra) */
     MALLOC_S spl; /* strlen(sp) */
-    struct rawsin *next;
 };
 
 struct sctpsin { /* SCTP socket information */
@@ -160,7 +170,6 @@ struct sctpsin { /* SCTP socket information */
     char *rport;   /* remote port */
     char *laddrs;  /* local address */
     char *raddrs;  /* remote address */
-    struct sctpsin *next;
 };
 
 struct tcp_udp { /* IPv4 TCP and UDP socket
@@ -208,6 +217,9 @@ typedef struct uxsin {    /* UNIX socket information */
     uint32_t ty;          /* socket type */
     unsigned int opt;     /* socket options */
     unsigned int ss;      /* socket state */
+    unsigned long rxq;    /* receive queue value */
+    unsigned long txq;    /* transmit queue value */
+    unsigned char qs;     /* queue values status: 0 = none */
 
 #if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
     struct uxsin *icons; /* incoming socket conections */
@@ -217,7 +229,6 @@ typedef struct uxsin {    /* UNIX socket information */
     struct uxsin *peer;  /* connected peer(s) info */
 #endif                   /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
 
-    struct uxsin *next;
 } uxsin_t;
 
 /*
@@ -226,7 +237,7 @@ typedef struct uxsin {    /* UNIX socket information */
 
 static char *AX25path = (char *)NULL; /* path to AX25 /proc information */
 /* AX25 socket info, hashed by inode */
-static struct ax25sin **AX25sin = (struct ax25sin **)NULL;
+static inohash_t AX25sin;
 static char *ax25st[] = {
     "LISTENING",   /* 0 */
     "SABM SENT",   /* 1 */
@@ -237,21 +248,21 @@ static char *ax25st[] = {
 #define NAX25ST (sizeof(ax25st) / sizeof(char *))
 static char *ICMPpath = (char *)NULL; /* path to ICMP /proc information */
 /* ICMP socket info, hashed by inode */
-static struct icmpin **Icmpin = (struct icmpin **)NULL;
+static inohash_t Icmpin;
 static char *Ipxpath = (char *)NULL; /* path to IPX /proc information */
 /* IPX socket info, hashed by inode */
-static struct ipxsin **Ipxsin = (struct ipxsin **)NULL;
+static inohash_t Ipxsin;
 static char *Nlkpath = (char *)NULL; /* path to Netlink /proc information */
 /* Netlink socket info, hashed by
  * inode */
-static struct nlksin **Nlksin = (struct nlksin **)NULL;
+static inohash_t Nlksin;
 /* packet info, hashed by inode */
-static struct packin **Packin = (struct packin **)NULL;
+static inohash_t Packin;
 static char *Packpath = (char *)NULL; /* path to packet /proc information */
 static char *Rawpath = (char *)NULL;  /* path to raw socket /proc
                                        * information */
 /* raw socket info, hashed by inode */
-static struct rawsin **Rawsin = (struct rawsin **)NULL;
+static inohash_t Rawsin;
 static char *SCTPPath[] = {
     /* paths to /proc/net STCP info */
     (char *)NULL, /* 0 = /proc/net/sctp/assocs */
@@ -264,7 +275,7 @@ static char *SCTPSfx[] = {
     "sctp/eps"     /* 1 = /proc/net/sctp/eps */
 };
 /* SCTP info, hashed by inode */
-static struct sctpsin **SCTPsin = (struct sctpsin **)NULL;
+static inohash_t SCTPsin;
 /* path to /proc/net socket status */
 static char *SockStatPath = (char *)NULL;
 static char *TCPpath = (char *)NULL; /* path to TCP /proc information */
@@ -280,12 +291,17 @@ static int TcpUdp_bucks = 0; /* dynamically sized hash bucket
    and protocol */
 static struct tcp_udp **TcpUdpIPC = (struct tcp_udp **)NULL;
 #endif /* defined(HASEPTOPTS) */
+/* free IPv4 TCP & UDP info structures */
+static struct tcp_udp *TcpUdpFree = (struct tcp_udp *)NULL;
+/* IPv4 TCP, UDP and UDPLITE table
+ * signatures */
+static struct proc_sig TcpUdpSig[3];
 
 #if defined(HASIPv6)
 static char *Raw6path = (char *)NULL; /* path to raw IPv6 /proc information */
 /* IPv6 raw socket info, hashed by
  * inode */
-static struct rawsin **Rawsin6 = (struct rawsin **)NULL;
+static inohash_t Rawsin6;
 /* path to /proc/net IPv6 socket
  * status */
 static char *SockStatPath6 = (char *)NULL;
@@ -306,6 +322,11 @@ static char *UDPLITE6path = (char *)NULL;
    and protocol */
 static struct tcp_udp6 **TcpUdp6IPC = (struct tcp_udp6 **)NULL;
 #    endif /* defined(HASEPTOPTS) */
+/* free IPv6 TCP & UDP info structures */
+static struct tcp_udp6 *TcpUdp6Free = (struct tcp_udp6 *)NULL;
+/* IPv6 TCP, UDP and UDPLITE table
+ * signatures */
+static struct proc_sig TcpUdp6Sig[3];
 #endif     /* defined(HASIPv6) */
 
 static char *UDPpath = (char *)NULL; /* path to UDP /proc information */
@@ -313,7 +334,8 @@ static char *UDPpath = (char *)NULL; /* path to UDP /proc information */
 static char *UDPLITEpath = (char *)NULL;
 static char *UNIXpath = (char *)NULL; /* path to UNIX /proc information */
 /* UNIX socket info, hashed by inode */
-static uxsin_t **Uxsin = (uxsin_t **)NULL;
+static inohash_t Uxsin;
+static struct proc_sig UxSig; /* UNIX socket table signature */
 
 /*
  * Local function prototypes
@@ -326,6 +348,7 @@ static void enter_uxsinfo(struct lsof_context *ctx, uxsin_t *up);
 static void fill_uxicino(struct lsof_context *ctx, INODETYPE si, INODETYPE sc);
 static void fill_uxpino(struct lsof_context *ctx, INODETYPE si, INODETYPE pi);
 static int get_diagmsg(int sockfd);
+static int get_unix_diag(struct lsof_context *ctx);
 static void get_uxpeeri(struct lsof_context *ctx);
 static void parse_diag(struct lsof_context *ctx, struct unix_diag_msg *dm,
                        int len);
@@ -353,6 +376,8 @@ static struct sctpsin *check_sctp(struct lsof_context *ctx, INODETYPE i);
 static struct tcp_udp *check_tcpudp(struct lsof_context *ctx, INODETYPE i,
                                     char **p);
 static uxsin_t *check_unix(struct lsof_context *ctx, INODETYPE i);
+static void reset_uxsinfo(struct lsof_context *ctx);
+static void drop_tcpudp(struct lsof_context *ctx, int pr);
 static void get_ax25(struct lsof_context *ctx, char *p);
 static void get_icmp(struct lsof_context *ctx, char *p);
 static void get_ipx(struct lsof_context *ctx, char *p);
@@ -361,7 +386,20 @@ static void get_pack(struct lsof_context *ctx, char *p);
 static void get_raw(struct lsof_context *ctx, char *p);
 static void get_sctp(struct lsof_context *ctx);
 static char *get_sctpaddrs(char **fp, int i, int nf, int *x);
-static void get_tcpudp(struct lsof_context *ctx, char *p, int pr, int clr);
+static void enter_tcpudp(struct lsof_context *ctx, INODETYPE inode,
+                         unsigned long laddr, int lport, unsigned long faddr,
+                         int fport, unsigned long txq, unsigned long rxq,
+                         int pr, int state);
+static uxsin_t *enter_unix(struct lsof_context *ctx, INODETYPE inode,
+                           char *pcb, char *path, uint32_t ty,
+                           unsigned int opt, unsigned int ss);
+static void reset_inohash(struct lsof_context *ctx, inohash_t *h, size_t n,
+                          char *nm);
+static void enter_inohash(struct lsof_context *ctx, inohash_t *h,
+                          INODETYPE inode, void *elem, char *nm);
+static size_t get_sockstat(struct lsof_context *ctx, char *p, char *pfx,
+                           char *key);
+static void get_tcpudp(struct lsof_context *ctx, char *p, int pr);
 static void get_unix(struct lsof_context *ctx, char *p);
 static int isainb(char *a, char *b);
 static void print_ax25info(struct lsof_context *ctx, struct ax25sin *ap);
@@ -377,11 +415,26 @@ static char *ethernet_proto_to_str(unsigned int pr);
 static struct rawsin *check_raw6(struct lsof_context *ctx, INODETYPE i);
 static struct tcp_udp6 *check_tcpudp6(struct lsof_context *ctx, INODETYPE i,
                                       char **p);
+static void drop_tcpudp6(struct lsof_context *ctx, int pr);
 static void get_raw6(struct lsof_context *ctx, char *p);
-static void get_tcpudp6(struct lsof_context *ctx, char *p, int pr, int clr);
+static void enter_tcpudp6(struct lsof_context *ctx, INODETYPE inode,
+                          struct in6_addr *laddr, int lport,
+                          struct in6_addr *faddr, int fport,
+                          unsigned long txq, unsigned long rxq, int pr,
+                          int state);
+static void get_tcpudp6(struct lsof_context *ctx, char *p, int pr);
 static int hex_ipv6_to_in6(char *as, struct in6_addr *ad);
 #endif /* defined(HASIPv6) */
 
+#if defined(HASINETDIAG)
+static void enter_inet_diag(struct lsof_context *ctx, struct proc_sig *ps,
+                            int pr);
+static int get_inet_diag(struct lsof_context *ctx, int af, int pr,
+                         struct proc_sig *ps);
+static int inet_diag_filter(struct lsof_context *ctx, int af, int pr,
+                            unsigned char *bc, int bcsz, uint32_t *states);
+#endif /* defined(HASINETDIAG) */
+
 /*
  * build_IPstates() -- build the TCP and UDP state tables
  */
@@ -403,13 +456,80 @@ void build_IPstates(struct lsof_context *ctx) {
     }
 }
 
+/*
+ * enter_inohash() - enter a socket's information in an inode index
+ */
+static void enter_inohash(struct lsof_context *ctx, /* context */
+                          inohash_t *h,             /* inode index */
+                          INODETYPE inode,          /* socket inode number */
+                          void *elem,               /* socket information */
+                          char *nm)                 /* index name */
+{
+    if (inohash_insert(h, inode, elem)) {
+        (void)fprintf(stderr, "%s: can't grow %s socket hash\n", Pn, nm);
+        Error(ctx);
+    }
+}
+
+/*
+ * reset_inohash() - empty an inode index and size it for n sockets
+ */
+static void reset_inohash(struct lsof_context *ctx, /* context */
+                          inohash_t *h,             /* inode index */
+                          size_t n,                 /* expected sockets */
+                          char *nm)                 /* index name */
+{
+    if (inohash_reset(h, n)) {
+        (void)fprintf(stderr,
+                      "%s: can't allocate %s socket hash for %lu sockets\n",
+                      Pn, nm, (unsigned long)n);
+        Error(ctx);
+    }
+}
+
+/*
+ * get_sockstat() - get a count from a /proc/net/sockstat[6] line
+ *
+ * return: the value following key on the line that begins with pfx, or zero
+ */
+static size_t get_sockstat(struct lsof_context *ctx, /* context */
+                           char *p,   /* /proc/net/sockstat[6] path */
+                           char *pfx, /* line prefix, e.g., "RAW:" */
+                           char *key) /* value key, e.g., "inuse" */
+{
+    char buf[MAXPATHLEN], **fp;
+    FILE *fs;
+    int i, nf;
+    long v;
+    size_t rv = 0;
+
+    if (!p || !(fs = fopen(p, "r")))
+        return (0);
+    while (fgets(buf, sizeof(buf) - 1, fs)) {
+        if ((nf = get_fields(ctx, buf, (char *)NULL, &fp, (int *)NULL, 0)) <
+                3 ||
+            !fp[0] || strcmp(fp[0], pfx))
+            continue;
+        for (i = 1; i < nf - 1; i += 2) {
+            if (fp[i] && !strcmp(fp[i], key) && fp[i + 1]) {
+                if ((v = atol(fp[i + 1])) > 0)
+                    rv = (size_t)v;
+                break;
+            }
+        }
+        break;
+    }
+    (void)fclose(fs);
+    return (rv);
+}
+
 /*
  * check_ax25() - check for AX25 socket file
  */
 static struct ax25sin *check_ax25(struct lsof_context *ctx,
                                   INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(AX25sin, INOHASH, struct ax25sin, inode, i);
+    return (struct ax25sin *)inohash_find(&AX25sin, i);
 }
 
 /*
@@ -418,7 +538,7 @@ static struct ax25sin *check_ax25(struct lsof_context *ctx,
 static struct icmpin *check_icmp(struct lsof_context *ctx,
                                  INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(Icmpin, INOHASH, struct icmpin, inode, i);
+    return (struct icmpin *)inohash_find(&Icmpin, i);
 }
 
 /*
@@ -427,7 +547,7 @@ static struct icmpin *check_icmp(struct lsof_context *ctx,
 static struct ipxsin *check_ipx(struct lsof_context *ctx,
                                 INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(Ipxsin, INOHASH, struct ipxsin, inode, i);
+    return (struct ipxsin *)inohash_find(&Ipxsin, i);
 }
 
 /*
@@ -437,7 +557,7 @@ static struct nlksin *
 check_netlink(struct lsof_context *ctx,
               INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(Nlksin, INOHASH, struct nlksin, inode, i);
+    return (struct nlksin *)inohash_find(&Nlksin, i);
 }
 
 /*
@@ -446,7 +566,7 @@ check_netlink(struct lsof_context *ctx,
 static struct packin *check_pack(struct lsof_context *ctx,
                                  INODETYPE i) /* packet file's inode number */
 {
-    return HASH_FIND_ELEMENT(Packin, INOHASH, struct packin, inode, i);
+    return (struct packin *)inohash_find(&Packin, i);
 }
 
 /*
@@ -456,7 +576,7 @@ static struct packin *check_pack(struct lsof_context *ctx,
 static struct rawsin *check_raw(struct lsof_context *ctx,
                                 INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(Rawsin, INOHASH, struct rawsin, inode, i);
+    return (struct rawsin *)inohash_find(&Rawsin, i);
 }
 
 /*
@@ -465,7 +585,7 @@ static struct rawsin *check_raw(struct lsof_context *ctx,
 static struct sctpsin *check_sctp(struct lsof_context *ctx,
                                   INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(SCTPsin, INOHASH, struct sctpsin, inode, i);
+    return (struct sctpsin *)inohash_find(&SCTPsin, i);
 }
 
 /*
@@ -506,41 +626,80 @@ static struct tcp_udp *check_inet(struct lsof_context *ctx,
     return HASH_FIND_ELEMENT(TcpUdp, TCPUDPHASH, struct tcp_udp, inode, i);
 }
 
+#if defined(HASEPTOPTS)
 /*
- * clear_netsinfo -- clear allocated INET socket info
+ * clear_netsinfo -- clear the INET socket end point info of a gather
+ *
+ * The socket information itself is kept for the next gather, whose
+ * get_tcpudp() calls replace it only if it has changed.
  */
 void clear_netsinfo(struct lsof_context *ctx) {
-    int h;                   /* hash index */
-    struct tcp_udp *ti, *tp; /* temporary pointers */
+    int h;            /* hash index */
+    struct tcp_udp *tp; /* temporary pointer */
+    pxinfo_t *pp, *pnp;
+
+    if (!TcpUdp)
+        return;
+    for (h = 0; h < TcpUdp_bucks; h++) {
+        for (tp = TcpUdp[h]; tp; tp = tp->next) {
+            for (pp = tp->pxinfo; pp; pp = pnp) {
+                pnp = pp->next;
+                (void)free((FREE_P *)pp);
+            }
+            tp->pxinfo = (pxinfo_t *)NULL;
+        }
+    }
+}
+#endif /* defined(HASEPTOPTS) */
+
+/*
+ * drop_tcpudp() -- move a protocol's IPv4 socket information to the free list
+ */
+static void drop_tcpudp(struct lsof_context *ctx, /* context */
+                        int pr)                   /* protocol: 0 = TCP,
+                                                   * 1 = UDP, 2 = UDPLITE */
+{
+    int h;                    /* hash index */
+    struct tcp_udp **tpp, *tp; /* temporary pointers */
 
 #if defined(HASEPTOPTS)
     pxinfo_t *pp, *pnp;
+
+    /*
+     * Unlink the protocol's entries from the local IPC hash buckets first.
+     * Their peers, if any, are of the same protocol.
+     */
+    if (TcpUdpIPC) {
+        for (h = 0; h < IPCBUCKS; h++) {
+            for (tpp = &TcpUdpIPC[h]; (tp = *tpp);) {
+                if (tp->proto == pr)
+                    *tpp = tp->ipc_next;
+                else
+                    tpp = &tp->ipc_next;
+            }
+        }
+    }
 #endif /* defined(HASEPTOPTS) */
 
-    if (TcpUdp) {
-        for (h = 0; h < TcpUdp_bucks; h++) {
-            if ((ti = TcpUdp[h])) {
-                do {
-                    tp = ti->next;
+    for (h = 0; h < TcpUdp_bucks; h++) {
+        for (tpp = &TcpUdp[h]; (tp = *tpp);) {
+            if (tp->proto != pr) {
+                tpp = &tp->next;
+                continue;
+            }
+            *tpp = tp->next;
 
 #if defined(HASEPTOPTS)
-                    for (pp = ti->pxinfo; pp; pp = pnp) {
-                        pnp = pp->next;
-                        (void)free((FREE_P *)pp);
-                    }
+            for (pp = tp->pxinfo; pp; pp = pnp) {
+                pnp = pp->next;
+                (void)free((FREE_P *)pp);
+            }
 #endif /* defined(HASEPTOPTS) */
 
-                    (void)free((FREE_P *)ti);
-                    ti = tp;
-                } while (ti);
-                TcpUdp[h] = (struct tcp_udp *)NULL;
-            }
+            tp->next = TcpUdpFree;
+            TcpUdpFree = tp;
         }
     }
-    if (TcpUdpIPC) {
-        for (h = 0; h < IPCBUCKS; h++)
-            TcpUdpIPC[h] = (struct tcp_udp *)NULL;
-    }
 }
 
 #if defined(HASIPv6)
@@ -550,7 +709,7 @@ void clear_netsinfo(struct lsof_context *ctx) {
 static struct rawsin *check_raw6(struct lsof_context *ctx,
                                  INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(Rawsin6, INOHASH, struct rawsin, inode, i);
+    return (struct rawsin *)inohash_find(&Rawsin6, i);
 }
 
 /*
@@ -592,41 +751,81 @@ check_inet6(struct lsof_context *ctx,
     return HASH_FIND_ELEMENT(TcpUdp6, TCPUDP6HASH, struct tcp_udp6, inode, i);
 }
 
+#    if defined(HASEPTOPTS)
 /*
- * clear_nets6info -- clear allocated INET6 socket info
+ * clear_nets6info -- clear the INET6 socket end point info of a gather
+ *
+ * The socket information itself is kept for the next gather, whose
+ * get_tcpudp6() calls replace it only if it has changed.
  */
 void clear_nets6info(struct lsof_context *ctx) {
-    int h;                    /* hash index */
-    struct tcp_udp6 *ti, *tp; /* temporary pointers */
+    int h;              /* hash index */
+    struct tcp_udp6 *tp; /* temporary pointer */
+    pxinfo_t *pp, *pnp;
+
+    if (!TcpUdp6)
+        return;
+    for (h = 0; h < TcpUdp6_bucks; h++) {
+        for (tp = TcpUdp6[h]; tp; tp = tp->next) {
+            for (pp = tp->pxinfo; pp; pp = pnp) {
+                pnp = pp->next;
+                (void)free((FREE_P *)pp);
+            }
+            tp->pxinfo = (pxinfo_t *)NULL;
+        }
+    }
+}
+#    endif /* defined(HASEPTOPTS) */
+
+/*
+ * drop_tcpudp6() -- move a protocol's IPv6 socket information to the free
+ *		     list
+ */
+static void drop_tcpudp6(struct lsof_context *ctx, /* context */
+                         int pr)                   /* protocol: 0 = TCP,
+                                                    * 1 = UDP, 2 = UDPLITE */
+{
+    int h;                      /* hash index */
+    struct tcp_udp6 **tpp, *tp; /* temporary pointers */
 
 #    if defined(HASEPTOPTS)
     pxinfo_t *pp, *pnp;
+
+    /*
+     * Unlink the protocol's entries from the local IPC hash buckets first.
+     * Their peers, if any, are of the same protocol.
+     */
+    if (TcpUdp6IPC) {
+        for (h = 0; h < IPCBUCKS; h++) {
+            for (tpp = &TcpUdp6IPC[h]; (tp = *tpp);) {
+                if (tp->proto == pr)
+                    *tpp = tp->ipc_next;
+                else
+                    tpp = &tp->ipc_next;
+            }
+        }
+    }
 #    endif /* defined(HASEPTOPTS) */
 
-    if (TcpUdp6) {
-        for (h = 0; h < TcpUdp6_bucks; h++) {
-            if ((ti = TcpUdp6[h])) {
-                do {
-                    tp = ti->next;
+    for (h = 0; h < TcpUdp6_bucks; h++) {
+        for (tpp = &TcpUdp6[h]; (tp = *tpp);) {
+            if (tp->proto != pr) {
+                tpp = &tp->next;
+                continue;
+            }
+            *tpp = tp->next;
 
 #    if defined(HASEPTOPTS)
-                    for (pp = ti->pxinfo; pp; pp = pnp) {
-                        pnp = pp->next;
-                        (void)free((FREE_P *)pp);
-                    }
+            for (pp = tp->pxinfo; pp; pp = pnp) {
+                pnp = pp->next;
+                (void)free((FREE_P *)pp);
+            }
 #    endif /* defined(HASEPTOPTS) */
 
-                    (void)free((FREE_P *)ti);
-                    ti = tp;
-                } while (ti);
-                TcpUdp6[h] = (struct tcp_udp6 *)NULL;
-            }
+            tp->next = TcpUdp6Free;
+            TcpUdp6Free = tp;
         }
     }
-    if (TcpUdp6IPC) {
-        for (h = 0; h < IPCBUCKS; h++)
-            TcpUdp6IPC[h] = (struct tcp_udp6 *)NULL;
-    }
 }
 
 #endif /* defined(HASIPv6) */
@@ -637,44 +836,61 @@ void clear_nets6info(struct lsof_context *ctx) {
 static uxsin_t *check_unix(struct lsof_context *ctx,
                            INODETYPE i) /* socket file's inode number */
 {
-    return HASH_FIND_ELEMENT(Uxsin, INOHASH, uxsin_t, inode, i);
+    return (uxsin_t *)inohash_find(&Uxsin, i);
 }
 
+#if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
 /*
- * clear_uxsinfo -- clear allocated UNIX socket info
+ * clear_uxsinfo -- clear the UNIX socket end point info of a gather
+ *
+ * The socket information itself is kept for the next gather, whose
+ * get_unix() call replaces it only if it has changed.
  */
 void clear_uxsinfo(struct lsof_context *ctx) {
-    int h;            /* hash index */
-    uxsin_t *ui, *up; /* remporary pointers */
+    size_t h;    /* hash slot index */
+    uxsin_t *up; /* temporary pointer */
+    pxinfo_t *pp, *pnp;
+
+    INOHASH_FOREACH(&Uxsin, h, up) {
+        for (pp = up->pxinfo; pp; pp = pnp) {
+            pnp = pp->next;
+            (void)free((FREE_P *)pp);
+        }
+        up->pxinfo = (pxinfo_t *)NULL;
+    }
+}
+#endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
+
+/*
+ * reset_uxsinfo -- free the UNIX socket info and size Uxsin for the sockets
+ *		    now in use
+ */
+static void reset_uxsinfo(struct lsof_context *ctx) {
+    size_t h;    /* hash slot index */
+    uxsin_t *up; /* temporary pointer */
 
 #if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
     pxinfo_t *pp, *pnp;
 #endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
 
-    if (!Uxsin)
-        return;
-    for (h = 0; h < INOBUCKS; h++) {
-        if ((ui = Uxsin[h])) {
-            do {
-                up = ui->next;
+    INOHASH_FOREACH(&Uxsin, h, up) {
 
 #if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
-                for (pp = ui->pxinfo; pp; pp = pnp) {
-                    pnp = pp->next;
-                    (void)free((FREE_P *)pp);
-                }
+        for (pp = up->pxinfo; pp; pp = pnp) {
+            pnp = pp->next;
+            (void)free((FREE_P *)pp);
+        }
 #endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
 
-                if (ui->path)
-                    (void)free((FREE_P *)ui->path);
-                if (ui->pcb)
-                    (void)free((FREE_P *)ui->pcb);
-                (void)free((FREE_P *)ui);
-                ui = up;
-            } while (ui);
-            Uxsin[h] = (uxsin_t *)NULL;
-        }
+        if (up->path)
+            (void)free((FREE_P *)up->path);
+        if (up->pcb)
+            (void)free((FREE_P *)up->pcb);
+        (void)free((FREE_P *)up);
     }
+    (void)inohash_reset(&Uxsin, 0);
+    reset_inohash(ctx, &Uxsin,
+                  get_sockstat(ctx, SockStatPath, "sockets:", "used"), "UNIX");
 }
 
 /*
@@ -683,10 +899,10 @@ void clear_uxsinfo(struct lsof_context *ctx) {
 static void get_ax25(struct lsof_context *ctx,
                      char *p) /* /proc/net/ax25 path */
 {
-    struct ax25sin *ap, *np;
+    struct ax25sin *ap;
     FILE *as;
     char buf[MAXPATHLEN], *da, *dev_ch, *ep, **fp, *sa;
-    int h;
+    size_t h;
     INODETYPE inode;
     unsigned long rq, sq, state;
     MALLOC_S len;
@@ -696,29 +912,16 @@ static void get_ax25(struct lsof_context *ctx,
     /*
      * Do second time cleanup or first time setup.
      */
-    if (AX25sin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (ap = AX25sin[h]; ap; ap = np) {
-                np = ap->next;
-                if (ap->da)
-                    (void)free((FREE_P *)ap->da);
-                if (ap->dev_ch)
-                    (void)free((FREE_P *)ap->dev_ch);
-                if (ap->sa)
-                    (void)free((FREE_P *)ap->sa);
-                (void)free((FREE_P *)ap);
-            }
-            AX25sin[h] = (struct ax25sin *)NULL;
-        }
-    } else {
-        AX25sin = (struct ax25sin **)calloc(INOBUCKS, sizeof(struct ax25sin *));
-        if (!AX25sin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d AX25 hash pointer bytes\n", Pn,
-                          (int)(INOBUCKS * sizeof(struct ax25sin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&AX25sin, h, ap) {
+        if (ap->da)
+            (void)free((FREE_P *)ap->da);
+        if (ap->dev_ch)
+            (void)free((FREE_P *)ap->dev_ch);
+        if (ap->sa)
+            (void)free((FREE_P *)ap->sa);
+        (void)free((FREE_P *)ap);
     }
+    reset_inohash(ctx, &AX25sin, 0, "AX25");
     /*
      * Open the /proc/net/ax25 file, assign a page size buffer to the stream,
      * and read it.  Store AX25 socket info in the AX25sin[] hash buckets.
@@ -752,7 +955,7 @@ static void get_ax25(struct lsof_context *ctx,
             (inode = strtoull(fp[23], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(AX25sin, INOHASH, struct ax25sin, inode, inode))
+        if (inohash_find(&AX25sin, inode))
             continue;
         /*
          * Assemble the send and receive queue values and the state.
@@ -838,7 +1041,7 @@ static void get_ax25(struct lsof_context *ctx,
         ap->sq = sq;
         ap->sqs = sqs;
         ap->state = (int)state;
-        HASH_INSERT_ELEMENT(AX25sin, INOHASH, ap, inode);
+        enter_inohash(ctx, &AX25sin, inode, (void *)ap, "AX25");
     }
     (void)fclose(as);
 }
@@ -1065,6 +1268,255 @@ static void parse_diag(struct lsof_context *ctx,
     }
 }
 
+/*
+ * get_unix_diag() -- get UNIX socket information from a single unix_diag
+ *		      NETLINK dump
+ *
+ * return: 1 if the dump completed and Uxsin is filled -- or kept, when the
+ *	   dump is the same as the last one; 0 if /proc/net/unix must be
+ *	   read instead
+ *
+ * The kernel's /proc/net/unix Num column, a hashed PCB address, isn't
+ * available from unix_diag, so the socket cookie is reported in its place.
+ */
+static int get_unix_diag(struct lsof_context *ctx) {
+    struct unix_diag_msg *dm;
+    struct nlmsghdr *hp, *mp, nlh;
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct unix_diag_req req;
+    struct rtattr *rp;
+    struct sockaddr_nl sa;
+    struct unix_diag_rqlen *rq;
+    struct unix_diag_vfs *vp;
+    char *nm, *path, *pcb;
+    int i, nb, nl, nlk, ns, rl, rv = -1;
+    size_t l = 0;
+    uint32_t *icp, pi;
+    unsigned int opt, ss;
+    uxsin_t *up;
+    static char *rb = (char *)NULL;
+    static struct uxlink { /* peer and incoming connection links,
+                            * resolved after the dump */
+        INODETYPE si;      /* socket inode number */
+        INODETYPE oi;      /* other socket inode number */
+        int ic;            /* 1 == oi is an incoming connection */
+    } *lk = (struct uxlink *)NULL;
+    static int lka = 0; /* links allocated */
+
+    if (!rb && !(rb = (char *)malloc(UNIX_DIAG_BUFSZ))) {
+        (void)fprintf(stderr,
+                      "%s: can't allocate %d bytes for unix_diag buffer\n", Pn,
+                      UNIX_DIAG_BUFSZ);
+        Error(ctx);
+    }
+    if ((ns = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+                     NETLINK_SOCK_DIAG)) < 0) {
+        UxSig.valid = 0;
+        return (0);
+    }
+    /*
+     * Build and send the dump request.
+     */
+    zeromem((char *)&sa, sizeof(sa));
+    zeromem((char *)&nlh, sizeof(nlh));
+    zeromem((char *)&req, sizeof(req));
+    zeromem((char *)&msg, sizeof(msg));
+    sa.nl_family = AF_NETLINK;
+    req.sdiag_family = AF_UNIX;
+    req.udiag_states = (uint32_t)~0;
+    req.udiag_show = UDIAG_SHOW_NAME | UDIAG_SHOW_VFS | UDIAG_SHOW_RQLEN;
+    if (FeptE)
+        req.udiag_show |= UDIAG_SHOW_PEER | UDIAG_SHOW_ICONS;
+    nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req));
+    nlh.nlmsg_flags = NLM_F_DUMP | NLM_F_REQUEST;
+    nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    iov[0].iov_base = (void *)&nlh;
+    iov[0].iov_len = sizeof(nlh);
+    iov[1].iov_base = (void *)&req;
+    iov[1].iov_len = sizeof(req);
+    msg.msg_name = (void *)&sa;
+    msg.msg_namelen = sizeof(sa);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (sendmsg(ns, &msg, 0) < 0)
+        goto get_unix_diag_exit;
+    /*
+     * Receive the socket messages and collect them.
+     */
+    for (;;) {
+        if ((nb = recv(ns, rb, UNIX_DIAG_BUFSZ, 0)) <= 0)
+            goto get_unix_diag_exit;
+        for (hp = (struct nlmsghdr *)rb; NLMSG_OK(hp, nb);
+             hp = NLMSG_NEXT(hp, nb)) {
+            if (hp->nlmsg_type == NLMSG_DONE) {
+                rv = proc_sig_note(&UxSig, l);
+                goto get_unix_diag_exit;
+            }
+            if (hp->nlmsg_type == NLMSG_ERROR)
+                goto get_unix_diag_exit;
+            if (hp->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+                hp->nlmsg_len < NLMSG_LENGTH(sizeof(*dm)))
+                continue;
+            (void)proc_sig_grow(ctx, &UxSig, l + NLMSG_ALIGN(hp->nlmsg_len),
+                                "unix_diag dump");
+            mp = (struct nlmsghdr *)(UxSig.buf + l);
+            zeromem((char *)mp, NLMSG_ALIGN(hp->nlmsg_len));
+            (void)memcpy((void *)mp, (void *)hp, hp->nlmsg_len);
+            mp->nlmsg_seq = mp->nlmsg_pid = 0;
+            l += NLMSG_ALIGN(hp->nlmsg_len);
+        }
+    }
+
+get_unix_diag_exit:
+
+    (void)close(ns);
+    if (rv < 0) {
+        UxSig.valid = 0;
+        return (0);
+    }
+    /*
+     * If the dump is the same as the last one, keep Uxsin.  Otherwise enter
+     * the information of its socket messages.
+     */
+    if (!rv && Uxsin.slot)
+        return (1);
+    (void)reset_uxsinfo(ctx);
+    for (hp = (struct nlmsghdr *)UxSig.buf, nb = (int)UxSig.len, nlk = 0;
+         NLMSG_OK(hp, nb); hp = NLMSG_NEXT(hp, nb)) {
+        dm = (struct unix_diag_msg *)NLMSG_DATA(hp);
+        if (dm->udiag_family != AF_UNIX || !dm->udiag_ino ||
+            check_unix(ctx, (INODETYPE)dm->udiag_ino))
+            continue;
+        /*
+         * Enter the cookie as the PCB.
+         */
+        if (!(pcb = (char *)malloc(19))) {
+            (void)fprintf(stderr,
+                          "%s: can't allocate 19 bytes for UNIX PCB\n", Pn);
+            Error(ctx);
+        }
+        (void)snpf(pcb, 19, "0x%08x%08x", dm->udiag_cookie[1],
+                   dm->udiag_cookie[0]);
+        /*
+         * Convert the socket state to its /proc/net/unix form.
+         */
+        opt = ss = 0;
+
+#    if defined(HASSOSTATE)
+        if (dm->udiag_state == TCP_LISTEN)
+            opt = __SO_ACCEPTCON;
+        ss = (dm->udiag_state == TCP_ESTABLISHED) ? SS_CONNECTED
+                                                  : SS_UNCONNECTED;
+#    endif /* defined(HASSOSTATE) */
+
+        up = enter_unix(ctx, (INODETYPE)dm->udiag_ino, pcb,
+                        (char *)NULL, (uint32_t)dm->udiag_type, opt, ss);
+        /*
+         * Process the attributes.
+         */
+        rl = hp->nlmsg_len - NLMSG_LENGTH(sizeof(*dm));
+        for (rp = (struct rtattr *)(dm + 1); RTA_OK(rp, rl);
+             rp = RTA_NEXT(rp, rl)) {
+            switch (rp->rta_type) {
+            case UNIX_DIAG_NAME:
+
+                /*
+                 * Form the path as /proc/net/unix does: drop a bound
+                 * path's trailing NUL; precede an abstract name with '@'
+                 * and show its NULs as '@'.
+                 */
+                if ((nl = (int)RTA_PAYLOAD(rp)) <= 0)
+                    break;
+                nm = (char *)RTA_DATA(rp);
+                if (*nm) {
+                    if (!nm[nl - 1])
+                        nl--;
+                } else {
+                    nm++;
+                    nl--;
+                }
+                if (!(path = (char *)malloc(nl + 2))) {
+                    (void)fprintf(stderr,
+                                  "%s: can't allocate %d bytes for UNIX "
+                                  "path\n",
+                                  Pn, nl + 2);
+                    Error(ctx);
+                }
+                i = 0;
+                if (nm != (char *)RTA_DATA(rp))
+                    path[i++] = '@';
+                for (; nl > 0; nl--, nm++)
+                    path[i++] = *nm ? *nm : '@';
+                path[i] = '\0';
+                up->path = path;
+                break;
+            case UNIX_DIAG_VFS:
+                if (RTA_PAYLOAD(rp) < sizeof(*vp))
+                    break;
+                vp = (struct unix_diag_vfs *)RTA_DATA(rp);
+                up->sb_def = 1;
+                up->sb_dev = (dev_t)makedev(vp->udiag_vfs_dev >> 20,
+                                            vp->udiag_vfs_dev & 0xfffff);
+                up->sb_ino = (INODETYPE)vp->udiag_vfs_ino;
+                up->sb_rdev = (dev_t)0;
+                break;
+            case UNIX_DIAG_RQLEN:
+                if (RTA_PAYLOAD(rp) < sizeof(*rq))
+                    break;
+                rq = (struct unix_diag_rqlen *)RTA_DATA(rp);
+                up->rxq = (unsigned long)rq->udiag_rqueue;
+                /*
+                 * A listening socket's "transmit queue" is its backlog
+                 * limit; report zero, as is done for TCP.
+                 */
+                up->txq = (dm->udiag_state == TCP_LISTEN)
+                              ? 0UL
+                              : (unsigned long)rq->udiag_wqueue;
+                up->qs = 1;
+                break;
+            case UNIX_DIAG_PEER:
+            case UNIX_DIAG_ICONS:
+                icp = (uint32_t *)RTA_DATA(rp);
+                for (i = 0; i + (int)sizeof(uint32_t) <= (int)RTA_PAYLOAD(rp);
+                     i += sizeof(uint32_t), icp++) {
+                    if (!(pi = *icp))
+                        continue;
+                    if (nlk >= lka) {
+                        lka += 1024;
+                        if (!(lk = (struct uxlink *)realloc(
+                                  (MALLOC_P *)lk,
+                                  lka * sizeof(struct uxlink)))) {
+                            (void)fprintf(stderr,
+                                          "%s: no space for %d UNIX "
+                                          "socket links\n",
+                                          Pn, lka);
+                            Error(ctx);
+                        }
+                    }
+                    lk[nlk].si = (INODETYPE)dm->udiag_ino;
+                    lk[nlk].oi = (INODETYPE)pi;
+                    lk[nlk++].ic = (rp->rta_type == UNIX_DIAG_ICONS);
+                }
+                break;
+            }
+        }
+    }
+    /*
+     * Once all sockets are known, link the peers and incoming connections in
+     * the order get_uxpeeri() would.
+     */
+    for (i = 0; i < nlk; i++) {
+        if (lk[i].ic)
+            fill_uxicino(ctx, lk[i].si, lk[i].oi);
+        else {
+            fill_uxpino(ctx, lk[i].si, lk[i].oi);
+            fill_uxpino(ctx, lk[i].oi, lk[i].si);
+        }
+    }
+    return (1);
+}
+
 /*
  * prt_uxs() -- print UNIX socket information
  */
@@ -1529,9 +1981,9 @@ static void get_icmp(struct lsof_context *ctx, /* context */
 {
     char buf[MAXPATHLEN], *ep, **fp, *la, *ra;
     int fl = 1;
-    int h;
+    size_t h;
     INODETYPE inode;
-    struct icmpin *np, *icmpp;
+    struct icmpin *icmpp;
     MALLOC_S lal, ral;
     static char *vbuf = (char *)NULL;
     static size_t vsz = (size_t)0;
@@ -1539,23 +1991,10 @@ static void get_icmp(struct lsof_context *ctx, /* context */
     /*
      * Do second time cleanup or first time setup.
      */
-    if (Icmpin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (icmpp = Icmpin[h]; icmpp; icmpp = np) {
-                np = icmpp->next;
-                (void)free((FREE_P *)icmpp);
-            }
-            Icmpin[h] = (struct icmpin *)NULL;
-        }
-    } else {
-        Icmpin = (struct icmpin **)calloc(INOBUCKS, sizeof(struct icmpin *));
-        if (!Icmpin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d icmp hash pointer bytes\n", Pn,
-                          (int)(INOBUCKS * sizeof(struct icmpin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&Icmpin, h, icmpp) {
+        (void)free((FREE_P *)icmpp);
     }
+    reset_inohash(ctx, &Icmpin, 0, "ICMP");
     /*
      * Open the /proc/net/icmp file, assign a page size buffer to its stream,
      * and read the file.  Store icmp info in the Icmpin[] hash buckets.
@@ -1599,7 +2038,7 @@ static void get_icmp(struct lsof_context *ctx, /* context */
             (inode = strtoull(fp[9], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(Icmpin, INOHASH, struct icmpin, inode, inode))
+        if (inohash_find(&Icmpin, inode))
             continue;
         /*
          * Save the local address, and remote address.
@@ -1644,7 +2083,7 @@ static void get_icmp(struct lsof_context *ctx, /* context */
         icmpp->lal = lal;
         icmpp->ra = ra;
         icmpp->ral = ral;
-        HASH_INSERT_ELEMENT(Icmpin, INOHASH, icmpp, inode);
+        enter_inohash(ctx, &Icmpin, inode, (void *)icmpp, "ICMP");
     }
     (void)fclose(xs);
 }
@@ -1657,10 +2096,10 @@ static void get_ipx(struct lsof_context *ctx, /* context */
 {
     char buf[MAXPATHLEN], *ep, **fp, *la, *ra;
     int fl = 1;
-    int h;
+    size_t h;
     INODETYPE inode;
     unsigned long rxq, state, txq;
-    struct ipxsin *ip, *np;
+    struct ipxsin *ip;
     MALLOC_S len;
     static char *vbuf = (char *)NULL;
     static size_t vsz = (size_t)0;
@@ -1668,27 +2107,14 @@ static void get_ipx(struct lsof_context *ctx, /* context */
     /*
      * Do second time cleanup or first time setup.
      */
-    if (Ipxsin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (ip = Ipxsin[h]; ip; ip = np) {
-                np = ip->next;
-                if (ip->la)
-                    (void)free((FREE_P *)ip->la);
-                if (ip->ra)
-                    (void)free((FREE_P *)ip->ra);
-                (void)free((FREE_P *)ip);
-            }
-            Ipxsin[h] = (struct ipxsin *)NULL;
-        }
-    } else {
-        Ipxsin = (struct ipxsin **)calloc(INOBUCKS, sizeof(struct ipxsin *));
-        if (!Ipxsin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d IPX hash pointer bytes\n", Pn,
-                          (int)(INOBUCKS * sizeof(struct ipxsin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&Ipxsin, h, ip) {
+        if (ip->la)
+            (void)free((FREE_P *)ip->la);
+        if (ip->ra)
+            (void)free((FREE_P *)ip->ra);
+        (void)free((FREE_P *)ip);
     }
+    reset_inohash(ctx, &Ipxsin, 0, "IPX");
     /*
      * Open the /proc/net/ipx file, assign a page size buffer to the stream,
      * and read it.  Store IPX socket info in the Ipxsin[] hash buckets.
@@ -1727,7 +2153,7 @@ static void get_ipx(struct lsof_context *ctx, /* context */
             (inode = strtoull(fp[6], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(Ipxsin, INOHASH, struct ipxsin, inode, inode))
+        if (inohash_find(&Ipxsin, inode))
             continue;
         /*
          * Assemble the transmit and receive queue values and the state.
@@ -1792,7 +2218,7 @@ static void get_ipx(struct lsof_context *ctx, /* context */
         ip->txq = txq;
         ip->rxq = rxq;
         ip->state = (int)state;
-        HASH_INSERT_ELEMENT(Ipxsin, INOHASH, ip, inode);
+        enter_inohash(ctx, &Ipxsin, inode, (void *)ip, "IPX");
     }
     (void)fclose(xs);
 }
@@ -1805,32 +2231,20 @@ static void get_netlink(struct lsof_context *ctx, /* context */
 {
     char buf[MAXPATHLEN], *ep, **fp;
     int fr = 1;
-    int h, pr;
+    int pr;
+    size_t h;
     INODETYPE inode;
-    struct nlksin *np, *lp;
+    struct nlksin *lp;
     static char *vbuf = (char *)NULL;
     static size_t vsz = (size_t)0;
     FILE *xs;
     /*
      * Do second time cleanup or first time setup.
      */
-    if (Nlksin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (lp = Nlksin[h]; lp; lp = np) {
-                np = lp->next;
-                (void)free((FREE_P *)lp);
-            }
-            Nlksin[h] = (struct nlksin *)NULL;
-        }
-    } else {
-        Nlksin = (struct nlksin **)calloc(INOBUCKS, sizeof(struct nlksin *));
-        if (!Nlksin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d netlink hash pointer bytes\n",
-                          Pn, (int)(INOBUCKS * sizeof(struct nlksin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&Nlksin, h, lp) {
+        (void)free((FREE_P *)lp);
     }
+    reset_inohash(ctx, &Nlksin, 0, "Netlink");
     /*
      * Open the /proc/net/netlink file, assign a page size buffer to its stream,
      * and read the file.  Store Netlink info in the Nlksin[] hash buckets.
@@ -1865,7 +2279,7 @@ static void get_netlink(struct lsof_context *ctx, /* context */
             (inode = strtoull(fp[9], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(Nlksin, INOHASH, struct nlksin, inode, inode))
+        if (inohash_find(&Nlksin, inode))
             continue;
         /*
          * Save the protocol from the Eth column.
@@ -1885,7 +2299,7 @@ static void get_netlink(struct lsof_context *ctx, /* context */
         }
         lp->inode = inode;
         lp->pr = pr;
-        HASH_INSERT_ELEMENT(Nlksin, INOHASH, lp, inode);
+        enter_inohash(ctx, &Nlksin, inode, (void *)lp, "Netlink");
     }
     (void)fclose(xs);
 }
@@ -1898,9 +2312,10 @@ static void get_pack(struct lsof_context *ctx, /* context */
 {
     char buf[MAXPATHLEN], *ep, **fp;
     int fl = 1;
-    int h, ty;
+    int ty;
+    size_t h;
     INODETYPE inode;
-    struct packin *np, *pp;
+    struct packin *pp;
     unsigned long pr;
     static char *vbuf = (char *)NULL;
     static size_t vsz = (size_t)0;
@@ -1908,23 +2323,10 @@ static void get_pack(struct lsof_context *ctx, /* context */
     /*
      * Do second time cleanup or first time setup.
      */
-    if (Packin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (pp = Packin[h]; pp; pp = np) {
-                np = pp->next;
-                (void)free((FREE_P *)pp);
-            }
-            Packin[h] = (struct packin *)NULL;
-        }
-    } else {
-        Packin = (struct packin **)calloc(INOBUCKS, sizeof(struct packin *));
-        if (!Packin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d packet hash pointer bytes\n",
-                          Pn, (int)(INOBUCKS * sizeof(struct packin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&Packin, h, pp) {
+        (void)free((FREE_P *)pp);
     }
+    reset_inohash(ctx, &Packin, 0, "packet");
     /*
      * Open the /proc/net/packet file, assign a page size buffer to its stream,
      * and read the file.  Store packet info in the Packin[] hash buckets.
@@ -1959,7 +2361,7 @@ static void get_pack(struct lsof_context *ctx, /* context */
             (inode = strtoull(fp[8], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(Packin, INOHASH, struct packin, inode, inode))
+        if (inohash_find(&Packin, inode))
             continue;
         /*
          * Save the socket type and protocol.
@@ -1984,7 +2386,7 @@ static void get_pack(struct lsof_context *ctx, /* context */
         pp->inode = inode;
         pp->pr = (int)pr;
         pp->ty = ty;
-        HASH_INSERT_ELEMENT(Packin, INOHASH, pp, inode);
+        enter_inohash(ctx, &Packin, inode, (void *)pp, "packet");
     }
     (void)fclose(xs);
 }
@@ -1996,10 +2398,10 @@ static void get_raw(struct lsof_context *ctx, /* context */
                     char *p)                  /* /proc/net/raw path */
 {
     char buf[MAXPATHLEN], *ep, **fp, *la, *ra, *sp;
-    int h;
+    size_t h;
     INODETYPE inode;
     int nf = 12;
-    struct rawsin *np, *rp;
+    struct rawsin *rp;
     MALLOC_S lal, ral, spl;
     static char *vbuf = (char *)NULL;
     static size_t vsz = (size_t)0;
@@ -2007,27 +2409,15 @@ static void get_raw(struct lsof_context *ctx, /* context */
     /*
      * Do second time cleanup or first time setup.
      */
-    if (Rawsin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (rp = Rawsin[h]; rp; rp = np) {
-                np = rp->next;
-                if (rp->la)
-                    (void)free((FREE_P *)rp->la);
-                if (rp->ra)
-                    (void)free((FREE_P *)rp->ra);
-                (void)free((FREE_P *)rp);
-            }
-            Rawsin[h] = (struct rawsin *)NULL;
-        }
-    } else {
-        Rawsin = (struct rawsin **)calloc(INOBUCKS, sizeof(struct rawsin *));
-        if (!Rawsin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d raw hash pointer bytes\n", Pn,
-                          (int)(INOBUCKS * sizeof(struct rawsin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&Rawsin, h, rp) {
+        if (rp->la)
+            (void)free((FREE_P *)rp->la);
+        if (rp->ra)
+            (void)free((FREE_P *)rp->ra);
+        (void)free((FREE_P *)rp);
     }
+    reset_inohash(ctx, &Rawsin,
+                  get_sockstat(ctx, SockStatPath, "RAW:", "inuse"), "raw");
     /*
      * Open the /proc/net/raw file, assign a page size buffer to its stream,
      * and read the file.  Store raw socket info in the Rawsin[] hash buckets.
@@ -2063,7 +2453,7 @@ static void get_raw(struct lsof_context *ctx, /* context */
             (inode = strtoull(fp[9], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(Rawsin, INOHASH, struct rawsin, inode, inode))
+        if (inohash_find(&Rawsin, inode))
             continue;
         /*
          * Save the local address, remote address, and state.
@@ -2124,7 +2514,7 @@ static void get_raw(struct lsof_context *ctx, /* context */
         rp->ral = ral;
         rp->sp = sp;
         rp->spl = spl;
-        HASH_INSERT_ELEMENT(Rawsin, INOHASH, rp, inode);
+        enter_inohash(ctx, &Rawsin, inode, (void *)rp, "raw");
     }
     (void)fclose(xs);
 }
@@ -2134,45 +2524,33 @@ static void get_raw(struct lsof_context *ctx, /* context */
  */
 static void get_sctp(struct lsof_context *ctx) {
     char buf[MAXPATHLEN], *a, *ep, **fp, *id, *la, *lp, *ra, *rp, *ta;
-    int d, err, fl, h, i, j, nf, ty, x;
+    int d, err, fl, i, j, nf, ty, x;
+    size_t h;
     INODETYPE inode;
     MALLOC_S len, plen;
-    struct sctpsin *sp, *np;
+    struct sctpsin *sp;
     FILE *ss;
     static char *vbuf = (char *)NULL;
     static size_t vsz = (size_t)0;
     /*
      * Do second time cleanup or first time setup.
      */
-    if (SCTPsin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (sp = SCTPsin[h]; sp; sp = np) {
-                np = sp->next;
-                if (sp->addr)
-                    (void)free((FREE_P *)sp->addr);
-                if (sp->assocID)
-                    (void)free((FREE_P *)sp->assocID);
-                if (sp->lport)
-                    (void)free((FREE_P *)sp->lport);
-                if (sp->rport)
-                    (void)free((FREE_P *)sp->rport);
-                if (sp->laddrs)
-                    (void)free((FREE_P *)sp->laddrs);
-                if (sp->raddrs)
-                    (void)free((FREE_P *)sp->raddrs);
-                (void)free((FREE_P *)sp);
-            }
-            SCTPsin[h] = (struct sctpsin *)NULL;
-        }
-    } else {
-        SCTPsin = (struct sctpsin **)calloc(INOBUCKS, sizeof(struct sctpsin *));
-        if (!SCTPsin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d SCTP hash pointer bytes\n", Pn,
-                          (int)(INOBUCKS * sizeof(struct sctpsin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&SCTPsin, h, sp) {
+        if (sp->addr)
+            (void)free((FREE_P *)sp->addr);
+        if (sp->assocID)
+            (void)free((FREE_P *)sp->assocID);
+        if (sp->lport)
+            (void)free((FREE_P *)sp->lport);
+        if (sp->rport)
+            (void)free((FREE_P *)sp->rport);
+        if (sp->laddrs)
+            (void)free((FREE_P *)sp->laddrs);
+        if (sp->raddrs)
+            (void)free((FREE_P *)sp->raddrs);
+        (void)free((FREE_P *)sp);
     }
+    reset_inohash(ctx, &SCTPsin, 0, "SCTP");
     /*
      * Open the /proc/net/sctp files, assign a page size buffer to the streams,
      * and read them.  Store SCTP socket info in the SCTPsin[] hash buckets.
@@ -2232,8 +2610,7 @@ static void get_sctp(struct lsof_context *ctx) {
             if (!fp[j] || !*fp[j] ||
                 (inode = strtoull(fp[j], &ep, 0)) == ULONG_MAX || !ep || *ep)
                 continue;
-            sp = HASH_FIND_ELEMENT(SCTPsin, INOHASH, struct sctpsin, inode,
-                                   inode);
+            sp = (struct sctpsin *)inohash_find(&SCTPsin, inode);
             /*
              * Set the entry type.
              */
@@ -2442,7 +2819,7 @@ static void get_sctp(struct lsof_context *ctx) {
                     Error(ctx);
                 }
                 sp->inode = inode;
-                HASH_INSERT_ELEMENT(SCTPsin, INOHASH, sp, inode);
+                enter_inohash(ctx, &SCTPsin, inode, (void *)sp, "SCTP");
             }
             sp->addr = a;
             sp->assocID = id;
@@ -2490,58 +2867,334 @@ static char *get_sctpaddrs(char **fp, /* field pointers */
     return (cp);
 }
 
+#if defined(HASINETDIAG)
 /*
- * get_tcpudp() - get IPv4 TCP, UDP or UDPLITE net info
+ * inet_diag_filter() - compile the -i and -s selections into an inet_diag
+ *			socket state mask and filter bytecode
+ *
+ * The filter is applied only when a socket the kernel omits from the dump
+ * could not be listed anyway -- i.e., when only network selections were
+ * made, or when they are ANDed with the others.  It may pass more sockets
+ * than the selections do, never fewer.
+ *
+ * return: -1 = no socket of this family and protocol can be selected
+ *	    0 = no filter bytecode
+ *	   >0 = length of the bytecode in bc[]
  */
-static void get_tcpudp(struct lsof_context *ctx, /* context */
-                       char *p,                  /* /proc/net/{tcp,udp} path */
-                       int pr,                   /* protocol: 0 = TCP, 1 = UDP,
-                                                  *           2 = UDPLITE */
-                       int clr)                  /* 1 == clear the table */
-{
-    char buf[MAXPATHLEN], *ep, **fp;
-    unsigned long faddr, fport, laddr, lport, rxq, state, txq;
-    FILE *fs;
-    int h, nf;
-    INODETYPE inode;
-    struct tcp_udp *np, *tp;
-    static char *vbuf = (char *)NULL;
-    static size_t vsz = (size_t)0;
-
-#if defined(HASEPTOPTS)
-    pxinfo_t *pp, *pnp;
-#endif /* defined(HASEPTOPTS) */
 
+static int inet_diag_filter(struct lsof_context *ctx, /* context */
+                            int af,              /* AF_INET or AF_INET6 */
+                            int pr,              /* protocol: 0 = TCP,
+                                                  * 1 = UDP, 2 = UDPLITE */
+                            unsigned char *bc,   /* bytecode buffer */
+                            int bcsz,            /* sizeof(bc) */
+                            uint32_t *states)    /* state mask return */
+{
+    int al, i, j, lt, net, side, st;
+    struct inet_diag_bc_op *op;
+    struct inet_diag_hostcond *hc;
+    struct nwad *n;
+    int nt = 0;        /* number of terms */
+    int ts[2 * 64 + 1]; /* term start offsets */
+    int x = 0;         /* bc[] index */
+    static char *pn[] = {"TCP", "UDP", "UDPLITE"};
+
+    *states = (uint32_t)~0;
+    if (FeptE)
+        return (0);
+    if (!Selinet && !(Fand && (Selflags & (SELNA | SELNET))))
+        return (0);
     /*
-     * Delete previous table contents.
+     * Excluded and uninteresting states are never listed.
      */
-    if (TcpUdp) {
-        if (clr) {
-            for (h = 0; h < TcpUdp_bucks; h++) {
-                for (tp = TcpUdp[h]; tp; tp = np) {
-                    np = tp->next;
-
-#if defined(HASEPTOPTS)
-                    for (pp = tp->pxinfo; pp; pp = pnp) {
-                        pnp = pp->next;
-                        (void)free((FREE_P *)pp);
-                    }
-#endif /* defined(HASEPTOPTS) */
-
-                    (void)free((FREE_P *)tp);
+    for (st = 0; st < 32; st++) {
+        i = st + TcpStOff;
+        if (i < 0 || i >= TcpNstates)
+            continue;
+        if ((TcpStXn && TcpStX[i]) || (TcpStIn && !TcpStI[i]))
+            *states &= ~((uint32_t)1 << st);
+    }
+    /*
+     * See if the -i[46] selection covers this family.
+     */
+    net = (Selflags & SELNET) && (!FnetTy || (FnetTy == 4 && af == AF_INET) ||
+                                  (FnetTy == 6 && af == AF_INET6));
+    if (Fand) {
+        if ((Selflags & SELNET) && !net)
+            return (-1);
+        if (!(Selflags & SELNA) || !Nwad)
+            return (0);
+    } else {
+        if (net)
+            return (0);
+        if (!(Selflags & SELNA) || !Nwad)
+            return (-1);
+    }
+    /*
+     * Compile the network address selections that may match a socket of this
+     * family and protocol into terms, each matching the local or the foreign
+     * address and port of one selection.
+     */
+    for (n = Nwad; n; n = n->next) {
+        if (n->proto && strcasecmp(n->proto, pn[pr]))
+            continue;
+        if (n->af == AF_INET6 && af == AF_INET)
+            continue;
+        al = (n->af == AF_INET6) ? 16 : ((n->af == AF_INET) ? 4 : 0);
+        for (i = lt = 0; i < al; i++) {
+            if (n->a[i])
+                lt = 1;
+        }
+        if (!n->af && n->sport == -1)
+            return (0); /* a term that matches every socket */
+        for (side = 0; side < 2; side++) {
+            if (nt >= (int)(sizeof(ts) / sizeof(ts[0])) - 1 ||
+                (x + 48) > bcsz)
+                return (0);
+            ts[nt++] = x;
+            if (n->af || (n->sport != -1 && n->sport == n->eport)) {
+                op = (struct inet_diag_bc_op *)&bc[x];
+                op->code = side ? INET_DIAG_BC_D_COND : INET_DIAG_BC_S_COND;
+                op->yes = sizeof(*op) + sizeof(*hc) + al;
+                hc = (struct inet_diag_hostcond *)(op + 1);
+                hc->family = n->af ? n->af : AF_UNSPEC;
+                hc->prefix_len = lt ? n->plen : 0;
+                hc->port = (n->sport != -1 && n->sport == n->eport) ? n->sport
+                                                                    : -1;
+                (void)memcpy((void *)(hc + 1), (void *)n->a, al);
+                x += op->yes;
+            }
+            if (n->sport != -1 && n->sport != n->eport) {
+                for (j = 0; j < 2; j++) {
+                    op = (struct inet_diag_bc_op *)&bc[x];
+                    if (side)
+                        op->code = j ? INET_DIAG_BC_D_LE : INET_DIAG_BC_D_GE;
+                    else
+                        op->code = j ? INET_DIAG_BC_S_LE : INET_DIAG_BC_S_GE;
+                    op->yes = 2 * sizeof(*op);
+                    (op + 1)->code = (op + 1)->yes = 0;
+                    (op + 1)->no = j ? n->eport : n->sport;
+                    x += op->yes;
                 }
-                TcpUdp[h] = (struct tcp_udp *)NULL;
             }
-#if defined(HASEPTOPTS)
-            if (FeptE)
-                for (h = 0; h < IPCBUCKS; h++)
-                    TcpUdpIPC[h] = (struct tcp_udp *)NULL;
-#endif /* defined(HASEPTOPTS) */
+            /*
+             * A term that passes jumps to the end of the bytecode.
+             */
+            op = (struct inet_diag_bc_op *)&bc[x];
+            op->code = INET_DIAG_BC_JMP;
+            op->yes = sizeof(*op);
+            op->no = 0;
+            x += op->yes;
         }
+    }
+    if (!nt)
+        return (-1);
+    /*
+     * Set the jump offsets: a failed comparison goes to the next term -- or
+     * past the end, rejecting the socket, from the last one.
+     */
+    ts[nt] = x;
+    for (i = 0; i < nt; i++) {
+        for (j = ts[i]; j < ts[i + 1]; j += op->yes) {
+            op = (struct inet_diag_bc_op *)&bc[j];
+            if (op->code == INET_DIAG_BC_JMP)
+                op->no = x - j;
+            else
+                op->no = ((i + 1 < nt) ? ts[i + 1] : (x + 4)) - j;
+        }
+    }
+    return (x);
+}
+
+/*
+ * enter_inet_diag() - enter the IPv4 or IPv6 TCP, UDP or UDPLITE socket
+ *		       information of an inet_diag dump
+ */
+
+static void enter_inet_diag(struct lsof_context *ctx, /* context */
+                            struct proc_sig *ps, /* get_inet_diag() dump */
+                            int pr)              /* protocol: 0 = TCP,
+                                                  * 1 = UDP, 2 = UDPLITE */
+{
+    struct inet_diag_msg *dm;
+    struct nlmsghdr *hp;
+    int nb;
+    unsigned long txq;
+
+#    if defined(HASIPv6)
+    struct in6_addr fa6, la6;
+#    endif /* defined(HASIPv6) */
+
+    for (hp = (struct nlmsghdr *)ps->buf, nb = (int)ps->len; NLMSG_OK(hp, nb);
+         hp = NLMSG_NEXT(hp, nb)) {
+        dm = (struct inet_diag_msg *)NLMSG_DATA(hp);
         /*
-         * If no hash buckets have been allocated, do so now.
+         * The /proc/net/tcp transmit queue value of a listening socket is
+         * zero, not the backlog limit inet_diag reports.
          */
-    } else {
+        txq = (!pr && dm->idiag_state == TCP_LISTEN)
+                  ? 0
+                  : (unsigned long)dm->idiag_wqueue;
+        if (dm->idiag_family == AF_INET)
+            (void)enter_tcpudp(
+                ctx, (INODETYPE)dm->idiag_inode,
+                (unsigned long)dm->id.idiag_src[0],
+                (int)ntohs(dm->id.idiag_sport),
+                (unsigned long)dm->id.idiag_dst[0],
+                (int)ntohs(dm->id.idiag_dport), txq,
+                (unsigned long)dm->idiag_rqueue, pr, (int)dm->idiag_state);
+
+#    if defined(HASIPv6)
+        else if (dm->idiag_family == AF_INET6) {
+            (void)memcpy((void *)&la6, (void *)dm->id.idiag_src, sizeof(la6));
+            (void)memcpy((void *)&fa6, (void *)dm->id.idiag_dst, sizeof(fa6));
+            (void)enter_tcpudp6(
+                ctx, (INODETYPE)dm->idiag_inode, &la6,
+                (int)ntohs(dm->id.idiag_sport), &fa6,
+                (int)ntohs(dm->id.idiag_dport), txq,
+                (unsigned long)dm->idiag_rqueue, pr, (int)dm->idiag_state);
+        }
+#    endif /* defined(HASIPv6) */
+    }
+}
+
+/*
+ * get_inet_diag() - get IPv4 or IPv6 TCP, UDP or UDPLITE socket information
+ *		     with a NETLINK inet_diag dump
+ *
+ * The socket messages of the dump are collected in the signature's buffer,
+ * for enter_inet_diag().  Their timer fields, which lsof doesn't report, are
+ * zeroed, so that the dump of an idle table is the same from one gather to
+ * the next.
+ *
+ * return: 1 = the dump differs from the last one
+ *	   0 = the dump is the same as the last one
+ *	  -1 = the /proc/net file must be read instead
+ */
+
+static int get_inet_diag(struct lsof_context *ctx, /* context */
+                         int af,                   /* AF_INET or AF_INET6 */
+                         int pr,                   /* protocol: 0 = TCP,
+                                                    * 1 = UDP, 2 = UDPLITE */
+                         struct proc_sig *ps)      /* dump signature */
+{
+    unsigned char bc[INET_DIAG_BCSZ];
+    int bcl, nb, ns, rv = -1;
+    size_t l = 0;
+    struct inet_diag_msg *dm;
+    struct nlmsghdr *hp, *mp, nlh;
+    struct iovec iov[4];
+    struct msghdr msg;
+    struct nlattr nla;
+    struct inet_diag_req_v2 req;
+    struct sockaddr_nl sa;
+    uint32_t states;
+    static char *rb = (char *)NULL;
+
+    if ((bcl = inet_diag_filter(ctx, af, pr, bc, sizeof(bc), &states)) < 0)
+        return (proc_sig_note(ps, 0));
+    if (!rb && !(rb = (char *)malloc(INET_DIAG_BUFSZ))) {
+        (void)fprintf(stderr,
+                      "%s: can't allocate %d bytes for inet_diag buffer\n", Pn,
+                      INET_DIAG_BUFSZ);
+        Error(ctx);
+    }
+    if ((ns = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+                     NETLINK_SOCK_DIAG)) < 0) {
+        ps->valid = 0;
+        return (-1);
+    }
+    /*
+     * Build and send the dump request, with the filter bytecode, if any.
+     */
+    zeromem((char *)&sa, sizeof(sa));
+    zeromem((char *)&nlh, sizeof(nlh));
+    zeromem((char *)&req, sizeof(req));
+    zeromem((char *)&msg, sizeof(msg));
+    sa.nl_family = AF_NETLINK;
+    req.sdiag_family = (unsigned char)af;
+    req.sdiag_protocol =
+        (pr == 0) ? IPPROTO_TCP : ((pr == 1) ? IPPROTO_UDP : IPPROTO_UDPLITE);
+    req.idiag_states = states;
+    nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req));
+    nlh.nlmsg_flags = NLM_F_DUMP | NLM_F_REQUEST;
+    nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    iov[0].iov_base = (void *)&nlh;
+    iov[0].iov_len = sizeof(nlh);
+    iov[1].iov_base = (void *)&req;
+    iov[1].iov_len = sizeof(req);
+    msg.msg_iovlen = 2;
+    if (bcl) {
+        nla.nla_type = INET_DIAG_REQ_BYTECODE;
+        nla.nla_len = NLA_HDRLEN + bcl;
+        nlh.nlmsg_len += NLA_ALIGN(nla.nla_len);
+        iov[2].iov_base = (void *)&nla;
+        iov[2].iov_len = NLA_HDRLEN;
+        iov[3].iov_base = (void *)bc;
+        iov[3].iov_len = NLA_ALIGN(bcl);
+        msg.msg_iovlen = 4;
+    }
+    msg.msg_name = (void *)&sa;
+    msg.msg_namelen = sizeof(sa);
+    msg.msg_iov = iov;
+    if (sendmsg(ns, &msg, 0) < 0)
+        goto get_inet_diag_exit;
+    /*
+     * Receive the socket messages and collect them.
+     */
+    for (;;) {
+        if ((nb = recv(ns, rb, INET_DIAG_BUFSZ, 0)) <= 0)
+            goto get_inet_diag_exit;
+        for (hp = (struct nlmsghdr *)rb; NLMSG_OK(hp, nb);
+             hp = NLMSG_NEXT(hp, nb)) {
+            if (hp->nlmsg_type == NLMSG_DONE) {
+                rv = proc_sig_note(ps, l);
+                goto get_inet_diag_exit;
+            }
+            if (hp->nlmsg_type == NLMSG_ERROR)
+                goto get_inet_diag_exit;
+            if (hp->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+                hp->nlmsg_len < NLMSG_LENGTH(sizeof(*dm)))
+                continue;
+            (void)proc_sig_grow(ctx, ps, l + NLMSG_ALIGN(hp->nlmsg_len),
+                                "inet_diag dump");
+            mp = (struct nlmsghdr *)(ps->buf + l);
+            zeromem((char *)mp, NLMSG_ALIGN(hp->nlmsg_len));
+            (void)memcpy((void *)mp, (void *)hp, hp->nlmsg_len);
+            mp->nlmsg_seq = mp->nlmsg_pid = 0;
+            dm = (struct inet_diag_msg *)NLMSG_DATA(mp);
+            dm->idiag_timer = dm->idiag_retrans = 0;
+            dm->idiag_expires = 0;
+            l += NLMSG_ALIGN(hp->nlmsg_len);
+        }
+    }
+
+get_inet_diag_exit:
+
+    (void)close(ns);
+    if (rv < 0)
+        ps->valid = 0;
+    return (rv);
+}
+#endif /* defined(HASINETDIAG) */
+
+/*
+ * get_tcpudp() - get IPv4 TCP, UDP or UDPLITE net info
+ */
+static void get_tcpudp(struct lsof_context *ctx, /* context */
+                       char *p,                  /* /proc/net/{tcp,udp} path */
+                       int pr)                   /* protocol: 0 = TCP, 1 = UDP,
+                                                  *           2 = UDPLITE */
+{
+    char buf[MAXPATHLEN], *ep, **fp;
+    unsigned long faddr, fport, laddr, lport, rxq, state, txq;
+    FILE *fs;
+    int h, nf, rv;
+    INODETYPE inode;
+    /*
+     * If no hash buckets have been allocated, do so now.
+     */
+    if (!TcpUdp) {
 
         /*
          * Open the /proc/net/sockstat file and establish the hash bucket
@@ -2583,12 +3236,30 @@ static void get_tcpudp(struct lsof_context *ctx, /* context */
         }
 #endif /* defined(HASEPTOPTS) */
     }
+
     /*
-     * Open the /proc/net file, assign a page size buffer to the stream, and
-     * read it.
+     * Get the protocol's socket information from a NETLINK inet_diag dump, if
+     * possible; otherwise read the /proc/net file.  If it hasn't changed
+     * since the last gather, keep the protocol's table entries.  Otherwise
+     * replace them.
      */
-    if (!(fs = open_proc_stream(ctx, p, "r", &vbuf, &vsz, 0)))
-        return;
+
+#if defined(HASINETDIAG)
+    if ((rv = get_inet_diag(ctx, AF_INET, pr, &TcpUdpSig[pr])) >= 0) {
+        if (rv) {
+            (void)drop_tcpudp(ctx, pr);
+            (void)enter_inet_diag(ctx, &TcpUdpSig[pr], pr);
+        }
+        goto get_tcpudp_exit;
+    }
+#endif /* defined(HASINETDIAG) */
+
+    if (!(rv = proc_sig_read(ctx, p, &TcpUdpSig[pr])))
+        goto get_tcpudp_exit;
+    (void)drop_tcpudp(ctx, pr);
+    if ((rv < 0) || !TcpUdpSig[pr].len ||
+        !(fs = fmemopen((void *)TcpUdpSig[pr].buf, TcpUdpSig[pr].len, "r")))
+        goto get_tcpudp_exit;
     nf = 12;
     while (fgets(buf, sizeof(buf) - 1, fs)) {
         if (get_fields(ctx, buf, (nf == 12) ? (char *)NULL : ":", &fp,
@@ -2650,39 +3321,12 @@ static void get_tcpudp(struct lsof_context *ctx, /* context */
         if (!fp[13] || !*fp[13] ||
             (inode = strtoull(fp[13], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
-        if (HASH_FIND_ELEMENT(TcpUdp, TCPUDPHASH, struct tcp_udp, inode, inode))
-            continue;
-        /*
-         * Create a new entry and link it to its hash bucket.
-         */
-        if (!(tp = (struct tcp_udp *)malloc(sizeof(struct tcp_udp)))) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d bytes for tcp_udp struct\n",
-                          Pn, (int)sizeof(struct tcp_udp));
-            Error(ctx);
-        }
-        tp->inode = inode;
-        tp->faddr = faddr;
-        tp->fport = (int)(fport & 0xffff);
-        tp->laddr = laddr;
-        tp->lport = (int)(lport & 0xffff);
-        tp->txq = txq;
-        tp->rxq = rxq;
-        tp->proto = pr;
-        tp->state = (int)state;
-        HASH_INSERT_ELEMENT(TcpUdp, TCPUDPHASH, tp, inode);
-#if defined(HASEPTOPTS)
-        tp->pxinfo = (pxinfo_t *)NULL;
-        if (FeptE) {
-            tp->ipc_peer = (struct tcp_udp *)NULL;
-            if (tp->state == TCP_ESTABLISHED) {
-                int i = TCPUDP_IPC_HASH(tp);
-                tp->ipc_next = TcpUdpIPC[i];
-                TcpUdpIPC[i] = tp;
-            }
-        }
-#endif /* defined(HASEPTOPTS) */
+        (void)enter_tcpudp(ctx, inode, laddr, (int)(lport & 0xffff), faddr,
+                           (int)(fport & 0xffff), txq, rxq, pr, (int)state);
     }
+    (void)fclose(fs);
+
+get_tcpudp_exit:
 
 #if defined(HASEPTOPTS)
     /*
@@ -2692,7 +3336,61 @@ static void get_tcpudp(struct lsof_context *ctx, /* context */
         get_netpeeri(ctx);
 #endif /* defined(HASEPTOPTS) */
 
-    (void)fclose(fs);
+    return;
+}
+
+/*
+ * enter_tcpudp() - enter IPv4 TCP, UDP or UDPLITE socket information
+ */
+static void enter_tcpudp(struct lsof_context *ctx, /* context */
+                         INODETYPE inode,          /* socket inode number */
+                         unsigned long laddr,      /* local address */
+                         int lport,                /* local port */
+                         unsigned long faddr,      /* foreign address */
+                         int fport,                /* foreign port */
+                         unsigned long txq,        /* transmit queue */
+                         unsigned long rxq,        /* receive queue */
+                         int pr,                   /* protocol: 0 = TCP,
+                                                    * 1 = UDP, 2 = UDPLITE */
+                         int state)                /* protocol state */
+{
+    struct tcp_udp *tp;
+
+    if (HASH_FIND_ELEMENT(TcpUdp, TCPUDPHASH, struct tcp_udp, inode, inode))
+        return;
+    /*
+     * Take an entry from the free list, or create a new one, and link it to
+     * its hash bucket.
+     */
+    if ((tp = TcpUdpFree))
+        TcpUdpFree = tp->next;
+    else if (!(tp = (struct tcp_udp *)malloc(sizeof(struct tcp_udp)))) {
+        (void)fprintf(stderr,
+                      "%s: can't allocate %d bytes for tcp_udp struct\n", Pn,
+                      (int)sizeof(struct tcp_udp));
+        Error(ctx);
+    }
+    tp->inode = inode;
+    tp->faddr = faddr;
+    tp->fport = fport;
+    tp->laddr = laddr;
+    tp->lport = lport;
+    tp->txq = txq;
+    tp->rxq = rxq;
+    tp->proto = pr;
+    tp->state = state;
+    HASH_INSERT_ELEMENT(TcpUdp, TCPUDPHASH, tp, inode);
+#if defined(HASEPTOPTS)
+    tp->pxinfo = (pxinfo_t *)NULL;
+    if (FeptE) {
+        tp->ipc_peer = (struct tcp_udp *)NULL;
+        if (tp->state == TCP_ESTABLISHED) {
+            int i = TCPUDP_IPC_HASH(tp);
+            tp->ipc_next = TcpUdpIPC[i];
+            TcpUdpIPC[i] = tp;
+        }
+    }
+#endif /* defined(HASEPTOPTS) */
 }
 
 #if defined(HASIPv6)
@@ -2703,10 +3401,10 @@ static void get_raw6(struct lsof_context *ctx, /* context */
                      char *p)                  /* /proc/net/raw path */
 {
     char buf[MAXPATHLEN], *ep, **fp, *la, *ra, *sp;
-    int h;
+    size_t h;
     INODETYPE inode;
     int nf = 12;
-    struct rawsin *np, *rp;
+    struct rawsin *rp;
     MALLOC_S lal, ral, spl;
     static char *vbuf = (char *)NULL;
     static size_t vsz = (size_t)0;
@@ -2714,29 +3412,17 @@ static void get_raw6(struct lsof_context *ctx, /* context */
     /*
      * Do second time cleanup or first time setup.
      */
-    if (Rawsin6) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (rp = Rawsin6[h]; rp; rp = np) {
-                np = rp->next;
-                if (rp->la)
-                    (void)free((FREE_P *)rp->la);
-                if (rp->ra)
-                    (void)free((FREE_P *)rp->ra);
-                if (rp->sp)
-                    (void)free((FREE_P *)rp->sp);
-                (void)free((FREE_P *)rp);
-            }
-            Rawsin6[h] = (struct rawsin *)NULL;
-        }
-    } else {
-        Rawsin6 = (struct rawsin **)calloc(INOBUCKS, sizeof(struct rawsin *));
-        if (!Rawsin6) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d raw6 hash pointer bytes\n", Pn,
-                          (int)(INOBUCKS * sizeof(struct rawsin *)));
-            Error(ctx);
-        }
+    INOHASH_FOREACH(&Rawsin6, h, rp) {
+        if (rp->la)
+            (void)free((FREE_P *)rp->la);
+        if (rp->ra)
+            (void)free((FREE_P *)rp->ra);
+        if (rp->sp)
+            (void)free((FREE_P *)rp->sp);
+        (void)free((FREE_P *)rp);
     }
+    reset_inohash(ctx, &Rawsin6,
+                  get_sockstat(ctx, SockStatPath6, "RAW6:", "inuse"), "raw6");
     /*
      * Open the /proc/net/raw6 file, assign a page size buffer to the stream,
      * and read it.  Store raw6 socket info in the Rawsin6[] hash buckets.
@@ -2772,7 +3458,7 @@ static void get_raw6(struct lsof_context *ctx, /* context */
             (inode = strtoull(fp[9], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(Rawsin6, INOHASH, struct rawsin, inode, inode))
+        if (inohash_find(&Rawsin6, inode))
             continue;
         /*
          * Save the local address, remote address, and state.
@@ -2834,7 +3520,7 @@ static void get_raw6(struct lsof_context *ctx, /* context */
         rp->ral = ral;
         rp->sp = sp;
         rp->spl = spl;
-        HASH_INSERT_ELEMENT(Rawsin6, INOHASH, rp, inode);
+        enter_inohash(ctx, &Rawsin6, inode, (void *)rp, "raw6");
     }
     (void)fclose(xs);
 }
@@ -2844,50 +3530,19 @@ static void get_raw6(struct lsof_context *ctx, /* context */
  */
 static void get_tcpudp6(struct lsof_context *ctx, /* context */
                         char *p,                  /* /proc/net/{tcp,udp} path */
-                        int pr,  /* protocol: 0 = TCP, 1 = UDP */
-                        int clr) /* 1 == clear the table */
+                        int pr) /* protocol: 0 = TCP, 1 = UDP,
+                                 *           2 = UDPLITE */
 {
     char buf[MAXPATHLEN], *ep, **fp;
     struct in6_addr faddr, laddr;
     unsigned long fport, lport, rxq, state, txq;
     FILE *fs;
-    int h, i, nf;
+    int h, i, nf, rv;
     INODETYPE inode;
-    struct tcp_udp6 *np6, *tp6;
-    static char *vbuf = (char *)NULL;
-    static size_t vsz = (size_t)0;
-
-#    if defined(HASEPTOPTS)
-    pxinfo_t *pp, *pnp;
-#    endif /* defined(HASEPTOPTS) */
-
     /*
-     * Delete previous table contents.  Allocate a table for the first time.
+     * Allocate a table for the first time.
      */
-    if (TcpUdp6) {
-        if (clr) {
-            for (h = 0; h < TcpUdp6_bucks; h++) {
-                for (tp6 = TcpUdp6[h]; tp6; tp6 = np6) {
-                    np6 = tp6->next;
-
-#    if defined(HASEPTOPTS)
-                    for (pp = tp6->pxinfo; pp; pp = pnp) {
-                        pnp = pp->next;
-                        (void)free((FREE_P *)pp);
-                    }
-#    endif /* defined(HASEPTOPTS) */
-
-                    (void)free((FREE_P *)tp6);
-                }
-                TcpUdp6[h] = (struct tcp_udp6 *)NULL;
-            }
-#    if defined(HASEPTOPTS)
-            if (FeptE)
-                for (h = 0; h < IPCBUCKS; h++)
-                    TcpUdp6IPC[h] = (struct tcp_udp6 *)NULL;
-#    endif /* defined(HASEPTOPTS) */
-        }
-    } else {
+    if (!TcpUdp6) {
 
         /*
          * Open the /proc/net/sockstat6 file and establish the hash bucket
@@ -2942,12 +3597,29 @@ static void get_tcpudp6(struct lsof_context *ctx, /* context */
         }
 #    endif /* defined(HASEPTOPTS) */
     }
+
     /*
-     * Open the /proc/net file, assign a page size buffer to the stream,
-     * and read it.
+     * Get the protocol's socket information from a NETLINK inet_diag dump, if
+     * possible; otherwise read the /proc/net file.  Replace the protocol's
+     * table entries only if it has changed since the last gather.
      */
-    if (!(fs = open_proc_stream(ctx, p, "r", &vbuf, &vsz, 0)))
-        return;
+
+#    if defined(HASINETDIAG)
+    if ((rv = get_inet_diag(ctx, AF_INET6, pr, &TcpUdp6Sig[pr])) >= 0) {
+        if (rv) {
+            (void)drop_tcpudp6(ctx, pr);
+            (void)enter_inet_diag(ctx, &TcpUdp6Sig[pr], pr);
+        }
+        goto get_tcpudp6_exit;
+    }
+#    endif /* defined(HASINETDIAG) */
+
+    if (!(rv = proc_sig_read(ctx, p, &TcpUdp6Sig[pr])))
+        goto get_tcpudp6_exit;
+    (void)drop_tcpudp6(ctx, pr);
+    if ((rv < 0) || !TcpUdp6Sig[pr].len ||
+        !(fs = fmemopen((void *)TcpUdp6Sig[pr].buf, TcpUdp6Sig[pr].len, "r")))
+        goto get_tcpudp6_exit;
     nf = 12;
     while (fgets(buf, sizeof(buf) - 1, fs)) {
         if (get_fields(ctx, buf, (nf == 12) ? (char *)NULL : ":", &fp,
@@ -3005,40 +3677,13 @@ static void get_tcpudp6(struct lsof_context *ctx, /* context */
         if (!fp[13] || !*fp[13] ||
             (inode = strtoull(fp[13], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
-        if (HASH_FIND_ELEMENT(TcpUdp6, TCPUDP6HASH, struct tcp_udp6, inode,
-                              inode))
-            continue;
-        /*
-         * Create a new entry and link it to its hash bucket.
-         */
-        if (!(tp6 = (struct tcp_udp6 *)malloc(sizeof(struct tcp_udp6)))) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d bytes for tcp_udp6 struct\n",
-                          Pn, (int)sizeof(struct tcp_udp6));
-            Error(ctx);
-        }
-        tp6->inode = inode;
-        tp6->faddr = faddr;
-        tp6->fport = (int)(fport & 0xffff);
-        tp6->laddr = laddr;
-        tp6->lport = (int)(lport & 0xffff);
-        tp6->txq = txq;
-        tp6->rxq = rxq;
-        tp6->proto = pr;
-        tp6->state = (int)state;
-        HASH_INSERT_ELEMENT(TcpUdp6, TCPUDP6HASH, tp6, inode);
-#    if defined(HASEPTOPTS)
-        tp6->pxinfo = (pxinfo_t *)NULL;
-        if (FeptE) {
-            tp6->ipc_peer = (struct tcp_udp6 *)NULL;
-            if (tp6->state == TCP_ESTABLISHED) {
-                int i = TCPUDP6_IPC_HASH(tp6);
-                tp6->ipc_next = TcpUdp6IPC[i];
-                TcpUdp6IPC[i] = tp6;
-            }
-        }
-#    endif /* defined(HASEPTOPTS) */
+        (void)enter_tcpudp6(ctx, inode, &laddr, (int)(lport & 0xffff), &faddr,
+                            (int)(fport & 0xffff), txq, rxq, pr, (int)state);
     }
+    (void)fclose(fs);
+
+get_tcpudp6_exit:
+
 #    if defined(HASEPTOPTS)
     /*
      * If endpoint info has been requested, link INET6 socket peer info.
@@ -3047,10 +3692,106 @@ static void get_tcpudp6(struct lsof_context *ctx, /* context */
         get_net6peeri(ctx);
 #    endif /* defined(HASEPTOPTS) */
 
-    (void)fclose(fs);
+    return;
+}
+
+/*
+ * enter_tcpudp6() - enter IPv6 TCP, UDP or UDPLITE socket information
+ */
+static void enter_tcpudp6(struct lsof_context *ctx, /* context */
+                          INODETYPE inode,          /* socket inode number */
+                          struct in6_addr *laddr,   /* local address */
+                          int lport,                /* local port */
+                          struct in6_addr *faddr,   /* foreign address */
+                          int fport,                /* foreign port */
+                          unsigned long txq,        /* transmit queue */
+                          unsigned long rxq,        /* receive queue */
+                          int pr,                   /* protocol: 0 = TCP,
+                                                     * 1 = UDP, 2 = UDPLITE */
+                          int state)                /* protocol state */
+{
+    struct tcp_udp6 *tp6;
+
+    if (HASH_FIND_ELEMENT(TcpUdp6, TCPUDP6HASH, struct tcp_udp6, inode, inode))
+        return;
+    /*
+     * Take an entry from the free list, or create a new one, and link it to
+     * its hash bucket.
+     */
+    if ((tp6 = TcpUdp6Free))
+        TcpUdp6Free = tp6->next;
+    else if (!(tp6 = (struct tcp_udp6 *)malloc(sizeof(struct tcp_udp6)))) {
+        (void)fprintf(stderr,
+                      "%s: can't allocate %d bytes for tcp_udp6 struct\n", Pn,
+                      (int)sizeof(struct tcp_udp6));
+        Error(ctx);
+    }
+    tp6->inode = inode;
+    tp6->faddr = *faddr;
+    tp6->fport = fport;
+    tp6->laddr = *laddr;
+    tp6->lport = lport;
+    tp6->txq = txq;
+    tp6->rxq = rxq;
+    tp6->proto = pr;
+    tp6->state = state;
+    HASH_INSERT_ELEMENT(TcpUdp6, TCPUDP6HASH, tp6, inode);
+#    if defined(HASEPTOPTS)
+    tp6->pxinfo = (pxinfo_t *)NULL;
+    if (FeptE) {
+        tp6->ipc_peer = (struct tcp_udp6 *)NULL;
+        if (tp6->state == TCP_ESTABLISHED) {
+            int i = TCPUDP6_IPC_HASH(tp6);
+            tp6->ipc_next = TcpUdp6IPC[i];
+            TcpUdp6IPC[i] = tp6;
+        }
+    }
+#    endif /* defined(HASEPTOPTS) */
 }
 #endif /* defined(HASIPv6) */
 
+/*
+ * enter_unix() - allocate a UNIX socket info structure and link it to its
+ *		  Uxsin hash bucket
+ */
+static uxsin_t *enter_unix(struct lsof_context *ctx, /* context */
+                           INODETYPE inode,          /* socket inode */
+                           char *pcb,        /* malloc'd PCB (or NULL) */
+                           char *path,       /* malloc'd path (or NULL) */
+                           uint32_t ty,      /* socket type */
+                           unsigned int opt, /* socket options */
+                           unsigned int ss)  /* socket state */
+{
+    uxsin_t *up;
+
+    if (!(up = (uxsin_t *)malloc(sizeof(uxsin_t)))) {
+        (void)fprintf(stderr, "%s: can't allocate %d bytes for uxsin struct\n",
+                      Pn, (int)sizeof(uxsin_t));
+        Error(ctx);
+    }
+    up->inode = inode;
+    up->pcb = pcb;
+    up->path = path;
+    up->sb_def = 0;
+    up->ty = ty;
+    up->opt = opt;
+    up->ss = ss;
+    up->rxq = up->txq = 0UL;
+    up->qs = 0;
+
+#if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
+    /*
+     * Clean UNIX socket endpoint values.
+     */
+    up->icstat = 0;
+    up->pxinfo = (pxinfo_t *)NULL;
+    up->peer = up->icons = (uxsin_t *)NULL;
+#endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
+
+    enter_inohash(ctx, &Uxsin, inode, (void *)up, "UNIX");
+    return (up);
+}
+
 /*
  * get_unix() - get UNIX net info
  */
@@ -3059,56 +3800,33 @@ static void get_unix(struct lsof_context *ctx, /* context */
 {
     char buf[MAXPATHLEN], *ep, **fp, *path, *pcb;
     int fl = 1; /* First line */
-    int h, nf;
+    int nf;
     INODETYPE inode;
     MALLOC_S len;
-    uxsin_t *np, *up;
+    uxsin_t *up;
     FILE *us;
+    int rv;
     uint32_t ty;
-    static char *vbuf = (char *)NULL;
-    static size_t vsz = (size_t)0;
 
 #if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
-    pxinfo_t *pp, *pnp;
-#endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
-
     /*
-     * Do second time cleanup or first time setup.
+     * Prefer a single unix_diag NETLINK dump, which supplies the socket
+     * paths, VFS device and node numbers, peers and queue lengths at once.
      */
-    if (Uxsin) {
-        for (h = 0; h < INOBUCKS; h++) {
-            for (up = Uxsin[h]; up; up = np) {
-                np = up->next;
-
-#if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
-                for (pp = up->pxinfo; pp; pp = pnp) {
-                    pnp = pp->next;
-                    (void)free((FREE_P *)pp);
-                }
+    if (get_unix_diag(ctx))
+        return;
 #endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
 
-                if (up->path)
-                    (void)free((FREE_P *)up->path);
-                if (up->pcb)
-                    (void)free((FREE_P *)up->pcb);
-                (void)free((FREE_P *)up);
-            }
-            Uxsin[h] = (uxsin_t *)NULL;
-        }
-    } else {
-        Uxsin = (uxsin_t **)calloc(INOBUCKS, sizeof(uxsin_t *));
-        if (!Uxsin) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d bytes for Unix socket info\n",
-                          Pn, (int)(INOBUCKS * sizeof(uxsin_t *)));
-            Error(ctx);
-        }
-    }
     /*
-     * Open the /proc/net/unix file, assign a page size buffer to the stream,
-     * read the file's contents, and add them to the Uxsin hash buckets.
+     * Read the /proc/net/unix file.  If it hasn't changed since the last
+     * gather, keep Uxsin -- and skip the stat(2) of every socket path.
+     * Otherwise add the file's contents to emptied Uxsin hash buckets.
      */
-    if (!(us = open_proc_stream(ctx, p, "r", &vbuf, &vsz, 0)))
+    if (!(rv = proc_sig_read(ctx, p, &UxSig)) && Uxsin.slot)
+        return;
+    (void)reset_uxsinfo(ctx);
+    if ((rv < 0) || !UxSig.len ||
+        !(us = fmemopen((void *)UxSig.buf, UxSig.len, "r")))
         return;
     while (fgets(buf, sizeof(buf) - 1, us)) {
         if ((nf = get_fields(ctx, buf, ":", &fp, (int *)NULL, 0)) < 7)
@@ -3142,7 +3860,7 @@ static void get_unix(struct lsof_context *ctx, /* context */
             (inode = strtoull(fp[6], &ep, 0)) == ULONG_MAX || !ep || *ep)
             continue;
         /* Skip if already exists in hash table */
-        if (HASH_FIND_ELEMENT(Uxsin, INOHASH, uxsin_t, inode, inode))
+        if (inohash_find(&Uxsin, inode))
             continue;
         if (!fp[0] || !*fp[0])
             pcb = (char *)NULL;
@@ -3195,20 +3913,9 @@ static void get_unix(struct lsof_context *ctx, /* context */
          * Allocate and fill a Unix socket info structure; link it to its
          * hash bucket.
          */
-        if (!(up = (uxsin_t *)malloc(sizeof(uxsin_t)))) {
-            (void)fprintf(stderr,
-                          "%s: can't allocate %d bytes for uxsin struct\n", Pn,
-                          (int)sizeof(uxsin_t));
-            Error(ctx);
-        }
-        up->inode = inode;
-        up->next = (uxsin_t *)NULL;
-        up->pcb = pcb;
-        up->sb_def = 0;
-        up->ty = ty;
-        up->opt = (unsigned int)proc_flags;
-        up->ss = (unsigned int)proc_st;
-        if ((up->path = path) && (*path == '/')) {
+        up = enter_unix(ctx, inode, pcb, path, ty, (unsigned int)proc_flags,
+                        (unsigned int)proc_st);
+        if (path && (*path == '/')) {
 
             /*
              * If an absolute path (i.e., one that begins with a '/') exists
@@ -3229,17 +3936,6 @@ static void get_unix(struct lsof_context *ctx, /* context */
                 up->sb_rdev = sb.st_rdev;
             }
         }
-
-#if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
-        /*
-         * Clean UNIX socket endpoint values.
-         */
-        up->icstat = 0;
-        up->pxinfo = (pxinfo_t *)NULL;
-        up->peer = up->icons = (uxsin_t *)NULL;
-#endif /* defined(HASEPTOPTS) && defined(HASUXSOCKEPT) */
-
-        HASH_INSERT_ELEMENT(Uxsin, INOHASH, up, inode);
     }
 
 #if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
@@ -3377,15 +4073,7 @@ static void print_ax25info(struct lsof_context *ctx, /* context */
     (void)snpf(&pbuf[pl], sizeof(pbuf) - pl, "%s%s)", cp ? ", " : "",
                cp ? cp : "");
     pl = strlen(pbuf);
-    if (!(cp = (char *)malloc(pl + 1))) {
-        (void)fprintf(
-            stderr,
-            "%s: can't allocate %d bytes for AX25 sock state, PID: %d\n", Pn,
-            (int)(pl + 1), Lp->pid);
-        Error(ctx);
-    }
-    (void)snpf(cp, pl + 1, "%s", pbuf);
-    Lf->nma = cp;
+    (void)add_nma(ctx, pbuf, (int)pl);
 }
 
 /*
@@ -3394,7 +4082,7 @@ static void print_ax25info(struct lsof_context *ctx, /* context */
 static void print_ipxinfo(struct lsof_context *ctx, /* context */
                           struct ipxsin *ip)        /* IPX socket info */
 {
-    char *cp, pbuf[256];
+    char pbuf[256];
     MALLOC_S pl;
 
     if (Lf->nma)
@@ -3402,14 +4090,79 @@ static void print_ipxinfo(struct lsof_context *ctx, /* context */
     (void)snpf(pbuf, sizeof(pbuf), "(Tx=%lx Rx=%lx State=%02x)", ip->txq,
                ip->rxq, ip->state);
     pl = strlen(pbuf);
-    if (!(cp = (char *)malloc(pl + 1))) {
-        (void)fprintf(
-            stderr, "%s: can't allocate %d bytes for IPX sock state, PID: %d\n",
-            Pn, (int)(pl + 1), Lp->pid);
-        Error(ctx);
+    (void)add_nma(ctx, pbuf, (int)pl);
+}
+
+/*
+ * Socket information tables, as selected by a socket's protocol name
+ */
+
+#define SPT_AX25 0x1       /* AX25path */
+#define SPT_IPX 0x2        /* Ipxpath */
+#define SPT_RAW 0x4        /* Rawpath */
+#define SPT_NETLINK 0x8    /* Nlkpath */
+#define SPT_PACKET 0x10    /* Packpath */
+#define SPT_UNIX 0x20      /* UNIXpath */
+#define SPT_RAW6 0x40      /* Raw6path */
+#define SPT_TCP6 0x80      /* TCP6path */
+#define SPT_UDP6 0x100     /* UDP6path */
+#define SPT_UDPLITE6 0x200 /* UDPLITE6path */
+#define SPT_TCP 0x400      /* TCPpath */
+#define SPT_UDP 0x800      /* UDPpath */
+#define SPT_UDPLITE 0x1000 /* UDPLITEpath */
+#define SPT_SCTP 0x2000    /* SCTPPath[] */
+#define SPT_ICMP 0x4000    /* ICMPpath */
+#define SPT_ALL 0x7fff     /* all tables */
+
+static struct sock_proto {
+    char *nm; /* protocol name, as the system.sockprotoname extended
+               * attribute of a socket reports it */
+    int tbls; /* SPT_* tables that may hold the socket */
+} SockProto[] = {{"UNIX", SPT_UNIX},
+                 {"UNIX-STREAM", SPT_UNIX},
+                 {"TCP", SPT_TCP},
+                 {"TCPv6", SPT_TCP6},
+                 {"UDP", SPT_UDP},
+                 {"UDPv6", SPT_UDP6},
+                 {"UDP-Lite", SPT_UDPLITE},
+                 {"UDPLITEv6", SPT_UDPLITE6},
+                 {"RAW", SPT_RAW},
+                 {"RAWv6", SPT_RAW6},
+                 {"PING", SPT_ICMP},
+                 {"PINGv6", 0},
+                 {"NETLINK", SPT_NETLINK},
+                 {"PACKET", SPT_PACKET},
+                 {"AX25", SPT_AX25},
+                 {"IPX", SPT_IPX},
+                 {"SCTP", SPT_SCTP},
+                 {"SCTPv6", SPT_SCTP},
+                 {(char *)NULL, 0}};
+
+/*
+ * get_sock_tables() - get the socket information tables that may hold a
+ *		       socket
+ *
+ * return: SPT_* table mask; SPT_ALL if the socket's protocol name is
+ *	   unavailable or unknown
+ */
+
+static int get_sock_tables(char *pbr, /* socket's path before readlink() */
+                           char *pn,  /* protocol name receiving buffer */
+                           int pnl)   /* sizeof(pn) */
+{
+    ssize_t nl;
+    struct sock_proto *sp;
+
+    if (!pbr || (nl = getxattr(pbr, "system.sockprotoname", pn, pnl - 1)) < 1) {
+        *pn = '\0';
+        return (SPT_ALL);
+    }
+    pn[nl] = '\0';
+    for (sp = SockProto; sp->nm; sp++) {
+        if (!strcmp(pn, sp->nm))
+            return (sp->tbls);
     }
-    (void)snpf(cp, pl + 1, "%s", pbuf);
-    Lf->nma = cp;
+    return (SPT_ALL);
 }
 
 /*
@@ -3434,10 +4187,10 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
     struct nlksin *np;
     struct packin *pp;
     char *pr;
-    static char *prp = (char *)NULL;
+    char pn[64];
     struct rawsin *rp;
     struct sctpsin *sp;
-    static ssize_t sz;
+    int spt;
     struct tcp_udp *tp;
     uxsin_t *up;
 
@@ -3455,14 +4208,37 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
     }
 
     /*
+     * When neither the output nor the selections need the socket's protocol
+     * information, leave the socket unidentified.  That spares its protocol
+     * name lookup and the loading of the protocol info caches.
+     */
+    if (!(NeedAttr & NEED_SOCK)) {
+        Lf->type = LSOF_FILE_SOCKET;
+        if (ss & SB_INO) {
+            Lf->inode = (INODETYPE)s->st_ino;
+            Lf->inp_ty = 1;
+        }
+        if (ss & SB_DEV) {
+            Lf->dev = s->st_dev;
+            Lf->dev_def = 1;
+        }
+        return;
+    }
+
+    /*
+     * Select the protocol info caches that may hold the socket's inode
+     * by the socket's protocol name, so that only those need be loaded.
+     *
      * Check for socket's inode presence in the protocol info caches.
      */
-    if (AX25path) {
+    spt = get_sock_tables(pbr, pn, sizeof(pn));
+    if ((spt & SPT_AX25) && AX25path) {
         (void)get_ax25(ctx, AX25path);
         (void)free((FREE_P *)AX25path);
         AX25path = (char *)NULL;
     }
-    if ((ss & SB_INO) && (ap = check_ax25(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_AX25) && (ss & SB_INO) &&
+        (ap = check_ax25(ctx, (INODETYPE)s->st_ino))) {
 
         /*
          * The inode is connected to an AX25 /proc record.
@@ -3480,12 +4256,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (Ipxpath) {
+    if ((spt & SPT_IPX) && Ipxpath) {
         (void)get_ipx(ctx, Ipxpath);
         (void)free((FREE_P *)Ipxpath);
         Ipxpath = (char *)NULL;
     }
-    if ((ss & SB_INO) && (ip = check_ipx(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_IPX) && (ss & SB_INO) &&
+        (ip = check_ipx(ctx, (INODETYPE)s->st_ino))) {
         /*
          * The inode is connected to an IPX /proc record.
          *
@@ -3538,12 +4315,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (Rawpath) {
+    if ((spt & SPT_RAW) && Rawpath) {
         (void)get_raw(ctx, Rawpath);
         (void)free((FREE_P *)Rawpath);
         Rawpath = (char *)NULL;
     }
-    if ((ss & SB_INO) && (rp = check_raw(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_RAW) && (ss & SB_INO) &&
+        (rp = check_raw(ctx, (INODETYPE)s->st_ino))) {
         /*
          * The inode is connected to a raw /proc record.
          *
@@ -3598,12 +4376,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (Nlkpath) {
+    if ((spt & SPT_NETLINK) && Nlkpath) {
         (void)get_netlink(ctx, Nlkpath);
         (void)free((FREE_P *)Nlkpath);
         Nlkpath = (char *)NULL;
     }
-    if ((ss & SB_INO) && (np = check_netlink(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_NETLINK) && (ss & SB_INO) &&
+        (np = check_netlink(ctx, (INODETYPE)s->st_ino))) {
         /*
          * The inode is connected to a Netlink /proc record.
          *
@@ -3625,12 +4404,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (Packpath) {
+    if ((spt & SPT_PACKET) && Packpath) {
         (void)get_pack(ctx, Packpath);
         (void)free((FREE_P *)Packpath);
         Packpath = (char *)NULL;
     }
-    if ((ss & SB_INO) && (pp = check_pack(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_PACKET) && (ss & SB_INO) &&
+        (pp = check_pack(ctx, (INODETYPE)s->st_ino))) {
         /*
          * The inode is connected to a packet /proc record.
          *
@@ -3661,12 +4441,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (UNIXpath) {
+    if ((spt & SPT_UNIX) && UNIXpath) {
         (void)get_unix(ctx, UNIXpath);
         (void)free((FREE_P *)UNIXpath);
         UNIXpath = (char *)NULL;
     }
-    if ((ss & SB_INO) && (up = check_unix(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_UNIX) && (ss & SB_INO) &&
+        (up = check_unix(ctx, (INODETYPE)s->st_ino))) {
 
         /*
          * The inode is connected to a UNIX /proc record.
@@ -3689,6 +4470,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
 #if defined(HASSOSTATE)
         Lf->lts.ss = up->ss;
 #endif /* defined(HASSOSTATE) */
+#if defined(HASTCPTPIQ)
+        if (up->qs) {
+            Lf->lts.rq = up->rxq;
+            Lf->lts.sq = up->txq;
+            Lf->lts.rqs = Lf->lts.sqs = 1;
+        }
+#endif /* defined(HASTCPTPIQ) */
 #if defined(HASEPTOPTS) && defined(HASUXSOCKEPT)
         if (FeptE) {
             (void)enter_uxsinfo(ctx, up);
@@ -3768,13 +4556,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
     }
 
 #if defined(HASIPv6)
-    if (Raw6path) {
+    if ((spt & SPT_RAW6) && Raw6path) {
         if (!Fxopt)
             (void)get_raw6(ctx, Raw6path);
         (void)free((FREE_P *)Raw6path);
         Raw6path = (char *)NULL;
     }
-    if (!Fxopt && (ss & SB_INO) &&
+    if ((spt & SPT_RAW6) && !Fxopt && (ss & SB_INO) &&
         (rp = check_raw6(ctx, (INODETYPE)s->st_ino))) {
 
         /*
@@ -3832,28 +4620,29 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (TCP6path) {
+    if ((spt & SPT_TCP6) && TCP6path) {
         if (!Fxopt)
-            (void)get_tcpudp6(ctx, TCP6path, 0, 1);
+            (void)get_tcpudp6(ctx, TCP6path, 0);
         (void)free((FREE_P *)TCP6path);
         TCP6path = (char *)NULL;
     }
 
-    if (UDP6path) {
+    if ((spt & SPT_UDP6) && UDP6path) {
         if (!Fxopt)
-            (void)get_tcpudp6(ctx, UDP6path, 1, 0);
+            (void)get_tcpudp6(ctx, UDP6path, 1);
         (void)free((FREE_P *)UDP6path);
         UDP6path = (char *)NULL;
     }
 
-    if (UDPLITE6path) {
+    if ((spt & SPT_UDPLITE6) && UDPLITE6path) {
         if (!Fxopt)
-            (void)get_tcpudp6(ctx, UDPLITE6path, 2, 0);
+            (void)get_tcpudp6(ctx, UDPLITE6path, 2);
         (void)free((FREE_P *)UDPLITE6path);
         UDPLITE6path = (char *)NULL;
     }
 
-    if (!Fxopt && (ss & SB_INO) &&
+    if ((spt & (SPT_TCP6 | SPT_UDP6 | SPT_UDPLITE6)) && !Fxopt &&
+        (ss & SB_INO) &&
         (tp6 = check_tcpudp6(ctx, (INODETYPE)s->st_ino, &pr))) {
 
         /*
@@ -3884,7 +4673,7 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
              */
             if (i >= 0 && i < TcpNstates) {
                 if (TcpStI[i])
-                    TcpStI[i] = 2;
+                    SEL_FOUND(ctx, TcpStI[i], 2);
                 else {
                     Lf->sf |= SELEXCLF;
                     return;
@@ -3940,29 +4729,29 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
     }
 #endif /* defined(HASIPv6) */
 
-    if (TCPpath) {
+    if ((spt & SPT_TCP) && TCPpath) {
         if (!Fxopt)
-            (void)get_tcpudp(ctx, TCPpath, 0, 1);
+            (void)get_tcpudp(ctx, TCPpath, 0);
         (void)free((FREE_P *)TCPpath);
         TCPpath = (char *)NULL;
     }
 
-    if (UDPpath) {
+    if ((spt & SPT_UDP) && UDPpath) {
         if (!Fxopt)
-            (void)get_tcpudp(ctx, UDPpath, 1, 0);
+            (void)get_tcpudp(ctx, UDPpath, 1);
         (void)free((FREE_P *)UDPpath);
         UDPpath = (char *)NULL;
     }
 
-    if (UDPLITEpath) {
+    if ((spt & SPT_UDPLITE) && UDPLITEpath) {
         if (!Fxopt)
-            (void)get_tcpudp(ctx, UDPLITEpath, 2, 0);
+            (void)get_tcpudp(ctx, UDPLITEpath, 2);
         (void)free((FREE_P *)UDPLITEpath);
         UDPLITEpath = (char *)NULL;
     }
 
-    if (!Fxopt && (ss & SB_INO) &&
-        (tp = check_tcpudp(ctx, (INODETYPE)s->st_ino, &pr))) {
+    if ((spt & (SPT_TCP | SPT_UDP | SPT_UDPLITE)) && !Fxopt &&
+        (ss & SB_INO) && (tp = check_tcpudp(ctx, (INODETYPE)s->st_ino, &pr))) {
 
         /*
          * The inode is connected to an IPv4 TCP or UDP /proc record.
@@ -3992,7 +4781,7 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
              */
             if (i >= 0 && i < TcpNstates) {
                 if (TcpStI[i])
-                    TcpStI[i] = 2;
+                    SEL_FOUND(ctx, TcpStI[i], 2);
                 else {
                     Lf->sf |= SELEXCLF;
                     return;
@@ -4047,14 +4836,15 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (SCTPPath[0]) {
+    if ((spt & SPT_SCTP) && SCTPPath[0]) {
         (void)get_sctp(ctx);
         for (i = 0; i < NSCTPPATHS; i++) {
             (void)free((FREE_P *)SCTPPath[i]);
             SCTPPath[i] = (char *)NULL;
         }
     }
-    if ((ss & SB_INO) && (sp = check_sctp(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_SCTP) && (ss & SB_INO) &&
+        (sp = check_sctp(ctx, (INODETYPE)s->st_ino))) {
 
         /*
          * The inode is connected to an SCTP /proc record.
@@ -4102,12 +4892,13 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
         return;
     }
 
-    if (ICMPpath) {
+    if ((spt & SPT_ICMP) && ICMPpath) {
         (void)get_icmp(ctx, ICMPpath);
         (void)free((FREE_P *)ICMPpath);
         ICMPpath = (char *)NULL;
     }
-    if ((ss & SB_INO) && (icmpp = check_icmp(ctx, (INODETYPE)s->st_ino))) {
+    if ((spt & SPT_ICMP) && (ss & SB_INO) &&
+        (icmpp = check_icmp(ctx, (INODETYPE)s->st_ino))) {
 
         /*
          * The inode is connected to an ICMP /proc record.
@@ -4164,17 +4955,96 @@ void process_proc_sock(struct lsof_context *ctx, /* context */
     }
     if (Fxopt)
         enter_nm(ctx, "can't identify protocol (-X specified)");
+    else if (!pn[0])
+        enter_nm(ctx, "can't identify protocol");
     else {
-        (void)snpf(Namech, Namechl, "protocol: ");
-        if (!prp) {
-            i = (int)strlen(Namech);
-            prp = &Namech[i];
-            sz = (ssize_t)(Namechl - i - 1);
-        }
-        if ((getxattr(pbr, "system.sockprotoname", prp, sz)) < 0)
-            enter_nm(ctx, "can't identify protocol");
-        else
-            enter_nm(ctx, Namech);
+        (void)snpf(Namech, Namechl, "protocol: %s", pn);
+        enter_nm(ctx, Namech);
+    }
+}
+
+/*
+ * preload_sock_info() - load the socket information that process_proc_sock()
+ *			 otherwise loads on first use
+ *
+ * This must be called before processes are scanned by multiple threads, since
+ * the socket information tables are shared and not locked.
+ */
+void preload_sock_info(struct lsof_context *ctx) /* context */
+{
+    int i;
+
+    if (AX25path) {
+        (void)get_ax25(ctx, AX25path);
+        CLEAN(AX25path);
+    }
+    if (Ipxpath) {
+        (void)get_ipx(ctx, Ipxpath);
+        CLEAN(Ipxpath);
+    }
+    if (Rawpath) {
+        (void)get_raw(ctx, Rawpath);
+        CLEAN(Rawpath);
+    }
+    if (Nlkpath) {
+        (void)get_netlink(ctx, Nlkpath);
+        CLEAN(Nlkpath);
+    }
+    if (Packpath) {
+        (void)get_pack(ctx, Packpath);
+        CLEAN(Packpath);
+    }
+    if (UNIXpath) {
+        (void)get_unix(ctx, UNIXpath);
+        CLEAN(UNIXpath);
+    }
+
+#if defined(HASIPv6)
+    if (Raw6path) {
+        if (!Fxopt)
+            (void)get_raw6(ctx, Raw6path);
+        CLEAN(Raw6path);
+    }
+    if (TCP6path) {
+        if (!Fxopt)
+            (void)get_tcpudp6(ctx, TCP6path, 0);
+        CLEAN(TCP6path);
+    }
+    if (UDP6path) {
+        if (!Fxopt)
+            (void)get_tcpudp6(ctx, UDP6path, 1);
+        CLEAN(UDP6path);
+    }
+    if (UDPLITE6path) {
+        if (!Fxopt)
+            (void)get_tcpudp6(ctx, UDPLITE6path, 2);
+        CLEAN(UDPLITE6path);
+    }
+#endif /* defined(HASIPv6) */
+
+    if (TCPpath) {
+        if (!Fxopt)
+            (void)get_tcpudp(ctx, TCPpath, 0);
+        CLEAN(TCPpath);
+    }
+    if (UDPpath) {
+        if (!Fxopt)
+            (void)get_tcpudp(ctx, UDPpath, 1);
+        CLEAN(UDPpath);
+    }
+    if (UDPLITEpath) {
+        if (!Fxopt)
+            (void)get_tcpudp(ctx, UDPLITEpath, 2);
+        CLEAN(UDPLITEpath);
+    }
+    if (SCTPPath[0]) {
+        (void)get_sctp(ctx);
+        for (i = 0; i < NSCTPPATHS; i++)
+            CLEAN(SCTPPath[i]);
+    }
+    if (ICMPpath) {
+        (void)get_icmp(ctx, ICMPpath);
+        CLEAN(ICMPpath);
     }
 }
 
@@ -67,6 +67,16 @@
 
 /* #define	HASAOPT		1 */
 
+/*
+ * HASARENA is defined for those dialects that allocate lfile structures and
+ * their name, name addition and device character strings from the context's
+ * per-gather arena, rather than with malloc().  Such a dialect must not
+ * free() or realloc() those strings, nor give its lfile additions malloc()'d
+ * space, since the structures are discarded without CLRLFILEADD.
+ */
+
+#    define HASARENA 1
+
 /*
  * HASBLKDEV is defined for those dialects that want block device information
  * recorded in BDevtp[].
@@ -133,6 +143,14 @@
 
 #    define HASEOPT 1
 
+/*
+ * HASFDMEMO is defined for those dialects that keep the stat(2) results of
+ * file descriptors between delta gathers (see delta_mark()) and supply
+ * fd_memo_free() to free them.
+ */
+
+#    define HASFDMEMO 1
+
 /*
  * HASFSINO is defined for those dialects that have the file system
  * inode element, fs_ino, in the lfile structure definition in lsof.h.
@@ -228,6 +246,22 @@
 
 #    define HASLWP 1
 
+/*
+ * HASMATCHLIMIT is defined for those dialects whose process reading stops
+ * at the selected file limit (--max-matches) and skips the rest of a
+ * process's files once -t has selected it.
+ */
+
+#    define HASMATCHLIMIT 1
+
+/*
+ * HASMNTCHG names a file whose poll(2) POLLPRI event announces a change of
+ * the mount table, so that the -W server and the repeat mode can read the
+ * table again.
+ */
+
+#    define HASMNTCHG "/proc/self/mountinfo"
+
 /*
  * HASMNTSTAT indicates the dialect supports the mount stat(2) result option
  * in its l_vfs and mounts structures.
@@ -270,6 +304,42 @@
 
 /* #define	HASNLIST	1 */
 
+/*
+ * HASPARSCAN is defined for those dialects that can scan processes with
+ * multiple threads -- i.e., support the -j option.
+ */
+
+#    if defined(HASPTHREADS)
+#        define HASPARSCAN 1
+#    endif /* defined(HASPTHREADS) */
+
+/*
+ * HASPIDLIST is defined for those dialects whose gather_proc_info() can read
+ * the processes of a list of PIDs without reading the whole process table --
+ * for -p and lsof_gather_pids().
+ */
+
+#    define HASPIDLIST 1
+
+/*
+ * HASPROCSTREAM is defined for those dialects whose gather_proc_info() calls
+ * stream_procs() after each process while lsof_gather_stream() is streaming,
+ * so that a process's lproc and lfile structures are freed once the caller
+ * has been handed them.
+ */
+
+#    define HASPROCSTREAM 1
+
+/*
+ * HASSAFETHR is defined for those dialects whose "safe" (i.e., timed) stat(),
+ * lstat() and readlink() calls are made by worker threads, rather than by a
+ * child process.
+ */
+
+#    if defined(HASPTHREADS)
+#        define HASSAFETHR 1
+#    endif /* defined(HASPTHREADS) */
+
 /*
  * HASPIPEFN is defined for those dialects that have a special function to
  * process DTYPE_PIPE file structure entries.  Its value is the name of the
@@ -400,6 +470,12 @@
 
 /* #define	HASNOSOCKSECURITY	1	*/
 
+/*
+ * HASSERVE is defined for those dialects that support the -W query server.
+ */
+
+#    define HASSERVE 1
+
 /*
  * HASSETLOCALE is defined for those dialects that have <locale.h> and
  * setlocale().
@@ -481,6 +557,13 @@
 
 #    define HASTCPUDPSTATE 1
 
+/*
+ * HASTIMERFD is defined for those dialects that have timerfd_create(2); the
+ * repeat mode then starts its passes at fixed period boundaries.
+ */
+
+#    define HASTIMERFD 1
+
 /*
  * HASTMPNODE is defined for those dialects that have tmpnodes.
  */
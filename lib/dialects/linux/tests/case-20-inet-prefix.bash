@@ -0,0 +1,58 @@
+#!/bin/bash
+source tests/common.bash
+
+if [ -z "$(nc -h 2>&1 | grep '\s\-4')" ]; then
+    echo "nc does not support -4 option, skipping" >> $report
+    exit 77
+fi
+
+nc -l -4 127.0.0.1 10003 > /dev/null < /dev/zero &
+server=$!
+sleep 1
+
+# Each line is: expected PID-found (1) or not (0), then the lsof options.
+# The -i addresses are matched by prefix.
+while read -r expected opts; do
+    if $lsof -n -P -t $opts | grep -q -x $server; then
+	found=1
+    else
+	found=0
+    fi
+    if [[ $found != $expected ]]; then
+	echo "lsof $opts: expected $expected, found $found" >> $report
+	$lsof -n -P $opts >> $report 2>&1
+	kill -9 $server
+	exit 1
+    fi
+done <<END
+1 -i@127.0.0.0/8:10003
+1 -i@126.0.0.0/7:10000-10005
+1 -iTCP@127.0.0.1/32
+1 -i@[::ffff:127.0.0.0]/104:10003
+0 -i@127.0.0.0/8:10004
+0 -i@127.1.0.0/16:10003
+0 -iUDP@127.0.0.0/8:10003
+1 -a -p $server -i@127.0.0.0/8 -i@10.0.0.0/8
+END
+
+# Addresses may be listed in a file; each line not located is reported.
+list=/tmp/lsof-inet-prefix-$$.list
+cat > $list <<END
+# a comment, then a blank line
+
+  @10.0.0.0/8:1-100
+@127.0.0.0/24:10003
+END
+out=$($lsof -n -P -V -a -p $server -i @$list -F n 2>&1)
+kill -9 $server > /dev/null 2>&1
+rm -f $list
+if ! echo "$out" | grep -q "^n127.0.0.1:10003"; then
+    echo "-i @$list didn't select $server: $out" >> $report
+    exit 1
+fi
+if ! echo "$out" | grep -q "not located: @10.0.0.0/8:1-100\$" ||
+   echo "$out" | grep -q "not located: @127"; then
+    echo "-i @$list reported: $out" >> $report
+    exit 1
+fi
+exit 0
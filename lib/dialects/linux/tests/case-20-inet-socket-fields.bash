@@ -0,0 +1,34 @@
+#!/bin/bash
+source tests/common.bash
+
+if [ -z "$(nc -h 2>&1 | grep '\s\-4')" ]; then
+    echo "nc does not support -4 option, skipping" >> $report
+    exit 77
+fi
+
+nc -l -4 127.0.0.1 10004 > /dev/null < /dev/zero &
+server=$!
+sleep 1
+
+fd=$($lsof -n -P -a -p $server -i TCP:10004 -F f | sed -n 's/^f//p')
+if [ -z "$fd" ]; then
+    echo "no TCP:10004 socket found for $server" >> $report
+    kill -9 $server
+    exit 1
+fi
+
+# A socket's device and inode fields must be the same whether or not the
+# other fields are selected.
+full=$($lsof -n -P -a -p $server -d $fd -F)
+for f in d D i; do
+    expected=$(echo "$full" | grep "^$f")
+    result=$($lsof -n -P -a -p $server -d $fd -F pf$f | grep "^$f")
+    if [[ "$result" != "$expected" ]]; then
+	echo "-F pf$f: expected \"$expected\", got \"$result\"" >> $report
+	echo "$full" >> $report
+	kill -9 $server
+	exit 1
+    fi
+done
+kill -9 $server
+exit 0
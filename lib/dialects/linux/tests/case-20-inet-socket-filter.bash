@@ -0,0 +1,41 @@
+#!/bin/bash
+source tests/common.bash
+
+if [ -z "$(nc -h 2>&1 | grep '\s\-4')" ]; then
+    echo "nc does not support -4 option, skipping" >> $report
+    exit 77
+fi
+
+nc -l -4 127.0.0.1 10001 > /dev/null < /dev/zero &
+server=$!
+sleep 1
+
+# Each line is: expected PID-found (1) or not (0), then the lsof options.
+# The -i and -s selections may be pushed down into the kernel's socket dump.
+while read -r expected opts; do
+    if $lsof -n -P -t $opts | grep -q -x $server; then
+	found=1
+    else
+	found=0
+    fi
+    if [[ $found != $expected ]]; then
+	echo "lsof $opts: expected $expected, found $found" >> $report
+	$lsof -n -P $opts >> $report 2>&1
+	kill -9 $server
+	exit 1
+    fi
+done <<END
+1 -iTCP:10001
+1 -i@127.0.0.1:10001
+1 -i4TCP:10000-10002
+1 -iTCP:10001 -sTCP:LISTEN
+0 -iTCP:10001 -sTCP:ESTABLISHED
+0 -iUDP:10001
+0 -i6TCP:10001
+0 -i@127.0.0.2:10001
+1 -a -p $server -iTCP:10001
+0 -a -p $server -iTCP:10002
+END
+
+kill -9 $server > /dev/null 2>&1
+exit 0
@@ -0,0 +1,44 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # Enough FDs for several io_uring batches, with pipes among them and
+    # some offsets.
+    for i in $(seq 200); do
+	exec {fd}</etc/passwd
+    done
+    read -r -n 5 line <&$fd
+    exec {pr}< <(sleep 60)
+    exec {pw}> >(sleep 60)
+
+    # Write the scans to files: a command substitution would add a pipe
+    # of its own to this shell's FDs.
+    sync=$(mktemp)
+    ring=$(mktemp)
+    $lsof -o -p $$ -F pfdatison > $sync
+    LSOFIOURING=1 $lsof -o -p $$ -F pfdatison > $ring
+    if ! diff $sync $ring; then
+	echo "io_uring batched and synchronous scans differ"
+	rm -f $sync $ring
+	exit 1
+    fi
+    if ! grep -q -x "o0t5" $ring; then
+	echo "offset of FD $fd is not 0t5"
+	rm -f $sync $ring
+	exit 1
+    fi
+    rm -f $sync $ring
+
+    # Time both ways; the report shows which is faster here.
+    for how in synchronous io_uring; do
+	if [[ $how == io_uring ]]; then
+	    export LSOFIOURING=1
+	fi
+	s=$(date +%s%N)
+	for i in 1 2 3 4 5; do
+	    $lsof -p $$ > /dev/null
+	done
+	echo "$how: $(( ($(date +%s%N) - s) / 5000 )) usec per scan"
+    done
+    exit 0
+} >> $report 2>&1
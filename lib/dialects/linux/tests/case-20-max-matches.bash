@@ -0,0 +1,30 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # The shell has more than two files; --max-matches should stop at
+    # two of them, in either form.
+    for opt in "--max-matches 2" "--max-matches=2"; do
+	n=$($lsof $opt -p $$ -F f | grep -c '^f')
+	if [ "$n" != 2 ]; then
+	    echo "$opt: expected 2 files, got $n"
+	    exit 1
+	fi
+    done
+
+    # -t skips the rest of a process's files once it is selected, but
+    # not while a named file is still unfound: both files should be
+    # found in the shell.
+    a=$(mktemp)
+    b=$(mktemp)
+    exec 3< $a 4< $b
+    pids=$($lsof -t $a $b)
+    s=$?
+    exec 3<&- 4<&-
+    rm -f $a $b
+    if [ $s != 0 ] || [ "$pids" != $$ ]; then
+	echo "-t: exit status $s, PIDs: $pids"
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
@@ -0,0 +1,41 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    if ! $lsof -h 2>&1 | grep -q -e '-j \[n\]'; then
+	echo "parallel process scanning is not available, skipping"
+	exit 77
+    fi
+
+    sleep 60 &
+    spid=$!
+    pids=$$,$spid
+
+    serial=$($lsof -p $pids -F pfn)
+    parallel=$($lsof -j 4 -p $pids -F pfn)
+    if [[ "$serial" != "$parallel" ]]; then
+	echo "serial and parallel scans differ"
+	echo "$serial"
+	echo
+	echo "$parallel"
+	kill $spid
+	exit 1
+    fi
+
+    # A full parallel scan must still find this shell's cwd.
+    line=$($lsof -j -a -d cwd -F p | grep -x "p$$")
+    if [[ "$line" != "p$$" ]]; then
+	echo "parallel scan did not find PID $$"
+	kill $spid
+	exit 1
+    fi
+
+    # A file name following -j isn't taken as its thread count.
+    line=$($lsof -F p -j /proc/$spid/cwd 2>&1 | grep -x "p$spid")
+    kill $spid
+    if [[ "$line" != "p$spid" ]]; then
+	echo "lsof -F p -j /proc/$spid/cwd did not find PID $spid: $line"
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
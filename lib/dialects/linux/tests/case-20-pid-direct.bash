@@ -0,0 +1,33 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # -p reads the /proc directories of its PIDs directly; a task ID
+    # that isn't a process ID, which reading /proc wouldn't find, must
+    # not be listed as a process.
+    tid=
+    for t in /proc/[0-9]*/task/[0-9]*; do
+	p=${t#/proc/}
+	p=${p%%/*}
+	if [ "${t##*/}" != "$p" ]; then
+	    tid=${t##*/}
+	    break
+	fi
+    done
+    if [ -z "$tid" ]; then
+	echo "no task that isn't a process found, skipping"
+	exit 77
+    fi
+    if $lsof -w -p $tid -F p | grep -q "^p$tid\$"; then
+	echo "-p $tid listed task $tid as a process"
+	exit 1
+    fi
+
+    # The shell itself is still listed, alone.
+    out=$($lsof -p $$ -F p)
+    if [ "$out" != "p$$" ]; then
+	echo "-p $$: $out"
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
@@ -0,0 +1,33 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # Two pipes, so that the second one's stat(2) results are derived from
+    # the first one's.
+    exec 7< <(sleep 60)
+    exec 8> >(sleep 60)
+
+    for fd in 7 8; do
+	if [[ $fd == 7 ]]; then
+	    mode=r
+	else
+	    mode=w
+	fi
+	ino=$(stat -L -c %i /proc/$$/fd/$fd)
+	out=$($lsof -p $$ -a -d $fd -F ati)
+	echo "$out"
+	if ! echo "$out" | grep -q -x "a$mode"; then
+	    echo "FD $fd: access mode is not $mode"
+	    exit 1
+	fi
+	if ! echo "$out" | grep -q -x "tFIFO"; then
+	    echo "FD $fd: type is not FIFO"
+	    exit 1
+	fi
+	if ! echo "$out" | grep -q -x "i$ino"; then
+	    echo "FD $fd: inode is not $ino"
+	    exit 1
+	fi
+    done
+    exit 0
+} >> $report 2>&1
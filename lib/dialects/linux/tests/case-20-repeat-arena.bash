@@ -0,0 +1,32 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # Hold enough files that their lfile structures fill several arena
+    # chunks, then check that each repeat pass, which reuses the chunks,
+    # lists what a single pass does.
+    (
+	for i in $(seq 10 1000); do
+	    eval "exec $i</dev/null"
+	done
+	exec sleep 60
+    ) &
+    spid=$!
+    sleep 1
+
+    once=$($lsof -p $spid -F pfn)
+    if [[ $(echo "$once" | grep -c '^n/dev/null$') -lt 900 ]]; then
+	echo "missing /dev/null files"
+	kill $spid
+	exit 1
+    fi
+    repeat=$($lsof -r 1c3 -p $spid -F pfn)
+    kill $spid
+    expected=$(printf '%s\nm\n%s\nm\n%s\nm' "$once" "$once" "$once")
+    if [[ "$repeat" != "$expected" ]]; then
+	echo "repeat passes differ from a single pass"
+	diff <(echo "$expected") <(echo "$repeat")
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
@@ -0,0 +1,65 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # Open a file, then close it and open another while lsof repeats
+    # in delta mode; the later passes should list only those changes.
+    d=$(mktemp -d)
+    (
+	exec 20<$d
+	sleep 3
+	exec 20<&-
+	exec 21</dev/null
+	exec sleep 60
+    ) &
+    spid=$!
+
+    out=$($lsof -r 2:dc3 -p $spid -a -d 20-21 -F fn)
+    kill $spid
+    rmdir $d
+    first=$(echo "$out" | sed -n '1,/^m$/p')
+    rest=$(echo "$out" | sed -n '/^m$/,$p' | sed 1d)
+    if ! echo "$first" | grep -q "^n$d\$"; then
+	echo "first pass does not list the open directory"
+	echo "$out"
+	exit 1
+    fi
+    if ! echo "$rest" | grep -q '^n/dev/null$'; then
+	echo "opened file not listed"
+	echo "$out"
+	exit 1
+    fi
+    if ! echo "$rest" | grep -q "^n$d (closed)\$"; then
+	echo "closed file not listed"
+	echo "$out"
+	exit 1
+    fi
+    if [[ $(echo "$rest" | grep -c "^n$d") -ne 1 ]]; then
+	echo "unchanged file listed again"
+	echo "$out"
+	exit 1
+    fi
+
+    # A write and a new link of an open file change its size and link
+    # count, but not its open file; a later pass must see them.
+    f=$(mktemp)
+    (
+	exec 22>>$f
+	sleep 3
+	echo changed >&22
+	ln $f $f.link
+	exec sleep 60
+    ) &
+    spid=$!
+
+    out=$($lsof +L -r 2:dc3 -p $spid -a -d 22 -F skn)
+    kill $spid
+    rm -f $f $f.link
+    rest=$(echo "$out" | sed -n '/^m$/,$p' | sed 1d)
+    if ! echo "$rest" | grep -q '^s8$' || ! echo "$rest" | grep -q '^k2$'; then
+	echo "size and link count changes not listed"
+	echo "$out"
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
@@ -0,0 +1,36 @@
+#!/bin/bash
+source tests/common.bash
+
+if ! type flock > /dev/null 2>&1; then
+    echo "flock not found, skipping" >> $report
+    exit 77
+fi
+
+{
+    # Lock a file while lsof repeats; the passes after the lock is taken,
+    # including those for which /proc/locks doesn't change and the lock
+    # information of the earlier pass is kept, should show the lock.
+    f=$(mktemp)
+    (
+	sleep 1
+	exec flock $f sleep 60
+    ) &
+    spid=$!
+
+    out=$($lsof -r 2c3 -p $spid -a -F ln $f)
+    kill $spid
+    rm -f $f
+    files=$(echo "$out" | grep -c "^n$f\$")
+    if [[ $files -lt 2 ]]; then
+	echo "locked file not listed by the later passes"
+	echo "$out"
+	exit 1
+    fi
+    if [[ $(echo "$out" | grep -c '^lW$') -ne $files ]] ||
+	   [[ $(echo "$out" | tail -n 3 | head -n 1) != "lW" ]]; then
+	echo "lock not listed by every pass after it was taken"
+	echo "$out"
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
@@ -0,0 +1,33 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # Repeat five times a fifth of a second apart with the latency in
+    # the marker; the passes should take about a second, not five.
+    start=$(date +%s%N)
+    out=$($lsof -r 0.2:lc5 -p $$ -F p)
+    end=$(date +%s%N)
+    n=$(echo "$out" | grep -c -E '^mscan=[0-9]+us overruns=[0-9]+$')
+    if [ "$n" != 5 ]; then
+	echo "expected 5 latency markers, got $n"
+	echo "$out"
+	exit 1
+    fi
+    ms=$(( (end - start) / 1000000 ))
+    if [ $ms -ge 3000 ]; then
+	echo "five 0.2 second passes took $ms ms"
+	exit 1
+    fi
+
+    # A time may end in a `.', but may not be zero.
+    n=$($lsof -r 1.c2 -p $$ -F p | grep -c '^m$')
+    if [ "$n" != 2 ]; then
+	echo "-r 1.c2: expected 2 markers, got $n"
+	exit 1
+    fi
+    if $lsof -r 0c2 -p $$ -F p > /dev/null 2>&1; then
+	echo "-r 0c2 was accepted"
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
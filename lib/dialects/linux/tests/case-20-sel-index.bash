@@ -0,0 +1,41 @@
+#!/bin/bash
+source tests/common.bash
+
+{
+    # The -p, -g, -u and -d lists are looked up through the indexes built
+    # from them; long and overlapping lists must select what they did
+    # when they were walked.
+    pids=$(seq -s, 2 3000)
+    if ! $lsof -w -p $pids,$$ -F p | grep -q "^p$$\$"; then
+	echo "-p of a long list didn't list $$"
+	exit 1
+    fi
+    pgid=$(ps -o pgid= -p $$ | tr -d ' ')
+    if ! $lsof -w -g $pids,$pgid -F p | grep -q "^p$$\$"; then
+	echo "-g of a long list didn't list $$"
+	exit 1
+    fi
+    uid=$(id -u)
+    if $lsof -w -u $uid -p ^$$ -a -F p | grep -q "^p$$\$"; then
+	echo "-p ^$$ listed $$"
+	exit 1
+    fi
+    if $lsof -w -u ^$uid -p $$ -a -F p | grep -q "^p$$\$"; then
+	echo "-u ^$uid listed $$"
+	exit 1
+    fi
+
+    # Overlapping and abutting FD ranges select their union.
+    same_fds() {
+	a=$($lsof -w -p $$ -a -d "$1" -F f)
+	b=$($lsof -w -p $$ -a -d "$2" -F f)
+	if [ "$a" != "$b" ]; then
+	    echo "-d $1: $a"
+	    echo "-d $2: $b"
+	    exit 1
+	fi
+    }
+    same_fds 0-1,1-2,4,3,cwd 0-4,cwd
+    same_fds ^0-1,^1-2,^4,^3 ^0-4
+    exit 0
+} >> $report 2>&1
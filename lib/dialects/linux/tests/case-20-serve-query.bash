@@ -0,0 +1,50 @@
+#!/bin/bash
+source tests/common.bash
+
+if [ -z "$(nc -h 2>&1 | grep '\-U')" ]; then
+    echo "nc does not support unix socket, skipping" >> $report
+    exit 77
+fi
+
+{
+    # Start a -W server, then check that a query answers with the field
+    # output of the same options given on the command line.
+    sock=/tmp/$name-$$.sock
+    $lsof -W $sock &
+    server=$!
+    sleep 15 &
+    spid=$!
+    for i in 1 2 3 4 5; do
+	[ -S $sock ] && break
+	sleep 1
+    done
+
+    expected=$($lsof -p $spid -a -d 0-2 -F pfn)
+    answer=$(echo "-p $spid -a -d 0-2" | nc -U $sock)
+    if [[ "$answer" != "$expected" ]]; then
+	echo "query answer differs from a command line listing"
+	diff <(echo "$expected") <(echo "$answer")
+	kill $server
+	rm -f $sock
+	exit 1
+    fi
+
+    # While sixteen queries are being answered, a new connection waits for
+    # one of them to finish, then is answered.
+    clients=
+    for i in $(seq 16); do
+	(sleep 4; echo "-p $spid -a -d 0-2") | nc -U $sock > /dev/null &
+	clients="$clients $!"
+    done
+    sleep 2
+    answer=$(echo "-p $spid -a -d 0-2" | nc -U $sock)
+    wait $clients
+    kill $server
+    rm -f $sock
+    if [[ "$answer" != "$expected" ]]; then
+	echo "query answer while the server was full differs"
+	diff <(echo "$expected") <(echo "$answer")
+	exit 1
+    fi
+    exit 0
+} >> $report 2>&1
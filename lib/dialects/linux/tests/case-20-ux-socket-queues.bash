@@ -0,0 +1,45 @@
+#!/bin/bash
+source tests/common.bash
+
+if [ -z "$(nc -h 2>&1 | grep '\-U')" ]; then
+    echo "nc does not support unix socket, skipping" >> $report
+    exit 77
+fi
+
+ux="/tmp/$name $$.sock"
+nc -l -U "$ux" > /dev/null < /dev/zero &
+server=$!
+
+for i in $(seq 0 10); do
+    sleep 1
+    if [ -S "$ux" ]; then
+	break
+    fi
+done
+
+fserver=/tmp/${name}-server-$$
+$lsof -n -Tqs -P -U -a -p $server > $fserver
+# nc      22512 yamato    3u  unix 0x00000000000000d5      0t0 470697 /tmp/a b.sock type=STREAM (LISTEN QR=0 QS=0)
+if ! cat $fserver | grep -q "^.* unix 0x[0-9a-f]\+ \+0t0 \+[0-9]\+ $ux type=STREAM (LISTEN QR=[0-9]\+ QS=[0-9]\+)"; then
+    echo "failed in listing queue lengths" >> $report
+    cat $fserver >> $report
+    kill -9 $server
+    rm -f "$ux"
+    exit 1
+fi
+
+$lsof -n -Tq -P -U -a -p $server -FT > $fserver
+# TQR=0
+# TQS=0
+if ! grep -q "^TQR=[0-9]\+$" $fserver || ! grep -q "^TQS=[0-9]\+$" $fserver; then
+    echo "failed in listing queue length fields" >> $report
+    cat $fserver >> $report
+    kill -9 $server
+    rm -f "$ux"
+    exit 1
+fi
+
+kill -9 $server
+rm -f "$ux" $fserver
+
+exit 0
@@ -72,4 +72,142 @@
             (table)[__h] = (element);                                          \
         })
 
+/*
+ * Open addressing inode index
+ *
+ * An inohash_t maps inode numbers to element pointers.  Its slot count is a
+ * power of two, probing is linear from a mixed inode number, and the table
+ * doubles when an insertion would fill more than three quarters of it.
+ *
+ * INODETYPE must be defined before this header is included.  A zeroed
+ * inohash_t is an empty, unallocated index.
+ **/
+#    include <stdint.h>
+#    include <stdlib.h>
+#    include <string.h>
+
+#    define INOHASH_MINSLOTS 16 /* minimum slot count -- a power of two */
+
+typedef struct inohash_slot {
+    INODETYPE ino; /* inode number */
+    void *elem;    /* element pointer; NULL == empty slot */
+} inohash_slot_t;
+
+typedef struct inohash {
+    inohash_slot_t *slot; /* slots */
+    size_t mask;          /* slot count - 1 */
+    size_t count;         /* elements in use */
+} inohash_t;
+
+/* Mix an inode number's bits (the MurmurHash3 64 bit finalizer) */
+static inline size_t inohash_mix(INODETYPE ino) {
+    uint64_t h = (uint64_t)ino;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return ((size_t)h);
+}
+
+/* Return the slot count that holds n elements below the load limit */
+static inline size_t inohash_slots(size_t n) {
+    size_t ns = INOHASH_MINSLOTS;
+
+    while (ns - ns / 4 < n + 1)
+        ns *= 2;
+    return (ns);
+}
+
+/* Find an inode's element, return NULL if not found */
+static inline void *inohash_find(const inohash_t *h, INODETYPE ino) {
+    size_t i;
+
+    if (!h->slot)
+        return (NULL);
+    for (i = inohash_mix(ino) & h->mask; h->slot[i].elem;
+         i = (i + 1) & h->mask) {
+        if (h->slot[i].ino == ino)
+            return (h->slot[i].elem);
+    }
+    return (NULL);
+}
+
+/* Size an index for n elements and empty it, keeping a larger allocation
+ *
+ * return: 0 on success; -1 if no space could be allocated
+ **/
+static inline int inohash_reset(inohash_t *h, size_t n) {
+    size_t ns = inohash_slots(n);
+    inohash_slot_t *sp;
+
+    if (h->slot && ns <= h->mask + 1) {
+        (void)memset((void *)h->slot, 0, (h->mask + 1) * sizeof(*h->slot));
+        h->count = 0;
+        return (0);
+    }
+    if (!(sp = (inohash_slot_t *)calloc(ns, sizeof(*sp))))
+        return (-1);
+    if (h->slot)
+        free((void *)h->slot);
+    h->slot = sp;
+    h->mask = ns - 1;
+    h->count = 0;
+    return (0);
+}
+
+/* Insert an element, replacing any element already entered for its inode
+ *
+ * return: 0 on success; -1 if no space could be allocated
+ **/
+static inline int inohash_insert(inohash_t *h, INODETYPE ino, void *elem) {
+    size_t i, j, ns;
+    inohash_slot_t *sp;
+
+    if (!h->slot || h->count + 1 > (h->mask + 1) - (h->mask + 1) / 4) {
+
+        /*
+         * Double the slot count and rehash the elements.
+         */
+        ns = h->slot ? (h->mask + 1) * 2 : INOHASH_MINSLOTS;
+        if (!(sp = (inohash_slot_t *)calloc(ns, sizeof(*sp))))
+            return (-1);
+        if (h->slot) {
+            for (j = 0; j <= h->mask; j++) {
+                if (!h->slot[j].elem)
+                    continue;
+                for (i = inohash_mix(h->slot[j].ino) & (ns - 1); sp[i].elem;
+                     i = (i + 1) & (ns - 1))
+                    ;
+                sp[i] = h->slot[j];
+            }
+            free((void *)h->slot);
+        }
+        h->slot = sp;
+        h->mask = ns - 1;
+    }
+    for (i = inohash_mix(ino) & h->mask; h->slot[i].elem;
+         i = (i + 1) & h->mask) {
+        if (h->slot[i].ino == ino) {
+            h->slot[i].elem = elem;
+            return (0);
+        }
+    }
+    h->slot[i].ino = ino;
+    h->slot[i].elem = elem;
+    h->count++;
+    return (0);
+}
+
+/* Iterate over an index's elements
+ *
+ * h: pointer to inohash_t
+ * i: size_t slot index
+ * e: element pointer, set to each element in turn
+ **/
+#    define INOHASH_FOREACH(h, i, e)                                           \
+        for ((i) = 0; (h)->slot && (i) <= (h)->mask; (i)++)                    \
+            if (((e) = (h)->slot[(i)].elem))
+
 #endif
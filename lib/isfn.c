@@ -349,7 +349,7 @@ int is_file_named(struct lsof_context *ctx,
 #    endif /* defined(HAVECLONEMAJ) */
     }
     if (s)
-        s->f = 1;
+        SEL_FOUND(ctx, s->f, 1);
     return (1);
 }
 #else  /* !defined(USE_LIB_IS_FILE_NAMED) */
@@ -97,6 +97,15 @@ struct lsof_context *lsof_new() {
 
         /* COMMAND column width limit */
         CmdLim = CMDL;
+
+        /* all file attributes are needed */
+        NeedAttr = NEED_ALL;
+
+        /* select all files when no selection is made */
+        SelAll = SELALL;
+
+        /* own PID, whose FDs initialize() probes for the offset type */
+        Mypid = getpid();
     }
     return ctx;
 }
@@ -119,6 +128,19 @@ enum lsof_error lsof_avoid_forking(struct lsof_context *ctx, int avoid) {
     return LSOF_SUCCESS;
 }
 
+API_EXPORT
+enum lsof_error lsof_set_scan_threads(struct lsof_context *ctx, int threads) {
+    if (!ctx || ctx->frozen || threads < 0) {
+        return LSOF_ERROR_INVALID_ARGUMENT;
+    }
+#if defined(HASPARSCAN)
+    ScanThr = (threads > MAXSCANTHR) ? MAXSCANTHR : threads;
+    return LSOF_SUCCESS;
+#else  /* !defined(HASPARSCAN) */
+    return LSOF_ERROR_UNSUPPORTED;
+#endif /* defined(HASPARSCAN) */
+}
+
 API_EXPORT
 enum lsof_error lsof_logic_and(struct lsof_context *ctx) {
     if (!ctx || ctx->frozen) {
@@ -128,6 +150,32 @@ enum lsof_error lsof_logic_and(struct lsof_context *ctx) {
     return LSOF_SUCCESS;
 }
 
+API_EXPORT
+enum lsof_error lsof_set_fields(struct lsof_context *ctx, uint32_t fields) {
+    if (!ctx || ctx->frozen || (fields & ~LSOF_FIELD_ALL)) {
+        return LSOF_ERROR_INVALID_ARGUMENT;
+    }
+    NeedAttr = (int)fields;
+    /* A socket's device and inode come from its protocol information. */
+    if (NeedAttr & NEED_NODE)
+        NeedAttr |= NEED_SOCK;
+    return LSOF_SUCCESS;
+}
+
+API_EXPORT
+enum lsof_error lsof_set_max_matches(struct lsof_context *ctx,
+                                     size_t max_matches) {
+    if (!ctx || ctx->frozen) {
+        return LSOF_ERROR_INVALID_ARGUMENT;
+    }
+#if defined(HASMATCHLIMIT)
+    ctx->max_matches = max_matches;
+    return LSOF_SUCCESS;
+#else  /* !defined(HASMATCHLIMIT) */
+    return LSOF_ERROR_UNSUPPORTED;
+#endif /* defined(HASMATCHLIMIT) */
+}
+
 API_EXPORT
 enum lsof_error lsof_select_process(struct lsof_context *ctx, char *command,
                                     int exclude) {
@@ -230,29 +278,178 @@ enum lsof_error lsof_freeze(struct lsof_context *ctx) {
         AllProc = 0;
     }
 
+    need_sel_attrs(ctx);
+    compile_sels(ctx);
     initialize(ctx);
     hashSfile(ctx);
     ctx->frozen = 1;
     return LSOF_SUCCESS;
 }
 
-API_EXPORT
-enum lsof_error lsof_gather(struct lsof_context *ctx,
-                            struct lsof_result **result) {
-    enum lsof_error ret = LSOF_SUCCESS;
-    int pi = 0;  /* proc index */
-    int upi = 0; /* user proc index */
-    struct lsof_process *p;
-    struct lproc *lp;
-    int fi = 0; /* file index */
-    size_t num_files;
-    struct lsof_file *f;
-    struct lfile *lf;
-    struct lfile *lf_next;
-    size_t sel_procs = 0;
+/*
+ * The result block
+ *
+ * lsof_gather() returns its result in one allocation, in this order: the
+ * lsof_result, the process array, the files of all processes in process
+ * order, the selection array and a pool of the strings they point to.  The
+ * pool holds each distinct string once; rstr_pool indexes it by content while
+ * the result is built.
+ */
+
+#define RSTR_MINSLOTS 64 /* minimum string index slot count -- a power of 2 */
+#define RESALIGN(n) (((n) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+
+struct rstr_slot {
+    const char *s; /* string (NULL == empty slot) */
+    size_t len;    /* its length */
+    size_t hash;   /* its hash */
+    size_t off;    /* its pool offset */
+};
+
+struct rstr_pool {
+    struct rstr_slot *slot; /* slots */
+    size_t mask;            /* slot count - 1 */
+    size_t count;           /* strings in use */
+    size_t size;            /* pool size */
+    int err;                /* no space for the index */
+};
+
+/*
+ * rstr_hash() - hash a string (FNV-1a) and return its length
+ */
+
+static size_t rstr_hash(const char *s, /* string */
+                        size_t *len)   /* returned length */
+{
+    size_t h = (size_t)14695981039346656037ULL;
+    const unsigned char *cp;
+
+    for (cp = (const unsigned char *)s; *cp; cp++) {
+        h ^= (size_t)*cp;
+        h *= (size_t)1099511628211ULL;
+    }
+    *len = (size_t)(cp - (const unsigned char *)s);
+    return (h);
+}
+
+/*
+ * rstr_slot() - find a string's slot, or the empty slot it would go in
+ */
+
+static struct rstr_slot *rstr_slot(struct rstr_pool *sp, /* pool index */
+                                   const char *s,        /* string */
+                                   size_t len,           /* its length */
+                                   size_t h)             /* its hash */
+{
+    struct rstr_slot *rs;
+    size_t i;
+
+    for (i = h & sp->mask;; i = (i + 1) & sp->mask) {
+        rs = &sp->slot[i];
+        if (!rs->s || (rs->hash == h && rs->len == len && !strcmp(rs->s, s)))
+            return (rs);
+    }
+}
+
+/*
+ * rstr_add() - add a string to the pool, once
+ */
+
+static void rstr_add(struct rstr_pool *sp, /* pool index */
+                     const char *s)        /* string (may be NULL) */
+{
+    struct rstr_slot *os, *rs;
+    size_t h, i, len, ns;
+
+    if (!s || sp->err)
+        return;
+    if (!sp->slot || sp->count + 1 > sp->mask + 1 - (sp->mask + 1) / 4) {
+
+        /*
+         * Double the index (or allocate it) and rehash its strings.
+         */
+        ns = sp->slot ? (sp->mask + 1) * 2 : RSTR_MINSLOTS;
+        os = sp->slot;
+        if (!(sp->slot = (struct rstr_slot *)calloc(ns, sizeof(*sp->slot)))) {
+            sp->slot = os;
+            sp->err = 1;
+            return;
+        }
+        i = os ? sp->mask + 1 : 0;
+        sp->mask = ns - 1;
+        if (os) {
+            while (i--) {
+                if (os[i].s)
+                    *rstr_slot(sp, os[i].s, os[i].len, os[i].hash) = os[i];
+            }
+            free(os);
+        }
+    }
+    h = rstr_hash(s, &len);
+    if ((rs = rstr_slot(sp, s, len, h))->s)
+        return;
+    rs->s = s;
+    rs->len = len;
+    rs->hash = h;
+    rs->off = sp->size;
+    sp->size += len + 1;
+    sp->count++;
+}
+
+/*
+ * rstr_get() - get a string's pool copy
+ */
+
+static char *rstr_get(struct rstr_pool *sp, /* pool index */
+                      char *pool,           /* pool */
+                      const char *s)        /* string (may be NULL) */
+{
+    size_t h, len;
+
+    if (!s)
+        return (NULL);
+    h = rstr_hash(s, &len);
+    return (pool + rstr_slot(sp, s, len, h)->off);
+}
+
+/*
+ * put_sel() - count a selection and pool its string, or fill it in
+ */
+
+static void put_sel(struct lsof_selection *sel, /* selections (NULL == count) */
+                    size_t *n,                  /* selection index */
+                    struct rstr_pool *sp,       /* string pool index */
+                    char *pool,                 /* string pool */
+                    enum lsof_selection_type type, /* selection type */
+                    int found,                     /* selection found */
+                    char *string,                  /* string argument */
+                    uint64_t integer)              /* integer argument */
+{
+    if (!sel) {
+        rstr_add(sp, string);
+    } else {
+        sel[*n].type = type;
+        sel[*n].found = found;
+        sel[*n].string = rstr_get(sp, pool, string);
+        sel[*n].integer = integer;
+    }
+    (*n)++;
+}
+
+/*
+ * put_sels() - count the selections and pool their strings, or fill them in
+ *
+ * return: the selection count
+ */
+
+static size_t put_sels(struct lsof_context *ctx,    /* context */
+                       struct lsof_selection *sel, /* NULL == count */
+                       struct rstr_pool *sp,       /* string pool index */
+                       char *pool)                 /* string pool */
+{
+    size_t n = 0;
+    int found, i;
     char *cp;
-    char buf[64];
-    int s;
     struct str_lst *str;
     struct sfile *sfp;
     struct nwad *np, *npn;
@@ -265,412 +462,568 @@ enum lsof_error lsof_gather(struct lsof_context *ctx,
 #if defined(HASSELINUX)
     cntxlist_t *cntxp;
 #endif /* defined(HASSELINUX) */
-    int pass;
-    int i;
-    struct lsof_selection *selections;
-    size_t num_selections = 0;
 
-    if (!result) {
-        ret = LSOF_ERROR_INVALID_ARGUMENT;
-        return ret;
-    } else if (!ctx->frozen) {
-        ret = lsof_freeze(ctx);
-        if (ret != LSOF_SUCCESS)
-            return ret;
+    /* command */
+    for (str = Cmdl; str; str = str->next) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_COMMAND, str->f, str->str, 0);
     }
 
-    gather_proc_info(ctx);
-
-    /* Cleanup orphaned cur_file, if any*/
-    if (ctx->cur_file) {
-        CLEAN(ctx->cur_file->dev_ch);
-        CLEAN(ctx->cur_file->nm);
-        CLEAN(ctx->cur_file->nma);
-        CLEAN(ctx->cur_file);
+    /* command regex */
+    for (i = 0; i < NCmdRxU; i++) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_COMMAND_REGEX,
+                CmdRx[i].mc > 0, CmdRx[i].exp, 0);
     }
 
-    /* Count selected procs */
-    for (pi = 0; pi < ctx->procs_size; pi++) {
-        lp = &ctx->procs[pi];
-        if (lp->pss) {
-            sel_procs++;
-        }
+    /* select file or file system */
+    for (sfp = Sfile; sfp; sfp = sfp->next) {
+        put_sel(sel, &n, sp, pool,
+                sfp->type ? LSOF_SELECTION_PATH : LSOF_SELECTION_FILE_SYSTEM,
+                sfp->f, sfp->aname, 0);
     }
 
-    /* Fill result */
-    struct lsof_result *res =
-        (struct lsof_result *)malloc(sizeof(struct lsof_result));
-    struct lsof_process *user_procs =
-        (struct lsof_process *)malloc(sizeof(struct lsof_process) * sel_procs);
-    memset(user_procs, 0, sizeof(struct lsof_process) * sel_procs);
-
-    for (pi = 0, upi = 0; pi < ctx->procs_size; pi++) {
-        /* Copy fields from lproc */
-        lp = &ctx->procs[pi];
-        if (lp->pss) {
-            /* selected process */
-            p = &user_procs[upi++];
-
-            p->command = lp->cmd;
-            lp->cmd = NULL;
-            p->pid = lp->pid;
-
-#if defined(HASTASKS)
-            p->tid = lp->tid;
-            p->task_cmd = lp->tcmd;
-            lp->tcmd = NULL;
-#endif
-#if defined(HASZONES)
-            p->solaris_zone = lp->zn;
-            lp->zn = NULL;
-#endif
-#if defined(HASSELINUX)
-            p->selinux_context = lp->cntx;
-            lp->cntx = NULL;
-#endif
+#if defined(HASPROCFS)
+    /* procfs */
+    if (Procsrch) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_FILE_SYSTEM, Procfind,
+                Mtprocfs ? Mtprocfs->dir : HASPROCFS, 0);
+    }
 
-            p->pgid = lp->pgid;
-            p->ppid = lp->ppid;
-            p->uid = lp->uid;
+    for (pfi = Procfsid; pfi; pfi = pfi->next) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_PATH, pfi->f, pfi->nm, 0);
+    }
+#endif /* defined(HASPROCFS) */
 
-            /* Compute number of files in the linked list */
-            num_files = 0;
-            for (lf = lp->file; lf; lf = lf->next) {
-                if (!is_file_sel(ctx, lp, lf))
-                    continue;
-                num_files++;
+    /* network address */
+    for (np = Nwad; np;) {
+        found = np->f;
+        if (!(cp = np->arg)) {
+            np = np->next;
+            continue;
+        }
+        for (npn = np->next; npn; npn = npn->next) {
+            if (!npn->arg)
+                continue;
+            if (!strcmp(cp, npn->arg)) {
+                /* Found duplicate specification */
+                found |= npn->f;
+            } else {
+                break;
             }
+        }
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_NETWORK_ADDRESS, found,
+                np->arg, 0);
+        np = npn;
+    }
 
-            p->files = (struct lsof_file *)malloc(sizeof(struct lsof_file) *
-                                                  num_files);
-            memset(p->files, 0, sizeof(struct lsof_file) * num_files);
-            p->num_files = num_files;
-            for (fi = 0, lf = lp->file; lf; lf = lf_next) {
-                if (is_file_sel(ctx, lp, lf)) {
-                    /* Copy fields from lfile */
-                    f = &p->files[fi++];
-                    f->flags = 0;
-
-                    /* FD column */
-                    f->fd_type = lf->fd_type;
-                    f->fd_num = lf->fd_num;
-                    f->access = lf->access;
-                    f->lock = lf->lock;
-
-                    /* TYPE column */
-                    f->file_type = lf->type;
-                    f->unknown_file_type_number = lf->unknown_file_type_number;
-
-                    /* DEVICE column */
-                    f->dev = lf->dev;
-                    if (lf->dev_def) {
-                        f->flags |= LSOF_FILE_FLAG_DEV_VALID;
-                    }
-                    f->rdev = lf->rdev;
-                    if (lf->rdev_def) {
-                        f->flags |= LSOF_FILE_FLAG_RDEV_VALID;
-                    }
-
-                    /* SIZE, SIZE/OFF, OFFSET column */
-                    f->size = lf->sz;
-                    if (lf->sz_def) {
-                        f->flags |= LSOF_FILE_FLAG_SIZE_VALID;
-                    }
-                    f->offset = lf->off;
-                    if (lf->off_def) {
-                        f->flags |= LSOF_FILE_FLAG_OFFSET_VALID;
-                    }
-
-                    /* NLINK column */
-                    f->num_links = lf->nlink;
-                    if (lf->nlink_def) {
-                        f->flags |= LSOF_FILE_FLAG_NUM_LINKS_VALID;
-                    }
-
-                    /* NODE column */
-                    f->inode = lf->inode;
-                    if (lf->inp_ty == 1 || lf->inp_ty == 3) {
-                        f->flags |= LSOF_FILE_FLAG_INODE_VALID;
-                    }
-
-                    /* NAME column */
-                    f->name = lf->nm;
-                    lf->nm = NULL;
-                }
-                lf_next = lf->next;
+    /* ip protocol */
+    if (Fnet) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_INTERNET, Fnet == 2, NULL,
+                0);
+    }
+
+#if defined(HASTCPUDPSTATE)
+    /* tcp/tpi protocol state */
+    if (TcpStIn) {
+        for (i = 0; i < TcpNstates; i++) {
+            if (TcpStI[i]) {
+                put_sel(sel, &n, sp, pool, LSOF_SELECTION_PROTOCOL_STATE,
+                        TcpStI[i] == 2, TcpSt[i], 0);
             }
         }
-
-        for (lf = lp->file; lf; lf = lf_next) {
-            /* free lf */
-            lf_next = lf->next;
-            CLEAN(lf->nma);
-            CLEAN(lf->dev_ch);
-#if defined(CLRLFILEADD)
-            CLRLFILEADD(lf)
-#endif /* defined(CLRLFILEADD) */
-            CLEAN(lf);
+    }
+    if (UdpStIn) {
+        for (i = 0; i < UdpNstates; i++) {
+            if (UdpStI[i]) {
+                put_sel(sel, &n, sp, pool, LSOF_SELECTION_PROTOCOL_STATE,
+                        UdpStI[i] == 2, UdpSt[i], 0);
+            }
         }
-        lp->file = NULL;
+    }
+#endif /* defined(HASTCPUDPSTATE) */
 
-        /* skip and free */
-        CLEAN(lp->cmd);
-#if defined(HASTASKS)
-        CLEAN(lp->tcmd);
-#endif
-#if defined(HASSELINUX)
-        CLEAN(lp->cntx);
-#endif /* defined(HASSELINUX) */
-        continue;
+    /* nfs */
+    if (Fnfs) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_NFS, Fnfs == 2, NULL, 0);
     }
 
-    /* Cleanup */
-    CLEAN(ctx->procs);
-    ctx->cur_proc = NULL;
+    /* pid */
+    for (i = 0; i < Npid; i++) {
+        if (Spid[i].x)
+            continue;
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_PID, Spid[i].f, NULL,
+                Spid[i].i);
+    }
 
-    res->processes = user_procs;
-    res->num_processes = sel_procs;
+    /* pgid */
+    for (i = 0; i < Npgid; i++) {
+        if (Spgid[i].x)
+            continue;
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_PGID, Spgid[i].f, NULL,
+                Spgid[i].i);
+    }
 
-    ctx->procs_size = ctx->procs_cap = 0;
-    ctx->cur_file = ctx->prev_file = NULL;
+    /* uid */
+    for (i = 0; i < Nuid; i++) {
+        if (Suid[i].excl)
+            continue;
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_UID, Suid[i].f, Suid[i].lnm,
+                Suid[i].uid);
+    }
 
-    /* Collect selection result */
-    for (pass = 0; pass < 2; pass++) {
-        num_selections = 0;
+#if defined(HASTASKS)
+    /* tasks */
+    if (Ftask) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_TASK, Ftask == 2, NULL, 0);
+    }
+#endif /* defined(HASTASKS) */
 
-        /* command */
-        for (str = Cmdl; str; str = str->next) {
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_COMMAND;
-                selections[num_selections].found = str->f;
-                selections[num_selections].string = str->str;
+#if defined(HASZONES)
+    /* solaris zones */
+    if (ZoneArg) {
+        for (i = 0; i < HASHZONE; i++) {
+            for (zp = ZoneArg[i]; zp; zp = zp->next) {
+                put_sel(sel, &n, sp, pool, LSOF_SELECTION_SOLARIS_ZONE, zp->f,
+                        zp->zn, 0);
             }
-            num_selections++;
         }
+    }
+#endif /* defined(HASZONES) */
 
-        /* command regex */
-        for (i = 0; i < NCmdRxU; i++) {
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_COMMAND_REGEX;
-                selections[num_selections].found = CmdRx[i].mc > 0;
-                selections[num_selections].string = CmdRx[i].exp;
-            }
-            num_selections++;
-        }
+#if defined(HASSELINUX)
+    /* SELinux context */
+    for (cntxp = CntxArg; cntxp; cntxp = cntxp->next) {
+        put_sel(sel, &n, sp, pool, LSOF_SELECTION_SELINUX_CONTEXT, cntxp->f,
+                cntxp->cntx, 0);
+    }
+#endif /* defined(HASSELINUX) */
 
-        /* select file or file system */
-        for (sfp = Sfile; sfp; sfp = sfp->next) {
-            if (pass) {
-                selections[num_selections].type =
-                    sfp->type ? LSOF_SELECTION_PATH
-                              : LSOF_SELECTION_FILE_SYSTEM;
-                selections[num_selections].found = sfp->f;
-                selections[num_selections].string = sfp->aname;
-            }
-            num_selections++;
-        }
+    return (n);
+}
 
-#if defined(HASPROCFS)
-        /* procfs */
-        if (Procsrch) {
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_FILE_SYSTEM;
-                selections[num_selections].found = Procfind;
-                selections[num_selections].string =
-                    Mtprocfs ? Mtprocfs->dir : HASPROCFS;
-            }
-            num_selections++;
-        }
+/*
+ * put_file() - copy an lfile to a result file
+ */
 
-        for (pfi = Procfsid; pfi; pfi = pfi->next) {
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_PATH;
-                selections[num_selections].found = pfi->f;
-                selections[num_selections].string = pfi->nm;
-            }
-            num_selections++;
-        }
-#endif /* defined(HASPROCFS) */
+static void put_file(struct lsof_file *f, /* result file */
+                     struct lfile *lf,    /* lfile */
+                     struct rstr_pool *sp, /* string pool index */
+                     char *pool)           /* string pool */
+{
+    f->flags = 0;
+
+    /* FD column */
+    f->fd_type = lf->fd_type;
+    f->fd_num = lf->fd_num;
+    f->access = lf->access;
+    f->lock = lf->lock;
+
+    /* TYPE column */
+    f->file_type = lf->type;
+    f->unknown_file_type_number = lf->unknown_file_type_number;
+
+    /* DEVICE column */
+    f->dev = lf->dev;
+    if (lf->dev_def) {
+        f->flags |= LSOF_FILE_FLAG_DEV_VALID;
+    }
+    f->rdev = lf->rdev;
+    if (lf->rdev_def) {
+        f->flags |= LSOF_FILE_FLAG_RDEV_VALID;
+    }
 
-        /* network address */
-        for (np = Nwad; np;) {
-            int found = np->f;
-            if (!(cp = np->arg)) {
-                np = np->next;
-                continue;
-            }
-            for (npn = np->next; npn; npn = npn->next) {
-                if (!npn->arg)
-                    continue;
-                if (!strcmp(cp, npn->arg)) {
-                    /* Found duplicate specification */
-                    found |= npn->f;
-                } else {
-                    break;
-                }
-            }
+    /* SIZE, SIZE/OFF, OFFSET column */
+    f->size = lf->sz;
+    if (lf->sz_def) {
+        f->flags |= LSOF_FILE_FLAG_SIZE_VALID;
+    }
+    f->offset = lf->off;
+    if (lf->off_def) {
+        f->flags |= LSOF_FILE_FLAG_OFFSET_VALID;
+    }
 
-            if (pass) {
-                selections[num_selections].type =
-                    LSOF_SELECTION_NETWORK_ADDRESS;
-                selections[num_selections].found = found;
-                selections[num_selections].string = np->arg;
-            }
-            num_selections++;
-            np = npn;
-        }
+    /* NLINK column */
+    f->num_links = lf->nlink;
+    if (lf->nlink_def) {
+        f->flags |= LSOF_FILE_FLAG_NUM_LINKS_VALID;
+    }
 
-        /* ip protocol */
-        if (Fnet) {
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_INTERNET;
-                selections[num_selections].found = Fnet == 2;
-            }
-            num_selections++;
-        }
+    /* NODE column */
+    f->inode = lf->inode;
+    if (lf->inp_ty == 1 || lf->inp_ty == 3) {
+        f->flags |= LSOF_FILE_FLAG_INODE_VALID;
+    }
 
-#if defined(HASTCPUDPSTATE)
-        /* tcp/tpi protocol state */
-        if (TcpStIn) {
-            for (i = 0; i < TcpNstates; i++) {
-                if (TcpStI[i]) {
-                    if (pass) {
-                        selections[num_selections].type =
-                            LSOF_SELECTION_PROTOCOL_STATE;
-                        selections[num_selections].found = TcpStI[i] == 2;
-                        selections[num_selections].string = TcpSt[i];
-                    }
-                    num_selections++;
-                }
-            }
-        }
-        if (UdpStIn) {
-            for (i = 0; i < UdpNstates; i++) {
-                if (UdpStI[i]) {
-                    if (pass) {
-                        selections[num_selections].type =
-                            LSOF_SELECTION_PROTOCOL_STATE;
-                        selections[num_selections].found = UdpStI[i] == 2;
-                        selections[num_selections].string = UdpSt[i];
-                    }
-                    num_selections++;
-                }
-            }
-        }
-#endif /* defined(HASTCPUDPSTATE) */
+    /* NAME column */
+    f->name = rstr_get(sp, pool, lf->nm);
+}
 
-        /* nfs */
-        if (Fnfs) {
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_NFS;
-                selections[num_selections].found = Fnfs == 2;
-            }
-            num_selections++;
-        }
+/*
+ * has_sel_file() - does a process have a selected file?
+ */
 
-        /* pid */
-        for (i = 0; i < Npid; i++) {
-            if (Spid[i].x)
-                continue;
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_PID;
-                selections[num_selections].found = Spid[i].f;
-                selections[num_selections].integer = Spid[i].i;
-            }
-            num_selections++;
-        }
+static int has_sel_file(struct lsof_context *ctx, /* context */
+                        struct lproc *lp)         /* lproc */
+{
+    struct lfile *lf;
 
-        /* pgid */
-        for (i = 0; i < Npgid; i++) {
-            if (Spgid[i].x)
-                continue;
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_PGID;
-                selections[num_selections].found = Spgid[i].f;
-                selections[num_selections].integer = Spgid[i].i;
-            }
-            num_selections++;
-        }
+    for (lf = lp->file; lf; lf = lf->next) {
+        if (is_file_sel(ctx, lp, lf))
+            return (1);
+    }
+    return (0);
+}
+
+/*
+ * put_result() - build a result block from the selected processes of an
+ *		  lproc array and, optionally, the selection status
+ *
+ * When the context selects files by change status, processes without such
+ * files are left out.
+ *
+ * return: LSOF_SUCCESS, or LSOF_ERROR_NO_MEMORY
+ */
+
+static enum lsof_error put_result(struct lsof_context *ctx, /* context */
+                                  struct lproc *procs,      /* lproc array */
+                                  int nprocs,               /* its length */
+                                  int sels, /* report selection status */
+                                  struct lsof_result **result) /* result */
+{
+    struct rstr_pool sp;
+    size_t nf = 0, np = 0, ns = 0;
+    size_t fo, po, so, sz, i;
+    struct lsof_result *res;
+    struct lsof_process *p;
+    struct lsof_file *f;
+    struct lproc *lp;
+    struct lfile *lf;
+    char *blk, *pool;
+    int pi;
 
-        /* uid */
-        for (i = 0; i < Nuid; i++) {
-            if (Suid[i].excl)
+    /*
+     * Count the selected processes, their selected files and the selections,
+     * and index the distinct strings they carry.
+     */
+    zeromem((char *)&sp, sizeof(sp));
+    for (pi = 0; pi < nprocs; pi++) {
+        lp = &procs[pi];
+        if (!lp->pss || (ctx->delta_sel && !has_sel_file(ctx, lp)))
+            continue;
+        np++;
+        rstr_add(&sp, lp->cmd);
+#if defined(HASTASKS)
+        rstr_add(&sp, lp->tcmd);
+#endif /* defined(HASTASKS) */
+#if defined(HASZONES)
+        rstr_add(&sp, lp->zn);
+#endif /* defined(HASZONES) */
+#if defined(HASSELINUX)
+        rstr_add(&sp, lp->cntx);
+#endif /* defined(HASSELINUX) */
+        for (lf = lp->file; lf; lf = lf->next) {
+            if (!is_file_sel(ctx, lp, lf))
                 continue;
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_UID;
-                selections[num_selections].found = Suid[i].f;
-                selections[num_selections].string = Suid[i].lnm;
-                selections[num_selections].integer = Suid[i].uid;
-            }
-            num_selections++;
+            nf++;
+            rstr_add(&sp, lf->nm);
         }
+    }
+    if (sels)
+        ns = put_sels(ctx, (struct lsof_selection *)NULL, &sp, (char *)NULL);
+    /*
+     * Allocate the block and fill its string pool.
+     */
+    po = RESALIGN(sizeof(struct lsof_result));
+    fo = po + RESALIGN(np * sizeof(struct lsof_process));
+    so = fo + RESALIGN(nf * sizeof(struct lsof_file));
+    sz = so + RESALIGN(ns * sizeof(struct lsof_selection));
+    if (sp.err || !(blk = (char *)calloc(1, sz + sp.size))) {
+        CLEAN(sp.slot);
+        return (LSOF_ERROR_NO_MEMORY);
+    }
+    pool = blk + sz;
+    for (i = 0; sp.slot && i <= sp.mask; i++) {
+        if (sp.slot[i].s)
+            (void)memcpy(pool + sp.slot[i].off, sp.slot[i].s,
+                         sp.slot[i].len + 1);
+    }
+    res = (struct lsof_result *)blk;
+    res->processes = (struct lsof_process *)(blk + po);
+    res->num_processes = np;
+    res->selections = (struct lsof_selection *)(blk + so);
+    res->num_selections = ns;
+    /*
+     * Fill in the processes, each pointing to its range of the file array,
+     * and the selections.
+     */
+    p = res->processes;
+    f = (struct lsof_file *)(blk + fo);
+    for (pi = 0; pi < nprocs; pi++) {
+        lp = &procs[pi];
+        if (!lp->pss || (ctx->delta_sel && !has_sel_file(ctx, lp)))
+            continue;
+        p->command = rstr_get(&sp, pool, lp->cmd);
+        p->pid = lp->pid;
 
 #if defined(HASTASKS)
-        /* tasks */
-        if (Ftask) {
-            if (pass) {
-                selections[num_selections].type = LSOF_SELECTION_TASK;
-                selections[num_selections].found = Ftask == 2;
-            }
-            num_selections++;
+        p->tid = lp->tid;
+        p->task_cmd = rstr_get(&sp, pool, lp->tcmd);
+#endif
+#if defined(HASZONES)
+        p->solaris_zone = rstr_get(&sp, pool, lp->zn);
+#endif
+#if defined(HASSELINUX)
+        p->selinux_context = rstr_get(&sp, pool, lp->cntx);
+#endif
+
+        p->pgid = lp->pgid;
+        p->ppid = lp->ppid;
+        p->uid = lp->uid;
+        p->files = f;
+        for (lf = lp->file; lf; lf = lf->next) {
+            if (is_file_sel(ctx, lp, lf))
+                put_file(f++, lf, &sp, pool);
         }
-#endif /* defined(HASTASKS) */
+        p->num_files = (uint32_t)(f - p->files);
+        p++;
+    }
+    if (sels)
+        (void)put_sels(ctx, res->selections, &sp, pool);
+    CLEAN(sp.slot);
+    *result = res;
+    return (LSOF_SUCCESS);
+}
 
+/*
+ * free_procs() - free the lproc structures of a gather, keeping their array
+ */
+
+static void free_procs(struct lsof_context *ctx) /* context */
+{
+    int pi;
+    struct lproc *lp;
+
+#if !defined(HASARENA)
+    /* Cleanup orphaned cur_file, if any*/
+    if (ctx->cur_file) {
+        CLEAN(ctx->cur_file->dev_ch);
+        CLEAN(ctx->cur_file->nm);
+        CLEAN(ctx->cur_file->nma);
+        CLEAN(ctx->cur_file);
+    }
+#endif /* !defined(HASARENA) */
+
+    for (pi = 0; pi < ctx->procs_size; pi++) {
+        lp = &ctx->procs[pi];
+        (void)free_lproc(lp);
 #if defined(HASZONES)
-        /* solaris zones */
-        if (ZoneArg) {
-            for (i = 0; i < HASHZONE; i++) {
-                for (zp = ZoneArg[i]; zp; zp = zp->next) {
-                    if (pass) {
-                        selections[num_selections].type =
-                            LSOF_SELECTION_SOLARIS_ZONE;
-                        selections[num_selections].found = zp->f;
-                        selections[num_selections].string = zp->zn;
-                    }
-                    num_selections++;
-                }
-            }
-        }
+        CLEAN(lp->zn);
 #endif /* defined(HASZONES) */
-
 #if defined(HASSELINUX)
-        /* SELinux context */
-        if (CntxArg) {
-            for (cntxp = CntxArg; cntxp; cntxp = cntxp->next) {
-                if (pass) {
-                    selections[num_selections].type =
-                        LSOF_SELECTION_SELINUX_CONTEXT;
-                    selections[num_selections].found = cntxp->f;
-                    selections[num_selections].string = cntxp->cntx;
-                }
-                num_selections++;
-            }
-        }
+        CLEAN(lp->cntx);
 #endif /* defined(HASSELINUX) */
+    }
+    ctx->procs_size = 0;
+    ctx->cur_proc = NULL;
+    ctx->cur_file = ctx->prev_file = NULL;
+
+#if defined(HASARENA)
+    /* Discard all files in O(1), keeping the space for the next gather */
+    arena_reset(ctx);
+#endif /* defined(HASARENA) */
+}
 
-        /* allocation selections array */
-        if (pass == 0) {
-            selections = (struct lsof_selection *)malloc(
-                sizeof(struct lsof_selection) * num_selections);
-            memset(selections, 0,
-                   sizeof(struct lsof_selection) * num_selections);
-            res->selections = selections;
-            res->num_selections = num_selections;
+/*
+ * stream_procs() - hand the selected processes gathered so far to the
+ *		    lsof_gather_stream() callback, then free them
+ *
+ * return: 1 if the gather should stop; 0 otherwise
+ */
+
+int stream_procs(struct lsof_context *ctx) /* context */
+{
+    struct lsof_result *res = (struct lsof_result *)NULL;
+    int stop = 0;
+    size_t pi;
+
+    if (!ctx->procs_size)
+        return (0);
+    if ((ctx->stream_err =
+             put_result(ctx, ctx->procs, ctx->procs_size, 0, &res)) !=
+        LSOF_SUCCESS) {
+        stop = 1;
+    } else {
+        for (pi = 0; !stop && pi < res->num_processes; pi++) {
+            stop = ctx->stream_cb(&res->processes[pi], ctx->stream_data);
         }
+        CLEAN(res);
     }
+    free_procs(ctx);
+    return (stop ? 1 : 0);
+}
 
-    /* Params */
-    *result = res;
+API_EXPORT
+enum lsof_error lsof_gather(struct lsof_context *ctx,
+                            struct lsof_result **result) {
+    enum lsof_error ret = LSOF_SUCCESS;
+
+    if (!result) {
+        ret = LSOF_ERROR_INVALID_ARGUMENT;
+        return ret;
+    } else if (!ctx->frozen) {
+        ret = lsof_freeze(ctx);
+        if (ret != LSOF_SUCCESS)
+            return ret;
+    }
+
+    gather_proc_info(ctx);
+
+    /* Fill result */
+    ret = put_result(ctx, ctx->procs, ctx->procs_size, 1, result);
+
+    /* Cleanup */
+    free_procs(ctx);
+    CLEAN(ctx->procs);
+    ctx->procs_cap = 0;
+
+    return ret;
+}
+
+API_EXPORT
+enum lsof_error lsof_gather_pids(struct lsof_context *ctx, const uint32_t *pids,
+                                 size_t num_pids, struct lsof_result **result) {
+#if defined(HASPIDLIST)
+    static const uint32_t no_pids[1] = {0};
+    enum lsof_error ret;
+
+    if (!ctx || !result || (!pids && num_pids)) {
+        return LSOF_ERROR_INVALID_ARGUMENT;
+    }
+
+    /* An empty set selects no process */
+    ctx->pid_set = pids ? pids : no_pids;
+    ctx->pid_set_size = num_pids;
+    ret = lsof_gather(ctx, result);
+    ctx->pid_set = NULL;
+    ctx->pid_set_size = 0;
+    return ret;
+#else  /* !defined(HASPIDLIST) */
+    return LSOF_ERROR_UNSUPPORTED;
+#endif /* defined(HASPIDLIST) */
+}
+
+API_EXPORT
+enum lsof_error lsof_gather_stream(struct lsof_context *ctx,
+                                   lsof_process_callback on_process,
+                                   void *user_data) {
+    enum lsof_error ret = LSOF_SUCCESS;
+
+    if (!ctx || !on_process) {
+        return LSOF_ERROR_INVALID_ARGUMENT;
+    } else if (!ctx->frozen) {
+        ret = lsof_freeze(ctx);
+        if (ret != LSOF_SUCCESS)
+            return ret;
+    }
+
+    ctx->stream_cb = on_process;
+    ctx->stream_data = user_data;
+    ctx->stream_err = LSOF_SUCCESS;
+
+    gather_proc_info(ctx);
+
+    /*
+     * Hand over what the dialect hasn't streamed -- all of it if the dialect
+     * can't stream.
+     */
+    (void)stream_procs(ctx);
+    ret = ctx->stream_err;
+
+    /* Cleanup */
+    ctx->stream_cb = NULL;
+    ctx->stream_data = NULL;
+    free_procs(ctx);
+    CLEAN(ctx->procs);
+    ctx->procs_cap = 0;
 
     return ret;
 }
 
+API_EXPORT
+enum lsof_error lsof_gather_delta(struct lsof_context *ctx,
+                                  struct lsof_result **added,
+                                  struct lsof_result **removed,
+                                  struct lsof_result **changed) {
+    enum lsof_error ret = LSOF_SUCCESS;
+
+    if (!ctx || !added || !removed || !changed) {
+        return LSOF_ERROR_INVALID_ARGUMENT;
+    } else if (!ctx->frozen) {
+        ret = lsof_freeze(ctx);
+        if (ret != LSOF_SUCCESS)
+            return ret;
+    }
+    *added = *removed = *changed = NULL;
+
+    ctx->delta = 1;
+    gather_proc_info(ctx);
+    (void)delta_mark(ctx);
+
+    /* Fill the results, each from the files of one change status */
+    ctx->delta_sel = DELTA_SEL(DELTA_ADDED);
+    ret = put_result(ctx, ctx->procs, ctx->procs_size, 1, added);
+    if (ret == LSOF_SUCCESS) {
+        ctx->delta_sel = DELTA_SEL(DELTA_CHANGED);
+        ret = put_result(ctx, ctx->procs, ctx->procs_size, 0, changed);
+    }
+    if (ret == LSOF_SUCCESS) {
+        ctx->delta_sel = DELTA_SEL(DELTA_REMOVED);
+        ret = put_result(ctx, ctx->delta_procs, ctx->delta_procs_size, 0,
+                         removed);
+    }
+    ctx->delta_sel = 0;
+    if (ret != LSOF_SUCCESS) {
+        CLEAN(*added);
+        CLEAN(*changed);
+        CLEAN(*removed);
+    }
+
+    /* Keep this gather for the next call */
+    delta_save(ctx);
+    free_procs(ctx);
+
+    return ret;
+}
+
+/*
+ * free_mnt() - free the local mount table, so that the next readmnt()
+ *		reads it again
+ */
+
+void free_mnt(struct lsof_context *ctx) /* context */
+{
+    struct mounts *mnt, *mnt_next;
+
+    if (!Lmist)
+        return;
+    for (mnt = Lmi; mnt; mnt = mnt_next) {
+        mnt_next = mnt->next;
+        CLEAN(mnt->dir);
+        CLEAN(mnt->fsname);
+        CLEAN(mnt->fsnmres);
+#if defined(HASFSTYPE)
+        CLEAN(mnt->fstype);
+#endif
+        CLEAN(mnt);
+    }
+    Lmi = NULL;
+    Lmist = 0;
+}
+
 API_EXPORT
 void lsof_destroy(struct lsof_context *ctx) {
     int i;
     struct str_lst *str_lst, *str_lst_next;
     struct int_lst *int_lst, *int_lst_next;
-    struct mounts *mnt, *mnt_next;
     if (!ctx) {
         return;
     }
@@ -687,29 +1040,22 @@ void lsof_destroy(struct lsof_context *ctx) {
     }
     CLEAN(Suid);
     CLEAN(Nmlst);
+    free_sels(ctx);
 
     /* Free temporary */
     CLEAN(Namech);
+    delta_free(ctx, 1);
+    CLEAN(ctx->procs);
+#if defined(HASARENA)
+    arena_free(ctx);
+#endif /* defined(HASARENA) */
 #if defined(HASNLIST)
     CLEAN(Nl);
     Nll = 0;
 #endif /* defined(HASNLIST) */
 
     /* Free local mount info */
-    if (Lmist) {
-        for (mnt = Lmi; mnt; mnt = mnt_next) {
-            mnt_next = mnt->next;
-            CLEAN(mnt->dir);
-            CLEAN(mnt->fsname);
-            CLEAN(mnt->fsnmres);
-#if defined(HASFSTYPE)
-            CLEAN(mnt->fstype);
-#endif
-            CLEAN(mnt);
-        }
-        Lmi = NULL;
-        Lmist = 0;
-    }
+    free_mnt(ctx);
 
     /* state table */
 #if !defined(USE_LIB_PRINT_TCPTPI)
@@ -724,30 +1070,21 @@ void lsof_destroy(struct lsof_context *ctx) {
     CLEAN(UdpSt);
     CLEAN(Pn);
 
+#if defined(HASFDMEMO)
+    /* Free the delta gathers' FD stat(2) results */
+    (void)fd_memo_free(ctx);
+#endif /* defined(HASFDMEMO) */
+
+#if defined(HASIOURING)
+    /* Close the io_uring */
+    (void)ring_close(ctx);
+#endif /* defined(HASIOURING) */
+
     CLEAN(ctx);
 }
 
 API_EXPORT
 void lsof_free_result(struct lsof_result *result) {
-    int pi, fi;
-    struct lsof_process *p;
-    struct lsof_file *f;
-    for (pi = 0; pi < result->num_processes; pi++) {
-        p = &result->processes[pi];
-        /* Free files */
-        for (fi = 0; fi < p->num_files; fi++) {
-            f = &p->files[fi];
-            CLEAN(f->name);
-        }
-        CLEAN(p->files);
-
-        /* Free process fields */
-        CLEAN(p->command);
-        CLEAN(p->task_cmd);
-        CLEAN(p->solaris_zone);
-        CLEAN(p->selinux_context);
-    }
-    CLEAN(result->processes);
-    CLEAN(result->selections);
+    /* The result, its arrays and its strings are one allocation */
     CLEAN(result);
-}
\ No newline at end of file
+}
@@ -30,6 +30,7 @@
 
 #include "common.h"
 #include "dlsof.h"
+#include <limits.h>
 
 #if defined(HASWIDECHAR)
 #    if defined(WIDECHARINCL)
@@ -40,6 +41,11 @@
 #    endif /* defined(HASWCTYPE_H) */
 #endif     /* defined(HASWIDECHAR) */
 
+#if defined(HASSAFETHR)
+#    include <pthread.h>
+#    include <time.h>
+#endif /* defined(HASSAFETHR) */
+
 /*
  * Local definitions
  */
@@ -48,16 +54,57 @@
 #    define MAXSYMLINKS 32
 #endif /* !defined(MAXSYMLINKS) */
 
+#if defined(HASSAFETHR)
+#    define SAFE_MAXTHR 8   /* maximum worker threads that aren't hung */
+#    define SAFE_MAXHUNG 32 /* maximum hung worker threads */
+
+#    define SAFE_QUEUED 0    /* safe_req.state: waiting for a worker */
+#    define SAFE_RUNNING 1   /* safe_req.state: a worker is running it */
+#    define SAFE_DONE 2      /* safe_req.state: the function returned */
+#    define SAFE_ABANDONED 3 /* safe_req.state: the caller stopped waiting */
+
+/*
+ * A request to a worker thread.  The caller frees it, unless the caller
+ * abandons it at its deadline; then the worker frees it, if the function
+ * ever returns.
+ */
+
+struct safe_req {
+    int (*fn)();              /* function to perform */
+    char arg[MAXPATHLEN + 1]; /* function argument */
+    union {
+        char rbuf[MAXPATHLEN + 1]; /* response buffer */
+        struct stat _;             /* (aligns rbuf for stat()) */
+    } r;
+    int rbln;              /* response buffer length */
+    int rv;                /* function return value */
+    int en;                /* function errno */
+    int state;             /* SAFE_* state */
+    struct safe_req *next; /* next queued request */
+};
+#endif /* defined(HASSAFETHR) */
+
 /*
  * Local function prototypes
  */
 
+#if !defined(HASSAFETHR)
 static void closePipes(void);
+#endif /* !defined(HASSAFETHR) */
 static int dolstat(char *path, char *buf, int len);
 static int dostat(char *path, char *buf, int len);
 static int doreadlink(char *path, char *buf, int len);
 static int doinchild(struct lsof_context *ctx, int (*fn)(), char *fp,
                      char *rbuf, int rbln);
+#if defined(HASSAFETHR)
+static int doinworker(struct lsof_context *ctx, int (*fn)(), char *fp,
+                      char *rbuf, int rbln);
+static void safe_fork_child(void);
+static void safe_fork_parent(void);
+static void safe_fork_prepare(void);
+static void safe_init(void);
+static void *safe_worker(void *arg);
+#endif /* defined(HASSAFETHR) */
 
 #if defined(HASINTSIGNAL)
 static int handleint(int sig);
@@ -69,16 +116,37 @@ static void handleint(int sig);
  * Local variables
  */
 
-static pid_t Cpid = 0;  /* child PID */
 static jmp_buf Jmp_buf; /* jump buffer */
-static int Pipes[] =    /* pipes for child process */
+
+#if defined(HASSAFETHR)
+/*
+ * The worker threads are shared by all contexts, and may outlive them.
+ */
+static pthread_mutex_t SafeMtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SafeWork = PTHREAD_COND_INITIALIZER;
+/* a request has been queued, or
+ * idle workers have been retired */
+static pthread_cond_t SafeDone; /* a request is done (a CLOCK_MONOTONIC
+                                 * condition, set up by safe_init()) */
+static pthread_once_t SafeOnce = PTHREAD_ONCE_INIT;
+static struct safe_req *SafeHead = (struct safe_req *)NULL;
+static struct safe_req *SafeTail = (struct safe_req *)NULL;
+/* queued requests */
+static int SafeThr = 0;    /* worker threads, hung or not */
+static int SafeIdle = 0;   /* idle worker threads */
+static int SafeHung = 0;   /* workers running abandoned requests */
+static int SafeRetire = 0; /* idle workers asked to exit */
+#else                      /* !defined(HASSAFETHR) */
+static pid_t Cpid = 0; /* child PID */
+static int Pipes[] =   /* pipes for child process */
     {-1, -1, -1, -1};
 static int CtSigs[] = {0, SIGINT, SIGKILL};
 /* child termination signals (in order
  * of application) -- the first is a
  * dummy to allow pipe closure to
  * cause the child to exit */
-#define NCTSIGS (sizeof(CtSigs) / sizeof(int))
+#    define NCTSIGS (sizeof(CtSigs) / sizeof(int))
+#endif /* defined(HASSAFETHR) */
 
 #if defined(HASNLIST)
 /*
@@ -117,6 +185,18 @@ void build_Nl(struct lsof_context *ctx,
 }
 #endif /* defined(HASNLIST) */
 
+#if defined(HASSAFETHR)
+/*
+ * childx() - make the idle worker threads exit
+ */
+
+void childx(struct lsof_context *ctx) {
+    (void)pthread_mutex_lock(&SafeMtx);
+    SafeRetire = SafeIdle;
+    (void)pthread_cond_broadcast(&SafeWork);
+    (void)pthread_mutex_unlock(&SafeMtx);
+}
+#else  /* !defined(HASSAFETHR) */
 /*
  * childx() - make child process exit (if possible)
  */
@@ -194,6 +274,7 @@ static void closePipes() {
         }
     }
 }
+#endif /* defined(HASSAFETHR) */
 
 /*
  * compdev() - compare Devtp[] entries
@@ -234,7 +315,8 @@ void closefrom_shim(struct lsof_context *ctx, int low) {
 }
 
 /*
- * doinchild() -- do a function in a child process
+ * doinchild() -- do a function in a child process, or in a worker thread
+ *		  where there are threads
  */
 
 static int doinchild(struct lsof_context *ctx,
@@ -254,6 +336,11 @@ static int doinchild(struct lsof_context *ctx,
                       Pn, rbln);
         Error(ctx);
     }
+
+#if defined(HASSAFETHR)
+    if (!Fovhd)
+        return (doinworker(ctx, fn, fp, rbuf, rbln));
+#else  /* !defined(HASSAFETHR) */
     /*
      * Set up to handle an alarm signal; handle an alarm signal; build
      * pipes for exchanging information with a child process; start the
@@ -412,7 +499,10 @@ static int doinchild(struct lsof_context *ctx,
             errno = ECHILD;
             return (-1);
         }
-    } else {
+    } else
+#endif /* defined(HASSAFETHR) */
+
+    {
 
         /*
          * Do the operation directly -- not in a child.
@@ -431,6 +521,139 @@ static int doinchild(struct lsof_context *ctx,
     return (rv);
 }
 
+#if defined(HASSAFETHR)
+/*
+ * doinworker() -- do a function in a worker thread
+ *
+ * The caller waits for the function until TmLimit seconds have passed.  If
+ * it hasn't returned by then, the request is abandoned to the worker, which
+ * is counted as hung until the function returns, and a new worker is
+ * started for the next request.
+ */
+
+static int doinworker(struct lsof_context *ctx,
+                      int (*fn)(), /* function to perform */
+                      char *fp,    /* function parameter */
+                      char *rbuf,  /* response buffer */
+                      int rbln)    /* response buffer length */
+{
+    sigset_t all, old;
+    struct timespec dl;
+    int en, rv, te;
+    struct safe_req *pq, *q, *rq;
+    pthread_attr_t ta;
+    pthread_t tid;
+
+    if (strlen(fp) >= sizeof(rq->arg)) {
+        errno = ENAMETOOLONG;
+        return (-1);
+    }
+    (void)pthread_once(&SafeOnce, safe_init);
+    if (!(rq = (struct safe_req *)malloc(sizeof(struct safe_req)))) {
+        (void)fprintf(stderr, "%s: no space for worker thread request\n", Pn);
+        Error(ctx);
+    }
+    rq->fn = fn;
+    (void)strcpy(rq->arg, fp);
+    zeromem(rq->r.rbuf, rbln);
+    rq->rbln = rbln;
+    rq->state = SAFE_QUEUED;
+    rq->next = (struct safe_req *)NULL;
+    (void)clock_gettime(CLOCK_MONOTONIC, &dl);
+    dl.tv_sec += TmLimit;
+    (void)pthread_mutex_lock(&SafeMtx);
+    /*
+     * Don't wait on a file system that has already hung too many workers.
+     */
+    if (SafeHung >= SAFE_MAXHUNG) {
+        (void)pthread_mutex_unlock(&SafeMtx);
+        (void)free((FREE_P *)rq);
+        errno = ETIMEDOUT;
+        return (1);
+    }
+    /*
+     * Queue the request.  If no worker is idle, start another, with all
+     * signals blocked, so they're delivered to the calling threads.
+     */
+    if (SafeTail)
+        SafeTail->next = rq;
+    else
+        SafeHead = rq;
+    SafeTail = rq;
+    SafeRetire = 0;
+    if (!SafeIdle && (SafeThr - SafeHung) < SAFE_MAXTHR) {
+        (void)sigfillset(&all);
+        (void)pthread_sigmask(SIG_SETMASK, &all, &old);
+        (void)pthread_attr_init(&ta);
+        (void)pthread_attr_setdetachstate(&ta, PTHREAD_CREATE_DETACHED);
+        if (!(te = pthread_create(&tid, &ta, safe_worker, (void *)NULL)))
+            SafeThr++;
+        (void)pthread_attr_destroy(&ta);
+        (void)pthread_sigmask(SIG_SETMASK, &old, (sigset_t *)NULL);
+        if (te && SafeThr == SafeHung) {
+            (void)fprintf(stderr, "%s: can't start worker thread: %s\n", Pn,
+                          strerror(te));
+            Error(ctx);
+        }
+    }
+    (void)pthread_cond_signal(&SafeWork);
+    /*
+     * Wait for the function to return, or for the deadline to pass.
+     */
+    while (rq->state != SAFE_DONE) {
+        if (pthread_cond_timedwait(&SafeDone, &SafeMtx, &dl) == ETIMEDOUT)
+            break;
+    }
+    if (rq->state == SAFE_DONE) {
+        (void)memcpy(rbuf, rq->r.rbuf, rbln);
+        rv = rq->rv;
+        en = rq->en;
+        (void)free((FREE_P *)rq);
+    } else {
+        if (rq->state == SAFE_QUEUED) {
+            for (pq = (struct safe_req *)NULL, q = SafeHead; q != rq;
+                 q = q->next)
+                pq = q;
+            if (pq)
+                pq->next = rq->next;
+            else
+                SafeHead = rq->next;
+            if (SafeTail == rq)
+                SafeTail = pq;
+            (void)free((FREE_P *)rq);
+        } else {
+            rq->state = SAFE_ABANDONED;
+            if (++SafeHung == SAFE_MAXHUNG && !Fwarn)
+                (void)fprintf(stderr,
+                              "%s: WARNING -- %d worker threads may be hung.\n",
+                              Pn, SafeHung);
+        }
+        rv = 1;
+        en = ETIMEDOUT;
+    }
+    (void)pthread_mutex_unlock(&SafeMtx);
+    errno = en;
+    return (rv);
+}
+#endif /* defined(HASSAFETHR) */
+
+/*
+ * dosafely() - do a dialect's file system function safely (i. e., with
+ *		timeout)
+ *
+ * The function is called as the child process functions are, with arg as
+ * its path argument; its response buffer must not exceed MAXPATHLEN bytes.
+ */
+
+int dosafely(struct lsof_context *ctx, /* context */
+             int (*fn)(),              /* function to perform */
+             char *arg,                /* function argument */
+             char *rbuf,               /* response buffer */
+             int rbln)                 /* response buffer length */
+{
+    return (doinchild(ctx, fn, arg, rbuf, rbln));
+}
+
 /*
  * dolstat() - do an lstat() function
  */
@@ -496,14 +719,24 @@ void enter_dev_ch(struct lsof_context *ctx, char *m) {
 
     if (!m || *m == '\0')
         return;
+
+#if defined(HASARENA)
+    if (!(mp = arena_strcpy(ctx, m, strlen(m)))) {
+#else  /* !defined(HASARENA) */
     if (!(mp = mkstrcpy(m, (MALLOC_S *)NULL))) {
+#endif /* defined(HASARENA) */
+
         (void)fprintf(stderr, "%s: no more dev_ch space at PID %d: \n", Pn,
                       Lp->pid);
         safestrprt(m, stderr, 1);
         Error(ctx);
     }
+
+#if !defined(HASARENA)
     if (Lf->dev_ch)
         (void)free((FREE_P *)Lf->dev_ch);
+#endif /* !defined(HASARENA) */
+
     Lf->dev_ch = mp;
 }
 
@@ -726,14 +959,24 @@ void enter_nm(struct lsof_context *ctx, char *m) {
 
     if (!m || *m == '\0')
         return;
+
+#if defined(HASARENA)
+    if (!(mp = arena_strcpy(ctx, m, strlen(m)))) {
+#else  /* !defined(HASARENA) */
     if (!(mp = mkstrcpy(m, (MALLOC_S *)NULL))) {
+#endif /* defined(HASARENA) */
+
         (void)fprintf(stderr, "%s: no more nm space at PID %d for: ", Pn,
                       Lp->pid);
         safestrprt(m, stderr, 1);
         Error(ctx);
     }
+
+#if !defined(HASARENA)
     if (Lf->nm)
         (void)free((FREE_P *)Lf->nm);
+#endif /* !defined(HASARENA) */
+
     Lf->nm = mp;
 }
 
@@ -821,8 +1064,265 @@ int hashbyname(char *nm, /* pointer to NUL-terminated name */
     return (((int)(i * 31415)) & (mod - 1));
 }
 
+/*
+ * Network address selection tries
+ *
+ * compile_nwad() enters each -i selection in the binary trie of its address
+ * family, at the node of its address prefix -- at a prefix of no bits when
+ * it has no address.  Nodes with one child and no selections aren't kept, so
+ * a trie has no more than two nodes for each selection.  A node's selections
+ * are sorted by starting port and carry the running maximum of their ending
+ * ports, so that is_nw_addr() can pass over those that can't hold a port.
+ */
+
+struct nwad_ent {
+    int sp;         /* starting port (INT_MIN == any) */
+    int ep;         /* ending port (INT_MAX == any) */
+    int mep;        /* maximum ep of this and the preceding entries */
+    struct nwad *n; /* selection */
+};
+
+struct nwad_node {
+    unsigned char a[MAX_AF_ADDR]; /* address prefix, remaining bits zero */
+    int plen;                     /* prefix length (bits) */
+    struct nwad_node *child[2];   /* longer prefixes, by their next bit */
+    struct nwad_ent *ent;         /* selections of this prefix */
+    int nent;                     /* ent[] count */
+    int entl;                     /* ent[] allocation */
+};
+
+#define NWAD_BIT(a, b) (((a)[(b) >> 3] >> (7 - ((b)&7))) & 1)
+
+/*
+ * nwad_match() - does an address begin with a prefix?
+ */
+
+static int nwad_match(unsigned char *a, /* address */
+                      unsigned char *p, /* prefix */
+                      int pl)           /* prefix length (bits) */
+{
+    int nb = pl >> 3;
+
+    if (nb && memcmp((void *)a, (void *)p, (size_t)nb))
+        return (0);
+    if ((pl & 7) && ((a[nb] ^ p[nb]) & (0xff00 >> (pl & 7)) & 0xff))
+        return (0);
+    return (1);
+}
+
+/*
+ * nwad_node_new() - allocate a trie node
+ */
+
+static struct nwad_node *nwad_node_new(unsigned char *a, /* address */
+                                       int pl) /* prefix length (bits) */
+{
+    int i;
+    struct nwad_node *t;
+
+    if (!(t = (struct nwad_node *)calloc(1, sizeof(struct nwad_node))))
+        return ((struct nwad_node *)NULL);
+    for (i = 0; i < (pl + 7) / 8; i++) {
+        t->a[i] = a[i];
+    }
+    if (pl & 7)
+        t->a[pl >> 3] &= (unsigned char)(0xff00 >> (pl & 7));
+    t->plen = pl;
+    return (t);
+}
+
+/*
+ * nwad_insert() - enter a selection in a trie
+ *
+ * return: 0 on success; -1 if no space could be allocated
+ */
+
+static int nwad_insert(struct nwad_node **tp, /* trie root pointer */
+                       unsigned char *a,      /* address */
+                       int pl,                /* prefix length (bits) */
+                       struct nwad *n)        /* selection */
+{
+    int b, cl;
+    struct nwad_ent *e;
+    struct nwad_node *g, *nt, *t;
+
+    for (;;) {
+        if (!(t = *tp)) {
+            if (!(t = *tp = nwad_node_new(a, pl)))
+                return (-1);
+            break;
+        }
+        /*
+         * Count the leading bits the prefix shares with the node's.
+         */
+        b = (pl < t->plen) ? pl : t->plen;
+        for (cl = 0; cl + 8 <= b && a[cl >> 3] == t->a[cl >> 3]; cl += 8)
+            ;
+        for (; cl < b && NWAD_BIT(a, cl) == NWAD_BIT(t->a, cl); cl++)
+            ;
+        if (cl == t->plen) {
+
+            /*
+             * The node's prefix begins the selection's: stop at it, or go on
+             * to its child.
+             */
+            if (pl == t->plen)
+                break;
+            tp = &t->child[NWAD_BIT(a, t->plen)];
+            continue;
+        }
+        /*
+         * The prefixes part before the node's ends.  The selection's node goes
+         * above the node if its prefix ends first; otherwise both go below a
+         * node of their shared bits.
+         */
+        if (!(nt = nwad_node_new(a, pl)))
+            return (-1);
+        if (cl == pl) {
+            nt->child[NWAD_BIT(t->a, pl)] = t;
+            *tp = nt;
+        } else {
+            if (!(g = nwad_node_new(a, cl))) {
+                (void)free((FREE_P *)nt);
+                return (-1);
+            }
+            g->child[NWAD_BIT(t->a, cl)] = t;
+            g->child[NWAD_BIT(a, cl)] = nt;
+            *tp = g;
+        }
+        t = nt;
+        break;
+    }
+    if (t->nent >= t->entl) {
+        b = t->entl ? t->entl * 2 : 4;
+        if (!(e = (struct nwad_ent *)realloc(
+                  (MALLOC_P *)t->ent, (MALLOC_S)(b * sizeof(struct nwad_ent)))))
+            return (-1);
+        t->ent = e;
+        t->entl = b;
+    }
+    e = &t->ent[t->nent++];
+    e->sp = (n->sport == -1) ? INT_MIN : n->sport;
+    e->ep = (n->sport == -1) ? INT_MAX : n->eport;
+    e->n = n;
+    return (0);
+}
+
+/*
+ * comp_nwad_ent() - compare trie node selections by their starting ports
+ */
+
+static int comp_nwad_ent(COMP_P *a1, COMP_P *a2) {
+    struct nwad_ent *e1 = (struct nwad_ent *)a1;
+    struct nwad_ent *e2 = (struct nwad_ent *)a2;
+
+    if (e1->sp < e2->sp)
+        return (-1);
+    if (e1->sp > e2->sp)
+        return (1);
+    return (0);
+}
+
+/*
+ * nwad_sort() - sort the selections of a trie's nodes
+ */
+
+static void nwad_sort(struct nwad_node *t) /* trie */
+{
+    int i;
+
+    for (; t; t = t->child[1]) {
+        if (t->nent > 1)
+            (void)qsort((QSORT_P *)t->ent, (size_t)t->nent,
+                        (size_t)sizeof(struct nwad_ent), comp_nwad_ent);
+        for (i = 0; i < t->nent; i++) {
+            t->ent[i].mep = (i && t->ent[i - 1].mep > t->ent[i].ep)
+                                ? t->ent[i - 1].mep
+                                : t->ent[i].ep;
+        }
+        nwad_sort(t->child[0]);
+    }
+}
+
+/*
+ * nwad_free() - free a trie
+ */
+
+static void nwad_free(struct nwad_node *t) /* trie */
+{
+    struct nwad_node *c;
+
+    for (; t; t = c) {
+        nwad_free(t->child[0]);
+        c = t->child[1];
+        if (t->ent)
+            (void)free((FREE_P *)t->ent);
+        (void)free((FREE_P *)t);
+    }
+}
+
+/*
+ * compile_nwad() - compile the network address selections into tries
+ */
+
+void compile_nwad(struct lsof_context *ctx) /* context */
+{
+    int al, i, pl;
+    struct nwad *n;
+
+    for (n = Nwad; n; n = n->next) {
+
+        /*
+         * An all-zero address selects any address.
+         */
+#if defined(HASIPv6)
+        al = (n->af == AF_INET6) ? MAX_AF_ADDR : MIN_AF_ADDR;
+#else  /* !defined(HASIPv6) */
+        al = MIN_AF_ADDR;
+#endif /* defined(HASIPv6) */
+
+        for (i = pl = 0; i < al; i++) {
+            if (n->a[i]) {
+                pl = n->plen;
+                break;
+            }
+        }
+        if (n->af != AF_INET6) {
+            if (nwad_insert(&ctx->nwad_trie[0], n->a, pl, n))
+                goto no_space;
+        }
+
+#if defined(HASIPv6)
+        if (n->af != AF_INET) {
+            if (nwad_insert(&ctx->nwad_trie[1], n->a, pl, n))
+                goto no_space;
+        }
+#endif /* defined(HASIPv6) */
+    }
+    nwad_sort(ctx->nwad_trie[0]);
+    nwad_sort(ctx->nwad_trie[1]);
+    return;
+
+no_space:
+    (void)fprintf(stderr, "%s: no space for the network address tries\n", Pn);
+    Error(ctx);
+}
+
+/*
+ * free_nwad() - free the network address selection tries
+ */
+
+void free_nwad(struct lsof_context *ctx) /* context */
+{
+    nwad_free(ctx->nwad_trie[0]);
+    nwad_free(ctx->nwad_trie[1]);
+    ctx->nwad_trie[0] = ctx->nwad_trie[1] = (struct nwad_node *)NULL;
+}
+
 /*
  * is_nw_addr() - is this network address selected?
+ *
+ * Every selection that matches the address is marked found.
  */
 
 int is_nw_addr(struct lsof_context *ctx, /* context */
@@ -831,10 +1331,57 @@ int is_nw_addr(struct lsof_context *ctx, /* context */
                int af)                   /* address family -- e.g., AF_INET,
                                           * AF_INET6 */
 {
+    int al, h, i, l, m;
+    int rv = 0;
     struct nwad *n;
+    struct nwad_node *t;
 
     if (!(n = Nwad))
         return (0);
+
+#if defined(HASIPv6)
+    if (af == AF_INET6)
+        al = MAX_AF_ADDR;
+    else if (af == AF_INET)
+        al = MIN_AF_ADDR;
+    else
+        return (0);
+#else  /* !defined(HASIPv6) */
+    al = MIN_AF_ADDR;
+#endif /* defined(HASIPv6) */
+
+    if (ctx->sels_compiled) {
+
+        /*
+         * Descend the trie of the address family along the address, looking
+         * at each node for the selections whose port ranges hold the port:
+         * those before the last one starting at or below it, back to where
+         * no earlier one ends at or above it.
+         */
+        for (t = ctx->nwad_trie[(al == MIN_AF_ADDR) ? 0 : 1];
+             t && nwad_match(ia, t->a, t->plen);
+             t = (t->plen < al * 8) ? t->child[NWAD_BIT(ia, t->plen)]
+                                    : (struct nwad_node *)NULL) {
+            for (i = -1, l = 0, h = t->nent - 1; l <= h;) {
+                m = (l + h) / 2;
+                if (t->ent[m].sp <= p) {
+                    i = m;
+                    l = m + 1;
+                } else
+                    h = m - 1;
+            }
+            for (; i >= 0 && t->ent[i].mep >= p; i--) {
+                if (t->ent[i].ep < p)
+                    continue;
+                n = t->ent[i].n;
+                if (n->proto && strcasecmp(n->proto, Lf->iproto) != 0)
+                    continue;
+                SEL_FOUND(ctx, n->f, 1);
+                rv = 1;
+            }
+        }
+        return (rv);
+    }
     for (; n; n = n->next) {
         if (n->proto) {
             if (strcasecmp(n->proto, Lf->iproto) != 0)
@@ -842,44 +1389,18 @@ int is_nw_addr(struct lsof_context *ctx, /* context */
         }
         if (af && n->af && af != n->af)
             continue;
-
-#if defined(HASIPv6)
-        if (af == AF_INET6) {
-            if (n->a[15] || n->a[14] || n->a[13] || n->a[12] || n->a[11] ||
-                n->a[10] || n->a[9] || n->a[8] || n->a[7] || n->a[6] ||
-                n->a[5] || n->a[4] || n->a[3] || n->a[2] || n->a[1] ||
-                n->a[0]) {
-                if (ia[15] != n->a[15] || ia[14] != n->a[14] ||
-                    ia[13] != n->a[13] || ia[12] != n->a[12] ||
-                    ia[11] != n->a[11] || ia[10] != n->a[10] ||
-                    ia[9] != n->a[9] || ia[8] != n->a[8] || ia[7] != n->a[7] ||
-                    ia[6] != n->a[6] || ia[5] != n->a[5] || ia[4] != n->a[4] ||
-                    ia[3] != n->a[3] || ia[2] != n->a[2] || ia[1] != n->a[1] ||
-                    ia[0] != n->a[0])
-                    continue;
-            }
-        } else if (af == AF_INET)
-#endif /* defined(HASIPv6) */
-
-        {
-            if (n->a[3] || n->a[2] || n->a[1] || n->a[0]) {
-                if (ia[3] != n->a[3] || ia[2] != n->a[2] || ia[1] != n->a[1] ||
-                    ia[0] != n->a[0])
-                    continue;
-            }
+        for (i = 0; i < al; i++) {
+            if (n->a[i])
+                break;
         }
-
-#if defined(HASIPv6)
-        else
+        if (i < al && !nwad_match(ia, n->a, n->plen))
             continue;
-#endif /* defined(HASIPv6) */
-
         if (n->sport == -1 || (p >= n->sport && p <= n->eport)) {
-            n->f = 1;
-            return (1);
+            SEL_FOUND(ctx, n->f, 1);
+            rv = 1;
         }
     }
-    return (0);
+    return (rv);
 }
 
 /*
@@ -1491,6 +2012,108 @@ void safestrprtn(char *sp,  /* string to print pointer pointer */
         putc('\n', fs);
 }
 
+#if defined(HASSAFETHR)
+/*
+ * safe_fork_prepare() - hold the worker thread state across a fork(2)
+ */
+
+static void safe_fork_prepare(void) { (void)pthread_mutex_lock(&SafeMtx); }
+
+/*
+ * safe_fork_parent() - release the worker thread state after a fork(2)
+ */
+
+static void safe_fork_parent(void) { (void)pthread_mutex_unlock(&SafeMtx); }
+
+/*
+ * safe_fork_child() - forget the worker threads in a fork(2) child
+ *
+ * The child has none of the workers, so it starts its own when it needs
+ * them.  The requests still queued belong to threads the child doesn't
+ * have either.
+ */
+
+static void safe_fork_child(void) {
+    pthread_condattr_t ca;
+    struct safe_req *rq;
+
+    while ((rq = SafeHead)) {
+        SafeHead = rq->next;
+        (void)free((FREE_P *)rq);
+    }
+    SafeTail = (struct safe_req *)NULL;
+    SafeThr = SafeIdle = SafeHung = SafeRetire = 0;
+    (void)pthread_cond_init(&SafeWork, (pthread_condattr_t *)NULL);
+    (void)pthread_condattr_init(&ca);
+    (void)pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&SafeDone, &ca);
+    (void)pthread_condattr_destroy(&ca);
+    (void)pthread_mutex_unlock(&SafeMtx);
+}
+
+/*
+ * safe_init() - set up the worker thread completion condition, and the
+ *		 handling of a fork(2) -- e.g., by the -W query server
+ */
+
+static void safe_init(void) {
+    pthread_condattr_t ca;
+
+    (void)pthread_condattr_init(&ca);
+    (void)pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&SafeDone, &ca);
+    (void)pthread_condattr_destroy(&ca);
+    (void)pthread_atfork(safe_fork_prepare, safe_fork_parent,
+                         safe_fork_child);
+}
+
+/*
+ * safe_worker() - run queued requests in a worker thread
+ */
+
+static void *safe_worker(void *arg) /* unused */
+{
+    int en, rv;
+    struct safe_req *rq;
+
+    (void)pthread_mutex_lock(&SafeMtx);
+    for (;;) {
+        SafeIdle++;
+        while (!SafeHead && !SafeRetire)
+            (void)pthread_cond_wait(&SafeWork, &SafeMtx);
+        SafeIdle--;
+        if (!SafeHead) {
+            SafeRetire--;
+            break;
+        }
+        rq = SafeHead;
+        if (!(SafeHead = rq->next))
+            SafeTail = (struct safe_req *)NULL;
+        rq->state = SAFE_RUNNING;
+        (void)pthread_mutex_unlock(&SafeMtx);
+        rv = rq->fn(rq->arg, rq->r.rbuf, rq->rbln);
+        en = errno;
+        (void)pthread_mutex_lock(&SafeMtx);
+        if (rq->state == SAFE_ABANDONED) {
+
+            /*
+             * The caller stopped waiting; the worker is no longer hung.
+             */
+            SafeHung--;
+            (void)free((FREE_P *)rq);
+            continue;
+        }
+        rq->rv = rv;
+        rq->en = en;
+        rq->state = SAFE_DONE;
+        (void)pthread_cond_broadcast(&SafeDone);
+    }
+    SafeThr--;
+    (void)pthread_mutex_unlock(&SafeMtx);
+    return (NULL);
+}
+#endif /* defined(HASSAFETHR) */
+
 /*
  * statsafely() - stat path safely (i. e., with timeout)
  */
@@ -30,6 +30,7 @@
 
 #include "common.h"
 #include "dlsof.h"
+#include "hash.h"
 #include "lsof.h"
 #include "proto.h"
 
@@ -42,6 +43,11 @@ static void prt_evtfdinfo(struct lsof_context *ctx, pxinfo_t *pp, int ps);
 static void prt_ptyinfo(struct lsof_context *ctx, pxinfo_t *pp, int prt_edev,
                         int ps);
 #endif /* defined(HASPTYEPT) */
+static int comp_fd_range(COMP_P *a1, COMP_P *a2);
+static struct int_lst *find_sel_id(struct lsof_context *ctx, inohash_t *set,
+                                   struct int_lst *lst, int n, int id);
+static struct seluid *find_sel_uid(struct lsof_context *ctx, uid_t uid);
+static int sel_files_found(struct lsof_context *ctx);
 
 /*
  * add_nma() - add to NAME column addition
@@ -55,6 +61,22 @@ void add_nma(struct lsof_context *ctx, char *cp, /* string to add */
 
     if (!cp || !len)
         return;
+
+#if defined(HASARENA)
+    /*
+     * The old addition stays in the arena until the file is discarded.
+     */
+    if (Lf->nma) {
+        char *op = Lf->nma;
+
+        nl = (int)strlen(op);
+        if ((Lf->nma = arena_alloc(ctx, (size_t)(len + nl + 2), 1)))
+            (void)memcpy(Lf->nma, op, (size_t)nl);
+    } else {
+        nl = 0;
+        Lf->nma = arena_alloc(ctx, (size_t)(len + 1), 1);
+    }
+#else  /* !defined(HASARENA) */
     if (Lf->nma) {
         nl = (int)strlen(Lf->nma);
         Lf->nma =
@@ -63,6 +85,8 @@ void add_nma(struct lsof_context *ctx, char *cp, /* string to add */
         nl = 0;
         Lf->nma = (char *)malloc((MALLOC_S)(len + 1));
     }
+#endif /* defined(HASARENA) */
+
     if (!Lf->nma) {
         fd_to_string(Lf->fd_type, Lf->fd_num, fd);
         (void)fprintf(stderr, "%s: no name addition space: PID %ld, FD %s", Pn,
@@ -90,6 +114,21 @@ void alloc_lfile(struct lsof_context *ctx,
 {
     int fds;
 
+#if defined(HASARENA)
+    /*
+     * Discard a previously allocated structure that was not linked, and all
+     * arena space allocated since it was.  Then allocate a new structure.
+     */
+    if (Lf)
+        arena_release(ctx, &ctx->file_mark);
+    arena_mark(ctx, &ctx->file_mark);
+    if (!(Lf = (struct lfile *)arena_alloc(ctx, sizeof(struct lfile),
+                                           ARENAALIGN))) {
+        (void)fprintf(stderr, "%s: no local file space at PID %d\n", Pn,
+                      Lp->pid);
+        Error(ctx);
+    }
+#else  /* !defined(HASARENA) */
     if (Lf) {
         /*
          * If reusing a previously allocated structure, release any allocated
@@ -114,12 +153,15 @@ void alloc_lfile(struct lsof_context *ctx,
                       Lp->pid);
         Error(ctx);
     }
+#endif /* defined(HASARENA) */
+
     /*
      * Initialize the structure.
      */
     Lf->access = LSOF_FILE_ACCESS_NONE;
     Lf->lock = LSOF_LOCK_NONE;
-    Lf->dev_def = Lf->inp_ty = Lf->is_com = Lf->is_nfs = Lf->is_stream =
+    Lf->chg = Lf->dev_def = Lf->inp_ty = Lf->is_com = Lf->is_nfs =
+        Lf->is_stream =
         Lf->lmi_srch = Lf->nlink_def = Lf->off_def = Lf->sz_def = Lf->rdev_def =
             (unsigned char)0;
     Lf->li[0].af = Lf->li[1].af = 0;
@@ -236,8 +278,6 @@ void alloc_lproc(struct lsof_context *ctx, int pid, /* Process ID */
                  int pss,                           /* process select state */
                  int sf)                            /* process select flags */
 {
-    static int sz = 0;
-
     if (!Lproc) {
         if (!(Lproc = (struct lproc *)malloc(
                   (MALLOC_S)(LPROCINCR * sizeof(struct lproc))))) {
@@ -246,19 +286,33 @@ void alloc_lproc(struct lsof_context *ctx, int pid, /* Process ID */
                           Pn, LPROCINCR);
             Error(ctx);
         }
-        sz = LPROCINCR;
-    } else if ((Nlproc + 1) > sz) {
-        sz += LPROCINCR;
+        ctx->procs_cap = LPROCINCR;
+    } else if ((Nlproc + 1) > ctx->procs_cap) {
+        ctx->procs_cap += LPROCINCR;
         if (!(Lproc = (struct lproc *)realloc(
-                  (MALLOC_P *)Lproc, (MALLOC_S)(sz * sizeof(struct lproc))))) {
+                  (MALLOC_P *)Lproc,
+                  (MALLOC_S)(ctx->procs_cap * sizeof(struct lproc))))) {
             (void)fprintf(stderr,
                           "%s: no realloc space for %d local proc structures\n",
-                          Pn, sz);
+                          Pn, (int)ctx->procs_cap);
             Error(ctx);
         }
     }
     Lp = &Lproc[Nlproc++];
     Lp->pid = pid;
+    ctx->files_done = 0;
+
+#if defined(HASARENA)
+    /*
+     * Discard an unlinked file structure left by the previous process, so
+     * that the process's files begin at its arena mark.
+     */
+    if (Lf) {
+        arena_release(ctx, &ctx->file_mark);
+        Lf = (struct lfile *)NULL;
+    }
+    arena_mark(ctx, &Lp->amark);
+#endif /* defined(HASARENA) */
 
 #if defined(HASEPTOPTS)
     Lp->ept = 0;
@@ -275,6 +329,7 @@ void alloc_lproc(struct lsof_context *ctx, int pid, /* Process ID */
     Lp->sf = (short)sf;
     Lp->pss = (short)pss;
     Lp->uid = (uid_t)uid;
+    Lp->start = 0;
     /*
      * Allocate space for the full command name and copy it there.
      */
@@ -301,6 +356,161 @@ void alloc_lproc(struct lsof_context *ctx, int pid, /* Process ID */
 #endif /* defined(HASSELINUX) */
 }
 
+#if defined(HASARENA)
+/*
+ * arena_alloc() - allocate space from the arena
+ *
+ * return: space pointer; NULL if no space
+ */
+
+char *arena_alloc(struct lsof_context *ctx, /* context */
+                  size_t len,               /* length */
+                  size_t align)             /* alignment (a power of two) */
+{
+    struct lsof_arena *a = &ctx->arena;
+    struct arena_chunk *c;
+    size_t hl, off, sz;
+
+    hl = (sizeof(struct arena_chunk) + ARENAALIGN - 1) & ~(ARENAALIGN - 1);
+    if ((c = a->cur)) {
+
+        /*
+         * Allocate from the current chunk, or from the next one, which a
+         * release or reset has left empty.
+         */
+        off = (c->used + align - 1) & ~(align - 1);
+        if ((off + len) <= c->size) {
+            c->used = off + len;
+            return ((char *)c + hl + off);
+        }
+        if ((c = c->next) && (len <= c->size)) {
+            c->used = len;
+            a->cur = c;
+            return ((char *)c + hl);
+        }
+    }
+    /*
+     * Add a chunk after the current one.
+     */
+    sz = (len > ARENACHUNK) ? len : ARENACHUNK;
+    if (!(c = (struct arena_chunk *)malloc((MALLOC_S)(hl + sz))))
+        return ((char *)NULL);
+    c->size = sz;
+    c->used = len;
+    if (a->cur) {
+        c->next = a->cur->next;
+        a->cur->next = c;
+    } else {
+        c->next = a->first;
+        a->first = c;
+    }
+    a->cur = c;
+    return ((char *)c + hl);
+}
+
+/*
+ * arena_free() - free the arena's chunks
+ */
+
+void arena_free(struct lsof_context *ctx) /* context */
+{
+    struct arena_chunk *c, *cn;
+
+    for (c = ctx->arena.first; c; c = cn) {
+        cn = c->next;
+        (void)free((FREE_P *)c);
+    }
+    ctx->arena.first = ctx->arena.cur = (struct arena_chunk *)NULL;
+}
+
+/*
+ * arena_mark() - mark the arena's allocation position
+ */
+
+void arena_mark(struct lsof_context *ctx, /* context */
+                struct arena_mark *m)     /* mark receiver */
+{
+    if ((m->chunk = ctx->arena.cur))
+        m->used = m->chunk->used;
+    else
+        m->used = (size_t)0;
+}
+
+/*
+ * arena_move() - move another context's arena space to the end of this one's
+ *
+ * The other context's arena is left empty.
+ */
+
+void arena_move(struct lsof_context *ctx,  /* receiving context */
+                struct lsof_context *from) /* moving context */
+{
+    struct lsof_arena *a = &ctx->arena;
+    struct lsof_arena *f = &from->arena;
+    struct arena_chunk *c;
+
+    if (!f->first)
+        return;
+    for (c = f->first; c->next; c = c->next)
+        ;
+    if (a->cur) {
+
+        /*
+         * Put the moving chunks after the current one, ahead of any empty
+         * ones.
+         */
+        c->next = a->cur->next;
+        a->cur->next = f->first;
+    } else
+        a->first = f->first;
+    a->cur = f->cur;
+    f->first = f->cur = (struct arena_chunk *)NULL;
+}
+
+/*
+ * arena_release() - return the arena to a marked allocation position
+ */
+
+void arena_release(struct lsof_context *ctx, /* context */
+                   struct arena_mark *m)     /* mark */
+{
+    if (m->chunk) {
+        ctx->arena.cur = m->chunk;
+        m->chunk->used = m->used;
+    } else
+        arena_reset(ctx);
+}
+
+/*
+ * arena_reset() - return the arena to its start, keeping its chunks
+ */
+
+void arena_reset(struct lsof_context *ctx) /* context */
+{
+    if ((ctx->arena.cur = ctx->arena.first))
+        ctx->arena.cur->used = (size_t)0;
+}
+
+/*
+ * arena_strcpy() - copy a string to the arena
+ *
+ * return: copy pointer; NULL if no space
+ */
+
+char *arena_strcpy(struct lsof_context *ctx, /* context */
+                   char *s,                  /* string */
+                   size_t len)               /* its length */
+{
+    char *cp;
+
+    if ((cp = arena_alloc(ctx, len + 1, 1))) {
+        (void)memcpy(cp, s, len);
+        cp[len] = '\0';
+    }
+    return (cp);
+}
+#endif /* defined(HASARENA) */
+
 /*
  * ck_fd_status() - check FD status
  *
@@ -315,41 +525,153 @@ extern int ck_fd_status(struct lsof_context *ctx,
                                   * none */
 {
     struct fd_lst *fp;
+    int h, l, m;
+    int r = (FdlTy == 1) ? 1 : 2;
 
     if (!(fp = Fdl) || (fd_type == LSOF_FD_NUMERIC && num < 0))
         return (0);
-    /*
-     * Check for an exclusion match.
-     */
-    if (FdlTy == 1) {
-        for (; fp; fp = fp->next) {
-            if (fp->fd_type != fd_type)
-                continue;
-            if (fp->fd_type == LSOF_FD_NUMERIC) {
-                if (num >= fp->lo && num <= fp->hi)
-                    return (1);
-            } else {
-                return (1);
-            }
+    if (ctx->sels_compiled) {
+
+        /*
+         * Look the FD up in the compiled list: its type in the type mask, its
+         * number in the sorted, disjoint ranges.
+         */
+        if (fd_type != LSOF_FD_NUMERIC)
+            return ((ctx->fd_type_mask & ((uint32_t)1 << fd_type)) ? r : 0);
+        for (l = 0, h = ctx->fd_ranges_num - 1; l <= h;) {
+            m = (l + h) / 2;
+            if (num < ctx->fd_ranges[m].lo)
+                h = m - 1;
+            else if (num > ctx->fd_ranges[m].hi)
+                l = m + 1;
+            else
+                return (r);
         }
         return (0);
     }
     /*
-     * If Fdl isn't an exclusion list, check for an inclusion match.
+     * Check for an exclusion or inclusion match.
      */
     for (; fp; fp = fp->next) {
         if (fp->fd_type != fd_type)
             continue;
         if (fp->fd_type == LSOF_FD_NUMERIC) {
             if (num >= fp->lo && num <= fp->hi)
-                return (2);
+                return (r);
         } else {
-            return (2);
+            return (r);
         }
     }
     return (0);
 }
 
+/*
+ * comp_fd_range() - compare FD ranges by their starts
+ */
+
+static int comp_fd_range(COMP_P *a1, COMP_P *a2) {
+    struct fd_range *r1 = (struct fd_range *)a1;
+    struct fd_range *r2 = (struct fd_range *)a2;
+
+    if (r1->lo < r2->lo)
+        return (-1);
+    if (r1->lo > r2->lo)
+        return (1);
+    return (0);
+}
+
+/*
+ * compile_sels() - compile the PID, PGID, UID, FD and network address
+ *		    selections
+ *
+ * The -p, -g and -u entries are indexed by ID, the -d list is reduced to a
+ * type mask and sorted, disjoint number ranges, and the -i addresses are
+ * entered in prefix tries, so that is_proc_excl(), ck_fd_status() and
+ * is_nw_addr() needn't walk them for each process and file.
+ */
+
+void compile_sels(struct lsof_context *ctx) {
+    struct fd_lst *fp;
+    int i, n;
+
+    if (ctx->sels_compiled)
+        return;
+    if (inohash_reset(&ctx->sel_pid_set, (size_t)Npid) ||
+        inohash_reset(&ctx->sel_pgid_set, (size_t)Npgid) ||
+        inohash_reset(&ctx->sel_uid_set, (size_t)Nuid))
+        goto no_space;
+    for (i = 0; i < Npid; i++) {
+        if (inohash_insert(&ctx->sel_pid_set, (INODETYPE)Spid[i].i,
+                           (void *)&Spid[i]))
+            goto no_space;
+    }
+    for (i = 0; i < Npgid; i++) {
+        if (inohash_insert(&ctx->sel_pgid_set, (INODETYPE)Spgid[i].i,
+                           (void *)&Spgid[i]))
+            goto no_space;
+    }
+    for (i = 0; i < Nuid; i++) {
+        if (inohash_insert(&ctx->sel_uid_set, (INODETYPE)Suid[i].uid,
+                           (void *)&Suid[i]))
+            goto no_space;
+    }
+    /*
+     * Collect the numeric FD ranges, then sort and merge the ones that
+     * overlap or abut.
+     */
+    ctx->fd_type_mask = 0;
+    for (fp = Fdl, n = 0; fp; fp = fp->next) {
+        if (fp->fd_type == LSOF_FD_NUMERIC)
+            n++;
+        else
+            ctx->fd_type_mask |= (uint32_t)1 << fp->fd_type;
+    }
+    if (n) {
+        if (!(ctx->fd_ranges = (struct fd_range *)malloc(
+                  (MALLOC_S)(n * sizeof(struct fd_range)))))
+            goto no_space;
+        for (fp = Fdl, n = 0; fp; fp = fp->next) {
+            if (fp->fd_type != LSOF_FD_NUMERIC)
+                continue;
+            ctx->fd_ranges[n].lo = fp->lo;
+            ctx->fd_ranges[n++].hi = fp->hi;
+        }
+        (void)qsort((QSORT_P *)ctx->fd_ranges, (size_t)n,
+                    (size_t)sizeof(struct fd_range), comp_fd_range);
+        for (i = 1, ctx->fd_ranges_num = 1; i < n; i++) {
+            struct fd_range *lr = &ctx->fd_ranges[ctx->fd_ranges_num - 1];
+
+            if (ctx->fd_ranges[i].lo <= lr->hi ||
+                ctx->fd_ranges[i].lo - 1 == lr->hi) {
+                if (ctx->fd_ranges[i].hi > lr->hi)
+                    lr->hi = ctx->fd_ranges[i].hi;
+            } else
+                ctx->fd_ranges[ctx->fd_ranges_num++] = ctx->fd_ranges[i];
+        }
+    }
+    compile_nwad(ctx);
+    ctx->sels_compiled = 1;
+    return;
+
+no_space:
+    (void)fprintf(stderr, "%s: no space for the selection indexes\n", Pn);
+    Error(ctx);
+}
+
+/*
+ * free_sels() - free the compiled selections
+ */
+
+void free_sels(struct lsof_context *ctx) {
+    CLEAN(ctx->sel_pid_set.slot);
+    CLEAN(ctx->sel_pgid_set.slot);
+    CLEAN(ctx->sel_uid_set.slot);
+    CLEAN(ctx->fd_ranges);
+    ctx->fd_ranges_num = 0;
+    free_nwad(ctx);
+    ctx->sels_compiled = 0;
+}
+
 /*
  * comppid() - compare PIDs
  */
@@ -373,6 +695,286 @@ int comppid(COMP_P *a1, COMP_P *a2) {
     return (0);
 }
 
+/*
+ * delta_key() - hash key of a file of a process for delta_mark()
+ */
+
+static INODETYPE delta_key(struct lproc *lp, /* lproc structure pointer */
+                           struct lfile *lf) /* lfile structure pointer */
+{
+    uint64_t k;
+
+    k = ((uint64_t)(unsigned int)lp->pid << 32) ^ (uint64_t)lp->start ^
+        ((uint64_t)lf->fd_type << 24) ^ (uint64_t)(unsigned int)lf->fd_num;
+
+#if defined(HASTASKS)
+    k ^= (uint64_t)(unsigned int)lp->tid << 40;
+#endif /* defined(HASTASKS) */
+
+    /*
+     * Spread the many memory-mapped files of a process by their nodes.
+     */
+    if (lf->fd_type != LSOF_FD_NUMERIC)
+        k ^= (uint64_t)lf->inode;
+    return ((INODETYPE)k);
+}
+
+/*
+ * delta_str() - compare two possibly NULL strings for delta_mark()
+ *
+ * return: 0 if they are the same; 1 otherwise
+ */
+
+static int delta_str(char *s1, /* string 1 */
+                     char *s2) /* string 2 */
+{
+    if (!s1 || !s2)
+        return (s1 != s2);
+    return (strcmp(s1, s2) ? 1 : 0);
+}
+
+/*
+ * delta_same() - is a file of the previous gather the same open file as one
+ *		  of this gather?
+ *
+ * A numeric FD is identified by its process and number, so replacing the
+ * file it refers to changes it; other files, like memory-mapped ones, are
+ * also identified by their device, node and name.
+ */
+
+static int delta_same(struct lproc *pp, /* previous lproc */
+                      struct lfile *pf, /* previous lfile */
+                      struct lproc *cp, /* current lproc */
+                      struct lfile *cf) /* current lfile */
+{
+    if ((pp->pid != cp->pid) || (pp->start != cp->start) ||
+        (pf->fd_type != cf->fd_type) || (pf->fd_num != cf->fd_num))
+        return (0);
+
+#if defined(HASTASKS)
+    if (pp->tid != cp->tid)
+        return (0);
+#endif /* defined(HASTASKS) */
+
+    if (pf->fd_type == LSOF_FD_NUMERIC)
+        return (1);
+    if ((pf->dev_def != cf->dev_def) || (pf->dev_def && pf->dev != cf->dev) ||
+        (pf->inp_ty != cf->inp_ty) || (pf->inode != cf->inode))
+        return (0);
+    return (!delta_str(pf->nm, cf->nm));
+}
+
+/*
+ * delta_differs() - does an open file of the previous gather differ from
+ *		     its state in this gather?
+ *
+ * The size and offset aren't compared, since reads and writes move them
+ * all the time.
+ */
+
+static int delta_differs(struct lfile *pf, /* previous lfile */
+                         struct lfile *cf) /* current lfile */
+{
+    if ((pf->type != cf->type) ||
+        (pf->unknown_file_type_number != cf->unknown_file_type_number) ||
+        (pf->access != cf->access) || (pf->lock != cf->lock))
+        return (1);
+    if ((pf->dev_def != cf->dev_def) || (pf->dev_def && pf->dev != cf->dev) ||
+        (pf->rdev_def != cf->rdev_def) ||
+        (pf->rdev_def && pf->rdev != cf->rdev) || (pf->inp_ty != cf->inp_ty) ||
+        (pf->inode != cf->inode) || (pf->nlink_def != cf->nlink_def) ||
+        (pf->nlink_def && pf->nlink != cf->nlink))
+        return (1);
+    if ((pf->lts.type != cf->lts.type) ||
+        ((pf->lts.type >= 0) && (pf->lts.state.i != cf->lts.state.i)))
+        return (1);
+    return (strcmp(pf->iproto, cf->iproto) || delta_str(pf->nm, cf->nm) ||
+            delta_str(pf->nma, cf->nma) || delta_str(pf->dev_ch, cf->dev_ch));
+}
+
+/*
+ * delta_free() - free the processes of the previous gather
+ */
+
+void delta_free(struct lsof_context *ctx, /* context */
+                int all) /* also free the lproc array and the arena */
+{
+    size_t pi;
+    struct lproc *lp;
+
+#if defined(HASARENA)
+    struct lsof_arena ta;
+#endif /* defined(HASARENA) */
+
+    for (pi = 0; pi < ctx->delta_procs_size; pi++) {
+        lp = &ctx->delta_procs[pi];
+        (void)free_lproc(lp);
+
+#if defined(HASZONES)
+        CLEAN(lp->zn);
+#endif /* defined(HASZONES) */
+
+#if defined(HASSELINUX)
+        CLEAN(lp->cntx);
+#endif /* defined(HASSELINUX) */
+    }
+    ctx->delta_procs_size = 0;
+    if (!all)
+        return;
+    CLEAN(ctx->delta_procs);
+    ctx->delta_procs_cap = 0;
+
+#if defined(HASARENA)
+    ta = ctx->arena;
+    ctx->arena = ctx->delta_arena;
+    arena_free(ctx);
+    ctx->delta_arena = ctx->arena;
+    ctx->arena = ta;
+#endif /* defined(HASARENA) */
+}
+
+/*
+ * delta_mark() - mark the selected files of this gather and of the previous
+ *		  one with their change status
+ *
+ * Files of this gather are marked DELTA_ADDED, DELTA_CHANGED or DELTA_NONE,
+ * and the files of the previous gather that are no longer open are marked
+ * DELTA_REMOVED.  Processes are told apart by PID and start time, so a
+ * process that reuses a PID has only added files.  When there is no previous
+ * gather, all files are added.
+ *
+ * return: the number of processes of this gather with selected files
+ */
+
+int delta_mark(struct lsof_context *ctx) /* context */
+{
+    struct delta_ent {
+        struct lproc *lp;       /* previous lproc */
+        struct lfile *lf;       /* previous lfile */
+        struct delta_ent *next; /* next entry with the same key */
+    } *dp, *ents = (struct delta_ent *)NULL;
+    inohash_t h;
+    INODETYPE k;
+    struct lfile *lf;
+    struct lproc *lp;
+    size_t n, pi;
+    int ns = 0, sel;
+
+    /*
+     * Index the selected files of the previous gather, marking them removed
+     * until they're found again.
+     */
+    zeromem((char *)&h, sizeof(h));
+    for (n = pi = 0; pi < ctx->delta_procs_size; pi++) {
+        lp = &ctx->delta_procs[pi];
+        if (!lp->pss)
+            continue;
+        for (lf = lp->file; lf; lf = lf->next) {
+            if (is_file_sel(ctx, lp, lf))
+                n++;
+        }
+    }
+    if (n) {
+        if (!(ents = (struct delta_ent *)malloc(
+                  (MALLOC_S)(n * sizeof(struct delta_ent)))) ||
+            inohash_reset(&h, n)) {
+            (void)fprintf(stderr, "%s: no space for %d previous files\n", Pn,
+                          (int)n);
+            Error(ctx);
+        }
+    }
+    for (dp = ents, pi = 0; n && pi < ctx->delta_procs_size; pi++) {
+        lp = &ctx->delta_procs[pi];
+        if (!lp->pss)
+            continue;
+        for (lf = lp->file; lf; lf = lf->next) {
+            if (!is_file_sel(ctx, lp, lf))
+                continue;
+            lf->chg = DELTA_REMOVED;
+            dp->lp = lp;
+            dp->lf = lf;
+            k = delta_key(lp, lf);
+            dp->next = (struct delta_ent *)inohash_find(&h, k);
+            (void)inohash_insert(&h, k, (void *)dp);
+            dp++;
+        }
+    }
+    /*
+     * Look up each selected file of this gather.
+     */
+    for (pi = 0; pi < Nlproc; pi++) {
+        lp = &Lproc[pi];
+        if (!lp->pss)
+            continue;
+        for (sel = 0, lf = lp->file; lf; lf = lf->next) {
+            if (!is_file_sel(ctx, lp, lf))
+                continue;
+            sel = 1;
+            for (dp = n ? (struct delta_ent *)inohash_find(
+                              &h, delta_key(lp, lf))
+                        : (struct delta_ent *)NULL;
+                 dp; dp = dp->next) {
+                if ((dp->lf->chg == DELTA_REMOVED) &&
+                    delta_same(dp->lp, dp->lf, lp, lf))
+                    break;
+            }
+            if (!dp) {
+                lf->chg = DELTA_ADDED;
+                continue;
+            }
+            dp->lf->chg = DELTA_NONE;
+            lf->chg = delta_differs(dp->lf, lf) ? DELTA_CHANGED : DELTA_NONE;
+        }
+        ns += sel;
+    }
+    if (ents)
+        (void)free((FREE_P *)ents);
+    if (h.slot)
+        (void)free((FREE_P *)h.slot);
+    return (ns);
+}
+
+/*
+ * delta_save() - keep the processes of this gather as the previous gather
+ *		  of the next one
+ *
+ * The older previous gather is freed.  Its lproc array and arena are kept
+ * for the next gather.
+ */
+
+void delta_save(struct lsof_context *ctx) /* context */
+{
+    struct lproc *tp;
+    size_t tc;
+
+#if defined(HASARENA)
+    struct lsof_arena ta;
+#endif /* defined(HASARENA) */
+
+    (void)delta_free(ctx, 0);
+    tp = ctx->delta_procs;
+    tc = ctx->delta_procs_cap;
+    ctx->delta_procs = Lproc;
+    ctx->delta_procs_cap = ctx->procs_cap;
+    ctx->delta_procs_size = Nlproc;
+    Lproc = tp;
+    ctx->procs_cap = tc;
+    Nlproc = 0;
+    Lp = (struct lproc *)NULL;
+    Plf = (struct lfile *)NULL;
+
+#if defined(HASARENA)
+    /*
+     * An unlinked file structure stays behind in the saved arena.
+     */
+    Lf = (struct lfile *)NULL;
+    ta = ctx->arena;
+    ctx->arena = ctx->delta_arena;
+    ctx->delta_arena = ta;
+    arena_reset(ctx);
+#endif /* defined(HASARENA) */
+}
+
 /*
  * ent_inaddr() - enter Internet addresses
  */
@@ -456,6 +1058,12 @@ int examine_lproc(struct lsof_context *ctx) {
      */
     if (!Lp->pss) {
         (void)free_lproc(Lp);
+
+#if defined(HASARENA)
+        arena_release(ctx, &Lp->amark);
+        Lf = (struct lfile *)NULL;
+#endif /* defined(HASARENA) */
+
         Nlproc--;
     }
     /*
@@ -470,6 +1078,12 @@ int examine_lproc(struct lsof_context *ctx) {
  */
 
 void free_lproc(struct lproc *lp) {
+
+#if defined(HASARENA)
+    /*
+     * The files and their strings are discarded with the arena space.
+     */
+#else  /* !defined(HASARENA) */
     struct lfile *lf, *nf;
 
     for (lf = lp->file; lf; lf = nf) {
@@ -493,6 +1107,8 @@ void free_lproc(struct lproc *lp) {
         nf = lf->next;
         (void)free((FREE_P *)lf);
     }
+#endif /* defined(HASARENA) */
+
     lp->file = (struct lfile *)NULL;
     if (lp->cmd) {
         (void)free((FREE_P *)lp->cmd);
@@ -535,7 +1151,7 @@ int is_cmd_excl(struct lsof_context *ctx, char *cmd, /* command name */
         return (0);
     for (sp = Cmdl; sp; sp = sp->next) {
         if (!sp->x && !strncmp(sp->str, cmd, sp->len)) {
-            sp->f = 1;
+            SEL_FOUND(ctx, sp->f, 1);
             *pss |= PS_PRI;
             *sf |= SELCMD;
             return (0);
@@ -547,7 +1163,7 @@ int is_cmd_excl(struct lsof_context *ctx, char *cmd, /* command name */
      */
     for (i = 0; i < NCmdRxU; i++) {
         if (!regexec(&CmdRx[i].cx, cmd, 0, NULL, 0)) {
-            CmdRx[i].mc = 1;
+            SEL_FOUND(ctx, CmdRx[i].mc, 1);
             *pss |= PS_PRI;
             *sf |= SELCMD;
             return (0);
@@ -584,6 +1200,8 @@ int is_file_sel(struct lsof_context *ctx, /* context */
     }
 #endif /* defined(HASSECURITY) && defined(HASNOSOCKSECURITY) */
 
+    if (ctx->delta_sel && !(ctx->delta_sel & DELTA_SEL(lf->chg)))
+        return (0);
     if (AllProc)
         return (1);
     if (Fand && ((lf->sf & Selflags) != Selflags))
@@ -591,6 +1209,70 @@ int is_file_sel(struct lsof_context *ctx, /* context */
     return (1);
 }
 
+/*
+ * sel_pids_only() - can only the processes of the included PIDs be selected?
+ *
+ * When they can, a dialect may read just those processes instead of the
+ * whole process table.  That's so when PIDs have been included and either
+ * the selections are ANDed or the PIDs are the only selection.  Endpoint
+ * information needs the files of all processes.
+ *
+ * return: 1 if they can
+ */
+
+int sel_pids_only(struct lsof_context *ctx) /* context */
+{
+    if (AllProc || !Npidi || !(Selflags & SELPID))
+        return (0);
+
+#if defined(HASEPTOPTS)
+    if (FeptE)
+        return (0);
+#endif /* defined(HASEPTOPTS) */
+
+    return ((Fand || (Selflags == SELPID)) ? 1 : 0);
+}
+
+/*
+ * find_sel_id() - find a PID or PGID selection entry
+ */
+
+static struct int_lst *find_sel_id(struct lsof_context *ctx,
+                                   inohash_t *set,      /* compiled index */
+                                   struct int_lst *lst, /* Spid or Spgid */
+                                   int n,               /* lst[] count */
+                                   int id)              /* ID to find */
+{
+    int i;
+
+    if (ctx->sels_compiled)
+        return ((struct int_lst *)inohash_find(set, (INODETYPE)id));
+    for (i = 0; i < n; i++) {
+        if (lst[i].i == id)
+            return (&lst[i]);
+    }
+    return ((struct int_lst *)NULL);
+}
+
+/*
+ * find_sel_uid() - find a UID selection entry
+ */
+
+static struct seluid *find_sel_uid(struct lsof_context *ctx,
+                                   uid_t uid) /* UID to find */
+{
+    int i;
+
+    if (ctx->sels_compiled)
+        return ((struct seluid *)inohash_find(&ctx->sel_uid_set,
+                                              (INODETYPE)uid));
+    for (i = 0; i < Nuid; i++) {
+        if (Suid[i].uid == uid)
+            return (&Suid[i]);
+    }
+    return ((struct seluid *)NULL);
+}
+
 /*
  * is_proc_excl() - is process excluded?
  */
@@ -607,7 +1289,8 @@ int is_proc_excl(struct lsof_context *ctx, int pid, /* Process ID */
 #endif /* defined(HASTASKS) */
 
 {
-    int i, j;
+    struct int_lst *ip;
+    struct seluid *sup;
 
     *pss = *sf = 0;
 
@@ -628,41 +1311,23 @@ int is_proc_excl(struct lsof_context *ctx, int pid, /* Process ID */
      * If the excluding of process listing by UID has been specified, see if the
      * owner of this process is excluded.
      */
-    if (Nuidexcl) {
-        for (i = j = 0; (i < Nuid) && (j < Nuidexcl); i++) {
-            if (!Suid[i].excl)
-                continue;
-            if (Suid[i].uid == (uid_t)uid)
-                return (1);
-            j++;
-        }
-    }
+    if (Nuidexcl && (sup = find_sel_uid(ctx, (uid_t)uid)) && sup->excl)
+        return (1);
     /*
      * If the excluding of process listing by PGID has been specified, see if
      * this PGID is excluded.
      */
-    if (Npgidx) {
-        for (i = j = 0; (i < Npgid) && (j < Npgidx); i++) {
-            if (!Spgid[i].x)
-                continue;
-            if (Spgid[i].i == pgid)
-                return (1);
-            j++;
-        }
-    }
+    if (Npgidx && (ip = find_sel_id(ctx, &ctx->sel_pgid_set, Spgid, Npgid,
+                                    pgid)) &&
+        ip->x)
+        return (1);
     /*
      * If the excluding of process listing by PID has been specified, see if
      * this PID is excluded.
      */
-    if (Npidx) {
-        for (i = j = 0; (i < Npid) && (j < Npidx); i++) {
-            if (!Spid[i].x)
-                continue;
-            if (Spid[i].i == pid)
-                return (1);
-            j++;
-        }
-    }
+    if (Npidx &&
+        (ip = find_sel_id(ctx, &ctx->sel_pid_set, Spid, Npid, pid)) && ip->x)
+        return (1);
     /*
      * If the listing of all processes is selected, then this one is not
      * excluded.
@@ -687,18 +1352,13 @@ int is_proc_excl(struct lsof_context *ctx, int pid, /* Process ID */
      * if this one is included or excluded.
      */
     if (Npgidi && (Selflags & SELPGID)) {
-        for (i = j = 0; (i < Npgid) && (j < Npgidi); i++) {
-            if (Spgid[i].x)
-                continue;
-            if (Spgid[i].i == pgid) {
-                Spgid[i].f = 1;
-                *pss = PS_PRI;
-                *sf = SELPGID;
-                if (Selflags == SELPGID)
-                    return (0);
-                break;
-            }
-            j++;
+        if ((ip = find_sel_id(ctx, &ctx->sel_pgid_set, Spgid, Npgid, pgid)) &&
+            !ip->x) {
+            SEL_FOUND(ctx, ip->f, 1);
+            *pss = PS_PRI;
+            *sf = SELPGID;
+            if (Selflags == SELPGID)
+                return (0);
         }
         if ((Selflags == SELPGID) && !*sf)
             return (1);
@@ -708,18 +1368,13 @@ int is_proc_excl(struct lsof_context *ctx, int pid, /* Process ID */
      * included or excluded.
      */
     if (Npidi && (Selflags & SELPID)) {
-        for (i = j = 0; (i < Npid) && (j < Npidi); i++) {
-            if (Spid[i].x)
-                continue;
-            if (Spid[i].i == pid) {
-                Spid[i].f = 1;
-                *pss = PS_PRI;
-                *sf |= SELPID;
-                if (Selflags == SELPID)
-                    return (0);
-                break;
-            }
-            j++;
+        if ((ip = find_sel_id(ctx, &ctx->sel_pid_set, Spid, Npid, pid)) &&
+            !ip->x) {
+            SEL_FOUND(ctx, ip->f, 1);
+            *pss = PS_PRI;
+            *sf |= SELPID;
+            if (Selflags == SELPID)
+                return (0);
         }
         if ((Selflags == SELPID) && !*sf)
             return (1);
@@ -729,18 +1384,12 @@ int is_proc_excl(struct lsof_context *ctx, int pid, /* Process ID */
      * of this process has been included.
      */
     if (Nuidincl && (Selflags & SELUID)) {
-        for (i = j = 0; (i < Nuid) && (j < Nuidincl); i++) {
-            if (Suid[i].excl)
-                continue;
-            if (Suid[i].uid == (uid_t)uid) {
-                Suid[i].f = 1;
-                *pss = PS_PRI;
-                *sf |= SELUID;
-                if (Selflags == SELUID)
-                    return (0);
-                break;
-            }
-            j++;
+        if ((sup = find_sel_uid(ctx, (uid_t)uid)) && !sup->excl) {
+            SEL_FOUND(ctx, sup->f, 1);
+            *pss = PS_PRI;
+            *sf |= SELUID;
+            if (Selflags == SELUID)
+                return (0);
         }
         if (Selflags == SELUID && (*sf & SELUID) == 0)
             return (1);
@@ -802,6 +1451,103 @@ int is_proc_excl(struct lsof_context *ctx, int pid, /* Process ID */
     return (Fand ? 1 : 0);
 }
 
+/*
+ * need_sel_attrs() - add the file attributes the selections need to NeedAttr
+ */
+
+void need_sel_attrs(struct lsof_context *ctx) {
+    /*
+     * Endpoint information is gathered from all of them.
+     */
+    if (FeptE) {
+        NeedAttr = NEED_ALL;
+        return;
+    }
+    if (AllProc)
+        return;
+    if (Selflags & SELNW)
+        NeedAttr |= NEED_SOCK;
+    if (Selflags & (SELNFS | SELNM))
+        NeedAttr |= NEED_NODE;
+    if (Selflags & SELNLINK)
+        NeedAttr |= NEED_NLINK;
+    if (Selflags & SELCNTX)
+        NeedAttr |= NEED_CNTX;
+    /*
+     * Memory-mapped files may be selected by any file selection.
+     */
+    if (Selflags & SELFILE)
+        NeedAttr |= NEED_MAPS;
+}
+
+/*
+ * sel_files_found() - have all the file selections been found?
+ *
+ * The process selections are found before a process's files are read, so
+ * only the file selections can be left unfound by skipping files.
+ *
+ * return: 1 if they have
+ */
+
+static int sel_files_found(struct lsof_context *ctx) /* context */
+{
+    struct sfile *sfp;
+    struct nwad *np;
+
+#if defined(HASTCPUDPSTATE)
+    int i;
+#endif /* defined(HASTCPUDPSTATE) */
+
+#if defined(HASPROCFS)
+    struct procfsid *pfi;
+#endif /* defined(HASPROCFS) */
+
+#if defined(HASSELINUX)
+    cntxlist_t *cntxp;
+#endif /* defined(HASSELINUX) */
+
+    for (sfp = Sfile; sfp; sfp = sfp->next) {
+        if (!sfp->f)
+            return (0);
+    }
+
+#if defined(HASPROCFS)
+    if (Procsrch && !Procfind)
+        return (0);
+    for (pfi = Procfsid; pfi; pfi = pfi->next) {
+        if (!pfi->f)
+            return (0);
+    }
+#endif /* defined(HASPROCFS) */
+
+    for (np = Nwad; np; np = np->next) {
+        if (!np->f)
+            return (0);
+    }
+    if ((Fnet == 1) || (Fnfs == 1) || (Ftask == 1))
+        return (0);
+
+#if defined(HASTCPUDPSTATE)
+    for (i = 0; TcpStIn && (i < TcpNstates); i++) {
+        if (TcpStI[i] == 1)
+            return (0);
+    }
+    for (i = 0; UdpStIn && (i < UdpNstates); i++) {
+        if (UdpStI[i] == 1)
+            return (0);
+    }
+#endif /* defined(HASTCPUDPSTATE) */
+
+#if defined(HASSELINUX)
+    for (cntxp = CntxArg; cntxp; cntxp = cntxp->next) {
+        if (!cntxp->f)
+            return (0);
+    }
+#endif /* defined(HASSELINUX) */
+
+    return (1);
+}
+
 /*
  * link_lfile() - link local file structures
  */
@@ -904,6 +1650,21 @@ void link_lfile(struct lsof_context *ctx) {
         Fnfs = 2;
     if (Ftask && (Lf->sf & SELTASK))
         Ftask = 2;
+    /*
+     * Note when the rest of the process's files needn't be read: when the
+     * selected file limit has been reached, or, with -t, when the process
+     * has been selected and no file selection is left unfound.
+     *
+     * A delta gather's file selections depend on comparing the files with
+     * those of the previous one, which is done only after the walk.
+     */
+    if ((ctx->first_match || ctx->max_matches) && !ctx->delta &&
+        is_file_sel(ctx, Lp, Lf)) {
+        if (ctx->max_matches && (++ctx->matches >= ctx->max_matches))
+            ctx->files_done = 1;
+        else if (ctx->first_match && sel_files_found(ctx))
+            ctx->files_done = 1;
+    }
     Lf = (struct lfile *)NULL;
 }
 
@@ -1399,4 +2160,105 @@ void fd_to_string(enum lsof_fd_type fd_type, int fd_num, char *buf) {
         buf[0] = '\0';
         break;
     }
-}
\ No newline at end of file
+}
+
+#if defined(HASPARSCAN)
+/*
+ * Local definitions for found_defer()
+ */
+
+#    define FOUND_MINSLOTS 64 /* minimum slot count -- a power of two */
+#    define FOUND_HASH(fl)                                                     \
+        ((size_t)(((uintptr_t)(fl) >> 2) * 0x9e3779b97f4a7c15ULL >> 16))
+
+/*
+ * found_apply() - set the find states a scanning thread recorded
+ */
+
+void found_apply(struct lsof_context *ctx,  /* context */
+                 struct lsof_context *from) /* scanning thread's context */
+{
+    struct found_mark *m;
+    size_t i;
+
+    if (!from->found_marks)
+        return;
+    for (i = 0; i <= from->found_marks_mask; i++) {
+        m = &from->found_marks[i];
+        if (!m->fl)
+            continue;
+        if (m->sz == sizeof(char))
+            *(unsigned char *)m->fl = (unsigned char)m->v;
+        else if (m->sz == sizeof(short))
+            *(short *)m->fl = (short)m->v;
+        else
+            *(int *)m->fl = m->v;
+    }
+}
+
+/*
+ * found_defer() - record a find state for found_apply()
+ *
+ * A find state is recorded once; later settings of it are the same.
+ */
+
+void found_defer(struct lsof_context *ctx, /* scanning thread's context */
+                 void *fl,                 /* find state address */
+                 size_t sz,                /* its size */
+                 int v)                    /* its value */
+{
+    size_t i, j, ns;
+    struct found_mark *m = ctx->found_marks;
+
+    if (m) {
+        for (i = FOUND_HASH(fl) & ctx->found_marks_mask; m[i].fl;
+             i = (i + 1) & ctx->found_marks_mask) {
+            if (m[i].fl == fl)
+                return;
+        }
+    }
+    if (!m || ctx->found_marks_size + 1 > ctx->found_marks_mask -
+                                              ctx->found_marks_mask / 4) {
+
+        /*
+         * Double the slot count and rehash the recorded states.
+         */
+        ns = m ? (ctx->found_marks_mask + 1) * 2 : FOUND_MINSLOTS;
+        if (!(m = (struct found_mark *)calloc(ns, sizeof(struct found_mark)))) {
+            (void)fprintf(stderr,
+                          "%s: no space for scanning thread find states\n", Pn);
+            Error(ctx);
+        }
+        if (ctx->found_marks) {
+            for (j = 0; j <= ctx->found_marks_mask; j++) {
+                if (!ctx->found_marks[j].fl)
+                    continue;
+                for (i = FOUND_HASH(ctx->found_marks[j].fl) & (ns - 1);
+                     m[i].fl; i = (i + 1) & (ns - 1))
+                    ;
+                m[i] = ctx->found_marks[j];
+            }
+            (void)free((FREE_P *)ctx->found_marks);
+        }
+        ctx->found_marks = m;
+        ctx->found_marks_mask = ns - 1;
+    }
+    for (i = FOUND_HASH(fl) & ctx->found_marks_mask; m[i].fl;
+         i = (i + 1) & ctx->found_marks_mask)
+        ;
+    m[i].fl = fl;
+    m[i].sz = sz;
+    m[i].v = v;
+    ctx->found_marks_size++;
+}
+
+/*
+ * found_free() - free a scanning thread's recorded find states
+ */
+
+void found_free(struct lsof_context *ctx) /* scanning thread's context */
+{
+    CLEAN(ctx->found_marks);
+    ctx->found_marks_size = ctx->found_marks_mask = 0;
+}
+#endif /* defined(HASPARSCAN) */
@@ -54,6 +54,23 @@ extern void alloc_lfile(struct lsof_context *ctx, enum lsof_fd_type fd_type,
                         int num);
 extern void alloc_lproc(struct lsof_context *ctx, int pid, int pgid, int ppid,
                         UID_ARG uid, char *cmd, int pss, int sf);
+
+#    if defined(HASARENA)
+extern char *arena_alloc(struct lsof_context *ctx, size_t len, size_t align);
+extern void arena_free(struct lsof_context *ctx);
+extern void arena_mark(struct lsof_context *ctx, struct arena_mark *m);
+extern void arena_move(struct lsof_context *ctx, struct lsof_context *from);
+extern void arena_release(struct lsof_context *ctx, struct arena_mark *m);
+extern void arena_reset(struct lsof_context *ctx);
+extern char *arena_strcpy(struct lsof_context *ctx, char *s, size_t len);
+#    endif /* defined(HASARENA) */
+
+#    if defined(HASPARSCAN)
+extern void found_apply(struct lsof_context *ctx, struct lsof_context *from);
+extern void found_defer(struct lsof_context *ctx, void *fl, size_t sz, int v);
+extern void found_free(struct lsof_context *ctx);
+#    endif /* defined(HASPARSCAN) */
+
 extern void build_IPstates(struct lsof_context *ctx);
 extern void childx(struct lsof_context *ctx);
 extern void closefrom_shim(struct lsof_context *ctx, int low);
@@ -66,7 +83,11 @@ extern void ckkv(struct lsof_context *ctx, char *d, char *er, char *ev,
                  char *ea);
 extern void clr_devtab(struct lsof_context *ctx);
 extern int compdev(COMP_P *a1, COMP_P *a2);
+extern void compile_nwad(struct lsof_context *ctx);
+extern void compile_sels(struct lsof_context *ctx);
 extern int comppid(COMP_P *a1, COMP_P *a2);
+extern int dosafely(struct lsof_context *ctx, int (*fn)(), char *arg,
+                    char *rbuf, int rbln);
 
 #    if defined(WILLDROPGID)
 extern void dropgid(struct lsof_context *ctx);
@@ -81,6 +102,9 @@ extern int enter_dir(struct lsof_context *ctx, char *d, int descend);
 extern int enter_efsys(struct lsof_context *ctx, char *e, int rdlnk);
 #    endif /* defined(HASEOPT) */
 
+extern void delta_free(struct lsof_context *ctx, int all);
+extern int delta_mark(struct lsof_context *ctx);
+extern void delta_save(struct lsof_context *ctx);
 extern int enter_fd(struct lsof_context *ctx, char *f);
 extern int enter_network_address(struct lsof_context *ctx, char *na);
 extern int enter_id(struct lsof_context *ctx, enum IDType ty, char *p);
@@ -96,6 +120,7 @@ extern int enter_uid(struct lsof_context *ctx, char *us);
 extern void ent_inaddr(struct lsof_context *ctx, unsigned char *la, int lp,
                        unsigned char *fa, int fp, int af);
 extern int examine_lproc(struct lsof_context *ctx);
+extern int stream_procs(struct lsof_context *ctx);
 extern void Exit(struct lsof_context *ctx, enum ExitStatus xv) exiting;
 extern void Error(struct lsof_context *ctx) exiting;
 extern void find_ch_ino(struct lsof_context *ctx);
@@ -137,6 +162,9 @@ extern void process_nets6info(struct lsof_context *ctx, int f);
 #    endif     /* defined(HASEPTOPTS) */
 
 extern void free_lproc(struct lproc *lp);
+extern void free_mnt(struct lsof_context *ctx);
+extern void free_nwad(struct lsof_context *ctx);
+extern void free_sels(struct lsof_context *ctx);
 extern void gather_proc_info(struct lsof_context *ctx);
 extern char *gethostnm(struct lsof_context *ctx, unsigned char *ia, int af);
 
@@ -180,10 +208,16 @@ extern int lstatsafely(struct lsof_context *ctx, char *path, struct stat *buf);
 extern char *mkstrcpy(char *src, MALLOC_S *rlp);
 extern char *mkstrcat(char *s1, int l1, char *s2, int l2, char *s3, int l3,
                       MALLOC_S *clp);
+extern void need_sel_attrs(struct lsof_context *ctx);
 extern int printdevname(struct lsof_context *ctx, dev_t *dev, dev_t *rdev,
                         int f, int nty);
 extern void print_file(struct lsof_context *ctx);
 extern void print_init(struct lsof_context *ctx);
+#    if defined(HASSERVE)
+extern void print_warm(struct lsof_context *ctx);
+extern void send_names(struct lsof_context *ctx, int fd);
+extern void take_names(struct lsof_context *ctx, int fd);
+#    endif /* defined(HASSERVE) */
 extern void printname(struct lsof_context *ctx, int nl);
 extern char *print_kptr(KA_T kp, char *buf, size_t bufl);
 extern int print_proc(struct lsof_context *ctx);
@@ -203,8 +237,14 @@ extern void process_node(struct lsof_context *ctx, KA_T f);
 extern char *Readlink(struct lsof_context *ctx, char *arg);
 extern void readdev(struct lsof_context *ctx, int skip);
 extern struct mounts *readmnt(struct lsof_context *ctx);
+#    if defined(HASSERVE)
+extern void serve(struct lsof_context *ctx, int *argc, char ***argv);
+extern void serve_done(struct lsof_context *ctx);
+extern void warm_tables(struct lsof_context *ctx);
+#    endif /* defined(HASSERVE) */
 extern void rereaddev(struct lsof_context *ctx);
 extern char *safepup(unsigned int c, int *cl);
+extern int sel_pids_only(struct lsof_context *ctx);
 extern int safestrlen(char *sp, int flags);
 extern void safestrprtn(char *sp, int len, FILE *fs, int flags);
 extern void safestrprt(char *sp, FILE *fs, int flags);
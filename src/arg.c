@@ -57,6 +57,8 @@ static int enter_nwad(struct lsof_context *ctx, struct nwad *n, int sp, int ep,
                       char *s, struct hostent *he);
 static struct hostent *lkup_hostnm(char *hn, struct nwad *n);
 static char *isIPv4addr(char *hn, unsigned char *a, int al);
+static int enter_nwad_file(struct lsof_context *ctx, char *path);
+static char *get_plen(char *s, int max, int *pl);
 
 /*
  * ckfd_range() - check fd range
@@ -1434,6 +1436,12 @@ int enter_network_address(struct lsof_context *ctx, /* context */
         (void)fprintf(stderr, "%s: no network address specified\n", Pn);
         return (1);
     }
+    /*
+     * A '@' followed by a path that begins with '/' or '.' names a file of
+     * address specifications.
+     */
+    if (*na == '@' && (na[1] == '/' || na[1] == '.'))
+        return (enter_nwad_file(ctx, na + 1));
     zeromem((char *)&n, sizeof(n));
     wa = na;
     /*
@@ -1565,6 +1573,15 @@ int enter_network_address(struct lsof_context *ctx, /* context */
             }
             wa = p;
             n.af = AF_INET;
+            if (*wa == '/' && !(wa = get_plen(wa, MIN_AF_ADDR * 8, &n.plen))) {
+
+            unacc_prefix:
+                (void)fprintf(stderr,
+                              "%s: unacceptable address prefix length in: -i ",
+                              Pn);
+                safestrprt(na, stderr, 1);
+                goto nwad_exit;
+            }
         } else if (*wa == '[') {
 
 #if defined(HASIPv6)
@@ -1605,6 +1622,20 @@ int enter_network_address(struct lsof_context *ctx, /* context */
             } else
                 n.af = AF_INET6;
             wa = cp + 1;
+            if (*wa == '/') {
+                if (!(wa = get_plen(wa, MAX_AF_ADDR * 8, &n.plen)))
+                    goto unacc_prefix;
+                if (n.af == AF_INET) {
+
+                    /*
+                     * The prefix of an IPv4-mapped address must reach into
+                     * its IPv4 part.
+                     */
+                    if (n.plen <= 96)
+                        goto unacc_prefix;
+                    n.plen -= 96;
+                }
+            }
 #else  /* !defined(HASIPv6) */
             (void)fprintf(stderr, "%s: unsupported IPv6 address in: -i ", Pn);
             safestrprt(na, stderr, 1);
@@ -1909,6 +1940,8 @@ static int enter_nwad(struct lsof_context *ctx, /* context */
          * Construct and link the address specification.
          */
         *np = nc;
+        if (!np->plen)
+            np->plen = (nc.af == AF_INET) ? MIN_AF_ADDR * 8 : MAX_AF_ADDR * 8;
         np->sport = sp;
         np->eport = ep;
         np->f = 0;
@@ -1947,6 +1980,59 @@ static int enter_nwad(struct lsof_context *ctx, /* context */
     return (0);
 }
 
+/*
+ * enter_nwad_file() - enter the Internet addresses listed in a file
+ *
+ * Each line holds one address specification, in -i form.  Blank lines and
+ * those whose first non-blank character is '#' are skipped.
+ */
+
+static int enter_nwad_file(struct lsof_context *ctx, /* context */
+                           char *path)               /* file path */
+{
+    char buf[1024], *cp, *ep;
+    int err = 0;
+    FILE *fs;
+    int ln = 0;
+    static int nest = 0;
+
+    if (nest) {
+        (void)fprintf(stderr, "%s: -i file %s may not name another\n", Pn,
+                      path);
+        return (1);
+    }
+    if (!(fs = fopen(path, "r"))) {
+        (void)fprintf(stderr, "%s: can't open -i file %s: %s\n", Pn, path,
+                      strerror(errno));
+        return (1);
+    }
+    nest = 1;
+    while (fgets(buf, sizeof(buf), fs)) {
+        ln++;
+        if (!strchr(buf, '\n') && !feof(fs)) {
+            (void)fprintf(stderr, "%s: -i file %s line %d is too long\n", Pn,
+                          path, ln);
+            err = 1;
+            break;
+        }
+        for (cp = buf; *cp == ' ' || *cp == '\t'; cp++)
+            ;
+        for (ep = cp + strlen(cp); ep > cp && isspace((unsigned char)ep[-1]);
+             ep--)
+            ;
+        *ep = '\0';
+        if (!*cp || *cp == '#')
+            continue;
+        if (enter_network_address(ctx, cp)) {
+            (void)fprintf(stderr, "%s: at -i file %s line %d\n", Pn, path, ln);
+            err = 1;
+        }
+    }
+    (void)fclose(fs);
+    nest = 0;
+    return (err);
+}
+
 #if defined(HASTCPUDPSTATE)
 /*
  * enter_state_spec() -- enter TCP and UDP state specifications
@@ -2325,6 +2411,30 @@ int enter_uid(struct lsof_context *ctx, /* context */
     return (err);
 }
 
+/*
+ * get_plen() - get an address prefix length following a '/'
+ *
+ * return: the character position after the length; NULL if it's unacceptable
+ */
+
+static char *get_plen(char *s, /* '/' position */
+                      int max, /* maximum length (bits) */
+                      int *pl) /* length receptor */
+{
+    int l = 0;
+
+    if (*s++ != '/' || *s < '0' || *s > '9')
+        return ((char *)NULL);
+    for (; *s >= '0' && *s <= '9'; s++) {
+        if ((l = (l * 10) + *s - '0') > max)
+            return ((char *)NULL);
+    }
+    if (!l)
+        return ((char *)NULL);
+    *pl = l;
+    return (s);
+}
+
 /*
  * isIPv4addr() - is host name an IPv4 address
  */
@@ -2350,7 +2460,7 @@ static char *isIPv4addr(char *hn,         /* host name */
      * name for four octets, separated by dots.
      */
     ov[0] = (int)(*hn++ - '0');
-    while (*hn && (*hn != ':')) {
+    while (*hn && (*hn != ':') && (*hn != '/')) {
         if (*hn == '.') {
 
             /*
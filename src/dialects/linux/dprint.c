@@ -43,6 +43,8 @@ static char *socket_state_to_str(struct lsof_context *ctx, unsigned int ss);
  * print_unix() - print state of UNIX domain socket e.g. UNCONNECTED
  */
 static void print_unix(struct lsof_context *ctx, int nl) {
+    int ps = 0;
+
     if (Ftcptpi & TCPTPI_STATE) {
 #if defined(HASSOSTATE) && defined(HASSOOPT)
         char *cp = (Lf->lts.opt == __SO_ACCEPTCON)
@@ -54,10 +56,26 @@ static void print_unix(struct lsof_context *ctx, int nl) {
         else {
             putchar('(');
             (void)fputs(cp, stdout);
-            putchar(')');
         }
+        ps++;
 #endif /* defined(HASSOSTATE) && defined(HASSOOPT) */
     }
+
+#if defined(HASTCPTPIQ)
+    if ((Ftcptpi & TCPTPI_QUEUES) && Lf->lts.rqs && Lf->lts.sqs) {
+        if (Ffield)
+            (void)printf("%cQR=%lu%c%cQS=%lu%c", LSOF_FID_TCPTPI, Lf->lts.rq,
+                         Terminator, LSOF_FID_TCPTPI, Lf->lts.sq, Terminator);
+        else {
+            putchar(ps ? ' ' : '(');
+            (void)printf("QR=%lu QS=%lu", Lf->lts.rq, Lf->lts.sq);
+        }
+        ps++;
+    }
+#endif /* defined(HASTCPTPIQ) */
+
+    if (!Ffield && ps)
+        putchar(')');
     if (nl)
         putchar('\n');
 }
@@ -33,16 +33,52 @@
 #include "common.h"
 #include "cli.h"
 
+#if defined(HASMNTCHG) || defined(HASTIMERFD)
+#    include <poll.h>
+#endif /* defined(HASMNTCHG) || defined(HASTIMERFD) */
+
+#if defined(HASTIMERFD)
+#    include <sys/timerfd.h>
+#endif /* defined(HASTIMERFD) */
+
 /*
  * Local definitions
  */
 
+/*
+ * The IDs of the fields that aren't about files: those of the process set,
+ * the marker and the terminator.
+ */
+
+#define PROC_FIELDS "cgKLMpRuzZm0"
+
+/*
+ * The long options, whose GetOpt() return values lie beyond those of the
+ * option characters.  Each has a value, following `=' or as the next
+ * argument.
+ */
+
+#define LOPT_MAXMATCH 256 /* --max-matches */
+
+static struct lopt {
+    char *nm; /* name, after "--" */
+    int rv;   /* GetOpt() return value */
+} LongOpt[] = {
+
+#if defined(HASMATCHLIMIT)
+    {"max-matches", LOPT_MAXMATCH},
+#endif /* defined(HASMATCHLIMIT) */
+
+    {(char *)NULL, 0}};
+
 static int GObk[] = {1, 1};      /* option backspace values */
 static char GOp;                 /* option prefix -- '+' or '-' */
 static char *GOv = (char *)NULL; /* option `:' value pointer */
 static int GOx1 = 1;             /* first opt[][] index */
 static int GOx2 = 0;             /* second opt[][] index */
 
+static int GetLongOpt(struct lsof_context *ctx, int ct, char *opt[],
+                      int *err);
 static int GetOpt(struct lsof_context *ctx, int ct, char *opt[], char *rules,
                   int *err);
 static char *sv_fmt_str(struct lsof_context *ctx, char *f);
@@ -70,10 +106,34 @@ int main(int argc, char *argv[]) {
     struct sfile *sfp;
     struct lproc **slp = (struct lproc **)NULL;
     int sp = 0;
+    struct lproc **dlp = (struct lproc **)NULL;
+    int dsp = 0, nd = 0, ns = 0;
     struct str_lst *str, *strt;
     int version = 0;
     int xover = 0;
     int pr_count = 0;
+    unsigned long ri = 0;  /* repeat interval (microseconds) */
+    int rl = 0;            /* report each pass's latency in its marker */
+    unsigned long rsu = 0; /* scan time of the last pass (microseconds) */
+    unsigned long rov = 0; /* period boundaries it overran */
+    struct timespec rns, rts, rte;
+
+#if defined(HASTIMERFD)
+    int rtf = -1; /* repeat timerfd */
+    struct itimerspec rit;
+    struct pollfd rpf;
+    uint64_t rx;
+#endif /* defined(HASTIMERFD) */
+
+#if defined(HASSERVE)
+    int served = 0;
+#endif /* defined(HASSERVE) */
+
+#if defined(HASMNTCHG)
+    int mcf = -1;
+    struct pollfd mpf;
+#endif /* defined(HASMNTCHG) */
+
     /** liblsof context */
     struct lsof_context *ctx = NULL;
 
@@ -82,6 +142,10 @@ int main(int argc, char *argv[]) {
     size_t fmtl = (size_t)0;
 #endif /* defined(HAS_STRFTIME) */
 
+#if defined(HASMATCHLIMIT)
+    size_t mm; /* --max-matches count */
+#endif /* defined(HASMATCHLIMIT) */
+
 #if defined(HASZONES)
     znhash_t *zp;
 #endif /* defined(HASZONES) */
@@ -147,12 +211,27 @@ int main(int argc, char *argv[]) {
     Euid = geteuid();
     if ((Myuid = (uid_t)getuid()) && !Euid)
         Setuidroot = 1;
+
+#if defined(HASSERVE)
+    /*
+     * If -W is the first option, become a query server.  serve() returns
+     * only in the child answering a query, with the query as the options.
+     * The child checks /etc/passwd before it uses the user names it
+     * inherited.
+     */
+    if (argc > 1 && !strncmp(argv[1], "-W", 2)) {
+        serve(ctx, &argc, &argv);
+        served = 1;
+        CkPasswd = 1;
+    }
+#endif /* defined(HASSERVE) */
+
     /*
      * Create option mask.
      */
     (void)snpf(options, sizeof(options),
-               "?a%sbc:%sD:d:%s%sf:F:g:hHi:%s%slL:%s%snNo:Op:QPr:%ss:S:tT:u:"
-               "UvVwx:%s%s%s",
+               "?a%sbc:%sD:d:%s%sf:F:g:hHi:%s%s%slL:%s%snNo:Op:QPr:%ss:S:tT:u:"
+               "UvV%swx:%s%s%s",
 
 #if defined(HAS_AFS) && defined(HASAOPT)
                "A:",
@@ -178,6 +257,12 @@ int main(int argc, char *argv[]) {
                "",
 #endif /* defined(HASEPTOPTS) */
 
+#if defined(HASPARSCAN)
+               "j:",
+#else  /* !defined(HASPARSCAN) */
+               "",
+#endif /* defined(HASPARSCAN) */
+
 #if defined(HASKOPT)
                "k:",
 #else  /* !defined(HASKOPT) */
@@ -208,6 +293,12 @@ int main(int argc, char *argv[]) {
                "",
 #endif /* defined(HASPPID) */
 
+#if defined(HASSERVE)
+               "W:",
+#else  /* !defined(HASSERVE) */
+               "",
+#endif /* defined(HASSERVE) */
+
 #if defined(HASXOPT)
 #    if defined(HASXOPT_ROOT)
                (Myuid == 0) ? "X" : "",
@@ -570,6 +661,34 @@ int main(int argc, char *argv[]) {
                 err = 1;
             break;
 
+#if defined(HASPARSCAN)
+        case 'j':
+            if (!GOv || *GOv == '-' || *GOv == '+') {
+                i = (int)sysconf(_SC_NPROCESSORS_ONLN);
+                if (GOv) {
+                    GOx1 = GObk[0];
+                    GOx2 = GObk[1];
+                }
+            } else {
+                for (cp = GOv, i = n = 0; *cp; cp++) {
+                    if (!isdigit((unsigned char)*cp))
+                        break;
+                    i = (i * 10) + ((int)*cp - '0');
+                    n++;
+                }
+                if (!n)
+                    i = (int)sysconf(_SC_NPROCESSORS_ONLN);
+                if (*cp) {
+                    GOx1 = GObk[0];
+                    GOx2 = GObk[1] + n;
+                }
+            }
+            if (i > MAXSCANTHR)
+                i = MAXSCANTHR;
+            (void)lsof_set_scan_threads(ctx, (i > 0) ? i : 1);
+            break;
+#endif /* defined(HASPARSCAN) */
+
 #if defined(HASKOPT)
         case 'k':
             if (!GOv || *GOv == '-' || *GOv == '+') {
@@ -744,27 +863,72 @@ int main(int argc, char *argv[]) {
             }
             if (!GOv || *GOv == '-' || *GOv == '+') {
                 RptTm = RPTTM;
+                ri = (unsigned long)RPTTM * 1000000;
                 if (GOv) {
                     GOx1 = GObk[0];
                     GOx2 = GObk[1];
                 }
                 break;
             }
+            /*
+             * Assemble the seconds, which may have a fraction of up to six
+             * digits.  RptTm is kept non-zero for a sub-second interval,
+             * since it also says that repeat mode is in effect.  A zero
+             * interval is rejected.
+             */
             for (cp = GOv, i = n = 0; *cp; cp++) {
                 if (!isdigit((unsigned char)*cp))
                     break;
                 i = (i * 10) + ((int)*cp - '0');
                 n++;
             }
+            ri = (unsigned long)i * 1000000;
+            if (*cp == '.') {
+                for (cp++, l = 100000; isdigit((unsigned char)*cp); cp++) {
+                    ri += (unsigned long)(((int)*cp - '0') * l);
+                    l /= 10;
+                }
+                n++;
+            }
+            if (n && !ri) {
+                (void)fprintf(stderr, "%s: illegal -r time of zero: %s\n", Pn,
+                              GOv);
+                err = 1;
+                break;
+            }
             if (n)
-                RptTm = i;
-            else
+                RptTm = (ri && !i) ? 1 : i;
+            else {
                 RptTm = RPTTM;
+                ri = (unsigned long)RPTTM * 1000000;
+            }
             if (!*cp)
                 break;
             while (*cp && (*cp == ' '))
                 cp++;
 
+            /*
+             * A `:' precedes the d and l suffixes.  Since it can't be an
+             * option character, they can't be mistaken for options that
+             * follow -r in the same argument -- e.g., -r1l is -r1 -l.
+             */
+            while (n && *cp == ':') {
+                for (cp++, i = 0; *cp == 'd' || *cp == 'l'; cp++, i++) {
+                    if (*cp == 'd')
+                        ctx->delta = 1;
+                    else
+                        rl = 1;
+                }
+                if (!i)
+                    break;
+            }
+            if (n && *(cp - 1) == ':') {
+                (void)fprintf(stderr, "%s: no d or l after -r \":\": %s\n", Pn,
+                              GOv);
+                err = 1;
+                break;
+            }
+
             if (*cp == 'c') {
                 cp++;
                 for (i = 0; *cp && isdigit((unsigned char)*cp); cp++)
@@ -772,9 +936,11 @@ int main(int argc, char *argv[]) {
                 RptMaxCount = i;
             }
 
+            if (!*cp)
+                break;
             if (*cp != LSOF_FID_MARK) {
                 GOx1 = GObk[0];
-                GOx2 = GObk[1] + n;
+                GOx2 = GObk[1] + (int)(cp - GOv);
                 break;
             }
 
@@ -922,6 +1088,14 @@ int main(int argc, char *argv[]) {
         case 'V':
             Fverbose = 1;
             break;
+
+#if defined(HASSERVE)
+        case 'W':
+            (void)fprintf(stderr, "%s: -W must be the first option\n", Pn);
+            err = 1;
+            break;
+#endif /* defined(HASSERVE) */
+
         case 'w':
             Fwarn = (GOp == '+') ? 0 : 1;
             break;
@@ -997,6 +1171,24 @@ int main(int argc, char *argv[]) {
             break;
 #endif /* defined(HASSELINUX) */
 
+#if defined(HASMATCHLIMIT)
+        case LOPT_MAXMATCH:
+            for (cp = GOv, mm = 0, n = 0; cp && *cp; cp++) {
+                if (!isdigit((unsigned char)*cp))
+                    break;
+                mm = (mm * 10) + (size_t)(*cp - '0');
+                n++;
+            }
+            if (!n || *cp || !mm) {
+                (void)fprintf(stderr, "%s: illegal --max-matches count: %s\n",
+                              Pn, GOv ? GOv : "(none)");
+                err = 1;
+                break;
+            }
+            (void)lsof_set_max_matches(ctx, mm);
+            break;
+#endif /* defined(HASMATCHLIMIT) */
+
         default:
             (void)fprintf(stderr, "%s: unknown option (%c)\n", Pn, c);
             err = 1;
@@ -1062,6 +1254,17 @@ int main(int argc, char *argv[]) {
     }
 #endif /* defined(HASTCPUDPSTATE) */
 
+#if defined(HASSERVE)
+    /*
+     * A -W query that asks for neither field nor terse output gets the
+     * process ID, file descriptor and name fields.
+     */
+    if (served && !Ffield && !Fterse) {
+        FieldSel[LSOF_FIX_FD].st = FieldSel[LSOF_FIX_NAME].st = 1;
+        Ffield = 1;
+    }
+#endif /* defined(HASSERVE) */
+
     if (Fsize && Foffset) {
         (void)fprintf(stderr, "%s: -o and -s are mutually exclusive\n", Pn);
         err++;
@@ -1187,6 +1390,56 @@ int main(int argc, char *argv[]) {
             Selinet = 1;
         AllProc = 0;
     }
+    /*
+     * Tell the dialect which file attributes the output and the selections
+     * need.  -t output needs none of them; field output needs those of the
+     * fields selected.  Any file field makes the memory-mapped files needed.
+     * A socket's device and inode fields come from its protocol information,
+     * so they need it, too.
+     */
+    NeedAttr = 0;
+    if (Ffield) {
+        for (i = 0; FieldSel[i].nm; i++) {
+            if (FieldSel[i].st && !strchr(PROC_FIELDS, FieldSel[i].id))
+                NeedAttr |= NEED_MAPS;
+        }
+        if (FieldSel[LSOF_FIX_SIZE].st)
+            NeedAttr |= NEED_SIZE;
+        if (FieldSel[LSOF_FIX_OFFSET].st)
+            NeedAttr |= NEED_OFFSET;
+        if (FieldSel[LSOF_FIX_NLINK].st)
+            NeedAttr |= NEED_NLINK;
+        if (FieldSel[LSOF_FIX_DEVN].st || FieldSel[LSOF_FIX_INODE].st ||
+            FieldSel[LSOF_FIX_RDEV].st || FieldSel[LSOF_FIX_TYPE].st)
+            NeedAttr |= NEED_NODE;
+        if (FieldSel[LSOF_FIX_ACCESS].st)
+            NeedAttr |= NEED_ACCESS;
+        if (FieldSel[LSOF_FIX_LOCK].st)
+            NeedAttr |= NEED_LOCK;
+        if (FieldSel[LSOF_FIX_DEVCH].st || FieldSel[LSOF_FIX_DEVN].st ||
+            FieldSel[LSOF_FIX_INODE].st || FieldSel[LSOF_FIX_NAME].st ||
+            FieldSel[LSOF_FIX_PROTO].st || FieldSel[LSOF_FIX_RDEV].st ||
+            FieldSel[LSOF_FIX_TCPTPI].st || FieldSel[LSOF_FIX_TYPE].st)
+            NeedAttr |= NEED_SOCK;
+        if (FieldSel[LSOF_FIX_FG].st && (Fsv & FSV_FG))
+            NeedAttr |= NEED_FLAGS;
+        if (FieldSel[LSOF_FIX_CNTX].st && Fcntx)
+            NeedAttr |= NEED_CNTX;
+    } else if (!Fterse) {
+        NeedAttr = NEED_NODE | NEED_ACCESS | NEED_LOCK | NEED_MAPS | NEED_SOCK;
+        if (!Foffset)
+            NeedAttr |= NEED_SIZE;
+        if (!Fsize)
+            NeedAttr |= NEED_OFFSET;
+        if (Fnlink)
+            NeedAttr |= NEED_NLINK;
+        if (Fsv & FSV_FG)
+            NeedAttr |= NEED_FLAGS;
+        if (Fcntx)
+            NeedAttr |= NEED_CNTX;
+    }
+    if (Nlink)
+        NeedAttr |= NEED_NLINK;
     /*
      * Get the device for DEVDEV_PATH.
      */
@@ -1220,6 +1473,22 @@ int main(int argc, char *argv[]) {
                         FsearchErr == 0))
             Error(ctx);
     }
+    (void)need_sel_attrs(ctx);
+    (void)compile_sels(ctx);
+
+#if defined(HASMATCHLIMIT)
+    /*
+     * -t lists a process once one of its files is selected, so the rest of
+     * them needn't be read -- unless endpoint information, which comes from
+     * all of them, has been requested.
+     */
+    ctx->first_match = Fterse;
+#    if defined(HASEPTOPTS)
+    if (FeptE)
+        ctx->first_match = 0;
+#    endif /* defined(HASEPTOPTS) */
+#endif /* defined(HASMATCHLIMIT) */
+
     /*
      * Do dialect-specific initialization.
      */
@@ -1280,14 +1549,53 @@ int main(int argc, char *argv[]) {
 
     /*
      * Gather and report process information every RptTm seconds.
+     *
+     * The tables gathered from sources that rarely change -- the mount
+     * table, the user names, the socket tables and the locks -- are kept
+     * from one pass to the next and read again only when their sources
+     * change.
      */
-    if (RptTm)
+    if (RptTm) {
         CkPasswd = 1;
+
+#if defined(HASMNTCHG)
+        /*
+         * Watch for mount table changes, unless the entries of file system
+         * arguments point into the table.
+         */
+        if (!Sfile && !Efsysl)
+            mcf = open(HASMNTCHG, O_RDONLY | O_CLOEXEC);
+#endif /* defined(HASMNTCHG) */
+
+#if defined(HASTIMERFD)
+        /*
+         * Start the passes at fixed period boundaries, measured from now on
+         * the monotonic clock, so that the time a pass takes doesn't add to
+         * the period.  A pass that runs past boundaries skips them.
+         *
+         * The timerfd doesn't block, so that the boundaries a pass ran past
+         * can be taken from it before waiting for the next one.
+         */
+        if ((rtf = timerfd_create(CLOCK_MONOTONIC,
+                                  TFD_CLOEXEC | TFD_NONBLOCK)) >= 0) {
+            zeromem((char *)&rit, sizeof(rit));
+            rit.it_interval.tv_sec = (time_t)(ri / 1000000);
+            rit.it_interval.tv_nsec = (long)((ri % 1000000) * 1000);
+            rit.it_value = rit.it_interval;
+            if (timerfd_settime(rtf, 0, &rit, (struct itimerspec *)NULL)) {
+                (void)close(rtf);
+                rtf = -1;
+            }
+        }
+#endif /* defined(HASTIMERFD) */
+    }
     do {
 
         /*
          * Gather information about processes.
          */
+        if (rl)
+            (void)clock_gettime(CLOCK_MONOTONIC, &rts);
         gather_proc_info(ctx);
         /*
          * If the local process table has more than one entry, sort it by PID.
@@ -1312,7 +1620,31 @@ int main(int argc, char *argv[]) {
             (void)qsort((QSORT_P *)slp, (size_t)Nlproc,
                         (size_t)sizeof(struct lproc *), comppid);
         }
-        if ((n = Nlproc)) {
+        /*
+         * In delta mode (-r<t>d), sort the processes of the previous pass
+         * too, so that the files closed since then can be listed.
+         */
+        if (ctx->delta && (nd = (int)ctx->delta_procs_size)) {
+            if (nd > dsp) {
+                len = (MALLOC_S)(nd * sizeof(struct lproc *));
+                dsp = nd;
+                if (!dlp)
+                    dlp = (struct lproc **)malloc(len);
+                else
+                    dlp = (struct lproc **)realloc((MALLOC_P *)dlp, len);
+                if (!dlp) {
+                    (void)fprintf(stderr, "%s: no space for %d sort pointers\n",
+                                  Pn, nd);
+                    Error(ctx);
+                }
+            }
+            for (i = 0; i < nd; i++) {
+                dlp[i] = &ctx->delta_procs[i];
+            }
+            (void)qsort((QSORT_P *)dlp, (size_t)nd,
+                        (size_t)sizeof(struct lproc *), comppid);
+        }
+        if ((n = Nlproc) || nd) {
 
 #if defined(HASNCACHE)
             /*
@@ -1448,6 +1780,12 @@ int main(int argc, char *argv[]) {
             }
 #endif /* defined(HASEPTOPTS) */
 
+            /*
+             * In delta mode, mark the files added, changed and closed since
+             * the previous pass, so that only they are printed.
+             */
+            if (ctx->delta)
+                ns = delta_mark(ctx);
             /*
              * Print the selected processes and count them.
              *
@@ -1456,17 +1794,38 @@ int main(int argc, char *argv[]) {
              * process.
              */
             for (lf = Lf, print_init(ctx); PrPass < 2; PrPass++) {
+                if (ctx->delta)
+                    ctx->delta_sel =
+                        DELTA_SEL(DELTA_ADDED) | DELTA_SEL(DELTA_CHANGED);
                 for (i = n = 0; i < Nlproc; i++) {
                     Lp = (Nlproc > 1) ? slp[i] : &Lproc[i];
                     if (Lp->pss) {
                         if (print_proc(ctx))
                             n++;
                     }
-                    if (RptTm && PrPass)
+                    if (RptTm && PrPass && !ctx->delta)
                         (void)free_lproc(Lp);
                 }
+                /*
+                 * Print the closed files of the previous pass's processes.
+                 */
+                if (ctx->delta) {
+                    ctx->delta_sel = DELTA_SEL(DELTA_REMOVED);
+                    for (i = 0; i < nd; i++) {
+                        Lp = dlp[i];
+                        if (Lp->pss)
+                            (void)print_proc(ctx);
+                    }
+                    ctx->delta_sel = 0;
+                }
             }
             Lf = lf;
+            /*
+             * The +r exit test counts the processes with selected files,
+             * whether they changed or not.
+             */
+            if (ctx->delta)
+                n = ns;
         }
         /*
          * If a repeat time is set, sleep for the specified time.
@@ -1515,14 +1874,40 @@ int main(int argc, char *argv[]) {
             }
 #endif /* defined(HAS_STRFTIME) */
 
+            if (rl) {
+
+                /*
+                 * Measure the pass: its scan time and the period boundaries
+                 * it ran past.
+                 */
+                (void)clock_gettime(CLOCK_MONOTONIC, &rte);
+                rsu = (unsigned long)(rte.tv_sec - rts.tv_sec) * 1000000 +
+                      (unsigned long)((rte.tv_nsec - rts.tv_nsec) / 1000);
+                rov = rsu / ri;
+            }
+
+#if defined(HASTIMERFD)
+            /*
+             * Take the expirations of the boundaries the pass ran past, so
+             * that the wait below is for the next boundary.  Their count is
+             * the exact overrun count.
+             */
+            if (rtf >= 0) {
+                rov = 0;
+                if (read(rtf, (char *)&rx, sizeof(rx)) == sizeof(rx))
+                    rov = (unsigned long)rx;
+            }
+#endif /* defined(HASTIMERFD) */
             if (Ffield) {
                 putchar(LSOF_FID_MARK);
 
 #if defined(HAS_STRFTIME)
                 if (fmtr)
-                    (void)printf("%s", fmtr);
+                    (void)printf("%s%s", fmtr, rl ? " " : "");
 #endif /* defined(HAS_STRFTIME) */
 
+                if (rl)
+                    (void)printf("scan=%luus overruns=%lu", rsu, rov);
                 putchar(Terminator);
                 if (Terminator != '\n')
                     putchar('\n');
@@ -1535,13 +1920,70 @@ int main(int argc, char *argv[]) {
 #endif /* defined(HAS_STRFTIME) */
 
                     cp = "=======";
-                puts(cp);
+                if (rl)
+                    (void)printf("%s scan=%luus overruns=%lu\n", cp, rsu, rov);
+                else
+                    puts(cp);
             }
             (void)fflush(stdout);
             (void)childx(ctx);
-            (void)sleep(RptTm);
-            Hdr = Nlproc = 0;
+
+#if defined(HASTIMERFD)
+            /*
+             * Wait for the next period boundary.
+             */
+            if (rtf >= 0) {
+                rpf.fd = rtf;
+                rpf.events = POLLIN;
+                while (read(rtf, (char *)&rx, sizeof(rx)) < 0 &&
+                       (errno == EINTR ||
+                        (errno == EAGAIN &&
+                         (poll(&rpf, 1, -1) >= 0 || errno == EINTR))))
+                    ;
+            } else
+#endif /* defined(HASTIMERFD) */
+
+            {
+                rns.tv_sec = (time_t)(ri / 1000000);
+                rns.tv_nsec = (long)((ri % 1000000) * 1000);
+                (void)nanosleep(&rns, (struct timespec *)NULL);
+            }
+            Hdr = 0;
+            if (ctx->delta) {
+
+                /*
+                 * Keep the processes of the last pass to compare with the
+                 * next one.
+                 */
+                (void)delta_save(ctx);
+            } else {
+                Nlproc = 0;
+
+#if defined(HASARENA)
+                /*
+                 * Discard the files of the last pass, keeping their space.
+                 */
+                (void)arena_reset(ctx);
+                Lf = (struct lfile *)NULL;
+#endif /* defined(HASARENA) */
+            }
+
             CkPasswd = 1;
+
+#if defined(HASMNTCHG)
+            /*
+             * If the mount table has changed, have the next pass read it
+             * again.
+             */
+            if (mcf >= 0) {
+                mpf.fd = mcf;
+                mpf.events = POLLPRI;
+                mpf.revents = 0;
+                if (poll(&mpf, 1, 0) > 0 &&
+                    (mpf.revents & (POLLPRI | POLLERR)))
+                    (void)free_mnt(ctx);
+            }
+#endif /* defined(HASMNTCHG) */
         }
         if (RptMaxCount && (++pr_count == RptMaxCount))
             RptTm = 0;
@@ -1628,27 +2070,26 @@ int main(int argc, char *argv[]) {
          * consider all derivations found.  If no derivation from the same
          * argument was found, report only the first failure.
          *
+         * The derivations of an argument are adjacent in the list, and the
+         * same address given twice is found or not found twice.
          */
         for (; np; np = np->next) {
             if (!(cp = np->arg))
                 continue;
-            for (npn = np->next; npn; npn = npn->next) {
-                if (!npn->arg)
-                    continue;
-                if (!strcmp(cp, npn->arg)) {
-
-                    /*
-                     * If either of the duplicate specifications was found,
-                     * mark them both found.  If neither was found, mark all
-                     * but the first one found.
-                     */
-                    if (np->f)
-                        npn->f = np->f;
-                    else if (npn->f)
-                        np->f = npn->f;
-                    else
-                        npn->f = 1;
-                }
+            for (npn = np->next; npn && npn->arg; npn = npn->next) {
+                if (strcmp(cp, npn->arg))
+                    break;
+                /*
+                 * If either of the duplicate specifications was found, mark
+                 * them both found.  If neither was found, mark all but the
+                 * first one found.
+                 */
+                if (np->f)
+                    npn->f = np->f;
+                else if (npn->f)
+                    np->f = npn->f;
+                else
+                    npn->f = 1;
             }
         }
         for (np = Nwad; np; np = np->next) {
@@ -1807,10 +2248,51 @@ int main(int argc, char *argv[]) {
         rv = ev;
     if (!rv && ErrStat)
         rv = LSOF_EXIT_ERROR;
+
+#if defined(HASSERVE)
+    if (served)
+        (void)serve_done(ctx);
+#endif /* defined(HASSERVE) */
+
     Exit(ctx, rv);
     return (rv); /* to make code analyzers happy */
 }
 
+/*
+ * GetLongOpt() -- get a long option and its value
+ */
+
+static int GetLongOpt(struct lsof_context *ctx, /* context */
+                      int ct,                   /* option count */
+                      char *opt[],              /* options */
+                      int *err)                 /* error return */
+{
+    char *cp, *vp;
+    size_t l;
+    struct lopt *lo;
+
+    cp = &opt[GOx1++][2];
+    l = (vp = strchr(cp, '=')) ? (size_t)(vp - cp) : strlen(cp);
+    for (lo = LongOpt; lo->nm; lo++) {
+        if ((strlen(lo->nm) == l) && !strncmp(lo->nm, cp, l))
+            break;
+    }
+    if (!lo->nm) {
+        (void)fprintf(stderr, "%s: illegal option: --%s\n", Pn, cp);
+        *err = 2;
+        return ('-');
+    }
+    *err = 0;
+    GOp = '-';
+    if (vp)
+        GOv = vp + 1;
+    else if (GOx1 < ct)
+        GOv = opt[GOx1++];
+    else
+        GOv = (char *)NULL;
+    return (lo->rv);
+}
+
 /*
  * GetOpt() -- Local get option
  *
@@ -1850,6 +2332,8 @@ static int GetOpt(struct lsof_context *ctx, /* context */
             GOx1++;
             return (EOF);
         }
+        if (opt[GOx1][0] == '-' && opt[GOx1][1] == '-')
+            return (GetLongOpt(ctx, ct, opt, err));
         GOp = opt[GOx1][0];
         GOx2 = 1;
     }
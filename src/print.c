@@ -37,6 +37,11 @@
  */
 
 #define HCINC 64 /* host cache size increase chunk */
+
+#if defined(HASSERVE)
+#    define SNBUFL 4096 /* send_names() write size -- at most PIPE_BUF */
+#    define SNNAMEL 255 /* longest name send_names() sends */
+#endif                  /* defined(HASSERVE) */
 #define PORTHASHBUCKETS                                                        \
     128 /* port hash bucket count                                              \
          * !!MUST BE A POWER OF 2!! */
@@ -51,7 +56,33 @@ struct hostcache {
     int af;                       /* address family -- e.g., AF_INET
                                    * or AF_INET6 */
     char *name;                   /* name */
+
+#if defined(HASSERVE)
+    int lrn; /* looked up by this process, for send_names() */
+    int tkn; /* taken from a -W query by take_names() */
+#endif       /* defined(HASSERVE) */
+};
+
+struct uidcache {
+    uid_t uid;
+    char nm[LOGINML + 1];
+    struct uidcache *next;
+
+#if defined(HASSERVE)
+    int lrn; /* looked up by this process, for send_names() */
+#endif       /* defined(HASSERVE) */
+};
+
+#if defined(HASSERVE)
+struct sent_name {                /* a send_names() record, followed by the
+                                   * name's characters */
+    int ty;                       /* 'h' = host name, 'u' = user name */
+    int af;                       /* host address family */
+    unsigned char a[MAX_AF_ADDR]; /* host address */
+    uid_t uid;                    /* user ID */
+    int nl;                       /* name length */
 };
+#endif /* defined(HASSERVE) */
 
 struct porttab {
     int port;
@@ -80,12 +111,26 @@ static struct porttab **Pth[4] = {NULL, NULL, NULL, NULL};
 
 #define HASHPORT(p) (((((int)(p)) * 31415) >> 3) & (PORTHASHBUCKETS - 1))
 
+static int Ptf = 0; /* fill_porttab() has been called */
+
+static struct hostcache *hc = (struct hostcache *)NULL; /* host cache */
+static int hcx = 0;                                     /* entries in use */
+static int nhc = 0;                                     /* entries allocated */
+
+static struct uidcache **uc = (struct uidcache **)NULL; /* UID cache */
+static struct stat sbs; /* /etc/passwd stat(2) for the UID cache */
+
 #if !defined(HASNORPC_H)
 static void fill_portmap(struct lsof_context *ctx);
 static void update_portmap(struct lsof_context *ctx, struct porttab *pt,
                            char *pn);
 #endif /* !defined(HASNORPC_H) */
 
+static void alloc_porthash(struct lsof_context *ctx);
+static void clr_uidcache(void);
+static char *hc_add(struct lsof_context *ctx, unsigned char *ia, int af,
+                    char *hn);
+static struct hostcache *hc_find(unsigned char *ia, int af);
 static void fill_porttab(struct lsof_context *ctx);
 static char *lkup_port(struct lsof_context *ctx, int p, int pr, int src);
 static char *lkup_svcnam(struct lsof_context *ctx, int h, int p, int pr,
@@ -335,26 +380,69 @@ static void fill_porttab(struct lsof_context *ctx) {
 }
 
 /*
- * gethostnm() - get host name
+ * hc_add() - add an address/name entry to the host cache
  */
 
-char *gethostnm(struct lsof_context *ctx, /* context */
-                unsigned char *ia,        /* Internet address */
-                int af)                   /* address family -- e.g., AF_INET
-                                           * or AF_INET6 */
+static char *hc_add(struct lsof_context *ctx, /* context */
+                    unsigned char *ia,        /* Internet address */
+                    int af,                   /* address family */
+                    char *hn)                 /* name */
 {
     int al = MIN_AF_ADDR;
-    char hbuf[256];
-    static struct hostcache *hc = (struct hostcache *)NULL;
-    static int hcx = 0;
-    char *hn, *np;
-    struct hostent *he = (struct hostent *)NULL;
-    int i, j;
+    int i;
     MALLOC_S len;
-    static int nhc = 0;
+    char *np;
+
+#if defined(HASIPv6)
+    if (af == AF_INET6)
+        al = MAX_AF_ADDR;
+#endif /* defined(HASIPv6) */
+
     /*
-     * Search cache.
+     * Allocate space for name and copy name to it.
+     */
+    if (!(np = mkstrcpy(hn, (MALLOC_S *)NULL))) {
+        (void)fprintf(stderr, "%s: no space for host name: ", Pn);
+        safestrprt(hn, stderr, 1);
+        Error(ctx);
+    }
+    /*
+     * Add address/name entry to cache.  Allocate cache space in HCINC chunks.
      */
+    if (hcx >= nhc) {
+        nhc += HCINC;
+        len = (MALLOC_S)(nhc * sizeof(struct hostcache));
+        if (!hc)
+            hc = (struct hostcache *)malloc(len);
+        else
+            hc = (struct hostcache *)realloc((MALLOC_P *)hc, len);
+        if (!hc) {
+            (void)fprintf(stderr, "%s: no space for host cache\n", Pn);
+            Error(ctx);
+        }
+    }
+    hc[hcx].af = af;
+    for (i = 0; i < al; i++) {
+        hc[hcx].a[i] = ia[i];
+    }
+
+#if defined(HASSERVE)
+    hc[hcx].lrn = hc[hcx].tkn = 0;
+#endif /* defined(HASSERVE) */
+
+    hc[hcx].name = np;
+    return (hc[hcx++].name);
+}
+
+/*
+ * hc_find() - find an address's entry in the host cache
+ */
+
+static struct hostcache *hc_find(unsigned char *ia, /* Internet address */
+                                 int af)            /* address family */
+{
+    int al = MIN_AF_ADDR;
+    int i, j;
 
 #if defined(HASIPv6)
     if (af == AF_INET6)
@@ -364,13 +452,49 @@ char *gethostnm(struct lsof_context *ctx, /* context */
     for (i = 0; i < hcx; i++) {
         if (af != hc[i].af)
             continue;
+
+#if defined(HASSERVE)
+        /* A -n query doesn't use the names other queries looked up. */
+        if (!Fhost && hc[i].tkn)
+            continue;
+#endif /* defined(HASSERVE) */
+
         for (j = 0; j < al; j++) {
             if (ia[j] != hc[i].a[j])
                 break;
         }
         if (j >= al)
-            return (hc[i].name);
+            return (&hc[i]);
     }
+    return ((struct hostcache *)NULL);
+}
+
+/*
+ * gethostnm() - get host name
+ */
+
+char *gethostnm(struct lsof_context *ctx, /* context */
+                unsigned char *ia,        /* Internet address */
+                int af)                   /* address family -- e.g., AF_INET
+                                           * or AF_INET6 */
+{
+    int al = MIN_AF_ADDR;
+    char hbuf[256];
+    char *hn, *np;
+    struct hostcache *hp;
+    struct hostent *he = (struct hostent *)NULL;
+    MALLOC_S len;
+    /*
+     * Search cache.
+     */
+    if ((hp = hc_find(ia, af)))
+        return (hp->name);
+
+#if defined(HASIPv6)
+    if (af == AF_INET6)
+        al = MAX_AF_ADDR;
+#endif /* defined(HASIPv6) */
+
     /*
      * If -n has been specified, construct a numeric address.  Otherwise, look
      * up host name by address.  If that fails, or if there is no name in the
@@ -406,35 +530,41 @@ char *gethostnm(struct lsof_context *ctx, /* context */
         hn = hbuf;
     } else
         hn = (char *)he->h_name;
-    /*
-     * Allocate space for name and copy name to it.
-     */
-    if (!(np = mkstrcpy(hn, (MALLOC_S *)NULL))) {
-        (void)fprintf(stderr, "%s: no space for host name: ", Pn);
-        safestrprt(hn, stderr, 1);
-        Error(ctx);
-    }
-    /*
-     * Add address/name entry to cache.  Allocate cache space in HCINC chunks.
-     */
-    if (hcx >= nhc) {
-        nhc += HCINC;
-        len = (MALLOC_S)(nhc * sizeof(struct hostcache));
-        if (!hc)
-            hc = (struct hostcache *)malloc(len);
-        else
-            hc = (struct hostcache *)realloc((MALLOC_P *)hc, len);
-        if (!hc) {
-            (void)fprintf(stderr, "%s: no space for host cache\n", Pn);
+    np = hc_add(ctx, ia, af, hn);
+
+#if defined(HASSERVE)
+    /* A -n numeric address isn't a name another query can use. */
+    hc[hcx - 1].lrn = Fhost;
+#endif /* defined(HASSERVE) */
+
+    return (np);
+}
+
+/*
+ * alloc_porthash() - allocate the port hash buckets not yet allocated
+ */
+
+static void alloc_porthash(struct lsof_context *ctx) {
+    int h, nh;
+
+#if defined(HASNORPC_H)
+    nh = 2;
+#else  /* !defined(HASNORPC_H) */
+    nh = FportMap ? 4 : 2;
+#endif /* defined(HASNORPC_H) */
+
+    for (h = 0; h < nh; h++) {
+        if (Pth[h])
+            continue;
+        if (!(Pth[h] = (struct porttab **)calloc(PORTHASHBUCKETS,
+                                                 sizeof(struct porttab *)))) {
+            (void)fprintf(
+                stderr, "%s: can't allocate %d bytes for %s %s hash buckets\n",
+                Pn, (int)(2 * (PORTHASHBUCKETS * sizeof(struct porttab *))),
+                (h & 1) ? "UDP" : "TCP", (h > 1) ? "portmap" : "port");
             Error(ctx);
         }
     }
-    hc[hcx].af = af;
-    for (i = 0; i < al; i++) {
-        hc[hcx].a[i] = ia[i];
-    }
-    hc[hcx++].name = np;
-    return (np);
 }
 
 /*
@@ -447,7 +577,7 @@ static char *lkup_port(struct lsof_context *ctx, /* context */
                        int src) /* port source: 0 = local
                                  *		1 = foreign */
 {
-    int h, nh;
+    int h;
     MALLOC_S nl;
     char *nm, *pn;
     static char pb[128];
@@ -455,26 +585,7 @@ static char *lkup_port(struct lsof_context *ctx, /* context */
     /*
      * If the hash buckets haven't been allocated, do so.
      */
-    if (!Pth[0]) {
-
-#if defined(HASNORPC_H)
-        nh = 2;
-#else  /* !defined(HASNORPC_H) */
-        nh = FportMap ? 4 : 2;
-#endif /* defined(HASNORPC_H) */
-
-        for (h = 0; h < nh; h++) {
-            if (!(Pth[h] = (struct porttab **)calloc(
-                      PORTHASHBUCKETS, sizeof(struct porttab *)))) {
-                (void)fprintf(
-                    stderr,
-                    "%s: can't allocate %d bytes for %s %s hash buckets\n", Pn,
-                    (int)(2 * (PORTHASHBUCKETS * sizeof(struct porttab *))),
-                    (h & 1) ? "UDP" : "TCP", (h > 1) ? "portmap" : "port");
-                Error(ctx);
-            }
-        }
-    }
+    (void)alloc_porthash(ctx);
 
 #if !defined(HASNORPC_H)
     /*
@@ -574,7 +685,6 @@ static char *lkup_svcnam(struct lsof_context *ctx, /* context */
     static int gsbp = 0;
     int i;
     struct porttab *pt;
-    static int ptf = 0;
     struct servent *se;
     /*
      * Do nothing if -P has been specified.
@@ -602,7 +712,7 @@ static char *lkup_svcnam(struct lsof_context *ctx, /* context */
          *
          * After PORTABTHRESH getservbyport() calls, call fill_porttab() once,
          */
-        if (ptf)
+        if (Ptf)
             break;
         if (gsbp < PORTTABTHRESH) {
             for (i = 0; i < fln; i++) {
@@ -617,7 +727,7 @@ static char *lkup_svcnam(struct lsof_context *ctx, /* context */
             return ((char *)NULL);
         }
         (void)fill_porttab(ctx);
-        ptf++;
+        Ptf++;
         ss = 0;
     }
     return ((char *)NULL);
@@ -1305,6 +1415,187 @@ void print_init(struct lsof_context *ctx) {
 #endif /* defined(HASZONES) */
 }
 
+#if defined(HASSERVE)
+/*
+ * print_warm() - load the service name table before the -W server forks
+ *		  the children that answer its queries, so that they inherit
+ *		  it instead of each scanning the services data base
+ */
+
+void print_warm(struct lsof_context *ctx) {
+    if (!Fport || Ptf)
+        return;
+    (void)alloc_porthash(ctx);
+    (void)fill_porttab(ctx);
+    Ptf++;
+}
+
+/*
+ * put_name() - add a name record to a send_names() buffer, writing the
+ *		buffer when it is full
+ *
+ * return: 0 if the record was added
+ *	   1 if the buffer couldn't be written
+ */
+
+static int put_name(int fd,              /* pipe */
+                    char *b,             /* buffer */
+                    size_t *bl,          /* buffer length in use */
+                    struct sent_name *n, /* record */
+                    char *nm)            /* name */
+{
+    size_t l = sizeof(struct sent_name) + (size_t)n->nl;
+
+    if (*bl + l > SNBUFL) {
+        if (write(fd, b, *bl) != (ssize_t)*bl)
+            return (1);
+        *bl = 0;
+    }
+    (void)memcpy((void *)(b + *bl), (void *)n, sizeof(struct sent_name));
+    (void)memcpy((void *)(b + *bl + sizeof(struct sent_name)), (void *)nm,
+                 (size_t)n->nl);
+    *bl += l;
+    return (0);
+}
+
+/*
+ * send_names() - send the host and user names a -W query looked up to the
+ *		  server, so that the children it forks later inherit them
+ *
+ * The pipe doesn't block.  Each write fits in PIPE_BUF, so the server reads
+ * whole records; the names that don't fit in the pipe are dropped.
+ */
+
+void send_names(struct lsof_context *ctx, /* context */
+                int fd)                   /* pipe to the server */
+{
+    char b[SNBUFL];
+    size_t bl = 0;
+    int i;
+    struct sent_name n;
+    struct uidcache *up;
+
+    for (i = 0; i < hcx; i++) {
+        if (!hc[i].lrn || strlen(hc[i].name) > SNNAMEL)
+            continue;
+        zeromem((char *)&n, sizeof(n));
+        n.ty = 'h';
+        n.af = hc[i].af;
+        (void)memcpy((void *)n.a, (void *)hc[i].a, sizeof(n.a));
+        n.nl = (int)strlen(hc[i].name);
+        if (put_name(fd, b, &bl, &n, hc[i].name))
+            return;
+    }
+    for (i = 0; uc && (i < UIDCACHEL); i++) {
+        for (up = uc[i]; up; up = up->next) {
+            if (!up->lrn)
+                continue;
+            zeromem((char *)&n, sizeof(n));
+            n.ty = 'u';
+            n.uid = up->uid;
+            n.nl = (int)strlen(up->nm);
+            if (put_name(fd, b, &bl, &n, up->nm))
+                return;
+        }
+    }
+    if (bl)
+        (void)write(fd, b, bl);
+}
+
+/*
+ * take_names() - enter the names a -W query's child sent in the host and
+ *		  UID caches
+ */
+
+void take_names(struct lsof_context *ctx, /* context */
+                int fd)                   /* pipe from the child */
+{
+    static char *b = (char *)NULL;
+    static size_t bsz = 0;
+    size_t bl = 0, i;
+    int h, pc = 0;
+    char nm[SNNAMEL + 1];
+    struct sent_name n;
+    ssize_t nr;
+    struct stat sb;
+    struct uidcache *up;
+    /*
+     * Read what the child wrote.  It has exited, so that is all there is.
+     */
+    for (;;) {
+        if (bl + SNBUFL > bsz) {
+            bsz += 4 * SNBUFL;
+            if (!(b = (char *)realloc((MALLOC_P *)b, (MALLOC_S)bsz))) {
+                (void)fprintf(stderr, "%s: no space for -W query names\n", Pn);
+                Error(ctx);
+            }
+        }
+        if ((nr = read(fd, b + bl, bsz - bl)) < 0 && errno == EINTR)
+            continue;
+        if (nr <= 0)
+            break;
+        bl += (size_t)nr;
+    }
+    /*
+     * Enter the names not already cached.
+     */
+    for (i = 0; i + sizeof(n) <= bl; i += sizeof(n) + (size_t)n.nl) {
+        (void)memcpy((void *)&n, (void *)(b + i), sizeof(n));
+        if (n.nl < 0 || n.nl > SNNAMEL || i + sizeof(n) + (size_t)n.nl > bl)
+            break;
+        (void)memcpy((void *)nm, (void *)(b + i + sizeof(n)), (size_t)n.nl);
+        nm[n.nl] = '\0';
+        if (n.ty == 'h') {
+            if (!hc_find(n.a, n.af)) {
+                (void)hc_add(ctx, n.a, n.af, nm);
+                hc[hcx - 1].tkn = 1;
+            }
+            continue;
+        }
+        if (n.ty != 'u')
+            continue;
+        if (!pc) {
+
+            /*
+             * Before the first user name, drop the UID cache if /etc/passwd
+             * has changed since it was filled.
+             */
+            if (stat("/etc/passwd", &sb))
+                break;
+            if (!uc && !(uc = (struct uidcache **)calloc(
+                             UIDCACHEL, sizeof(struct uidcache *)))) {
+                (void)fprintf(
+                    stderr, "%s: no space for %d byte UID cache hash buckets\n",
+                    Pn, (int)(UIDCACHEL * (sizeof(struct uidcache *))));
+                Error(ctx);
+            } else if (sbs.st_mtime != sb.st_mtime ||
+                       sbs.st_ctime != sb.st_ctime)
+                (void)clr_uidcache();
+            sbs = sb;
+            pc = 1;
+        }
+        h = (int)((((unsigned long)n.uid * 31415L) >> 7) & (UIDCACHEL - 1));
+        for (up = uc[h]; up; up = up->next) {
+            if (up->uid == n.uid)
+                break;
+        }
+        if (up)
+            continue;
+        if (!(up = (struct uidcache *)malloc(sizeof(struct uidcache)))) {
+            (void)fprintf(stderr, "%s: no space for UID cache entry for: %lu\n",
+                          Pn, (unsigned long)n.uid);
+            Error(ctx);
+        }
+        up->uid = n.uid;
+        (void)strncpy(up->nm, nm, LOGINML);
+        up->nm[LOGINML] = '\0';
+        up->lrn = 0;
+        up->next = uc[h];
+        uc[h] = up;
+    }
+}
+#endif /* defined(HASSERVE) */
+
 /*
  * printname() - print output name field
  */
@@ -1500,6 +1791,15 @@ print_nma:
         safestrprt(Lf->nma, stdout, 0);
         ps++;
     }
+    /*
+     * Mark a file that was closed since the previous -r...d pass.
+     */
+    if (Lf->chg == DELTA_REMOVED) {
+        if (ps)
+            putchar(' ');
+        (void)fputs("(closed)", stdout);
+        ps++;
+    }
     /*
      * If this file has TCP/IP state information, print it.
      */
@@ -1594,6 +1894,27 @@ char *printsockty(int ty) /* socket type -- e.g., from so_type */
     return (buf);
 }
 
+/*
+ * clr_uidcache() - clear the UID cache
+ */
+
+static void clr_uidcache(void) {
+    int i;
+    struct uidcache *up, *upn;
+
+    if (!uc)
+        return;
+    for (i = 0; i < UIDCACHEL; i++) {
+        if ((up = uc[i])) {
+            do {
+                upn = up->next;
+                (void)free((FREE_P *)up);
+            } while ((up = upn) != (struct uidcache *)NULL);
+            uc[i] = (struct uidcache *)NULL;
+        }
+    }
+}
+
 /*
  * printuid() - print User ID or login name
  */
@@ -1608,12 +1929,6 @@ char *printuid(struct lsof_context *ctx, /* context */
     int i;
     struct passwd *pw;
     struct stat sb;
-    static struct stat sbs;
-    static struct uidcache {
-        uid_t uid;
-        char nm[LOGINML + 1];
-        struct uidcache *next;
-    } **uc = (struct uidcache **)NULL;
     struct uidcache *up, *upn;
     static char user[USERPRTL + 1];
 
@@ -1651,15 +1966,7 @@ char *printuid(struct lsof_context *ctx, /* context */
          */
         if (CkPasswd) {
             if (sbs.st_mtime != sb.st_mtime || sbs.st_ctime != sb.st_ctime) {
-                for (i = 0; i < UIDCACHEL; i++) {
-                    if ((up = uc[i])) {
-                        do {
-                            upn = up->next;
-                            (void)free((FREE_P *)up);
-                        } while ((up = upn) != (struct uidcache *)NULL);
-                        uc[i] = (struct uidcache *)NULL;
-                    }
-                }
+                (void)clr_uidcache();
                 sbs = sb;
             }
             CkPasswd = 0;
@@ -1699,6 +2006,11 @@ char *printuid(struct lsof_context *ctx, /* context */
             (void)strncpy(upn->nm, pw->pw_name, LOGINML);
             upn->nm[LOGINML] = '\0';
             upn->uid = (uid_t)uid;
+
+#if defined(HASSERVE)
+            upn->lrn = 1;
+#endif /* defined(HASSERVE) */
+
             upn->next = uc[i];
             uc[i] = upn;
             if (ty)
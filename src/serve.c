@@ -0,0 +1,390 @@
+/*
+ * serve.c - lsof query server (-W)
+ */
+
+/*
+ * Copyright 1994 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include "common.h"
+#include "cli.h"
+
+#if defined(HASSERVE)
+#    include <poll.h>
+#    include <sys/un.h>
+#    include <sys/wait.h>
+
+/*
+ * serve() keeps the tables whose filling is the bulk of lsof's startup cost
+ * and forks a child for each connection to its UNIX domain socket.  The
+ * child reads one line of lsof options from the connection and returns to
+ * main() with them as its command line, so the listing is made with the
+ * tables it inherited and is written to the connection.
+ *
+ * The mount and service name tables are read once; the mount table again
+ * when it changes.  The lock and socket tables are brought up to date by
+ * warm_tables() just before each fork, so the child doesn't read them for
+ * its first listing.  The host and user names a child looks up are sent
+ * back to the server through a pipe when it is done, for the children that
+ * follow.  Only the processes and their files are read afresh by each child.
+ *
+ * While SERVE_MAXCHILD children are answering, connections wait in the listen
+ * queue; the server goes on watching the mount table and reaping children.
+ */
+
+/*
+ * Local definitions
+ */
+
+#    define SERVE_MAXCHILD 16   /* queries answered at once */
+#    define SERVE_QUERYL 4096   /* query line length limit */
+#    define SERVE_QUERYTM 10000 /* query line read timeout (milliseconds) */
+#    define SERVE_REAPTM 1000   /* child reaping interval (milliseconds) */
+#    define SERVE_FULLTM 50     /* ... while SERVE_MAXCHILD are answering */
+
+/*
+ * Local static values
+ */
+
+static int Nmfd = -1; /* child's pipe to the server for send_names() */
+
+/*
+ * Local function prototypes
+ */
+
+static void serve_query(struct lsof_context *ctx, int cs, int dc, char **dv,
+                        int *argc, char ***argv);
+
+/*
+ * serve() - answer queries on the -W socket
+ *
+ * serve() returns only in the child forked to answer a query, with the
+ * query's options in *argc and *argv.
+ */
+
+void serve(struct lsof_context *ctx, /* context */
+           int *argc,                /* argument count pointer */
+           char ***argv)             /* argument vector pointer */
+{
+    char **av = *argv;
+    int cs, i, ls, lx, mx, nf;
+    int dc = 0;
+    int mf = -1;
+    int nc = 0;
+    int nfd[2];
+    struct {
+        pid_t pid; /* child answering a query */
+        int fd;    /* pipe from it */
+    } ch[SERVE_MAXCHILD];
+    char **dv = (char **)NULL;
+    char *path = (char *)NULL;
+    struct pollfd pf[2];
+    pid_t pid;
+    struct sockaddr_un sa;
+    struct stat sb;
+    mode_t um;
+    /*
+     * Get the socket path, which follows -W, and the options to apply to
+     * every query, which follow the path.
+     */
+    if (av[1][2]) {
+        path = &av[1][2];
+        dv = &av[2];
+        dc = *argc - 2;
+    } else if (*argc > 2) {
+        path = av[2];
+        dv = &av[3];
+        dc = *argc - 3;
+    } else {
+        (void)fprintf(stderr, "%s: -W needs a socket path\n", Pn);
+        usage(ctx, 1, 0, 0);
+    }
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        (void)fprintf(stderr, "%s: -W socket path too long: %s\n", Pn, path);
+        Error(ctx);
+    }
+    /*
+     * Replace a socket left by an earlier server, but nothing else.
+     *
+     * Bind the socket with a umask that leaves it accessible only to its
+     * owner, since the listings are made with the server's privileges.
+     */
+    if (!lstat(path, &sb)) {
+        if (!S_ISSOCK(sb.st_mode)) {
+            (void)fprintf(stderr, "%s: -W %s exists and isn't a socket\n", Pn,
+                          path);
+            Error(ctx);
+        }
+        (void)unlink(path);
+    }
+    if ((ls = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        (void)fprintf(stderr, "%s: can't create -W socket: %s\n", Pn,
+                      strerror(errno));
+        Error(ctx);
+    }
+    zeromem((char *)&sa, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    (void)strcpy(sa.sun_path, path);
+    um = umask(077);
+    if (bind(ls, (struct sockaddr *)&sa, sizeof(sa)) ||
+        listen(ls, SOMAXCONN)) {
+        (void)fprintf(stderr, "%s: can't listen on %s: %s\n", Pn, path,
+                      strerror(errno));
+        Error(ctx);
+    }
+    (void)umask(um);
+    for (i = 0; i < SERVE_MAXCHILD; i++) {
+        ch[i].pid = 0;
+        ch[i].fd = -1;
+    }
+    /*
+     * Fill the tables the children will inherit.
+     */
+    (void)readmnt(ctx);
+    (void)print_warm(ctx);
+
+#    if defined(HASMNTCHG)
+    mf = open(HASMNTCHG, O_RDONLY | O_CLOEXEC);
+#    endif /* defined(HASMNTCHG) */
+
+    for (;;) {
+
+        /*
+         * Reap the children that have finished and take the names they
+         * looked up.
+         */
+        while (nc) {
+            if ((pid = waitpid(-1, (int *)NULL, WNOHANG)) > 0) {
+                for (i = 0; i < SERVE_MAXCHILD; i++) {
+                    if (ch[i].pid != pid)
+                        continue;
+                    if (ch[i].fd >= 0) {
+                        (void)take_names(ctx, ch[i].fd);
+                        (void)close(ch[i].fd);
+                    }
+                    ch[i].pid = 0;
+                    ch[i].fd = -1;
+                    break;
+                }
+                nc--;
+            } else if (pid < 0 && errno == EINTR)
+                continue;
+            else {
+                if (pid < 0) {
+                    for (i = 0; i < SERVE_MAXCHILD; i++) {
+                        if (ch[i].fd >= 0)
+                            (void)close(ch[i].fd);
+                        ch[i].pid = 0;
+                        ch[i].fd = -1;
+                    }
+                    nc = 0;
+                }
+                break;
+            }
+        }
+        /*
+         * Wait for a connection or a mount table change.  While
+         * SERVE_MAXCHILD children are answering, leave the connections in
+         * the listen queue and look for a finished child more often.
+         */
+        nf = 0;
+        lx = mx = -1;
+        if (nc < SERVE_MAXCHILD) {
+            pf[nf].fd = ls;
+            pf[nf].events = POLLIN;
+            lx = nf++;
+        }
+        if (mf >= 0) {
+            pf[nf].fd = mf;
+            pf[nf].events = POLLPRI;
+            mx = nf++;
+        }
+        if (poll(pf, nf,
+                 (nc < SERVE_MAXCHILD) ? (nc ? SERVE_REAPTM : -1)
+                                       : SERVE_FULLTM) < 0) {
+            if (errno == EINTR)
+                continue;
+            (void)fprintf(stderr, "%s: -W poll error: %s\n", Pn,
+                          strerror(errno));
+            Error(ctx);
+        }
+        if (mx >= 0 && (pf[mx].revents & (POLLPRI | POLLERR))) {
+            (void)free_mnt(ctx);
+            (void)readmnt(ctx);
+        }
+        if (lx < 0 || !(pf[lx].revents & POLLIN))
+            continue;
+        if ((cs = accept(ls, (struct sockaddr *)NULL, (socklen_t *)NULL)) < 0)
+            continue;
+        /*
+         * Bring the lock and socket tables up to date for the child, and
+         * give it a pipe for the names it looks up.  Neither end of the pipe
+         * blocks.
+         */
+        (void)warm_tables(ctx);
+        if (pipe2(nfd, O_CLOEXEC | O_NONBLOCK))
+            nfd[0] = nfd[1] = -1;
+        if ((pid = fork()) < 0) {
+            if (!Fwarn)
+                (void)fprintf(stderr, "%s: WARNING: can't fork for query: %s\n",
+                              Pn, strerror(errno));
+            (void)close(cs);
+            if (nfd[0] >= 0) {
+                (void)close(nfd[0]);
+                (void)close(nfd[1]);
+            }
+            continue;
+        }
+        if (!pid) {
+            (void)close(ls);
+            if (mf >= 0)
+                (void)close(mf);
+            for (i = 0; i < SERVE_MAXCHILD; i++) {
+                if (ch[i].fd >= 0)
+                    (void)close(ch[i].fd);
+            }
+            if (nfd[0] >= 0)
+                (void)close(nfd[0]);
+            Nmfd = nfd[1];
+            (void)serve_query(ctx, cs, dc, dv, argc, argv);
+            return;
+        }
+        for (i = 0; i < SERVE_MAXCHILD; i++) {
+            if (!ch[i].pid)
+                break;
+        }
+        if (i < SERVE_MAXCHILD) {
+            ch[i].pid = pid;
+            ch[i].fd = nfd[0];
+        } else if (nfd[0] >= 0)
+            (void)close(nfd[0]);
+        if (nfd[1] >= 0)
+            (void)close(nfd[1]);
+        nc++;
+        (void)close(cs);
+    }
+}
+
+/*
+ * serve_done() - send the names a -W query looked up to the server
+ */
+
+void serve_done(struct lsof_context *ctx) /* context */
+{
+    if (Nmfd < 0)
+        return;
+    (void)send_names(ctx, Nmfd);
+    (void)close(Nmfd);
+    Nmfd = -1;
+}
+
+/*
+ * serve_query() - read a query in the child answering it
+ */
+
+static void serve_query(struct lsof_context *ctx, /* context */
+                        int cs,       /* connection socket */
+                        int dc,       /* count of options for every query */
+                        char **dv,    /* options for every query */
+                        int *argc,    /* returned argument count */
+                        char ***argv) /* returned argument vector */
+{
+    static char buf[SERVE_QUERYL + 1];
+    char *cp, **nv;
+    size_t bl = 0;
+    int i, n;
+    struct pollfd pf;
+
+    Mypid = getpid();
+    /*
+     * Make the connection the standard output and error, so the listing and
+     * any complaints about the query go to the client.
+     */
+    if (dup2(cs, 1) < 0 || dup2(cs, 2) < 0)
+        _exit(1);
+    /*
+     * Read the query line.
+     */
+    pf.fd = cs;
+    pf.events = POLLIN;
+    while (bl < SERVE_QUERYL) {
+        if (poll(&pf, 1, SERVE_QUERYTM) <= 0)
+            _exit(1);
+        if ((n = (int)read(cs, buf + bl, SERVE_QUERYL - bl)) < 0) {
+            if (errno == EINTR)
+                continue;
+            _exit(1);
+        }
+        if (!n || memchr(buf + bl, '\n', (size_t)n)) {
+            bl += (size_t)n;
+            break;
+        }
+        bl += (size_t)n;
+    }
+    if (cs > 2)
+        (void)close(cs);
+    buf[bl] = '\0';
+    if (!(cp = strchr(buf, '\n'))) {
+        if (bl >= SERVE_QUERYL) {
+            (void)fprintf(stderr, "%s: query longer than %d bytes\n", Pn,
+                          SERVE_QUERYL);
+            Error(ctx);
+        }
+    } else
+        *cp = '\0';
+    /*
+     * Build the argument vector: the program name, the options for every
+     * query, then the query's blank-separated words.
+     */
+    for (cp = buf, n = 0; *cp;) {
+        while (*cp == ' ' || *cp == '\t' || *cp == '\r')
+            cp++;
+        if (!*cp)
+            break;
+        n++;
+        while (*cp && *cp != ' ' && *cp != '\t' && *cp != '\r')
+            cp++;
+    }
+    if (!(nv = (char **)malloc(
+              (MALLOC_S)((1 + dc + n + 1) * sizeof(char *))))) {
+        (void)fprintf(stderr, "%s: no space for query arguments\n", Pn);
+        Error(ctx);
+    }
+    nv[0] = (*argv)[0];
+    for (i = 0; i < dc; i++) {
+        nv[1 + i] = dv[i];
+    }
+    for (cp = buf, n = 1 + dc; *cp;) {
+        while (*cp == ' ' || *cp == '\t' || *cp == '\r')
+            *cp++ = '\0';
+        if (!*cp)
+            break;
+        nv[n++] = cp;
+        while (*cp && *cp != ' ' && *cp != '\t' && *cp != '\r')
+            cp++;
+    }
+    nv[n] = (char *)NULL;
+    *argc = n;
+    *argv = nv;
+}
+#endif /* defined(HASSERVE) */
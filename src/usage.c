@@ -399,6 +399,10 @@ void usage(struct lsof_context *ctx, /* context */
 
         );
 
+#if defined(HASPARSCAN)
+        (void)fprintf(stderr, " [-j [n]]");
+#endif /* defined(HASPARSCAN) */
+
 #if defined(HASKOPT)
         (void)fprintf(stderr, " [-k k]");
 #endif /* defined(HASKOPT) */
@@ -433,7 +437,17 @@ void usage(struct lsof_context *ctx, /* context */
 #endif /* defined(HASTCPUDPSTATE) */
 
         );
-        (void)fprintf(stderr, " [-u s] [+|-w] [-x [fl]]");
+        (void)fprintf(stderr, " [-u s] [+|-w]");
+
+#if defined(HASSERVE)
+        (void)fprintf(stderr, " [-W s]");
+#endif /* defined(HASSERVE) */
+
+        (void)fprintf(stderr, " [-x [fl]]");
+
+#if defined(HASMATCHLIMIT)
+        (void)fprintf(stderr, "\n [--max-matches n]");
+#endif /* defined(HASMATCHLIMIT) */
 
 #if defined(HASZONES)
         (void)fprintf(stderr, " [-z [z]]");
@@ -504,6 +518,10 @@ void usage(struct lsof_context *ctx, /* context */
         );
         col = print_in_col(col, buf);
 
+#if defined(HASPARSCAN)
+        col = print_in_col(col, "-j [n] n scan threads");
+#endif /* defined(HASPARSCAN) */
+
 #if defined(HASTASKS)
         /* DEBUG	    col = print_in_col(col, "-K list tasKs (threads)");
          */
@@ -751,7 +769,8 @@ void usage(struct lsof_context *ctx, /* context */
 #endif /* defined(HASIPv6) */
 
         );
-        (void)fprintf(stderr, " [%s][proto][@host|addr][:svc_list|port_list]\n",
+        (void)fprintf(stderr,
+                      " [%s][proto][@host|addr[/len]][:svc_list|port_list]\n",
 
 #if defined(HASIPv6)
                       "46"
@@ -760,6 +779,7 @@ void usage(struct lsof_context *ctx, /* context */
 #endif /* defined(HASIPv6) */
 
         );
+        (void)fprintf(stderr, "         or @/path|@./path: a file of them\n");
 
         (void)fprintf(stderr, "  +|-r [%s] repeat every t seconds (%d); %s",
 
@@ -770,6 +790,12 @@ void usage(struct lsof_context *ctx, /* context */
 #endif /* defined(HAS_STRFTIME) */
 
                       RPTTM, " + until no files, - forever.\n");
+        (void)fprintf(stderr,
+                      "       A :d suffix to t lists only opened, changed %s",
+                      "and closed files.\n");
+        (void)fprintf(stderr,
+                      "       t may have a fraction (0.25); a :l suffix %s",
+                      "adds scan time to the marker.\n");
 
 #if defined(HAS_STRFTIME)
         (void)fprintf(
@@ -788,9 +814,21 @@ void usage(struct lsof_context *ctx, /* context */
 #endif /* defined(HASTCPUDPSTATE) */
 
         (void)fprintf(stderr, "  -u s   exclude(^)|select login|UID set s\n");
+
+#if defined(HASSERVE)
+        (void)fprintf(stderr,
+                      "  -W s   (first) serve queries on UNIX socket s %s",
+                      "with the options after s\n");
+#endif /* defined(HASSERVE) */
+
         (void)fprintf(
             stderr,
             "  -x [fl] cross over +d|+D File systems or symbolic Links\n");
+
+#if defined(HASMATCHLIMIT)
+        (void)fprintf(stderr,
+                      "  --max-matches n  stop after n selected files\n");
+#endif /* defined(HASMATCHLIMIT) */
         (void)fprintf(
             stderr,
             "  names  select named files or files on named file systems\n");
@@ -45,6 +45,8 @@ int main(int argc, char **argv) {
     struct lsof_file *f;
     int pi, fi;
     char buffer[128];
+    size_t nfiles = 0;  /* files preceding the process */
+    int packed = 1;     /* files are packed in process order */
     int exec_found = 0; /* executable found in result */
     int cwd_found = 0;  /* cwd found in result */
     struct stat exec_stat;
@@ -65,6 +67,9 @@ int main(int argc, char **argv) {
 
     for (pi = 0; pi < result->num_processes; pi++) {
         p = &result->processes[pi];
+        if (p->files != result->processes[0].files + nfiles)
+            packed = 0;
+        nfiles += p->num_files;
         for (fi = 0; fi < p->num_files; fi++) {
             f = &p->files[fi];
             if (f->fd_type == LSOF_FD_PROGRAM_TEXT) {
@@ -95,5 +100,8 @@ int main(int argc, char **argv) {
     if (!cwd_found) {
         fprintf(stderr, "ERROR!!!  current working directory wasn't found.\n");
     }
-    return !(exec_found && cwd_found);
+    if (!packed) {
+        fprintf(stderr, "ERROR!!!  files aren't packed in process order.\n");
+    }
+    return !(exec_found && cwd_found && packed);
 }
\ No newline at end of file
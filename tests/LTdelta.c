@@ -0,0 +1,122 @@
+/*
+ * LTdelta.c -- Lsof Test delta gather
+ *
+ * Check that lsof_gather_delta() first reports the open files of its own
+ * process as added, then a file descriptor opened between two calls as
+ * added, and then the same file descriptor, once closed, as removed.
+ */
+
+/*
+ * Copyright 2002 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include "lsof.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_FD 100 /* FD number of the test file */
+
+/* Count the files of the own process with an FD number (-1 == any FD) */
+static int count_fd(struct lsof_result *res, int fd) {
+    struct lsof_process *p;
+    int fi, n = 0, pi;
+
+    for (pi = 0; pi < res->num_processes; pi++) {
+        p = &res->processes[pi];
+        if (p->pid != (uint32_t)getpid())
+            continue;
+        for (fi = 0; fi < p->num_files; fi++) {
+            if (fd < 0 || (p->files[fi].fd_type == LSOF_FD_NUMERIC &&
+                           p->files[fi].fd_num == (uint32_t)fd))
+                n++;
+        }
+    }
+    return (n);
+}
+
+static int gather(struct lsof_context *ctx, struct lsof_result **added,
+                  struct lsof_result **removed, struct lsof_result **changed) {
+    if (lsof_gather_delta(ctx, added, removed, changed) != LSOF_SUCCESS) {
+        fprintf(stderr, "ERROR!!!  lsof_gather_delta() failed.\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void free_results(struct lsof_result *added, struct lsof_result *removed,
+                         struct lsof_result *changed) {
+    lsof_free_result(added);
+    lsof_free_result(removed);
+    lsof_free_result(changed);
+}
+
+int main(int argc, char **argv) {
+    struct lsof_context *ctx;
+    struct lsof_result *added, *removed, *changed;
+    int fd;
+
+    ctx = lsof_new();
+    (void)lsof_select_process(ctx, "LTdelta", 0);
+    (void)lsof_select_process(ctx, "lt-LTdelta", 0);
+
+    /* The first call reports all files as added */
+    if (gather(ctx, &added, &removed, &changed))
+        return 1;
+    if (!count_fd(added, -1) || count_fd(removed, -1) ||
+        count_fd(changed, -1)) {
+        fprintf(stderr, "ERROR!!!  the first call didn't add all files.\n");
+        return 1;
+    }
+    free_results(added, removed, changed);
+
+    /*
+     * Open a file at an FD number above those liblsof uses for the /proc
+     * directories of its own process while it scans it.
+     */
+    if ((fd = open(argv[0], O_RDONLY)) < 0 ||
+        (fd = fcntl(fd, F_DUPFD, TEST_FD)) < 0) {
+        fprintf(stderr, "ERROR!!!  can't open %s\n", argv[0]);
+        return 1;
+    }
+    if (gather(ctx, &added, &removed, &changed))
+        return 1;
+    if (count_fd(added, fd) != 1 || count_fd(removed, fd)) {
+        fprintf(stderr, "ERROR!!!  FD %d wasn't added.\n", fd);
+        return 1;
+    }
+    free_results(added, removed, changed);
+
+    /* Close it */
+    (void)close(fd);
+    if (gather(ctx, &added, &removed, &changed))
+        return 1;
+    if (count_fd(removed, fd) != 1 || count_fd(added, fd)) {
+        fprintf(stderr, "ERROR!!!  FD %d wasn't removed.\n", fd);
+        return 1;
+    }
+    free_results(added, removed, changed);
+
+    lsof_destroy(ctx);
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * LTfields.c -- Lsof Test field projection
+ *
+ * Check that lsof_set_fields() leaves the inode numbers and the memory-mapped
+ * files out of the files of its own process when they aren't asked for, but
+ * still reports a file descriptor, and that asking for them brings them back.
+ */
+
+/*
+ * Copyright 2002 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include "lsof.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_FD 100 /* FD number of the test file */
+
+struct counts {
+    int fd;    /* files at TEST_FD */
+    int inode; /* ... of them with a valid inode number */
+    int mem;   /* memory-mapped files */
+};
+
+/* Gather the own process with the fields given and count its files */
+static int gather(uint32_t fields, struct counts *c) {
+    struct lsof_context *ctx;
+    struct lsof_file *f;
+    struct lsof_process *p;
+    struct lsof_result *res;
+    int fi, pi;
+
+    c->fd = c->inode = c->mem = 0;
+    ctx = lsof_new();
+    (void)lsof_select_process(ctx, "LTfields", 0);
+    (void)lsof_select_process(ctx, "lt-LTfields", 0);
+    if (lsof_set_fields(ctx, fields) != LSOF_SUCCESS ||
+        lsof_gather(ctx, &res) != LSOF_SUCCESS) {
+        fprintf(stderr, "ERROR!!!  lsof_gather() failed.\n");
+        return 1;
+    }
+    if (lsof_set_fields(ctx, fields) != LSOF_ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr, "ERROR!!!  lsof_set_fields() after lsof_freeze().\n");
+        return 1;
+    }
+    lsof_destroy(ctx);
+    for (pi = 0; pi < res->num_processes; pi++) {
+        p = &res->processes[pi];
+        if (p->pid != (uint32_t)getpid())
+            continue;
+        for (fi = 0; fi < p->num_files; fi++) {
+            f = &p->files[fi];
+            if (f->fd_type == LSOF_FD_MEMORY)
+                c->mem++;
+            if (f->fd_type == LSOF_FD_NUMERIC && f->fd_num == TEST_FD) {
+                c->fd++;
+                if (f->flags & LSOF_FILE_FLAG_INODE_VALID)
+                    c->inode++;
+            }
+        }
+    }
+    lsof_free_result(res);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct counts c;
+    int fd;
+
+    if (lsof_set_fields(NULL, LSOF_FIELD_ALL) != LSOF_ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr, "ERROR!!!  lsof_set_fields() accepted no context.\n");
+        return 1;
+    }
+    if ((fd = open(argv[0], O_RDONLY)) < 0 ||
+        (fd = fcntl(fd, F_DUPFD, TEST_FD)) != TEST_FD) {
+        fprintf(stderr, "ERROR!!!  can't open %s at FD %d\n", argv[0],
+                TEST_FD);
+        return 1;
+    }
+
+    /* Ask for nothing: the file is still reported, without its inode */
+    if (gather(0, &c))
+        return 1;
+    if (c.fd != 1 || c.inode || c.mem) {
+        fprintf(stderr, "ERROR!!!  no fields: fd %d, inode %d, mem %d.\n",
+                c.fd, c.inode, c.mem);
+        return 1;
+    }
+
+    /* Ask for the node and the memory maps */
+    if (gather(LSOF_FIELD_NODE | LSOF_FIELD_MAPS, &c))
+        return 1;
+    if (c.fd != 1 || c.inode != 1 || !c.mem) {
+        fprintf(stderr, "ERROR!!!  node and maps: fd %d, inode %d, mem %d.\n",
+                c.fd, c.inode, c.mem);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * LThash.c -- Lsof Test inode hash index
+ *
+ * Check the lib/hash.h open addressing inode index and measure its lookup
+ * cost as the table grows, against the fixed 128 bucket chains it replaced.
+ *
+ * Usage: LThash [max]
+ *
+ *	max	the largest element count to measure (default 262144)
+ */
+
+/*
+ * Copyright 2002 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INODETYPE unsigned long long
+#include "hash.h"
+
+#define INOBUCKS 128 /* the former dsock.c bucket count */
+#define INOHASH(ino) ((int)((ino * 31415) >> 3) & (INOBUCKS - 1))
+#define CHAINMAX 65536 /* largest chained table measured */
+#define LOOKUPS 1000000
+
+struct elem {
+    INODETYPE inode;
+    struct elem *next;
+};
+
+static double now(void) {
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9 + (double)ts.tv_nsec);
+}
+
+int main(int argc, char **argv) {
+    struct elem **chain = (struct elem **)NULL;
+    struct elem *e, *ev;
+    inohash_t h = {0};
+    size_t i, j, max = 262144, n;
+    INODETYPE base = 100000;
+    double t0, tc, th;
+    volatile size_t found = 0;
+
+    if (argc > 1 && (max = (size_t)strtoul(argv[1], (char **)NULL, 0)) < 16) {
+        (void)fprintf(stderr, "usage: %s [max >= 16]\n", argv[0]);
+        return (2);
+    }
+    if (!(ev = (struct elem *)calloc(max, sizeof(struct elem))) ||
+        !(chain = (struct elem **)calloc(INOBUCKS, sizeof(struct elem *)))) {
+        (void)fprintf(stderr, "%s: no space\n", argv[0]);
+        return (1);
+    }
+    (void)printf("%10s %10s %12s %12s\n", "elements", "slots", "inohash ns",
+                 "chained ns");
+    for (n = 16; n <= max; n *= 4) {
+
+        /*
+         * Socket inode numbers are dense; use a run of them.  Fill the index
+         * from empty so it is grown, not pre-sized.
+         */
+        if (inohash_reset(&h, 0)) {
+            (void)fprintf(stderr, "%s: no space\n", argv[0]);
+            return (1);
+        }
+        for (i = 0; i < INOBUCKS; i++)
+            chain[i] = (struct elem *)NULL;
+        for (i = 0; i < n; i++) {
+            e = &ev[i];
+            e->inode = base + i;
+            if (inohash_insert(&h, e->inode, (void *)e)) {
+                (void)fprintf(stderr, "%s: no space\n", argv[0]);
+                return (1);
+            }
+            if (n <= CHAINMAX) {
+                e->next = chain[INOHASH(e->inode)];
+                chain[INOHASH(e->inode)] = e;
+            }
+        }
+        /*
+         * Check that every element and no absent inode is found.
+         */
+        if (h.count != n) {
+            (void)fprintf(stderr, "%s: count %lu != %lu\n", argv[0],
+                          (unsigned long)h.count, (unsigned long)n);
+            return (1);
+        }
+        for (i = 0; i < n; i++) {
+            if (inohash_find(&h, base + i) != (void *)&ev[i] ||
+                inohash_find(&h, base + n + i)) {
+                (void)fprintf(stderr, "%s: lookup of %llu failed\n", argv[0],
+                              base + i);
+                return (1);
+            }
+        }
+        /*
+         * Time hits, spread over the elements.
+         */
+        t0 = now();
+        for (i = j = 0; i < LOOKUPS; i++, j = (j + 7919) % n)
+            found += (inohash_find(&h, base + j) != NULL);
+        th = (now() - t0) / LOOKUPS;
+        tc = 0.0;
+        if (n <= CHAINMAX) {
+            t0 = now();
+            for (i = j = 0; i < LOOKUPS; i++, j = (j + 7919) % n) {
+                for (e = chain[INOHASH(base + j)]; e; e = e->next) {
+                    if (e->inode == base + j)
+                        break;
+                }
+                found += (e != NULL);
+            }
+            tc = (now() - t0) / LOOKUPS;
+        }
+        if (n <= CHAINMAX)
+            (void)printf("%10lu %10lu %12.1f %12.1f\n", (unsigned long)n,
+                         (unsigned long)(h.mask + 1), th, tc);
+        else
+            (void)printf("%10lu %10lu %12.1f %12s\n", (unsigned long)n,
+                         (unsigned long)(h.mask + 1), th, "-");
+    }
+    return (0);
+}
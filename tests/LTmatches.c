@@ -0,0 +1,108 @@
+/*
+ * LTmatches.c -- Lsof Test selected file limit
+ *
+ * Check that lsof_set_max_matches() stops lsof_gather() after the number of
+ * selected files asked for, both when all files are selected and when only
+ * those of its own process are.
+ */
+
+/*
+ * Copyright 2002 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include "lsof.h"
+#include <stdio.h>
+#include <unistd.h>
+
+/* Gather with the limit given and count the files and own files */
+static int gather(int own, size_t max, size_t *files, size_t *mine) {
+    struct lsof_context *ctx;
+    struct lsof_result *res;
+    enum lsof_error ret;
+    size_t pi;
+
+    *files = *mine = 0;
+    ctx = lsof_new();
+    if (own) {
+        (void)lsof_select_process(ctx, "LTmatches", 0);
+        (void)lsof_select_process(ctx, "lt-LTmatches", 0);
+    }
+    if ((ret = lsof_set_max_matches(ctx, max)) == LSOF_ERROR_UNSUPPORTED) {
+        lsof_destroy(ctx);
+        return -1;
+    }
+    if (ret != LSOF_SUCCESS || lsof_gather(ctx, &res) != LSOF_SUCCESS) {
+        fprintf(stderr, "ERROR!!!  lsof_gather() failed.\n");
+        return 1;
+    }
+    if (lsof_set_max_matches(ctx, max) != LSOF_ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr,
+                "ERROR!!!  lsof_set_max_matches() after lsof_freeze().\n");
+        return 1;
+    }
+    lsof_destroy(ctx);
+    for (pi = 0; pi < res->num_processes; pi++) {
+        *files += res->processes[pi].num_files;
+        if (res->processes[pi].pid == (uint32_t)getpid())
+            *mine += res->processes[pi].num_files;
+    }
+    lsof_free_result(res);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t all, files, mine;
+    int rv;
+
+    if (lsof_set_max_matches(NULL, 1) != LSOF_ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr,
+                "ERROR!!!  lsof_set_max_matches() accepted no context.\n");
+        return 1;
+    }
+
+    /* Without a limit, the own process has more than two files */
+    if ((rv = gather(1, 0, &all, &mine)))
+        return (rv < 0) ? 77 : 1;
+    if (mine < 3) {
+        fprintf(stderr, "ERROR!!!  no limit: %zu own files.\n", mine);
+        return 1;
+    }
+
+    /* Two of the own process's files */
+    if (gather(1, 2, &files, &mine))
+        return 1;
+    if (files != 2 || mine != 2) {
+        fprintf(stderr, "ERROR!!!  own, limit 2: %zu files, %zu own.\n", files,
+                mine);
+        return 1;
+    }
+
+    /* The first five files of all processes */
+    if (gather(0, 5, &files, &mine))
+        return 1;
+    if (files != 5) {
+        fprintf(stderr, "ERROR!!!  all, limit 5: %zu files.\n", files);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * LTpids.c -- Lsof Test PID set gathering
+ *
+ * Check that lsof_gather_pids() lists the processes of the PIDs it is given
+ * -- its own and its parent's -- and no others, ignoring a PID that isn't
+ * in use, and that an empty set lists no process.  Tasks aren't counted.
+ */
+
+/*
+ * Copyright 2002 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include "lsof.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define UNUSED_PID 0x7ffffff0 /* a PID not in use */
+
+int main(int argc, char **argv) {
+    struct lsof_context *ctx;
+    struct lsof_result *res;
+    enum lsof_error ret;
+    uint32_t pids[3];
+    size_t i;
+    int own = 0, parent = 0, other = 0;
+
+    pids[0] = UNUSED_PID;
+    pids[1] = (uint32_t)getppid();
+    pids[2] = (uint32_t)getpid();
+    ctx = lsof_new();
+    if (lsof_gather_pids(ctx, NULL, 1, &res) != LSOF_ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr, "ERROR!!!  lsof_gather_pids() accepted no PIDs.\n");
+        return 1;
+    }
+    if ((ret = lsof_gather_pids(ctx, pids, 3, &res)) ==
+        LSOF_ERROR_UNSUPPORTED) {
+        lsof_destroy(ctx);
+        return 77;
+    }
+    if (ret != LSOF_SUCCESS) {
+        fprintf(stderr, "ERROR!!!  lsof_gather_pids() failed.\n");
+        return 1;
+    }
+    for (i = 0; i < res->num_processes; i++) {
+        if (res->processes[i].tid)
+            continue;
+        if (res->processes[i].pid == pids[2])
+            own++;
+        else if (res->processes[i].pid == pids[1])
+            parent++;
+        else
+            other++;
+    }
+    lsof_free_result(res);
+    if (own != 1 || parent != 1 || other) {
+        fprintf(stderr, "ERROR!!!  own %d, parent %d, other %d processes.\n",
+                own, parent, other);
+        return 1;
+    }
+
+    /* The same context, with an empty set */
+    if (lsof_gather_pids(ctx, NULL, 0, &res) != LSOF_SUCCESS) {
+        fprintf(stderr, "ERROR!!!  lsof_gather_pids() of no PIDs failed.\n");
+        return 1;
+    }
+    if (res->num_processes) {
+        fprintf(stderr, "ERROR!!!  no PIDs: %zu processes.\n",
+                res->num_processes);
+        return 1;
+    }
+    lsof_free_result(res);
+    lsof_destroy(ctx);
+    return 0;
+}
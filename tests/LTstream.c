@@ -0,0 +1,99 @@
+/*
+ * LTstream.c -- Lsof Test streaming gather
+ *
+ * Check that lsof_gather_stream() hands liblsof's own process and its open
+ * executable to the callback, and that the callback can stop the gather.
+ */
+
+/*
+ * Copyright 2002 Purdue Research Foundation, West Lafayette, Indiana
+ * 47907.  All rights reserved.
+ *
+ * This software is not subject to any license of the American Telephone
+ * and Telegraph Company or the Regents of the University of California.
+ *
+ * Permission is granted to anyone to use this software for any purpose on
+ * any computer system, and to alter it and redistribute it freely, subject
+ * to the following restrictions:
+ *
+ * 1. Neither the authors nor Purdue University are responsible for any
+ *    consequences of the use of this software.
+ *
+ * 2. The origin of this software must not be misrepresented, either by
+ *    explicit claim or by omission.  Credit to the authors and Purdue
+ *    University must appear in documentation and sources.
+ *
+ * 3. Altered versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 4. This notice may not be removed or altered.
+ */
+
+#include "lsof.h"
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct state {
+    struct stat exec_stat; /* stat(2) of the executable */
+    int calls;             /* callback calls */
+    int stop;              /* stop after this many calls (0 == never) */
+    int self_found;        /* own process found */
+    int exec_found;        /* executable found */
+};
+
+static int on_process(struct lsof_process *p, void *user_data) {
+    struct state *st = (struct state *)user_data;
+    struct lsof_file *f;
+    int fi;
+
+    st->calls++;
+    if (p->pid == (uint32_t)getpid()) {
+        st->self_found = 1;
+        for (fi = 0; fi < p->num_files; fi++) {
+            f = &p->files[fi];
+            if (f->fd_type == LSOF_FD_PROGRAM_TEXT &&
+                (f->flags & LSOF_FILE_FLAG_INODE_VALID) &&
+                f->inode == st->exec_stat.st_ino)
+                st->exec_found = 1;
+        }
+    }
+    return (st->stop && st->calls >= st->stop);
+}
+
+int main(int argc, char **argv) {
+    struct lsof_context *ctx;
+    struct state st = {0};
+    int all;
+
+    if (stat(argv[0], &st.exec_stat)) {
+        fprintf(stderr, "Cannot stat %s, skipping executable check\n", argv[0]);
+        st.exec_found = 1;
+    }
+
+    /* Stream all processes */
+    ctx = lsof_new();
+    if (lsof_gather_stream(ctx, on_process, &st) != LSOF_SUCCESS) {
+        fprintf(stderr, "ERROR!!!  lsof_gather_stream() failed.\n");
+        return 1;
+    }
+    lsof_destroy(ctx);
+    if (!st.self_found || !st.exec_found) {
+        fprintf(stderr, "ERROR!!!  LTstream or its executable wasn't found.\n");
+        return 1;
+    }
+
+    /* Stream again, stopping after the first process */
+    all = st.calls;
+    st.calls = 0;
+    st.stop = 1;
+    ctx = lsof_new();
+    (void)lsof_gather_stream(ctx, on_process, &st);
+    lsof_destroy(ctx);
+    if (all > 1 && st.calls != 1) {
+        fprintf(stderr, "ERROR!!!  the gather didn't stop: %d calls.\n",
+                st.calls);
+        return 1;
+    }
+    return 0;
+}